@@ -0,0 +1,133 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#include <BandwidthLimiter.h>
+using namespace Common;
+
+#include <QMutexLocker>
+
+/**
+  * @class Common::BandwidthLimiter
+  *
+  * Limit the rate of the transfers with token buckets: a global one and one per peer. A limit of 0 means no limit.
+  * The buckets are implemented with the generic cell rate algorithm: each bucket only keeps the time at which it will be full again.
+  * A reservation is a compare-and-swap on this time, thus the threads transferring data never wait for a lock.
+  *
+  * The global rate is shared equally among the peers having at least one transfer. A peer with many transfers, for example
+  * one using all the upload threads, doesn't get more than the others.
+  *
+  * Usage from a transferring thread:
+  *  - Call 'transferStarted(..)' once.
+  *  - Before sending or after receiving some data call 'reserve(..)' and sleep during the returned time.
+  *  - Call 'transferFinished(..)' at the end.
+  * An instance of 'BandwidthLimiter' can be shared among several threads.
+  */
+
+BandwidthLimiter::Bucket::Bucket() :
+   theoreticalArrivalTime(0)
+{
+}
+
+/**
+  * @return The time to wait [ns] before transferring the given bytes.
+  */
+qint64 BandwidthLimiter::Bucket::reserve(qint64 now, int bytes, quint32 rate)
+{
+   if (rate == 0)
+      return 0;
+
+   const qint64 cost = Q_INT64_C(1000000000) * bytes / rate;
+
+   qint64 current = this->theoreticalArrivalTime.load();
+   qint64 next;
+   do
+      next = qMax(current, now) + cost;
+   while (!this->theoreticalArrivalTime.testAndSetOrdered(current, next, current));
+
+   return qMax(Q_INT64_C(0), next - now - BURST);
+}
+
+BandwidthLimiter::BandwidthLimiter() :
+   rate(0), ratePerPeer(0), nbPeers(0)
+{
+   this->timer.start();
+}
+
+BandwidthLimiter::~BandwidthLimiter()
+{
+   qDeleteAll(this->peers);
+}
+
+/**
+  * Can be called at any time.
+  * @param rate [byte/s].
+  * @param ratePerPeer [byte/s].
+  */
+void BandwidthLimiter::setLimits(quint32 rate, quint32 ratePerPeer)
+{
+   this->rate.store(rate);
+   this->ratePerPeer.store(ratePerPeer);
+}
+
+/**
+  * @return A handle to give to 'reserve(..)' and 'transferFinished(..)'.
+  */
+BandwidthLimiter::Peer* BandwidthLimiter::transferStarted(const Hash& peerID)
+{
+   QMutexLocker locker(&this->mutex);
+
+   Peer*& peer = this->peers[peerID];
+   if (!peer)
+      peer = new Peer(peerID);
+   peer->nbTransfers++;
+
+   this->nbPeers.store(this->peers.size());
+   return peer;
+}
+
+void BandwidthLimiter::transferFinished(Peer* peer)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (--peer->nbTransfers > 0)
+      return;
+
+   this->peers.remove(peer->ID);
+   delete peer;
+
+   this->nbPeers.store(this->peers.size());
+}
+
+/**
+  * Reserve some bytes in the global bucket and in the bucket of the given peer.
+  * @return The time to wait [ms] before transferring them.
+  */
+int BandwidthLimiter::reserve(Peer* peer, int bytes)
+{
+   const quint32 rate = this->rate.load();
+   const int nbPeers = this->nbPeers.load();
+
+   quint32 peerRate = this->ratePerPeer.load();
+   if (rate != 0 && nbPeers > 1 && (peerRate == 0 || rate / nbPeers < peerRate))
+      peerRate = qMax(1u, rate / nbPeers);
+
+   const qint64 now = this->timer.nsecsElapsed();
+   const qint64 delay = qMax(this->bucket.reserve(now, bytes, rate), peer->bucket.reserve(now, bytes, peerRate));
+
+   return delay / 1000000;
+}
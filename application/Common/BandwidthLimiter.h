@@ -0,0 +1,75 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#pragma once
+
+#include <QMutex>
+#include <QHash>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+
+#include <Common/Hash.h>
+#include <Common/Uncopyable.h>
+
+namespace Common
+{
+   class BandwidthLimiter : Common::Uncopyable
+   {
+      static const qint64 BURST = 100000000; // [ns]. The amount of data which can be sent at once after an idle period, expressed in time at the limited rate.
+
+      class Bucket
+      {
+      public:
+         Bucket();
+         qint64 reserve(qint64 now, int bytes, quint32 rate);
+
+      private:
+         QAtomicInteger<qint64> theoreticalArrivalTime; // [ns]. When the bucket will be full again.
+      };
+
+   public:
+      struct Peer
+      {
+         Peer(const Hash& ID) : ID(ID), nbTransfers(0) {}
+         const Hash ID;
+         int nbTransfers; // Protected by 'BandwidthLimiter::mutex'.
+         Bucket bucket;
+      };
+
+      BandwidthLimiter();
+      ~BandwidthLimiter();
+
+      void setLimits(quint32 rate, quint32 ratePerPeer);
+
+      Peer* transferStarted(const Hash& peerID);
+      void transferFinished(Peer* peer);
+
+      int reserve(Peer* peer, int bytes);
+
+   private:
+      QElapsedTimer timer;
+
+      QAtomicInteger<quint32> rate; // [byte/s]. 0 means no limit.
+      QAtomicInteger<quint32> ratePerPeer; // [byte/s]. 0 means no limit.
+      Bucket bucket;
+
+      QMutex mutex; // Protects 'peers'.
+      QHash<Hash, Peer*> peers; // The peers having at least one transfer.
+      QAtomicInt nbPeers;
+   };
+}
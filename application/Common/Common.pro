@@ -23,6 +23,7 @@ SOURCES += \
     ZeroCopyStreamQIODevice.cpp \
     Settings.cpp \
     TransferRateCalculator.cpp \
+    BandwidthLimiter.cpp \
     ProtoHelper.cpp \
     Timeoutable.cpp \
     PersistentData.cpp \
@@ -51,6 +52,7 @@ HEADERS += Hashes.h \
     ZeroCopyStreamQIODevice.h \
     Settings.h \
     TransferRateCalculator.h \
+    BandwidthLimiter.h \
     ProtoHelper.h \
     Timeoutable.h \
     Version.h \
@@ -67,12 +69,14 @@ HEADERS += Hashes.h \
     ConsoleReader.h \
     StringUtils.h \
     BloomFilter.h \
+    LatencyHistogram.h \
     Network/Message.h \
     KnownExtensions.h \
     Containers/Tree.h \
     Containers/SortedList.h \
     Containers/SortedArray.h \
     Containers/MapArray.h \
+    Containers/IndexedList.h \
     SelfWeakPointer.h \
     Hash_noShare.h \
     Hash_share.h \
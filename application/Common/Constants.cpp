@@ -19,7 +19,7 @@
 #include <Common/Constants.h>
 using namespace Common;
 
-const quint32 Constants::PROTOCOL_VERSION { 4 };
+const quint32 Constants::PROTOCOL_VERSION { 6 };
 
 const quint16 Constants::DEFAULT_CORE_REMOTE_CONTROL_PORT { 59485 };
 
@@ -39,6 +39,8 @@ const quint16 Constants::DEFAULT_CORE_REMOTE_CONTROL_PORT { 59485 };
 const QString Constants::HASH_CACHE_INDEX_FILENAME("hash_cache_index.sqlite");
 
 const QString Constants::FILE_QUEUE("queue." + FILE_EXTENSION); ///< This file contains the current downloads.
+const QString Constants::FILE_QUEUE_JOURNAL("queue_journal_%1.bin"); ///< The changes of the queue since it has been saved.
+const QString Constants::FILE_QUEUE_HASHES("queue_hashes_%1.bin"); ///< The chunk hashes of the queued files.
 const QString Constants::DIR_CHAT_MESSAGES("chat");
 const QString Constants::FILE_CHAT_MESSAGES("messages." + FILE_EXTENSION); ///< This file contains the last chat messages.
 const QString Constants::FILE_CHAT_ROOM_MESSAGES("messages_room_%1." + FILE_EXTENSION); ///< This file contains the last chat messages for a room.
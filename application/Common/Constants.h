@@ -38,6 +38,8 @@ namespace Common
       static const QString HASH_CACHE_INDEX_FILENAME;
 
       static const QString FILE_QUEUE;
+      static const QString FILE_QUEUE_JOURNAL;
+      static const QString FILE_QUEUE_HASHES;
       static const QString DIR_CHAT_MESSAGES;
       static const QString FILE_CHAT_MESSAGES;
       static const QString FILE_CHAT_ROOM_MESSAGES;
@@ -0,0 +1,285 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QDateTime>
+
+#include <Common/Uncopyable.h>
+
+/**
+  * @class Common::IndexedList
+  *
+  * An ordered list of unique items used as a work queue. Each item is indexed by a hash table thus these operations are in O(1):
+  *  - Membership test ('contains(..)').
+  *  - Insertion at the beginning or at the end.
+  *  - Removal of any item.
+  *  - Moving any item at the beginning or at the end.
+  * The time of insertion of each item is kept, see 'getOldestWaitTime()'.
+  * The type T must be usable as a QHash key.
+  */
+
+namespace Common
+{
+   template <typename T>
+   class IndexedList : Uncopyable
+   {
+      struct Node
+      {
+         T item;
+         Node* previous;
+         Node* next;
+         qint64 insertionTime; // [ms] since epoch.
+      };
+
+   public:
+      class const_iterator
+      {
+      public:
+         const_iterator(Node* node) : node(node) {}
+         bool operator==(const const_iterator& other) const { return this->node == other.node; }
+         bool operator!=(const const_iterator& other) const { return this->node != other.node; }
+         const T& operator*() const { return this->node->item; }
+         const_iterator& operator++() { this->node = this->node->next; return *this; }
+
+      private:
+         Node* node;
+      };
+
+      IndexedList();
+      ~IndexedList();
+
+      inline int size() const { return this->index.size(); }
+      inline bool isEmpty() const { return this->index.isEmpty(); }
+      inline bool contains(const T& item) const { return this->index.contains(item); }
+
+      bool append(const T& item);
+      bool prepend(const T& item);
+      IndexedList& operator<<(const T& item);
+
+      bool removeOne(const T& item);
+      void clear();
+
+      const T& first() const;
+      T takeFirst();
+
+      bool moveToFront(const T& item);
+      bool moveToBack(const T& item);
+
+      qint64 getOldestWaitTime() const;
+
+      QList<T> toList() const;
+
+      const_iterator begin() const { return const_iterator(this->head); }
+      const_iterator end() const { return const_iterator(nullptr); }
+
+   private:
+      void link(Node* node, Node* before);
+      void unlink(Node* node);
+
+      QHash<T, Node*> index;
+      Node* head;
+      Node* tail;
+   };
+}
+
+template <typename T>
+Common::IndexedList<T>::IndexedList() :
+   head(nullptr), tail(nullptr)
+{
+}
+
+template <typename T>
+Common::IndexedList<T>::~IndexedList()
+{
+   this->clear();
+}
+
+/**
+  * @return 'false' if the item is already in the list, in this case its position isn't changed.
+  */
+template <typename T>
+bool Common::IndexedList<T>::append(const T& item)
+{
+   if (this->index.contains(item))
+      return false;
+
+   Node* node = new Node { item, nullptr, nullptr, QDateTime::currentMSecsSinceEpoch() };
+   this->index.insert(item, node);
+   this->link(node, nullptr);
+   return true;
+}
+
+/**
+  * @return 'false' if the item is already in the list, in this case its position isn't changed.
+  */
+template <typename T>
+bool Common::IndexedList<T>::prepend(const T& item)
+{
+   if (this->index.contains(item))
+      return false;
+
+   Node* node = new Node { item, nullptr, nullptr, QDateTime::currentMSecsSinceEpoch() };
+   this->index.insert(item, node);
+   this->link(node, this->head);
+   return true;
+}
+
+template <typename T>
+Common::IndexedList<T>& Common::IndexedList<T>::operator<<(const T& item)
+{
+   this->append(item);
+   return *this;
+}
+
+template <typename T>
+bool Common::IndexedList<T>::removeOne(const T& item)
+{
+   Node* node = this->index.take(item);
+   if (!node)
+      return false;
+
+   this->unlink(node);
+   delete node;
+   return true;
+}
+
+template <typename T>
+void Common::IndexedList<T>::clear()
+{
+   for (Node* node = this->head; node;)
+   {
+      Node* next = node->next;
+      delete node;
+      node = next;
+   }
+   this->head = this->tail = nullptr;
+   this->index.clear();
+}
+
+/**
+  * The list must not be empty.
+  */
+template <typename T>
+const T& Common::IndexedList<T>::first() const
+{
+   return this->head->item;
+}
+
+/**
+  * The list must not be empty.
+  */
+template <typename T>
+T Common::IndexedList<T>::takeFirst()
+{
+   Node* node = this->head;
+   T item = node->item;
+   this->index.remove(item);
+   this->unlink(node);
+   delete node;
+   return item;
+}
+
+/**
+  * The insertion time of the item isn't changed.
+  */
+template <typename T>
+bool Common::IndexedList<T>::moveToFront(const T& item)
+{
+   Node* node = this->index.value(item);
+   if (!node)
+      return false;
+
+   this->unlink(node);
+   this->link(node, this->head);
+   return true;
+}
+
+/**
+  * The insertion time of the item isn't changed.
+  */
+template <typename T>
+bool Common::IndexedList<T>::moveToBack(const T& item)
+{
+   Node* node = this->index.value(item);
+   if (!node)
+      return false;
+
+   this->unlink(node);
+   this->link(node, nullptr);
+   return true;
+}
+
+/**
+  * Return the time [ms] since the insertion of the first item, 0 if the list is empty.
+  */
+template <typename T>
+qint64 Common::IndexedList<T>::getOldestWaitTime() const
+{
+   if (!this->head)
+      return 0;
+   return QDateTime::currentMSecsSinceEpoch() - this->head->insertionTime;
+}
+
+template <typename T>
+QList<T> Common::IndexedList<T>::toList() const
+{
+   QList<T> list;
+   list.reserve(this->index.size());
+   for (Node* node = this->head; node; node = node->next)
+      list << node->item;
+   return list;
+}
+
+/**
+  * Insert 'node' before 'before' or at the end if 'before' is 'nullptr'.
+  */
+template <typename T>
+void Common::IndexedList<T>::link(Node* node, Node* before)
+{
+   node->next = before;
+   node->previous = before ? before->previous : this->tail;
+
+   if (node->previous)
+      node->previous->next = node;
+   else
+      this->head = node;
+
+   if (before)
+      before->previous = node;
+   else
+      this->tail = node;
+}
+
+template <typename T>
+void Common::IndexedList<T>::unlink(Node* node)
+{
+   if (node->previous)
+      node->previous->next = node->next;
+   else
+      this->head = node->next;
+
+   if (node->next)
+      node->next->previous = node->previous;
+   else
+      this->tail = node->previous;
+
+   node->previous = node->next = nullptr;
+}
@@ -27,7 +27,7 @@
   * @class Common::SortedArray
   *
   * The goal of the class is to be able to use an ordered list as an array, here are listed some properties:
-  *  - Access to element by integer index like an array: 0, 1, 2, . . .
+  *  - Access to element by integer index like an array: 0, 1, 2, . . . An iteration can also begin at a given index.
   *  - Found the index of a given value.
   *  - The elements are kept ordered when a new one is inserted.
   * The type T must have the operator '<' defined. Otherwise a "lesser than" function can be given with the method 'setSortedFunction'.
@@ -109,6 +109,7 @@ namespace Common
       iterator end() const;
       iterator iteratorOf(const T& value) const;
       iterator iteratorOfNearest(const T& value) const;
+      iterator iteratorOfIndex(int index) const;
 
       const T& getFromIndex(int index) const;
       T& getFromIndex(int index);
@@ -401,6 +402,20 @@ typename Common::SortedArray<T, M>::iterator Common::SortedArray<T, M>::iterator
    return iterator(*this, positionOfNearest(this->d->root, value, this->d->lesserThanFun));
 }
 
+/**
+  * @return 'end()' if there is no item at the given index.
+  */
+template <typename T, int M>
+typename Common::SortedArray<T, M>::iterator Common::SortedArray<T, M>::iteratorOfIndex(int index) const
+{
+   if (index < 0 || index >= this->d->root->size)
+      return this->end();
+
+   int position;
+   Node* node = getFromIndex(this->d->root, index, 0, position);
+   return iterator(*this, { node, position });
+}
+
 /**
   * @exception NotFoundException
   */
@@ -0,0 +1,94 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#pragma once
+
+#include <QAtomicInteger>
+#include <QList>
+
+namespace Common
+{
+   /**
+     * @class Common::LatencyHistogram
+     * A thread-safe histogram of durations with power of two buckets:
+     * the bucket 'i' counts the durations in [2^i, 2^(i+1)[ µs, the first bucket includes the durations below 1 µs
+     * and the last one all the durations greater than 2^(NB_BUCKETS - 1) µs (~0.5 s).
+     */
+   class LatencyHistogram
+   {
+   public:
+      static const int NB_BUCKETS = 20;
+
+      LatencyHistogram() {}
+
+      inline void add(qint64 duration);
+      inline QList<quint32> getBuckets() const;
+      inline qint64 getPercentile(double percentile) const;
+
+   private:
+      QAtomicInteger<quint32> buckets[NB_BUCKETS];
+   };
+}
+
+/**
+  * @param duration [ns].
+  */
+inline void Common::LatencyHistogram::add(qint64 duration)
+{
+   quint64 durationUs = duration <= 0 ? 0 : static_cast<quint64>(duration) / 1000;
+   int bucket = 0;
+   while (durationUs > 1 && bucket < NB_BUCKETS - 1)
+   {
+      durationUs >>= 1;
+      bucket++;
+   }
+   this->buckets[bucket].fetchAndAddRelaxed(1);
+}
+
+inline QList<quint32> Common::LatencyHistogram::getBuckets() const
+{
+   QList<quint32> result;
+   result.reserve(NB_BUCKETS);
+   for (int i = 0; i < NB_BUCKETS; i++)
+      result << this->buckets[i].load();
+   return result;
+}
+
+/**
+  * Returns the upper bound [µs] of the bucket containing the given percentile, between 0 and 1.
+  * Returns 0 if the histogram is empty.
+  */
+inline qint64 Common::LatencyHistogram::getPercentile(double percentile) const
+{
+   const QList<quint32> buckets = this->getBuckets();
+   quint64 total = 0;
+   for (int i = 0; i < buckets.size(); i++)
+      total += buckets[i];
+
+   if (total == 0)
+      return 0;
+
+   quint64 n = 0;
+   for (int i = 0; i < buckets.size(); i++)
+   {
+      n += buckets[i];
+      if (n >= percentile * total)
+         return Q_INT64_C(1) << (i + 1);
+   }
+   return Q_INT64_C(1) << NB_BUCKETS;
+}
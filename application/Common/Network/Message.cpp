@@ -22,9 +22,13 @@ using namespace Common;
 #include <QIODevice>
 
 /**
-  * The 'Message' object take the ownership of the given protobuf message.
+  * Build a null message.
   */
-Message::Message(const MessageHeader& header, google::protobuf::Message* message) :
+Message::Message()
+{
+}
+
+Message::Message(const MessageHeader& header, const QSharedPointer<google::protobuf::Message>& message) :
    header(header), message(message)
 {
 }
@@ -39,6 +43,14 @@ const MessageHeader& Message::getHeader() const
    return this->header;
 }
 
+QSharedPointer<google::protobuf::Message> Message::getSharedMessage() const
+{
+   return this->message;
+}
+
+/**
+  * The size in the header must have been computed with 'message->ByteSizeLong()', the cached size is reused.
+  */
 int Message::writeMessageToBuffer(char* buffer, quint32 bufferSize, const MessageHeader& header, const google::protobuf::Message* message)
 {
    if (MessageHeader::HEADER_SIZE + header.getSize() > bufferSize)
@@ -46,8 +58,9 @@ int Message::writeMessageToBuffer(char* buffer, quint32 bufferSize, const Messag
 
    MessageHeader::writeHeader(buffer, header);
 
+   // The size has been computed by the caller to build the header.
    if (message)
-      message->SerializeToArray(buffer + MessageHeader::HEADER_SIZE, bufferSize - MessageHeader::HEADER_SIZE);
+      message->SerializeWithCachedSizesToArray(reinterpret_cast<google::protobuf::uint8*>(buffer + MessageHeader::HEADER_SIZE));
 
    return MessageHeader::HEADER_SIZE + header.getSize();
 }
@@ -81,8 +94,8 @@ Message Message::readMessage(const char* buffer, quint32 bufferSize)
    return readMessageBody(header, bufferBody);
 }
 
-Message Message::readMessageBodyFromDevice(const MessageHeader& header, QIODevice* ioDevice)
+Message Message::readMessageBodyFromDevice(const MessageHeader& header, QIODevice* ioDevice, const QSharedPointer<google::protobuf::Message>& recycled)
 {
    ZeroCopyInputStreamQIODevice inputStream(ioDevice);
-   return readMessageBody(header, &inputStream);
+   return readMessageBody(header, &inputStream, recycled);
 }
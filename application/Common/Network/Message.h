@@ -37,9 +37,11 @@ namespace Common
 
    class Message
    {
-      Message(const Common::MessageHeader& header, google::protobuf::Message* message);
+      Message(const Common::MessageHeader& header, const QSharedPointer<google::protobuf::Message>& message);
 
    public:
+      Message();
+
       bool isNull() const;
 
       const MessageHeader& getHeader() const;
@@ -47,6 +49,8 @@ namespace Common
       template <typename T = google::protobuf::Message>
       const T& getMessage() const;
 
+      QSharedPointer<google::protobuf::Message> getSharedMessage() const;
+
       static int writeMessageToBuffer(char* buffer, quint32 bufferSize, const MessageHeader& header, const google::protobuf::Message* message = 0);
       static int writeMessageToDevice(QIODevice* ioDevice, const MessageHeader& header, const google::protobuf::Message* message = 0);
 
@@ -57,19 +61,20 @@ namespace Common
 
       /**
         * Read the message content from the given device.
+        * @param recycled If not null this protobuf object is reused, it must have the type corresponding to the header.
         */
-      static Message readMessageBodyFromDevice(const MessageHeader& header, QIODevice* ioDevice);
+      static Message readMessageBodyFromDevice(const MessageHeader& header, QIODevice* ioDevice, const QSharedPointer<google::protobuf::Message>& recycled = QSharedPointer<google::protobuf::Message>());
 
       template <typename T>
-      static Message readMessageBody(const MessageHeader& header, T source);
+      static Message readMessageBody(const MessageHeader& header, T source, const QSharedPointer<google::protobuf::Message>& recycled = QSharedPointer<google::protobuf::Message>());
 
    private:
       static MessageHeader::MessageType getType(const google::protobuf::Message& message);
 
       template <typename T>
-      static Message readMessageBody(const MessageHeader& header, const char* buffer);
+      static Message readMessageBody(const MessageHeader& header, const char* buffer, const QSharedPointer<google::protobuf::Message>& recycled);
       template <typename T>
-      static Message readMessageBody(const MessageHeader& header, ZeroCopyInputStreamQIODevice* stream);
+      static Message readMessageBody(const MessageHeader& header, ZeroCopyInputStreamQIODevice* stream, const QSharedPointer<google::protobuf::Message>& recycled);
 
       MessageHeader header;
       QSharedPointer<google::protobuf::Message> message;
@@ -86,54 +91,57 @@ const T& Common::Message::getMessage() const
   * @exception ReadErrorException
   */
 template <typename T>
-Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, T source)
+Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, T source, const QSharedPointer<google::protobuf::Message>& recycled)
 {
    switch (header.getType())
    {
-   case MessageHeader::NULL_MESS:                        return readMessageBody<Protos::Common::Null>                (header, source);
-
-   case MessageHeader::CORE_IM_ALIVE:                    return readMessageBody<Protos::Core::IMAlive>               (header, source);
-   case MessageHeader::CORE_CHUNKS_OWNED:                return readMessageBody<Protos::Core::ChunksOwned>           (header, source);
-   case MessageHeader::CORE_CHAT_MESSAGES:               return readMessageBody<Protos::Common::ChatMessages>        (header, source);
-   case MessageHeader::CORE_GET_LAST_CHAT_MESSAGES:      return readMessageBody<Protos::Core::GetLastChatMessages>   (header, source);
-   case MessageHeader::CORE_FIND:                        return readMessageBody<Protos::Core::Find>                  (header, source);
-   case MessageHeader::CORE_FIND_RESULT:                 return readMessageBody<Protos::Common::FindResult>          (header, source);
-   case MessageHeader::CORE_GET_ENTRIES:                 return readMessageBody<Protos::Core::GetEntries>            (header, source);
-   case MessageHeader::CORE_GET_ENTRIES_RESULT:          return readMessageBody<Protos::Core::GetEntriesResult>      (header, source);
-   case MessageHeader::CORE_GET_HASHES:                  return readMessageBody<Protos::Core::GetHashes>             (header, source);
-   case MessageHeader::CORE_GET_HASHES_RESULT:           return readMessageBody<Protos::Core::GetHashesResult>       (header, source);
-   case MessageHeader::CORE_HASH_RESULT:                 return readMessageBody<Protos::Core::HashResult>            (header, source);
-   case MessageHeader::CORE_GET_CHUNKS:                  return readMessageBody<Protos::Core::GetChunks>             (header, source);
-   case MessageHeader::CORE_GET_CHUNKS_RESULT:           return readMessageBody<Protos::Core::GetChunksResult>       (header, source);
-
-   case MessageHeader::GUI_STATE:                        return readMessageBody<Protos::GUI::State>                  (header, source);
-   case MessageHeader::GUI_STATE_RESULT:                 return readMessageBody<Protos::Common::Null>                (header, source);
-   case MessageHeader::GUI_EVENT_CHAT_MESSAGES:          return readMessageBody<Protos::Common::ChatMessages>        (header, source);
-   case MessageHeader::GUI_EVENT_LOG_MESSAGES:           return readMessageBody<Protos::GUI::EventLogMessages>       (header, source);
-   case MessageHeader::GUI_ASK_FOR_AUTHENTICATION:       return readMessageBody<Protos::GUI::AskForAuthentication>   (header, source);
-   case MessageHeader::GUI_AUTHENTICATION:               return readMessageBody<Protos::GUI::Authentication>         (header, source);
-   case MessageHeader::GUI_AUTHENTICATION_RESULT:        return readMessageBody<Protos::GUI::AuthenticationResult>   (header, source);
-   case MessageHeader::GUI_LANGUAGE:                     return readMessageBody<Protos::GUI::Language>               (header, source);
-   case MessageHeader::GUI_CHANGE_PASSWORD:              return readMessageBody<Protos::GUI::ChangePassword>         (header, source);
-   case MessageHeader::GUI_SETTINGS:                     return readMessageBody<Protos::GUI::CoreSettings>           (header, source);
-   case MessageHeader::GUI_SEARCH:                       return readMessageBody<Protos::GUI::Search>                 (header, source);
-   case MessageHeader::GUI_SEARCH_TAG:                   return readMessageBody<Protos::GUI::Tag>                    (header, source);
-   case MessageHeader::GUI_SEARCH_RESULT:                return readMessageBody<Protos::Common::FindResult>          (header, source);
-   case MessageHeader::GUI_BROWSE:                       return readMessageBody<Protos::GUI::Browse>                 (header, source);
-   case MessageHeader::GUI_BROWSE_TAG:                   return readMessageBody<Protos::GUI::Tag>                    (header, source);
-   case MessageHeader::GUI_BROWSE_RESULT:                return readMessageBody<Protos::GUI::BrowseResult>           (header, source);
-   case MessageHeader::GUI_CANCEL_DOWNLOADS:             return readMessageBody<Protos::GUI::CancelDownloads>        (header, source);
-   case MessageHeader::GUI_PAUSE_DOWNLOADS:              return readMessageBody<Protos::GUI::PauseDownloads>         (header, source);
-   case MessageHeader::GUI_MOVE_DOWNLOADS:               return readMessageBody<Protos::GUI::MoveDownloads>          (header, source);
-   case MessageHeader::GUI_DOWNLOAD:                     return readMessageBody<Protos::GUI::Download>               (header, source);
-   case MessageHeader::GUI_CHAT_MESSAGE:                 return readMessageBody<Protos::GUI::ChatMessage>            (header, source);
-   case MessageHeader::GUI_CHAT_MESSAGE_RESULT:          return readMessageBody<Protos::GUI::ChatMessageResult>      (header, source);
-   case MessageHeader::GUI_JOIN_ROOM:                    return readMessageBody<Protos::GUI::JoinRoom>               (header, source);
-   case MessageHeader::GUI_LEAVE_ROOM:                   return readMessageBody<Protos::GUI::LeaveRoom>              (header, source);
-   case MessageHeader::GUI_REFRESH:                      return readMessageBody<Protos::Common::Null>                (header, source);
-   case MessageHeader::GUI_REFRESH_NETWORK_INTERFACES:   return readMessageBody<Protos::Common::Null>                (header, source);
-
-   default:                                              return readMessageBody<Protos::Common::Null>                (header, source);
+   case MessageHeader::NULL_MESS:                        return readMessageBody<Protos::Common::Null>                (header, source, recycled);
+
+   case MessageHeader::CORE_IM_ALIVE:                    return readMessageBody<Protos::Core::IMAlive>               (header, source, recycled);
+   case MessageHeader::CORE_CHUNKS_OWNED:                return readMessageBody<Protos::Core::ChunksOwned>           (header, source, recycled);
+   case MessageHeader::CORE_CHAT_MESSAGES:               return readMessageBody<Protos::Common::ChatMessages>        (header, source, recycled);
+   case MessageHeader::CORE_GET_LAST_CHAT_MESSAGES:      return readMessageBody<Protos::Core::GetLastChatMessages>   (header, source, recycled);
+   case MessageHeader::CORE_FIND:                        return readMessageBody<Protos::Core::Find>                  (header, source, recycled);
+   case MessageHeader::CORE_FIND_RESULT:                 return readMessageBody<Protos::Common::FindResult>          (header, source, recycled);
+   case MessageHeader::CORE_GET_ENTRIES:                 return readMessageBody<Protos::Core::GetEntries>            (header, source, recycled);
+   case MessageHeader::CORE_GET_ENTRIES_RESULT:          return readMessageBody<Protos::Core::GetEntriesResult>      (header, source, recycled);
+   case MessageHeader::CORE_GET_HASHES:                  return readMessageBody<Protos::Core::GetHashes>             (header, source, recycled);
+   case MessageHeader::CORE_GET_HASHES_RESULT:           return readMessageBody<Protos::Core::GetHashesResult>       (header, source, recycled);
+   case MessageHeader::CORE_HASH_RESULT:                 return readMessageBody<Protos::Core::HashResult>            (header, source, recycled);
+   case MessageHeader::CORE_GET_CHUNKS:                  return readMessageBody<Protos::Core::GetChunks>             (header, source, recycled);
+   case MessageHeader::CORE_GET_CHUNKS_RESULT:           return readMessageBody<Protos::Core::GetChunksResult>       (header, source, recycled);
+   case MessageHeader::CORE_CHUNK_DATA:                  return readMessageBody<Protos::Core::ChunkData>             (header, source, recycled);
+   case MessageHeader::CORE_CHUNK_WINDOW:                return readMessageBody<Protos::Core::ChunkWindow>           (header, source, recycled);
+   case MessageHeader::CORE_CHUNK_STREAM_RESET:          return readMessageBody<Protos::Core::ChunkStreamReset>      (header, source, recycled);
+
+   case MessageHeader::GUI_STATE:                        return readMessageBody<Protos::GUI::State>                  (header, source, recycled);
+   case MessageHeader::GUI_STATE_RESULT:                 return readMessageBody<Protos::Common::Null>                (header, source, recycled);
+   case MessageHeader::GUI_EVENT_CHAT_MESSAGES:          return readMessageBody<Protos::Common::ChatMessages>        (header, source, recycled);
+   case MessageHeader::GUI_EVENT_LOG_MESSAGES:           return readMessageBody<Protos::GUI::EventLogMessages>       (header, source, recycled);
+   case MessageHeader::GUI_ASK_FOR_AUTHENTICATION:       return readMessageBody<Protos::GUI::AskForAuthentication>   (header, source, recycled);
+   case MessageHeader::GUI_AUTHENTICATION:               return readMessageBody<Protos::GUI::Authentication>         (header, source, recycled);
+   case MessageHeader::GUI_AUTHENTICATION_RESULT:        return readMessageBody<Protos::GUI::AuthenticationResult>   (header, source, recycled);
+   case MessageHeader::GUI_LANGUAGE:                     return readMessageBody<Protos::GUI::Language>               (header, source, recycled);
+   case MessageHeader::GUI_CHANGE_PASSWORD:              return readMessageBody<Protos::GUI::ChangePassword>         (header, source, recycled);
+   case MessageHeader::GUI_SETTINGS:                     return readMessageBody<Protos::GUI::CoreSettings>           (header, source, recycled);
+   case MessageHeader::GUI_SEARCH:                       return readMessageBody<Protos::GUI::Search>                 (header, source, recycled);
+   case MessageHeader::GUI_SEARCH_TAG:                   return readMessageBody<Protos::GUI::Tag>                    (header, source, recycled);
+   case MessageHeader::GUI_SEARCH_RESULT:                return readMessageBody<Protos::Common::FindResult>          (header, source, recycled);
+   case MessageHeader::GUI_BROWSE:                       return readMessageBody<Protos::GUI::Browse>                 (header, source, recycled);
+   case MessageHeader::GUI_BROWSE_TAG:                   return readMessageBody<Protos::GUI::Tag>                    (header, source, recycled);
+   case MessageHeader::GUI_BROWSE_RESULT:                return readMessageBody<Protos::GUI::BrowseResult>           (header, source, recycled);
+   case MessageHeader::GUI_CANCEL_DOWNLOADS:             return readMessageBody<Protos::GUI::CancelDownloads>        (header, source, recycled);
+   case MessageHeader::GUI_PAUSE_DOWNLOADS:              return readMessageBody<Protos::GUI::PauseDownloads>         (header, source, recycled);
+   case MessageHeader::GUI_MOVE_DOWNLOADS:               return readMessageBody<Protos::GUI::MoveDownloads>          (header, source, recycled);
+   case MessageHeader::GUI_DOWNLOAD:                     return readMessageBody<Protos::GUI::Download>               (header, source, recycled);
+   case MessageHeader::GUI_CHAT_MESSAGE:                 return readMessageBody<Protos::GUI::ChatMessage>            (header, source, recycled);
+   case MessageHeader::GUI_CHAT_MESSAGE_RESULT:          return readMessageBody<Protos::GUI::ChatMessageResult>      (header, source, recycled);
+   case MessageHeader::GUI_JOIN_ROOM:                    return readMessageBody<Protos::GUI::JoinRoom>               (header, source, recycled);
+   case MessageHeader::GUI_LEAVE_ROOM:                   return readMessageBody<Protos::GUI::LeaveRoom>              (header, source, recycled);
+   case MessageHeader::GUI_REFRESH:                      return readMessageBody<Protos::Common::Null>                (header, source, recycled);
+   case MessageHeader::GUI_REFRESH_NETWORK_INTERFACES:   return readMessageBody<Protos::Common::Null>                (header, source, recycled);
+
+   default:                                              return readMessageBody<Protos::Common::Null>                (header, source, recycled);
    }
 }
 
@@ -141,14 +149,11 @@ Common::Message Common::Message::readMessageBody(const Common::MessageHeader& he
   * @exception ReadErrorException
   */
 template <typename T>
-Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, const char* buffer)
+Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, const char* buffer, const QSharedPointer<google::protobuf::Message>& recycled)
 {
-   T* message = new T();
-   if (!message->ParseFromArray(buffer, header.getSize()))
-   {
-      delete message;
+   QSharedPointer<google::protobuf::Message> message = recycled.isNull() ? QSharedPointer<google::protobuf::Message>(new T()) : recycled;
+   if (!static_cast<T*>(message.data())->ParseFromArray(buffer, header.getSize()))
       throw ReadErrorException();
-   }
    return Message(header, message);
 }
 
@@ -156,13 +161,10 @@ Common::Message Common::Message::readMessageBody(const Common::MessageHeader& he
   * @exception ReadErrorException
   */
 template <typename T>
-Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, ZeroCopyInputStreamQIODevice* stream)
+Common::Message Common::Message::readMessageBody(const Common::MessageHeader& header, ZeroCopyInputStreamQIODevice* stream, const QSharedPointer<google::protobuf::Message>& recycled)
 {
-   T* message = new T();
-   if (!message->ParseFromBoundedZeroCopyStream(stream, header.getSize()))
-   {
-      delete message;
+   QSharedPointer<google::protobuf::Message> message = recycled.isNull() ? QSharedPointer<google::protobuf::Message>(new T()) : recycled;
+   if (!static_cast<T*>(message.data())->ParseFromBoundedZeroCopyStream(stream, header.getSize()))
       throw ReadErrorException();
-   }
    return Message(header, message);
 }
@@ -95,6 +95,9 @@ QString MessageHeader::messToStr(MessageType type)
    case CORE_HASH_RESULT: return "HASH_RESULT";
    case CORE_GET_CHUNKS: return "GET_CHUNKS";
    case CORE_GET_CHUNKS_RESULT: return "GET_CHUNKS_RESULT";
+   case CORE_CHUNK_DATA: return "CHUNK_DATA";
+   case CORE_CHUNK_WINDOW: return "CHUNK_WINDOW";
+   case CORE_CHUNK_STREAM_RESET: return "CHUNK_STREAM_RESET";
 
    case GUI_STATE: return "STATE";
    case GUI_STATE_RESULT: return "STATE_RESULT";
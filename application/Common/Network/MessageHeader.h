@@ -58,6 +58,9 @@ namespace Common
 
          CORE_GET_CHUNKS =                0x0051,
          CORE_GET_CHUNKS_RESULT =         0x0052,
+         CORE_CHUNK_DATA =                0x0053,
+         CORE_CHUNK_WINDOW =              0x0054,
+         CORE_CHUNK_STREAM_RESET =        0x0055,
 
          /***** GUI *****/
          GUI_STATE =                      0x1001,
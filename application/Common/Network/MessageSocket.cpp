@@ -136,9 +136,24 @@ void MessageSocket::send(MessageHeader::MessageType type, const google::protobuf
 
    MessageHeader header(type, message ? message->ByteSizeLong() : 0, this->localID);
 
-   MESSAGE_SOCKET_LOG_DEBUG(QString("Socket[%1]::send: %2 to %3\n%4").arg(this->num).arg(header.toStr()).arg(this->remoteID.toStr()).arg(message ? ProtoHelper::getDebugStr(*message) : "<empty message>"));
+#ifdef DEBUG
+   if (type != MessageHeader::CORE_CHUNK_DATA) // The chunk data frames are too many and too big to be logged.
+      MESSAGE_SOCKET_LOG_DEBUG(QString("Socket[%1]::send: %2 to %3\n%4").arg(this->num).arg(header.toStr()).arg(this->remoteID.toStr()).arg(message ? ProtoHelper::getDebugStr(*message) : "<empty message>"));
+#endif
 
-   Message::writeMessageToDevice(this->socket, header, message);
+   // A small message is written with its header in one call, without any allocation.
+   const int messageSize = MessageHeader::HEADER_SIZE + header.getSize();
+   if (messageSize <= MAX_BUFFERED_MESSAGE_SIZE)
+   {
+      if (this->sendBuffer.size() < messageSize)
+         this->sendBuffer.resize(messageSize);
+      Message::writeMessageToBuffer(this->sendBuffer.data(), messageSize, header, message);
+      this->socket->write(this->sendBuffer.constData(), messageSize);
+   }
+   else
+   {
+      Message::writeMessageToDevice(this->socket, header, message);
+   }
 }
 
 /**
@@ -254,17 +269,38 @@ bool MessageSocket::readMessage()
 {
    try
    {
-      const Message& message = Message::readMessageBodyFromDevice(this->currentHeader, this->socket);
+      // The pooled object is taken during the call, a reentrant reading of the same type will allocate a new one.
+      QSharedPointer<google::protobuf::Message> recycled = this->messagesPool.take(this->currentHeader.getType());
+
+      const int size = this->currentHeader.getSize();
+      Message message;
+      if (size <= MAX_BUFFERED_MESSAGE_SIZE)
+      {
+         if (this->readBuffer.size() < size)
+            this->readBuffer.resize(size);
+         if (this->socket->read(this->readBuffer.data(), size) != size)
+            return false;
+         message = Message::readMessageBody(this->currentHeader, static_cast<const char*>(this->readBuffer.constData()), recycled);
+      }
+      else
+      {
+         message = Message::readMessageBodyFromDevice(this->currentHeader, this->socket, recycled);
+      }
 
-      MESSAGE_SOCKET_LOG_DEBUG(QString("Socket[%1]: Data received from %2, %3\n%4").arg(
-         QString::number(this->num),
-         this->socket->peerAddress().toString(),
-         message.getHeader().toStr(),
-         Common::ProtoHelper::getDebugStr(message.getMessage())
-      ));
+#ifdef DEBUG
+      if (message.getHeader().getType() != MessageHeader::CORE_CHUNK_DATA)
+         MESSAGE_SOCKET_LOG_DEBUG(QString("Socket[%1]: Data received from %2, %3\n%4").arg(
+            QString::number(this->num),
+            this->socket->peerAddress().toString(),
+            message.getHeader().toStr(),
+            Common::ProtoHelper::getDebugStr(message.getMessage())
+         ));
+#endif
 
       this->onNewMessage(message);
       emit newMessage(message);
+
+      this->messagesPool.insert(message.getHeader().getType(), message.getSharedMessage());
       return true;
    }
    catch (ReadErrorException& e)
@@ -273,6 +309,8 @@ bool MessageSocket::readMessage()
    }
 }
 
+const int MessageSocket::MAX_BUFFERED_MESSAGE_SIZE(64 * 1024);
+
 #ifdef DEBUG
    int MessageSocket::currentNum(0);
 #endif
@@ -23,6 +23,8 @@
 #include <QAbstractSocket>
 #include <QHostAddress>
 #include <QTimer>
+#include <QByteArray>
+#include <QHash>
 
 #include <google/protobuf/message.h>
 
@@ -80,6 +82,7 @@ namespace Common
    signals:
       /**
         * Emitted after a message is received. The method 'onNewMessage()' is called previously.
+        * The protobuf object is reused for the next message of the same type, it must not be kept after the call.
         */
       void newMessage(const Common::Message& message);
 
@@ -102,6 +105,8 @@ namespace Common
 
       bool readMessage();
 
+      static const int MAX_BUFFERED_MESSAGE_SIZE;
+
       ILogger* logger;
 
    protected:
@@ -118,6 +123,10 @@ namespace Common
 
       MessageHeader currentHeader;
 
+      QByteArray sendBuffer; // Reused to write the small messages in one call.
+      QByteArray readBuffer; // Reused to read the small messages in one call.
+      QHash<MessageHeader::MessageType, QSharedPointer<google::protobuf::Message>> messagesPool; // One idle protobuf object per type.
+
 #ifdef DEBUG
       // To identify the sockets in debug mode.
    protected:
@@ -18,9 +18,7 @@
   
 #pragma once
 
-#include <google/protobuf/repeated_field.h>
-
-#include <Protos/common.pb.h>
+#include <Protos/gui_protocol.pb.h>
 
 #include <Common/Timeoutable.h>
 
@@ -37,6 +35,6 @@ namespace RCC
       virtual void start() = 0;
 
    signals:
-      void result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>&);
+      void result(const Protos::GUI::BrowseResult&);
    };
 }
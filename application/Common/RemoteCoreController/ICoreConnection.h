@@ -162,16 +162,19 @@ namespace RCC
         * Get files and folders from one folder.
         * @param peerID Can be yourself.
         * @param entry A folder from the remote peer.
+        * @param entriesOffset The index of the first entry to get.
+        * @param nbMaxEntries 0 means no limit.
         */
-      virtual QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry) = 0;
+      virtual QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset = 0, quint32 nbMaxEntries = 0) = 0;
 
       /**
         * Get files and folders from some folders. Plus the root folders if asked.
         * @param peerID Can be yourself.
         * @param entries One or more folders from the remote peer.
         * @param withRoots
+        * @param knownVersions The last known version of each folder followed by the one of the roots, the unchanged ones are returned empty.
         */
-      virtual QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots = true) = 0;
+      virtual QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots = true, const QList<quint64>& knownVersions = QList<quint64>()) = 0;
 
       /**
         * Search some files and folders to the entire network, do not search in our own folders.
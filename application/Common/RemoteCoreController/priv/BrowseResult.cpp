@@ -28,18 +28,22 @@ BrowseResult::BrowseResult(InternalCoreConnection* coreConnection, const Common:
    this->init(coreConnection);
 }
 
-BrowseResult::BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entry& entry, int socketTimeout) :
+BrowseResult::BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset, quint32 nbMaxEntries, int socketTimeout) :
    IBrowseResult(socketTimeout), peerID(peerID), tag(0)
 {
    this->browseMessage.mutable_dirs()->add_entry()->CopyFrom(entry);
+   this->browseMessage.set_entries_offset(entriesOffset);
+   this->browseMessage.set_nb_max_entries(nbMaxEntries);
    this->init(coreConnection);
 }
 
-BrowseResult::BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, int socketTimeout) :
+BrowseResult::BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, const QList<quint64>& knownVersions, int socketTimeout) :
    IBrowseResult(socketTimeout), peerID(peerID), tag(0)
 {
    this->browseMessage.mutable_dirs()->CopyFrom(entries);
    this->browseMessage.set_get_roots(withRoots);
+   foreach (quint64 version, knownVersions)
+      this->browseMessage.add_known_versions(version);
    this->init(coreConnection);
 }
 
@@ -61,7 +65,7 @@ void BrowseResult::browseResult(const Protos::GUI::BrowseResult& browseResult)
    {
       this->tag = 0; // To avoid multi emit (should not occurs).
       this->stopTimer();
-      emit result(browseResult.entries());
+      emit result(browseResult);
    }
 }
 
@@ -36,8 +36,8 @@ namespace RCC
       Q_OBJECT
    public:
       BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, int socketTimeout);
-      BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entry& entry, int socketTimeout);
-      BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, int socketTimeout);
+      BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset, quint32 nbMaxEntries, int socketTimeout);
+      BrowseResult(InternalCoreConnection* coreConnection, const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, const QList<quint64>& knownVersions, int socketTimeout);
       void start();
       void setTag(quint64 tag);
 
@@ -169,16 +169,16 @@ QSharedPointer<IBrowseResult> CoreConnection::browse(const Common::Hash& peerID)
    return this->current().browse(peerID, this->SOCKET_TIMEOUT);
 }
 
-QSharedPointer<IBrowseResult> CoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entry& entry)
+QSharedPointer<IBrowseResult> CoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset, quint32 nbMaxEntries)
 {
 
-   return this->current().browse(peerID, entry, this->SOCKET_TIMEOUT);
+   return this->current().browse(peerID, entry, entriesOffset, nbMaxEntries, this->SOCKET_TIMEOUT);
 }
 
-QSharedPointer<IBrowseResult> CoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots)
+QSharedPointer<IBrowseResult> CoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, const QList<quint64>& knownVersions)
 {
 
-   return this->current().browse(peerID, entries, withRoots, this->SOCKET_TIMEOUT);
+   return this->current().browse(peerID, entries, withRoots, knownVersions, this->SOCKET_TIMEOUT);
 }
 
 QSharedPointer<ISearchResult> CoreConnection::search(const Protos::Common::FindPattern& findPattern, bool local)
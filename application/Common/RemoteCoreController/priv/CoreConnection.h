@@ -84,8 +84,8 @@ namespace RCC
       void resetCorePassword();
 
       QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID);
-      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry);
-      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots = true);
+      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset = 0, quint32 nbMaxEntries = 0);
+      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots = true, const QList<quint64>& knownVersions = QList<quint64>());
 
       QSharedPointer<ISearchResult> search(const Protos::Common::FindPattern& findPattern, bool local = false);
 
@@ -200,16 +200,16 @@ QSharedPointer<IBrowseResult> InternalCoreConnection::browse(const Common::Hash&
    return browseResult;
 }
 
-QSharedPointer<IBrowseResult> InternalCoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, int socketTimeout)
+QSharedPointer<IBrowseResult> InternalCoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset, quint32 nbMaxEntries, int socketTimeout)
 {
-   QSharedPointer<BrowseResult> browseResult = QSharedPointer<BrowseResult>(new BrowseResult(this, peerID, entry, socketTimeout));
+   QSharedPointer<BrowseResult> browseResult = QSharedPointer<BrowseResult>(new BrowseResult(this, peerID, entry, entriesOffset, nbMaxEntries, socketTimeout));
    this->browseResultsWithoutTag << browseResult.toWeakRef();
    return browseResult;
 }
 
-QSharedPointer<IBrowseResult> InternalCoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, int socketTimeout)
+QSharedPointer<IBrowseResult> InternalCoreConnection::browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, const QList<quint64>& knownVersions, int socketTimeout)
 {
-   QSharedPointer<BrowseResult> browseResult = QSharedPointer<BrowseResult>(new BrowseResult(this, peerID, entries, withRoots, socketTimeout));
+   QSharedPointer<BrowseResult> browseResult = QSharedPointer<BrowseResult>(new BrowseResult(this, peerID, entries, withRoots, knownVersions, socketTimeout));
    this->browseResultsWithoutTag << browseResult.toWeakRef();
    return browseResult;
 }
@@ -82,8 +82,8 @@ namespace RCC
       void resetCorePassword();
 
       QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, int socketTimeout);
-      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, int socketTimeout);
-      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, int socketTimeout);
+      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entry& entry, quint32 entriesOffset, quint32 nbMaxEntries, int socketTimeout);
+      QSharedPointer<IBrowseResult> browse(const Common::Hash& peerID, const Protos::Common::Entries& entries, bool withRoots, const QList<quint64>& knownVersions, int socketTimeout);
 
       QSharedPointer<ISearchResult> search(const Protos::Common::FindPattern& findPattern, bool local, int socketTimeout);
 
@@ -7,9 +7,46 @@
 #include <QElapsedTimer>
 #include <QRandomGenerator64>
 
+#include <google/protobuf/arena.h>
+
+#include <Protos/gui_protocol.pb.h>
+
 #include <Containers/SortedArray.h>
 using namespace Common;
 
+namespace
+{
+   void fillEntry(Protos::Common::Entry* entry, int i)
+   {
+      entry->set_type(Protos::Common::Entry::FILE);
+      entry->set_path("/Videos/My cat/");
+      entry->set_name(QString("file %1.avi").arg(i).toStdString());
+      entry->set_size(1024 * i);
+      entry->mutable_shared_entry()->mutable_id()->set_hash(std::string(28, 'a'));
+   }
+
+   void buildState(Protos::GUI::State& state, int nbDownloads)
+   {
+      for (int i = 0; i < nbDownloads; i++)
+      {
+         Protos::GUI::State::Download* download = state.add_download();
+         download->set_id(i + 1);
+         fillEntry(download->mutable_local_entry(), i);
+         download->set_status(Protos::GUI::State::Download::DOWNLOADING);
+         download->set_downloaded_bytes(512 * i);
+         download->add_peer_id()->set_hash(std::string(28, 'b'));
+         download->set_peer_source_nick("Bob");
+      }
+   }
+
+   void buildBrowseResult(Protos::GUI::BrowseResult& result, int nbEntries)
+   {
+      Protos::Common::Entries* entries = result.add_entries();
+      for (int i = 0; i < nbEntries; i++)
+         fillEntry(entries->add_entry(), i);
+   }
+}
+
 BenchmarkTests::BenchmarkTests()
 {
 }
@@ -166,3 +203,63 @@ void BenchmarkTests::sortedArray()
    }
    qDebug() << timer.elapsed();
 }
+
+/**
+  * Build, serialize and destroy a state with 10'000 downloads and a browse result with 50'000 entries,
+  * with the messages allocated on the heap and then in an arena.
+  */
+void BenchmarkTests::protobufArena()
+{
+   const int nbDownloads = 10000;
+   const int nbEntries = 50000;
+   const int nbIterations = 20;
+
+   QElapsedTimer timer;
+   std::string output;
+
+   qDebug() << "State with" << nbDownloads << "downloads, heap, build + serialize + destroy [ms] for" << nbIterations << "iterations:";
+   timer.start();
+   for (int i = 0; i < nbIterations; i++)
+   {
+      Protos::GUI::State state;
+      buildState(state, nbDownloads);
+      state.SerializeToString(&output);
+   }
+   qDebug() << timer.elapsed();
+   const size_t stateSize = output.size();
+
+   qDebug() << "State with" << nbDownloads << "downloads, arena, build + serialize + destroy [ms] for" << nbIterations << "iterations:";
+   timer.start();
+   for (int i = 0; i < nbIterations; i++)
+   {
+      google::protobuf::Arena arena;
+      Protos::GUI::State& state = *google::protobuf::Arena::CreateMessage<Protos::GUI::State>(&arena);
+      buildState(state, nbDownloads);
+      state.SerializeToString(&output);
+   }
+   qDebug() << timer.elapsed();
+   QCOMPARE(output.size(), stateSize);
+
+   qDebug() << "Browse result with" << nbEntries << "entries, heap, build + serialize + destroy [ms] for" << nbIterations << "iterations:";
+   timer.start();
+   for (int i = 0; i < nbIterations; i++)
+   {
+      Protos::GUI::BrowseResult result;
+      buildBrowseResult(result, nbEntries);
+      result.SerializeToString(&output);
+   }
+   qDebug() << timer.elapsed();
+   const size_t browseResultSize = output.size();
+
+   qDebug() << "Browse result with" << nbEntries << "entries, arena, build + serialize + destroy [ms] for" << nbIterations << "iterations:";
+   timer.start();
+   for (int i = 0; i < nbIterations; i++)
+   {
+      google::protobuf::Arena arena;
+      Protos::GUI::BrowseResult& result = *google::protobuf::Arena::CreateMessage<Protos::GUI::BrowseResult>(&arena);
+      buildBrowseResult(result, nbEntries);
+      result.SerializeToString(&output);
+   }
+   qDebug() << timer.elapsed();
+   QCOMPARE(output.size(), browseResultSize);
+}
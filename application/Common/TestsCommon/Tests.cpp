@@ -35,6 +35,7 @@
 #include <Containers/SortedList.h>
 #include <Containers/SortedArray.h>
 #include <Containers/MapArray.h>
+#include <Containers/IndexedList.h>
 #include <Network/MessageHeader.h>
 #include <PersistentData.h>
 #include <Settings.h>
@@ -44,7 +45,9 @@
 #include <ZeroCopyStreamQIODevice.h>
 #include <ProtoHelper.h>
 #include <BloomFilter.h>
+#include <LatencyHistogram.h>
 #include <TransferRateCalculator.h>
+#include <BandwidthLimiter.h>
 using namespace Common;
 
 Tests::Tests()
@@ -351,6 +354,13 @@ void Tests::sortedArray()
       for (SortedArray<char, 5>::iterator i = array.begin(); i != array.end() && j != orderedList.end(); ++i, ++j)
          QCOMPARE(*i, *j);
 
+      // Iterator from an integer index.
+      const int index = rng.bounded(array.size());
+      j = orderedList.begin() + index;
+      for (SortedArray<char, 5>::iterator i = array.iteratorOfIndex(index); i != array.end() && j != orderedList.end(); ++i, ++j)
+         QCOMPARE(*i, *j);
+      QVERIFY(array.iteratorOfIndex(array.size()) == array.end());
+
       int unknownElement = array.indexOf('*');
       QCOMPARE(unknownElement, -1);
 
@@ -488,6 +498,46 @@ void Tests::mapArray()
    }
 }
 
+void Tests::indexedList()
+{
+   IndexedList<int> list;
+
+   auto test =
+      [&](const QList<int>& expected)
+      {
+         QCOMPARE(list.size(), expected.size());
+         QCOMPARE(list.toList(), expected);
+      };
+
+   for (int i = 1; i <= 5; i++)
+      list << i;
+   test(QList<int> { 1, 2, 3, 4, 5 });
+
+   QVERIFY(!list.append(3));
+   QVERIFY(list.prepend(9));
+   test(QList<int> { 9, 1, 2, 3, 4, 5 });
+
+   QVERIFY(list.contains(4));
+   QVERIFY(!list.contains(42));
+
+   QVERIFY(list.moveToBack(9));
+   QVERIFY(list.moveToFront(4));
+   QVERIFY(!list.moveToFront(42));
+   test(QList<int> { 4, 1, 2, 3, 5, 9 });
+
+   QVERIFY(list.removeOne(2));
+   QVERIFY(!list.removeOne(2));
+   QCOMPARE(list.takeFirst(), 4);
+   QCOMPARE(list.first(), 1);
+   test(QList<int> { 1, 3, 5, 9 });
+
+   QVERIFY(list.getOldestWaitTime() >= 0);
+
+   list.clear();
+   QVERIFY(list.isEmpty());
+   QCOMPARE(list.getOldestWaitTime(), 0LL);
+}
+
 void Tests::transferRateCalculator()
 {
    QSKIP("TODO: Rewrite this test, take too much time.");
@@ -509,6 +559,89 @@ void Tests::transferRateCalculator()
    QCOMPARE(t.getTransferRate(), 0);
 }
 
+/**
+  * The delays are computed from the elapsed time, a small margin is accepted for the time spent between two reservations.
+  * The first 100 ms at the limited rate are free, see 'BandwidthLimiter::BURST'.
+  */
+void Tests::bandwidthLimiter()
+{
+   static const int MARGIN = 20; // [ms].
+   auto isAbout = [](int delay, int expected) { return delay <= expected && delay >= expected - MARGIN; };
+
+   const Hash peerID1 = Hash::rand();
+   const Hash peerID2 = Hash::rand();
+
+   // No limit.
+   {
+      BandwidthLimiter limiter;
+      BandwidthLimiter::Peer* peer = limiter.transferStarted(peerID1);
+      QCOMPARE(limiter.reserve(peer, 100000000), 0);
+      QCOMPARE(limiter.reserve(peer, 100000000), 0);
+      limiter.transferFinished(peer);
+   }
+
+   // Global limit of 1000 byte/s with a single peer.
+   {
+      BandwidthLimiter limiter;
+      limiter.setLimits(1000, 0);
+      BandwidthLimiter::Peer* peer = limiter.transferStarted(peerID1);
+      QCOMPARE(limiter.reserve(peer, 100), 0); // Within the burst.
+      const int delay = limiter.reserve(peer, 1000);
+      QVERIFY2(isAbout(delay, 1000), QString::number(delay).toLatin1().constData());
+      limiter.transferFinished(peer);
+   }
+
+   // Limit of 1000 byte/s per peer, the buckets of the peers are independent.
+   {
+      BandwidthLimiter limiter;
+      limiter.setLimits(0, 1000);
+      BandwidthLimiter::Peer* peer1 = limiter.transferStarted(peerID1);
+      BandwidthLimiter::Peer* peer2 = limiter.transferStarted(peerID2);
+      const int delay = limiter.reserve(peer1, 1100);
+      QVERIFY2(isAbout(delay, 1000), QString::number(delay).toLatin1().constData());
+      QCOMPARE(limiter.reserve(peer2, 100), 0);
+      limiter.transferFinished(peer1);
+      limiter.transferFinished(peer2);
+   }
+
+   // The global limit of 2000 byte/s is shared by two peers, a peer with two transfers doesn't get more.
+   {
+      BandwidthLimiter limiter;
+      limiter.setLimits(2000, 0);
+      BandwidthLimiter::Peer* peer1 = limiter.transferStarted(peerID1);
+      QCOMPARE(limiter.transferStarted(peerID1), peer1);
+      BandwidthLimiter::Peer* peer2 = limiter.transferStarted(peerID2);
+
+      // 1100 bytes at 1000 byte/s for the peer, the global bucket only needs 450 ms.
+      int delay = limiter.reserve(peer1, 1100);
+      QVERIFY2(isAbout(delay, 1000), QString::number(delay).toLatin1().constData());
+
+      // The peer 2 bucket is empty but the global one is still filled by the peer 1: (1100 + 100) / 2000 - 0.1 s.
+      delay = limiter.reserve(peer2, 100);
+      QVERIFY2(isAbout(delay, 500), QString::number(delay).toLatin1().constData());
+
+      // The second transfer of the peer 1 uses the same bucket.
+      limiter.transferFinished(peer1);
+      delay = limiter.reserve(peer1, 100);
+      QVERIFY2(isAbout(delay, 1100), QString::number(delay).toLatin1().constData());
+
+      limiter.transferFinished(peer1);
+      limiter.transferFinished(peer2);
+   }
+
+   // A more restrictive per peer limit is kept when the global rate is shared.
+   {
+      BandwidthLimiter limiter;
+      limiter.setLimits(10000, 1000);
+      BandwidthLimiter::Peer* peer1 = limiter.transferStarted(peerID1);
+      BandwidthLimiter::Peer* peer2 = limiter.transferStarted(peerID2);
+      const int delay = limiter.reserve(peer1, 1100);
+      QVERIFY2(isAbout(delay, 1000), QString::number(delay).toLatin1().constData());
+      limiter.transferFinished(peer1);
+      limiter.transferFinished(peer2);
+   }
+}
+
 void Tests::writePersistentData()
 {
    this->hash = Hash::rand();
@@ -725,6 +858,26 @@ void Tests::bloomFilter()
    qDebug() << "Measurement of the probability (p) for n =" << n << "with" << NB_TESTS << "tests:" << static_cast<double>(nbOfFalsePositive) / NB_TESTS;
 }
 
+void Tests::latencyHistogram()
+{
+   LatencyHistogram histogram;
+   QCOMPARE(histogram.getPercentile(0.5), Q_INT64_C(0));
+
+   histogram.add(500); // 0.5 µs.
+   histogram.add(3000); // 3 µs.
+   histogram.add(3500); // 3.5 µs.
+   histogram.add(Q_INT64_C(60) * 1000 * 1000 * 1000); // 1 min.
+
+   const QList<quint32> buckets = histogram.getBuckets();
+   QCOMPARE(buckets.size(), LatencyHistogram::NB_BUCKETS);
+   QCOMPARE(buckets[0], 1u);
+   QCOMPARE(buckets[1], 2u);
+   QCOMPARE(buckets[LatencyHistogram::NB_BUCKETS - 1], 1u);
+
+   QCOMPARE(histogram.getPercentile(0.5), Q_INT64_C(4));
+   QCOMPARE(histogram.getPercentile(1.0), Q_INT64_C(1) << LatencyHistogram::NB_BUCKETS);
+}
+
 void Tests::messageHeader()
 {
    const char data[] = {
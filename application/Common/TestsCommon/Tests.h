@@ -53,9 +53,15 @@ private slots:
    // MapArray class.
    void mapArray();
 
+   // IndexedList class.
+   void indexedList();
+
    // TransferRateCalculator
    void transferRateCalculator();
 
+   // BandwidthLimiter class.
+   void bandwidthLimiter();
+
    // PersistentData class.
    void writePersistentData();
    void readPersistentData();
@@ -76,6 +82,9 @@ private slots:
    // BloomFilter class.
    void bloomFilter();
 
+   // LatencyHistogram class.
+   void latencyHistogram();
+
    void messageHeader();
 
    // ZeroCopyOutputStreamQIODevice and ZeroCopyInputStreamQIODevice classes.
@@ -24,6 +24,7 @@ SOURCES += main.cpp \
     Tests.cpp \
     ../../Protos/common.pb.cc \
     ../../Protos/core_settings.pb.cc \
+    ../../Protos/gui_protocol.pb.cc \
     TreeTests.cpp \
     BenchmarkTests.cpp
 HEADERS += Tests.h \
@@ -51,5 +51,6 @@ void Timeoutable::stopTimer()
 void Timeoutable::timeoutSlot()
 {
    this->timeouted = true;
+   this->onTimeout();
    emit timeout();
 }
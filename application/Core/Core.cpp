@@ -174,6 +174,8 @@ Protos::Core::Settings* Core::createDefaultValuesSettings()
    settings->set_save_cache_period(60000);
    settings->set_check_received_data_integrity(true);
    settings->set_get_entries_timeout(5000);
+   settings->set_number_of_scanning_threads(4);
+   settings->set_hash_scheduling_policy(1);
 
    ///// PeerManager /////
    settings->set_pending_socket_timeout(10000);
@@ -181,20 +183,30 @@ Protos::Core::Settings* Core::createDefaultValuesSettings()
    settings->set_idle_socket_timeout(60000);
    settings->set_max_number_idle_socket(6);
    settings->set_get_hashes_timeout(20000);
+   settings->set_get_hashes_nb_next_files(16);
 
    ///// DownloadManager /////
-   settings->set_number_of_downloader(3);
+   settings->set_number_of_downloader(8);
+   settings->set_batch_max_chunks(64);
    settings->set_lan_speed(52428800);
    settings->set_time_recheck_chunk_factor(4);
    settings->set_switch_to_another_peer_factor(1.5);
    settings->set_download_rate_valid_time_factor(3000);
-   settings->set_save_queue_period(60000);
+   settings->set_save_queue_period(5000);
    settings->set_block_duration_corrupted_data(30000);
+   settings->set_max_peers_per_chunk(4);
+   settings->set_min_stripe_size(4194304);
+   settings->set_max_downloads_per_peer(4);
+   settings->set_endgame_threshold(134217728);
+   settings->set_download_rate_limit(0);
+   settings->set_download_rate_limit_per_peer(0);
 
    ///// UploadManager /////
    settings->set_upload_lifetime(5000);
    settings->set_upload_min_nb_thread(3);
    settings->set_upload_thread_lifetime(30000);
+   settings->set_upload_rate_limit(0);
+   settings->set_upload_rate_limit_per_peer(0);
 
    ///// NetworkListener /////
    settings->set_peer_imalive_period(5000);
@@ -255,6 +267,8 @@ void Core::checkSettingsIntegrity()
    }
    this->checkSetting("minimum_free_space", 0u, 4294967295u);
    this->checkSetting("save_cache_period", 1000u, 4294967295u);
+   this->checkSetting("number_of_scanning_threads", 1u, 32u);
+   this->checkSetting("hash_scheduling_policy", 0u, 1u);
 
    this->checkSetting("get_entries_timeout", 1000u, 60u * 1000u);
    this->checkSetting("pending_socket_timeout", 10u, 30u * 1000u);
@@ -262,18 +276,28 @@ void Core::checkSettingsIntegrity()
    this->checkSetting("idle_socket_timeout", 1000u, 60u * 60u * 1000u);
    this->checkSetting("max_number_idle_socket", 0u, 10u);
    this->checkSetting("get_hashes_timeout", 1000u, 60u * 1000u);
+   this->checkSetting("get_hashes_nb_next_files", 0u, 256u);
 
-   this->checkSetting("number_of_downloader", 1u, 10u);
+   this->checkSetting("number_of_downloader", 1u, 32u);
+   this->checkSetting("batch_max_chunks", 1u, 1024u);
    this->checkSetting("lan_speed", 1024u * 1024u, 1024u * 1024u * 1024u);
    this->checkSetting("time_recheck_chunk_factor", 1.0, 10.0);
    this->checkSetting("switch_to_another_peer_factor", 1.0, 10.0);
    this->checkSetting("download_rate_valid_time_factor", 100u, 100000u);
    this->checkSetting("save_queue_period", 1000u, 4294967295u);
    this->checkSetting("block_duration_corrupted_data", 0u, 60u * 60u * 1000u);
+   this->checkSetting("max_peers_per_chunk", 1u, 16u);
+   this->checkSetting("min_stripe_size", 64u * 1024u, 64u * 1024u * 1024u);
+   this->checkSetting("max_downloads_per_peer", 1u, 16u);
+   this->checkSetting("endgame_threshold", 0u, 1073741824u);
+   this->checkSetting("download_rate_limit", 0u, 4294967295u);
+   this->checkSetting("download_rate_limit_per_peer", 0u, 4294967295u);
 
    this->checkSetting("upload_lifetime", 0u, 30u * 1000u);
    this->checkSetting("upload_min_nb_thread", 1u, 1000u);
    this->checkSetting("upload_thread_lifetime", 0u, 60u * 60u * 1000u);
+   this->checkSetting("upload_rate_limit", 0u, 4294967295u);
+   this->checkSetting("upload_rate_limit_per_peer", 0u, 4294967295u);
 
    this->checkSetting("peer_imalive_period", 1000u, 60u * 1000u);
    this->checkSetting("unicast_base_port", 1u, 65535u);
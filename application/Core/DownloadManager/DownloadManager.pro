@@ -29,7 +29,12 @@ SOURCES += priv/FileDownload.cpp \
     priv/Log.cpp \
     priv/DownloadPredicate.cpp \
     priv/DownloadQueue.cpp \
+    priv/QueueJournal.cpp \
     priv/ChunkDownloader.cpp \
+    priv/ChunkStripe.cpp \
+    priv/ChunkBatch.cpp \
+    priv/ChunkScheduler.cpp \
+    priv/PeerConcurrency.cpp \
     priv/Utils.cpp
 HEADERS += IDownloadManager.h \
     IDownload.h \
@@ -46,7 +51,12 @@ HEADERS += IDownloadManager.h \
     ../../Protos/queue.pb.h \
     priv/DownloadPredicate.h \
     priv/DownloadQueue.h \
+    priv/QueueJournal.h \
     Utils.h \
     priv/LinkedPeers.h \
     IChunkDownloader.h \
-    priv/ChunkDownloader.h
+    priv/ChunkDownloader.h \
+    priv/ChunkStripe.h \
+    priv/ChunkBatch.h \
+    priv/ChunkScheduler.h \
+    priv/PeerConcurrency.h
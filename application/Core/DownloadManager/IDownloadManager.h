@@ -95,5 +95,10 @@ namespace DM
         * @return Byte/s.
         */
       virtual int getDownloadRate() = 0;
+
+      /**
+        * Limit the download rate, the rates are in byte/s. 0 means no limit.
+        */
+      virtual void setRateLimits(quint32 rate, quint32 ratePerPeer) = 0;
    };
 }
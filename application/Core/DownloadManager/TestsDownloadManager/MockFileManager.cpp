@@ -35,6 +35,11 @@ QSharedPointer<FM::IChunk> MockFileManager::getChunk(const Common::Hash& hash) c
    return QSharedPointer<FM::IChunk>();
 }
 
+QSharedPointer<FM::IChunk> MockFileManager::getCompleteChunk(const Common::Hash& hash) const
+{
+   return QSharedPointer<FM::IChunk>();
+}
+
 QList<QSharedPointer<FM::IChunk>> MockFileManager::getAllChunks(const Protos::Common::Entry& localEntry, const Common::Hashes& hashes) const
 {
    return QList<QSharedPointer<FM::IChunk>>();
@@ -50,12 +55,12 @@ void MockFileManager::newDirectory(Protos::Common::Entry& entry)
 
 }
 
-QSharedPointer<FM::IGetHashesResult> MockFileManager::getHashes(const Protos::Common::Entry& file)
+QSharedPointer<FM::IGetHashesResult> MockFileManager::getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, bool sendNextHashes)
 {
    return QSharedPointer<FM::IGetHashesResult>();
 }
 
-QSharedPointer<FM::IGetEntriesResult> MockFileManager::getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry)
+QSharedPointer<FM::IGetEntriesResult> MockFileManager::getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry, quint64 knownVersion, quint32 entriesOffset, quint32 nbMaxEntries)
 {
    return QSharedPointer<FM::IGetEntriesResult>();
 }
@@ -80,11 +85,21 @@ QList<Protos::Common::FindResult> MockFileManager::find(const QString& words, co
    return QList<Protos::Common::FindResult>();
 }
 
+bool MockFileManager::findAsync(const Common::Hash& requesterID, quint64 tag, const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize)
+{
+   return false;
+}
+
 QBitArray MockFileManager::haveChunks(const QList<Common::Hash>& hashes)
 {
    return QBitArray();
 }
 
+QBitArray MockFileManager::haveChunksByPrefix(const QList<quint64>& hashPrefixes)
+{
+   return QBitArray();
+}
+
 quint64 MockFileManager::getAmount()
 {
    return 0;
@@ -100,6 +115,11 @@ int MockFileManager::getProgress() const
    return 0;
 }
 
+MockFileManager::CacheQueuesStats MockFileManager::getCacheQueuesStats() const
+{
+   return CacheQueuesStats { 0, 0, 0, 0, 0, 0, 0, 0 };
+}
+
 void MockFileManager::dumpWordIndex() const
 {
 
@@ -15,19 +15,23 @@ public:
    QList<Common::SharedDir> getSharedDirs() const;
    QString getSharedDir(const Common::Hash& ID) const;
    QSharedPointer<FM::IChunk> getChunk(const Common::Hash& hash) const;
+   QSharedPointer<FM::IChunk> getCompleteChunk(const Common::Hash& hash) const;
    QList<QSharedPointer<FM::IChunk>> getAllChunks(const Protos::Common::Entry& localEntry, const Common::Hashes& hashes) const;
    QList<QSharedPointer<FM::IChunk>> newFile(Protos::Common::Entry& entry);
    void newDirectory(Protos::Common::Entry& entry);
-   QSharedPointer<FM::IGetHashesResult> getHashes(const Protos::Common::Entry& file);
-   QSharedPointer<FM::IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max());
+   QSharedPointer<FM::IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, bool sendNextHashes);
+   QSharedPointer<FM::IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max(), quint64 knownVersion = 0, quint32 entriesOffset = 0, quint32 nbMaxEntries = 0);
    Protos::Common::Entries getEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max());
    Protos::Common::Entries getEntries();
    QList<Protos::Common::FindResult> find(const QString& words, int maxNbResult, int maxSize);
    QList<Protos::Common::FindResult> find(const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize);
+   bool findAsync(const Common::Hash& requesterID, quint64 tag, const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize);
    QBitArray haveChunks(const QList<Common::Hash>& hashes);
+   QBitArray haveChunksByPrefix(const QList<quint64>& hashPrefixes);
    quint64 getAmount();
    CacheStatus getCacheStatus() const;
    int getProgress() const;
+   CacheQueuesStats getCacheQueuesStats() const;
    void dumpWordIndex() const;
    void printSimilarFiles() const;
 };
@@ -0,0 +1,113 @@
+#include <MockPeer.h>
+
+#include <limits>
+
+MockPeer::MockPeer(const Common::Hash& ID, const QString& nick)
+   : ID(ID), nick(nick), speed(std::numeric_limits<quint32>::max()), available(false)
+{
+}
+
+void MockPeer::setAvailable(bool available)
+{
+   this->available = available;
+}
+
+Common::Hash MockPeer::getID() const
+{
+   return this->ID;
+}
+
+QHostAddress MockPeer::getIP() const
+{
+   return QHostAddress();
+}
+
+quint16 MockPeer::getPort() const
+{
+   return 0;
+}
+
+QString MockPeer::getNick() const
+{
+   return this->nick;
+}
+
+QString MockPeer::getCoreVersion() const
+{
+   return QString();
+}
+
+quint64 MockPeer::getSharingAmount() const
+{
+   return 0;
+}
+
+quint32 MockPeer::getDownloadRate() const
+{
+   return 0;
+}
+
+quint32 MockPeer::getUploadRate() const
+{
+   return 0;
+}
+
+quint32 MockPeer::getSpeed()
+{
+   return this->speed;
+}
+
+void MockPeer::setSpeed(quint32 newSpeed)
+{
+   this->speed = newSpeed;
+}
+
+quint32 MockPeer::getExpectedSpeed()
+{
+   return this->speed;
+}
+
+PM::PeerStats MockPeer::getStats() const
+{
+   return PM::PeerStats { this->speed, 0, 0, 0, 0, 0.0, QList<quint32>() };
+}
+
+void MockPeer::block(int duration, const QString& reason)
+{
+   this->available = false;
+}
+
+bool MockPeer::isAlive() const
+{
+   return this->available;
+}
+
+bool MockPeer::isAvailable() const
+{
+   return this->available;
+}
+
+quint32 MockPeer::getProtocolVersion() const
+{
+   return 0;
+}
+
+QSharedPointer<PM::IGetEntriesResult> MockPeer::getEntries(const Protos::Core::GetEntries& dirs)
+{
+   return QSharedPointer<PM::IGetEntriesResult>();
+}
+
+QSharedPointer<PM::IGetHashesResult> MockPeer::getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles)
+{
+   return QSharedPointer<PM::IGetHashesResult>();
+}
+
+QSharedPointer<PM::IGetChunksResult> MockPeer::getChunks(const Protos::Core::GetChunks& chunks)
+{
+   return QSharedPointer<PM::IGetChunksResult>();
+}
+
+QString MockPeer::toStringLog() const
+{
+   return QString("%1 (mock)").arg(this->nick);
+}
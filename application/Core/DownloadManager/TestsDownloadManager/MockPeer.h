@@ -0,0 +1,46 @@
+#ifndef TESTS_DOWNLOADMANAGER_MOCKPEER_H
+#define TESTS_DOWNLOADMANAGER_MOCKPEER_H
+
+#include <PeerManager/IPeer.h>
+
+/**
+  * A peer which never answers, it's not available unless 'setAvailable(true)' is called.
+  */
+class MockPeer : public PM::IPeer
+{
+public:
+   MockPeer(const Common::Hash& ID, const QString& nick);
+
+   void setAvailable(bool available);
+
+   Common::Hash getID() const;
+   QHostAddress getIP() const;
+   quint16 getPort() const;
+   QString getNick() const;
+   QString getCoreVersion() const;
+   quint64 getSharingAmount() const;
+   quint32 getDownloadRate() const;
+   quint32 getUploadRate() const;
+   quint32 getSpeed();
+   void setSpeed(quint32 newSpeed);
+   quint32 getExpectedSpeed();
+   PM::PeerStats getStats() const;
+   void block(int duration, const QString& reason = QString());
+   bool isAlive() const;
+   bool isAvailable() const;
+   quint32 getProtocolVersion() const;
+
+   QSharedPointer<PM::IGetEntriesResult> getEntries(const Protos::Core::GetEntries& dirs);
+   QSharedPointer<PM::IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles = QList<Protos::Common::Entry>());
+   QSharedPointer<PM::IGetChunksResult> getChunks(const Protos::Core::GetChunks& chunks);
+
+   QString toStringLog() const;
+
+private:
+   const Common::Hash ID;
+   const QString nick;
+   quint32 speed;
+   bool available;
+};
+
+#endif
@@ -8,7 +8,7 @@ MockPeerManager::MockPeerManager()
 
 MockPeerManager::~MockPeerManager()
 {
-
+   qDeleteAll(this->peers);
 }
 
 void MockPeerManager::setNick(const QString& nick)
@@ -36,15 +36,20 @@ QList<PM::IPeer*> MockPeerManager::getPeers() const
 
 PM::IPeer* MockPeerManager::getPeer(const Common::Hash& ID)
 {
-   // Never called by the download manager.
-   return nullptr;
+   return this->peers.value(ID);
 }
 
+/**
+  * Called when the queue is loaded, the created peers are never available.
+  */
 PM::IPeer* MockPeerManager::createPeer(const Common::Hash& ID, const QString& nick)
 {
-   // Should never be called.
    this->createPeerNbCall++;
-   return nullptr;
+
+   MockPeer*& peer = this->peers[ID];
+   if (!peer)
+      peer = new MockPeer(ID, nick);
+   return peer;
 }
 
 void MockPeerManager::updatePeer(
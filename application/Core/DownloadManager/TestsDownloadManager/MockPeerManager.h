@@ -1,8 +1,12 @@
 #ifndef TESTS_DOWNLOADMANAGER_MOCKPEERMANAGER_H
 #define TESTS_DOWNLOADMANAGER_MOCKPEERMANAGER_H
 
+#include <QHash>
+
 #include <PeerManager/IPeerManager.h>
 
+#include <MockPeer.h>
+
 class MockPeerManager : public PM::IPeerManager
 {
    Q_OBJECT
@@ -33,6 +37,7 @@ public:
 
 private:
    int createPeerNbCall;
+   QHash<Common::Hash, MockPeer*> peers;
 };
 
 #endif
@@ -21,15 +21,33 @@ using namespace DM;
 
 #include <QtDebug>
 #include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
 
 #include <Protos/core_protocol.pb.h>
 #include <Protos/core_settings.pb.h>
 #include <Protos/common.pb.h>
+#include <Protos/queue.pb.h>
 
 #include <Common/LogManager/Builder.h>
+#include <Common/PersistentData.h>
+#include <Common/Constants.h>
+#include <Common/Settings.h>
 #include <Common/Global.h>
 
 #include <Builder.h>
+#include <IDownload.h>
+#include <priv/Constants.h>
+#include <priv/QueueJournal.h>
+#include <priv/FileDownload.h>
+#include <priv/ChunkScheduler.h>
+#include <priv/LinkedPeers.h>
+#include <priv/OccupiedPeers.h>
+#include <priv/PeerConcurrency.h>
+
+#include <MockPeer.h>
 
 /**
   * @class Tests
@@ -47,13 +65,348 @@ void Tests::initTestCase()
    LM::Builder::initMsgHandler();
    qDebug() << "===== initTestCase() =====";
 
+   try
+   {
+      Common::Global::setCurrentDirToTemp("DownloadManagerTests");
+   }
+   catch (Common::Global::UnableToSetTempDirException& e)
+   {
+      QFAIL(e.errorMessage.toLatin1().constData());
+   }
+
+   SETTINGS.setFilename("core_settings_download_manager_tests.txt");
+   SETTINGS.setSettingsMessage(new Protos::Core::Settings());
+
    this->fileManager = QSharedPointer<MockFileManager>(new MockFileManager());
    this->peerManager = QSharedPointer<MockPeerManager>(new MockPeerManager());
    this->downloadManager = Builder::newDownloadManager(this->fileManager, this->peerManager);
 }
 
+/**
+  * The paused and complete downloads must keep their status when the core is restarted, the downloads are
+  * deleted at exit and their status must not be journaled.
+  */
+void Tests::keepTheQueueStatusAfterARestart()
+{
+   qDebug() << "===== keepTheQueueStatusAfterARestart() =====";
+
+   removeQueueFiles();
+
+   const Protos::Queue::Queue::Entry::Status statuses[] = { Protos::Queue::Queue::Entry::QUEUED, Protos::Queue::Queue::Entry::PAUSED, Protos::Queue::Queue::Entry::COMPLETE };
+
+   Protos::Queue::Queue queue;
+   queue.set_version(FILE_QUEUE_VERSION);
+   for (int i = 0; i < 3; i++)
+      addQueueEntry(queue, i + 1, statuses[i]);
+   Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, queue, Common::Global::DataFolderType::LOCAL);
+
+   {
+      QSharedPointer<MockFileManager> fileManager(new MockFileManager());
+      QSharedPointer<IDownloadManager> downloadManager = Builder::newDownloadManager(fileManager, this->peerManager);
+      emit fileManager->fileCacheLoaded();
+
+      const QList<IDownload*> downloads = downloadManager->getDownloads();
+      QCOMPARE(downloads.size(), 3);
+      QCOMPARE(downloads[1]->getStatus(), PAUSED);
+      QCOMPARE(downloads[2]->getStatus(), COMPLETE);
+
+      // This change is journaled, the download manager is then deleted as at exit.
+      downloadManager->pauseDownloads(QList<quint64> { downloads[0]->getID() });
+      QCOMPARE(downloads[0]->getStatus(), PAUSED);
+   }
+
+   {
+      QSharedPointer<MockFileManager> fileManager(new MockFileManager());
+      QSharedPointer<IDownloadManager> downloadManager = Builder::newDownloadManager(fileManager, this->peerManager);
+      emit fileManager->fileCacheLoaded();
+
+      const QList<IDownload*> downloads = downloadManager->getDownloads();
+      QCOMPARE(downloads.size(), 3);
+      QCOMPARE(downloads[0]->getStatus(), PAUSED);
+      QCOMPARE(downloads[1]->getStatus(), PAUSED);
+      QCOMPARE(downloads[2]->getStatus(), COMPLETE);
+   }
+
+   removeQueueFiles();
+}
+
+/**
+  * The records of the journal are applied to the snapshot up to a record partially written (the core has crashed),
+  * the end of the journal is then removed.
+  */
+void Tests::ignoreATornJournalRecord()
+{
+   qDebug() << "===== ignoreATornJournalRecord() =====";
+
+   removeQueueFiles();
+
+   Protos::Queue::Queue queue;
+   queue.set_version(FILE_QUEUE_VERSION);
+   queue.set_journal_number(1);
+   queue.set_hash_table_number(1);
+   addQueueEntry(queue, 1, Protos::Queue::Queue::Entry::QUEUED);
+   addQueueEntry(queue, 2, Protos::Queue::Queue::Entry::QUEUED);
+   Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, queue, Common::Global::DataFolderType::LOCAL);
+
+   QByteArray journal;
+   Protos::Queue::JournalRecord record;
+
+   record.set_type(Protos::Queue::JournalRecord::ADD);
+   addQueueEntry(queue, 3, Protos::Queue::Queue::Entry::QUEUED);
+   record.mutable_entry()->CopyFrom(queue.entry(2));
+   record.mutable_entry()->set_rank(0);
+   appendJournalRecord(journal, record);
+
+   record.Clear();
+   record.set_type(Protos::Queue::JournalRecord::UPDATE);
+   record.mutable_entry()->CopyFrom(queue.entry(1));
+   record.mutable_entry()->set_status(Protos::Queue::Queue::Entry::PAUSED);
+   record.mutable_entry()->set_rank(42); // Ignored, the rank is only changed by 'MOVE'.
+   appendJournalRecord(journal, record);
+
+   record.Clear();
+   record.set_type(Protos::Queue::JournalRecord::MOVE);
+   record.add_id(1);
+   record.add_rank(4);
+   appendJournalRecord(journal, record);
+
+   const int validSize = journal.size();
+
+   // The last byte of the last record is missing.
+   record.Clear();
+   record.set_type(Protos::Queue::JournalRecord::REMOVE);
+   record.add_id(2);
+   QByteArray tornRecord;
+   appendJournalRecord(tornRecord, record);
+   journal.append(tornRecord.left(tornRecord.size() - 1));
+
+   const QString journalFilepath = Common::Global::getDataFolder(Common::Global::DataFolderType::LOCAL) + '/' + Common::Constants::FILE_QUEUE_JOURNAL.arg(1);
+   QFile journalFile(journalFilepath);
+   QVERIFY(journalFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+   QCOMPARE(journalFile.write(journal), static_cast<qint64>(journal.size()));
+   journalFile.close();
+
+   QueueJournal queueJournal;
+   const Protos::Queue::Queue loadedQueue = queueJournal.load();
+
+   QCOMPARE(loadedQueue.entry_size(), 3);
+   QCOMPARE(loadedQueue.entry(0).id(), 3ull);
+   QCOMPARE(loadedQueue.entry(1).id(), 2ull);
+   QCOMPARE(loadedQueue.entry(1).rank(), 2ull);
+   QCOMPARE(loadedQueue.entry(1).status(), Protos::Queue::Queue::Entry::PAUSED);
+   QCOMPARE(loadedQueue.entry(2).id(), 1ull);
+   QCOMPARE(loadedQueue.entry(2).rank(), 4ull);
+
+   QCOMPARE(QFileInfo(journalFilepath).size(), static_cast<qint64>(validSize));
+
+   removeQueueFiles();
+}
+
+/**
+  * The journal is merged into a new snapshot when it becomes bigger than the snapshot and than 'QUEUE_JOURNAL_MIN_SIZE_TO_COMPACT',
+  * the hash table is kept.
+  */
+void Tests::compactTheQueueJournal()
+{
+   qDebug() << "===== compactTheQueueJournal() =====";
+
+   removeQueueFiles();
+
+   Protos::Queue::Queue queue;
+   queue.set_version(FILE_QUEUE_VERSION);
+   for (int i = 0; i < 3; i++)
+      addQueueEntry(queue, i + 1, Protos::Queue::Queue::Entry::QUEUED);
+   Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, queue, Common::Global::DataFolderType::LOCAL);
+
+   // All the records are written in a single batch when the download manager is deleted.
+   const quint32 saveQueuePeriod = SETTINGS.get<quint32>("save_queue_period");
+   SETTINGS.set("save_queue_period", 3600000u);
+
+   {
+      QSharedPointer<MockFileManager> fileManager(new MockFileManager());
+      QSharedPointer<IDownloadManager> downloadManager = Builder::newDownloadManager(fileManager, this->peerManager);
+      emit fileManager->fileCacheLoaded();
+
+      const QList<IDownload*> downloads = downloadManager->getDownloads();
+      QCOMPARE(downloads.size(), 3);
+
+      // Each change of status journals the whole entry.
+      const int nbChanges = 2 * QUEUE_JOURNAL_MIN_SIZE_TO_COMPACT / queue.entry(0).ByteSizeLong() + 1;
+      for (int i = 0; i < nbChanges; i++)
+         downloadManager->pauseDownloads(QList<quint64> { downloads[0]->getID() }, i % 2 == 0);
+      QCOMPARE(downloads[0]->getStatus(), PAUSED);
+   } // The pending records are written when the download manager is deleted, then the journal is compacted.
+
+   SETTINGS.set("save_queue_period", saveQueuePeriod);
+
+   Protos::Queue::Queue compactedQueue;
+   Common::PersistentData::getValue(Common::Constants::FILE_QUEUE, compactedQueue, Common::Global::DataFolderType::LOCAL);
+   QCOMPARE(compactedQueue.journal_number(), compactedQueue.hash_table_number() + 1);
+   QCOMPARE(compactedQueue.entry_size(), 3);
+   QCOMPARE(compactedQueue.entry(0).status(), Protos::Queue::Queue::Entry::PAUSED);
+
+   const QString dataFolder = Common::Global::getDataFolder(Common::Global::DataFolderType::LOCAL);
+   QCOMPARE(QFileInfo(dataFolder + '/' + Common::Constants::FILE_QUEUE_JOURNAL.arg(compactedQueue.journal_number())).size(), 0ll);
+   QVERIFY(!QFile::exists(dataFolder + '/' + Common::Constants::FILE_QUEUE_JOURNAL.arg(compactedQueue.hash_table_number())));
+   QVERIFY(QFile::exists(dataFolder + '/' + Common::Constants::FILE_QUEUE_HASHES.arg(compactedQueue.hash_table_number())));
+
+   {
+      QSharedPointer<MockFileManager> fileManager(new MockFileManager());
+      QSharedPointer<IDownloadManager> downloadManager = Builder::newDownloadManager(fileManager, this->peerManager);
+      emit fileManager->fileCacheLoaded();
+
+      const QList<IDownload*> downloads = downloadManager->getDownloads();
+      QCOMPARE(downloads.size(), 3);
+      QCOMPARE(downloads[0]->getStatus(), PAUSED);
+      QCOMPARE(downloads[1]->getStatus(), QUEUED);
+      QCOMPARE(downloads[2]->getStatus(), QUEUED);
+   }
+
+   removeQueueFiles();
+}
+
+/**
+  * The chunks ready to be downloaded from a peer are given by the rank of their file then the rarest first,
+  * they are indexed again when the rank or the status of their file changes.
+  */
+void Tests::scheduleTheChunksByRankAndStatus()
+{
+   qDebug() << "===== scheduleTheChunksByRankAndStatus() =====";
+
+   LinkedPeers linkedPeers;
+   OccupiedPeers occupiedPeersAskingForHashes;
+   OccupiedPeers occupiedPeersDownloadingChunk;
+   PeerConcurrency peerConcurrency;
+   ChunkScheduler chunkScheduler;
+   Common::ThreadPool threadPool(1);
+   Common::TransferRateCalculator transferRateCalculator;
+   Common::BandwidthLimiter bandwidthLimiter;
+
+   MockPeer peer1(Common::Hash::rand(), "peer1");
+   MockPeer peer2(Common::Hash::rand(), "peer2");
+   peer1.setAvailable(true);
+   peer2.setAvailable(true);
+
+   // The file A has two chunks and the file B one, all their hashes are known.
+   QList<Common::Hash> hashesA { Common::Hash::rand(), Common::Hash::rand() };
+   QList<Common::Hash> hashesB { Common::Hash::rand() };
+   const Protos::Common::Entry entryA = newFileEntry("a.bin", hashesA);
+   const Protos::Common::Entry entryB = newFileEntry("b.bin", hashesB);
+
+   FileDownload fileDownloadA(this->fileManager, linkedPeers, occupiedPeersAskingForHashes, occupiedPeersDownloadingChunk, peerConcurrency, chunkScheduler, threadPool, &peer1, entryA, entryA, transferRateCalculator, bandwidthLimiter);
+   FileDownload fileDownloadB(this->fileManager, linkedPeers, occupiedPeersAskingForHashes, occupiedPeersDownloadingChunk, peerConcurrency, chunkScheduler, threadPool, &peer1, entryB, entryB, transferRateCalculator, bandwidthLimiter);
+   fileDownloadA.setQueueRank(2);
+   fileDownloadB.setQueueRank(1);
+   QCOMPARE(chunkScheduler.getNbReadyChunks(), 0); // The chunks don't have any peer yet.
+
+   fileDownloadA.peerSourceBecomesAvailable();
+   fileDownloadB.peerSourceBecomesAvailable();
+
+   // The second chunk of A is also owned by the peer 2.
+   QList<QSharedPointer<IChunkDownloader>> chunksA;
+   fileDownloadA.getUnfinishedChunks(chunksA, 2, false);
+   QCOMPARE(chunksA.size(), 2);
+   chunksA[1]->addPeer(&peer2);
+
+   QCOMPARE(chunkScheduler.getNbReadyChunks(), 3);
+   QCOMPARE(chunkScheduler.getPeers().size(), 2);
+
+   FileDownload* fileDownload = nullptr;
+   QSharedPointer<ChunkDownloader> chunk = chunkScheduler.getAChunkToDownload(&peer1, fileDownload);
+   QCOMPARE(fileDownload, &fileDownloadB); // The file with the lowest rank first.
+   QCOMPARE(chunk->getHash(), hashesB[0]);
+
+   chunk = chunkScheduler.getAChunkToDownload(&peer2, fileDownload);
+   QCOMPARE(fileDownload, &fileDownloadA);
+   QCOMPARE(chunk->getHash(), hashesA[1]);
+
+   // B goes after A, the first chunk of A has only one peer thus it's the rarest.
+   fileDownloadB.setQueueRank(3);
+   chunk = chunkScheduler.getAChunkToDownload(&peer1, fileDownload);
+   QCOMPARE(fileDownload, &fileDownloadA);
+   QCOMPARE(chunk->getHash(), hashesA[0]);
+
+   // The chunks of a paused file are removed from the index.
+   QVERIFY(fileDownloadA.pause(true));
+   QCOMPARE(chunkScheduler.getNbReadyChunks(), 1);
+   QVERIFY(!chunkScheduler.getPeers().contains(&peer2));
+   QVERIFY(chunkScheduler.getAChunkToDownload(&peer2, fileDownload).isNull());
+   chunk = chunkScheduler.getAChunkToDownload(&peer1, fileDownload);
+   QCOMPARE(fileDownload, &fileDownloadB);
+
+   QVERIFY(fileDownloadA.pause(false));
+   QCOMPARE(chunkScheduler.getNbReadyChunks(), 3);
+   chunk = chunkScheduler.getAChunkToDownload(&peer1, fileDownload);
+   QCOMPARE(fileDownload, &fileDownloadA);
+   QCOMPARE(chunk->getHash(), hashesA[0]);
+   chunk = chunkScheduler.getAChunkToDownload(&peer2, fileDownload);
+   QCOMPARE(chunk->getHash(), hashesA[1]);
+}
+
 void Tests::cleanupTestCase()
 {
    qDebug() << "===== cleanupTestCase() =====";
 }
 
+/**
+  * Add a file entry to a saved queue, its rank is its ID.
+  */
+void Tests::addQueueEntry(Protos::Queue::Queue& queue, quint64 id, Protos::Queue::Queue::Entry::Status status)
+{
+   Protos::Queue::Queue::Entry* entry = queue.add_entry();
+   entry->set_id(id);
+   entry->set_rank(id);
+   entry->set_status(status);
+
+   Protos::Common::Entry* remoteEntry = entry->mutable_remote_entry();
+   remoteEntry->set_type(Protos::Common::Entry::FILE);
+   remoteEntry->set_path("/");
+   remoteEntry->set_name(QString("file%1.txt").arg(id).toStdString());
+   remoteEntry->set_size(1000);
+   entry->mutable_local_entry()->CopyFrom(*remoteEntry);
+   entry->mutable_local_entry()->set_exists(false);
+
+   entry->mutable_peer_source_id()->set_hash(Common::Hash::rand().getData(), Common::Hash::HASH_SIZE);
+   entry->set_peer_source_nick("peer");
+}
+
+/**
+  * Append a record prefixed by its size, as written by 'QueueJournal'.
+  */
+void Tests::appendJournalRecord(QByteArray& journal, const Protos::Queue::JournalRecord& record)
+{
+   const int size = record.ByteSizeLong();
+   QByteArray data(sizeof(quint32) + size, Qt::Uninitialized);
+   qToLittleEndian<quint32>(size, data.data());
+   record.SerializeToArray(data.data() + sizeof(quint32), size);
+   journal.append(data);
+}
+
+/**
+  * Remove the snapshot, the journals and the hash tables of the queue.
+  */
+void Tests::removeQueueFiles()
+{
+   Common::PersistentData::rmValue(Common::Constants::FILE_QUEUE, Common::Global::DataFolderType::LOCAL);
+
+   QDir dataFolder(Common::Global::getDataFolder(Common::Global::DataFolderType::LOCAL));
+   const QStringList filenames = dataFolder.entryList(QStringList { Common::Constants::FILE_QUEUE_JOURNAL.arg('*'), Common::Constants::FILE_QUEUE_HASHES.arg('*') }, QDir::Files);
+   for (QStringListIterator i(filenames); i.hasNext();)
+      dataFolder.remove(i.next());
+}
+
+/**
+  * Return a file entry not yet created locally with one chunk per given hash.
+  */
+Protos::Common::Entry Tests::newFileEntry(const QString& name, const QList<Common::Hash>& hashes)
+{
+   Protos::Common::Entry entry;
+   entry.set_type(Protos::Common::Entry::FILE);
+   entry.set_path("/");
+   entry.set_name(name.toStdString());
+   entry.set_size(static_cast<quint64>(hashes.size()) * Common::Constants::CHUNK_SIZE);
+   entry.set_exists(false);
+   for (QListIterator<Common::Hash> i(hashes); i.hasNext();)
+      entry.add_chunk()->set_hash(i.next().getData(), Common::Hash::HASH_SIZE);
+   return entry;
+}
@@ -26,6 +26,7 @@
 #include <google/protobuf/message.h>
 
 #include <Protos/common.pb.h>
+#include <Protos/queue.pb.h>
 
 #include <Common/Hash.h>
 #include <Core/FileManager/Builder.h>
@@ -47,10 +48,22 @@ public:
 private slots:
    void initTestCase();
 
+   // Queue persistence, see 'QueueJournal'.
+   void keepTheQueueStatusAfterARestart();
+   void ignoreATornJournalRecord();
+   void compactTheQueueJournal();
+
+   // Chunk scheduling, see 'ChunkScheduler'.
+   void scheduleTheChunksByRankAndStatus();
 
    void cleanupTestCase();
 
 private:
+   static void addQueueEntry(Protos::Queue::Queue& queue, quint64 id, Protos::Queue::Queue::Entry::Status status);
+   static void appendJournalRecord(QByteArray& journal, const Protos::Queue::JournalRecord& record);
+   static Protos::Common::Entry newFileEntry(const QString& name, const QList<Common::Hash>& hashes);
+   static void removeQueueFiles();
+
    QSharedPointer<MockFileManager> fileManager;
    QSharedPointer<MockPeerManager> peerManager;
    QSharedPointer<IDownloadManager> downloadManager;
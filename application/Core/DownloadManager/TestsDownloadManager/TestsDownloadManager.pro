@@ -41,10 +41,12 @@ SOURCES += main.cpp \
     ../../../Protos/core_settings.pb.cc \
     ../../../Protos/core_protocol.pb.cc \ 
     MockFileManager.cpp \
-    MockPeerManager.cpp
+    MockPeerManager.cpp \
+    MockPeer.cpp
 HEADERS += Tests.h \
     ../../../Protos/common.pb.h \
     ../../../Protos/core_settings.pb.h \
     ../../../Protos/core_protocol.pb.h \
     MockFileManager.h \
-    MockPeerManager.h
+    MockPeerManager.h \
+    MockPeer.h
@@ -0,0 +1,488 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/ChunkBatch.h>
+using namespace DM;
+
+#include <QMutexLocker>
+
+#include <Common/Settings.h>
+#include <Core/FileManager/Exceptions.h>
+
+#include <priv/ChunkDownloader.h>
+#include <priv/Log.h>
+
+/**
+  * @class DM::ChunkBatch
+  *
+  * Download several chunks from one peer with a single 'GetChunks' request, used for the small files (one chunk).
+  * The peer sends the data of the chunks back-to-back on the same socket in the requested order, thus there is
+  * one round trip and one connection for the whole batch instead of one per file.
+  * The batch occupies the peer once, the chunk downloaders only reflect the state of their chunk, see 'ChunkDownloader::batchStarted(..)'.
+  * A chunk downloader stopped during the batch doesn't receive its data anymore, the data is read and dropped to reach the next chunk.
+  *
+  * Like 'ChunkStripe' the socket is read in the main thread when it's ready and the blocks are written by a thread of the pool.
+  */
+
+ChunkBatch::ChunkBatch(
+   const QList<QSharedPointer<ChunkDownloader>>& chunkDownloaders,
+   PM::IPeer* peer,
+   OccupiedPeers& occupiedPeersDownloadingChunk,
+   PeerConcurrency& peerConcurrency,
+   Common::TransferRateCalculator& transferRateCalculator,
+   Common::BandwidthLimiter& bandwidthLimiter,
+   Common::ThreadPool& threadPool
+) :
+   peer(peer),
+   occupiedPeersDownloadingChunk(occupiedPeersDownloadingChunk),
+   peerConcurrency(peerConcurrency),
+   transferRateCalculator(transferRateCalculator),
+   bandwidthLimiter(bandwidthLimiter),
+   threadPool(threadPool),
+   bytesReceived(0),
+   current(-1),
+   bytesToRead(0),
+   bytesInBuffer(0),
+   limiterPeer(nullptr),
+   deltaRead(0),
+   active(false),
+   ended(false),
+   writing(false),
+   waitingForBandwidth(false),
+   closeTheSocket(false)
+{
+   this->socketTimer.setSingleShot(true);
+   this->socketTimer.setInterval(SETTINGS.get<quint32>("socket_timeout"));
+   connect(&this->socketTimer, &QTimer::timeout, this, &ChunkBatch::socketTimeout);
+
+   for (QListIterator<QSharedPointer<ChunkDownloader>> i(chunkDownloaders); i.hasNext();)
+      this->items << Item { i.next(), 0, 0, QUEUED, false };
+}
+
+/**
+  * Send the request to the peer, the chunks must have been created, see 'FileDownload::prepareToDownload(..)'.
+  * @return 'false' if the request can't be sent, in this case 'batchFinished' isn't emitted.
+  */
+bool ChunkBatch::start()
+{
+   Protos::Core::GetChunks getChunksMess;
+   for (QMutableListIterator<Item> i(this->items); i.hasNext();)
+   {
+      Item& item = i.next();
+      item.offset = item.end = item.chunkDownloader->getChunk()->getKnownBytes();
+
+      Protos::Core::GetChunks::Chunk* chunk = getChunksMess.add_chunks();
+      chunk->mutable_hash()->set_hash(item.chunkDownloader->getHash().getData(), Common::Hash::HASH_SIZE);
+      chunk->set_offset(item.offset);
+   }
+
+   this->getChunksResult = this->peer->getChunks(getChunksMess);
+   if (this->getChunksResult.isNull())
+      return false;
+
+   L_DEBU(QString("Starting downloading a batch of %1 chunks from %2").arg(this->items.size()).arg(this->peer->getID().toStr()));
+
+   this->active = true;
+
+   for (QListIterator<Item> i(this->items); i.hasNext();)
+      i.next().chunkDownloader->batchStarted(this->peer);
+
+   this->occupiedPeersDownloadingChunk.setPeerAsOccupied(this->peer);
+   this->peerConcurrency.downloadStarted(this->peer);
+   this->requestTimer.start();
+
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::result, this, &ChunkBatch::result, Qt::DirectConnection);
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::stream, this, &ChunkBatch::stream, Qt::DirectConnection);
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::timeout, this, &ChunkBatch::getChunkTimeout, Qt::DirectConnection);
+
+   this->getChunksResult->start();
+   return true;
+}
+
+/**
+  * Abort the download, 'batchFinished' is emitted.
+  * If a block is being written we wait for the end of the writing.
+  */
+void ChunkBatch::stop()
+{
+   this->mutex.lock();
+   this->active = false;
+   this->mutex.unlock();
+
+   if (this->writing)
+   {
+      this->threadPool.wait(this->getWeakRef());
+      this->writing = false;
+   }
+
+   this->closeTheSocket = true; // The peer may still be sending data.
+   this->end();
+}
+
+PM::IPeer* ChunkBatch::getPeer() const
+{
+   return this->peer;
+}
+
+void ChunkBatch::init(QThread*)
+{
+}
+
+/**
+  * Called by the thread pool ('Common::ThreadPool') in another thread.
+  */
+void ChunkBatch::run()
+{
+   this->writeBlock();
+}
+
+/**
+  * Called in the main thread when the buffer has been written.
+  */
+void ChunkBatch::finished()
+{
+   this->writing = false;
+
+   if (this->ended)
+      return;
+
+   if (this->items[this->current].status != QUEUED)
+      this->end();
+   else
+      this->readBlock();
+}
+
+void ChunkBatch::result(const Protos::Core::GetChunksResult& result)
+{
+   if (result.status() != Protos::Core::GetChunksResult::OK)
+   {
+      L_WARN(QString("Status error from GetChunkResult: %1. Batch download aborted.").arg(result.status()));
+      for (QMutableListIterator<Item> i(this->items); i.hasNext();)
+      {
+         Item& item = i.next();
+         item.status = TRANSFER_ERROR;
+         item.peerToRemove = true;
+      }
+      this->end();
+      return;
+   }
+
+   if (result.results_size() != this->items.size())
+   {
+      L_ERRO(QString("Message 'GetChunkResult' doesn't contain a result for each chunk: %1 instead of %2. Batch download aborted.").arg(result.results_size()).arg(this->items.size()));
+      for (QMutableListIterator<Item> i(this->items); i.hasNext();)
+         i.next().status = TRANSFER_ERROR;
+      this->closeTheSocket = true;
+      this->end();
+      return;
+   }
+
+   this->peerConcurrency.newRTT(this->peer, this->requestTimer.elapsed());
+
+   for (int i = 0; i < this->items.size(); i++)
+   {
+      Item& item = this->items[i];
+      const Protos::Core::GetChunksResult::ChunkResult& chunkResult = result.results(i);
+
+      // The peer doesn't send anything for this chunk, the next one follows.
+      if (chunkResult.status() != Protos::Core::GetChunksResult::ChunkResult::OK)
+      {
+         L_DEBU(QString("Chunk status error from GetChunkResult: %1, chunk: %2").arg(chunkResult.status()).arg(item.chunkDownloader->getChunk()->toStringLog()));
+         item.status = TRANSFER_ERROR;
+         item.peerToRemove = true;
+      }
+      else if (static_cast<int>(chunkResult.chunk_size()) <= item.offset)
+      {
+         L_ERRO(QString("Message 'GetChunkResult' doesn't contain a valid chunk size: %1, chunk: %2. Batch download aborted.").arg(chunkResult.chunk_size()).arg(item.chunkDownloader->getChunk()->toStringLog()));
+         item.status = TRANSFER_ERROR;
+         this->closeTheSocket = true; // The following data can't be delimited, the stream is reset.
+         this->end();
+         return;
+      }
+      else
+      {
+         item.end = chunkResult.chunk_size();
+      }
+   }
+}
+
+void ChunkBatch::stream(const QSharedPointer<PM::ISocket>& socket)
+{
+   if (this->ended) // Aborted by 'result(..)'.
+      return;
+
+   this->socket = socket;
+
+   if (!this->nextItem())
+   {
+      this->end();
+      return;
+   }
+
+   static const int BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_writing");
+
+   this->buffer.resize(BUFFER_SIZE);
+   this->limiterPeer = this->bandwidthLimiter.transferStarted(this->peer->getID());
+   this->speedTimer.start();
+
+   connect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkBatch::readBlock);
+   this->readBlock(); // Some data may already be buffered.
+}
+
+void ChunkBatch::getChunkTimeout()
+{
+   L_WARN("Timeout from GetChunkResult, batch download aborted.");
+   for (QMutableListIterator<Item> i(this->items); i.hasNext();)
+      i.next().status = TRANSFER_ERROR;
+   this->end();
+}
+
+/**
+  * Read the available data until the buffer is full or the current chunk is received, the buffer is then written by the pool.
+  * Called each time the socket has new data, after a writing and after a delay imposed by the bandwidth limiter.
+  */
+void ChunkBatch::readBlock()
+{
+   static const int SPEED_UPDATE_PERIOD = 1000; // [ms].
+
+   if (this->ended || this->writing || this->waitingForBandwidth)
+      return;
+
+   forever
+   {
+      this->mutex.lock();
+      if (!this->active)
+      {
+         this->closeTheSocket = true; // The remote uploader must stop sending the rest of the data.
+         this->mutex.unlock();
+         this->end();
+         return;
+      }
+      this->mutex.unlock();
+
+      if (this->bytesToRead == 0 && !this->nextItem())
+      {
+         this->end();
+         return;
+      }
+
+      Item& item = this->items[this->current];
+      const int bytesRead = this->socket->read(this->buffer.data() + this->bytesInBuffer, qMin(this->bytesToRead, this->buffer.size() - this->bytesInBuffer));
+
+      if (bytesRead == 0)
+      {
+         this->socketTimer.start(); // Wait for the next 'readyRead()'.
+         return;
+      }
+      else if (bytesRead == -1)
+      {
+         L_WARN(QString("Socket : cannot receive data: %1").arg(item.chunkDownloader->getChunk()->toStringLog()));
+         this->closeTheSocket = true;
+         item.status = TRANSFER_ERROR;
+         this->end();
+         return;
+      }
+
+      this->socketTimer.stop();
+
+      this->bytesToRead -= bytesRead;
+      this->bytesInBuffer += bytesRead;
+      this->deltaRead += bytesRead;
+      this->bytesReceived += bytesRead;
+      this->transferRateCalculator.addData(bytesRead);
+
+      if (this->speedTimer.elapsed() > SPEED_UPDATE_PERIOD)
+      {
+         this->peer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+         this->speedTimer.start();
+         this->deltaRead = 0;
+      }
+
+      // The reading continues when both the writing and the delay are finished.
+      if (const int delay = this->bandwidthLimiter.reserve(this->limiterPeer, bytesRead))
+      {
+         this->waitingForBandwidth = true;
+         QTimer::singleShot(delay, this, &ChunkBatch::bandwidthAvailable);
+      }
+
+      // If the buffer is full or there is no more byte to read for the current chunk.
+      if (this->bytesInBuffer == this->buffer.size() || this->bytesToRead == 0)
+      {
+         this->writing = true;
+         this->threadPool.run(this->getWeakRef());
+      }
+
+      if (this->writing || this->waitingForBandwidth)
+         return;
+   }
+}
+
+void ChunkBatch::bandwidthAvailable()
+{
+   if (!this->waitingForBandwidth)
+      return;
+
+   this->waitingForBandwidth = false;
+   this->readBlock();
+}
+
+void ChunkBatch::socketTimeout()
+{
+   L_WARN(QString("Connection dropped, error = %1, bytesAvailable = %2").arg(this->socket->errorString()).arg(this->socket->bytesAvailable()));
+   this->closeTheSocket = true;
+   this->items[this->current].status = TRANSFER_ERROR;
+   this->end();
+}
+
+/**
+  * Go to the next item having some data to receive.
+  * @return 'false' if there is no more data to receive.
+  */
+bool ChunkBatch::nextItem()
+{
+   while (++this->current < this->items.size())
+   {
+      const Item& item = this->items[this->current];
+      if (item.end > item.offset)
+      {
+         this->bytesToRead = item.end - item.offset;
+         return true;
+      }
+   }
+   this->current = this->items.size() - 1;
+   return false;
+}
+
+/**
+  * Called in a thread of the pool, write the buffer to the current chunk.
+  * The data is dropped if the chunk downloader has been stopped.
+  */
+void ChunkBatch::writeBlock()
+{
+   Item& item = this->items[this->current];
+
+   try
+   {
+      if (this->writer.isNull() && item.chunkDownloader->isDownloading())
+         this->writer = item.chunkDownloader->getChunk()->getDataWriter();
+
+      if (!this->writer.isNull())
+         this->writer->write(this->buffer.constData(), this->bytesInBuffer);
+
+      this->bytesInBuffer = 0;
+
+      if (this->bytesToRead == 0)
+         this->writer.clear();
+   }
+   catch (FM::FileResetException)
+   {
+      L_DEBU("FileResetException");
+      this->closeTheSocket = true;
+      item.status = FILE_NON_EXISTENT;
+   }
+   catch (FM::ChunkDataUnknownException)
+   {
+      L_DEBU("ChunkDataUnknownException");
+      this->closeTheSocket = true;
+      item.status = UNABLE_TO_OPEN_THE_FILE;
+   }
+   catch (FM::UnableToOpenFileInWriteModeException)
+   {
+      L_DEBU("UnableToOpenFileInWriteModeException");
+      this->closeTheSocket = true;
+      item.status = UNABLE_TO_OPEN_THE_FILE;
+   }
+   catch (FM::IOErrorException&)
+   {
+      L_DEBU("IOErrorException");
+      this->closeTheSocket = true;
+      item.status = FILE_IO_ERROR;
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      L_DEBU("ChunkDeletedException");
+      this->closeTheSocket = true;
+      item.status = FILE_NON_EXISTENT;
+   }
+   catch (FM::TryToWriteBeyondTheEndOfChunkException&)
+   {
+      L_DEBU("TryToWriteBeyondTheEndOfChunkException");
+      this->closeTheSocket = true;
+      item.status = GOT_TOO_MUCH_DATA;
+   }
+   catch (FM::hashMismatchException)
+   {
+      static const quint32 BLOCK_DURATION = SETTINGS.get<quint32>("block_duration_corrupted_data");
+      L_USER(QString(tr("Corrupted data received for the file \"%1\" from peer %2. Peer blocked for %3 ms")).arg(item.chunkDownloader->getChunk()->getFilePath()).arg(this->peer->getNick()).arg(BLOCK_DURATION));
+      /*: A reason why the user has been blocked */
+      this->peer->block(BLOCK_DURATION, tr("Has sent corrupted data"));
+      this->closeTheSocket = true;
+      item.status = HASH_MISMATCH;
+   }
+}
+
+void ChunkBatch::end()
+{
+   static const int SPEED_UPDATE_PERIOD = 1000; // [ms].
+
+   if (this->ended)
+      return;
+   this->ended = true;
+
+   this->mutex.lock();
+   this->active = false;
+   this->mutex.unlock();
+
+   this->socketTimer.stop();
+   this->waitingForBandwidth = false;
+   this->writer.clear();
+
+   if (this->limiterPeer)
+   {
+      if (this->speedTimer.elapsed() > SPEED_UPDATE_PERIOD / 10)
+         this->peer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+
+      this->bandwidthLimiter.transferFinished(this->limiterPeer);
+      this->limiterPeer = nullptr;
+   }
+
+   bool error = !this->getChunksResult.isNull() && this->getChunksResult->isTimedout();
+   for (QListIterator<Item> i(this->items); i.hasNext() && !error;)
+      error = i.next().status == TRANSFER_ERROR;
+   this->peerConcurrency.downloadFinished(this->peer, this->bytesReceived, error);
+
+   if (!this->socket.isNull())
+   {
+      disconnect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkBatch::readBlock);
+      this->socket.clear();
+   }
+
+   if (!this->getChunksResult.isNull())
+   {
+      this->getChunksResult->setStatus(this->closeTheSocket);
+      this->getChunksResult.clear();
+   }
+
+   for (QListIterator<Item> i(this->items); i.hasNext();)
+   {
+      const Item& item = i.next();
+      item.chunkDownloader->batchFinished(item.status, item.peerToRemove);
+   }
+
+   emit batchFinished(this);
+}
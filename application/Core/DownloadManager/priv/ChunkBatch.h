@@ -0,0 +1,136 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <Protos/core_protocol.pb.h>
+
+#include <Common/SelfWeakPointer.h>
+#include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
+#include <Common/Uncopyable.h>
+#include <Common/IRunnable.h>
+#include <Common/ThreadPool.h>
+#include <Core/FileManager/IDataWriter.h>
+#include <Core/PeerManager/IPeer.h>
+#include <Core/PeerManager/IGetChunksResult.h>
+
+#include <IDownload.h>
+
+#include <priv/OccupiedPeers.h>
+#include <priv/PeerConcurrency.h>
+
+namespace DM
+{
+   class ChunkDownloader;
+
+   class ChunkBatch : public QObject, public Common::SelfWeakPointer<ChunkBatch>, public Common::IRunnable, Common::Uncopyable
+   {
+      Q_OBJECT
+   public:
+      ChunkBatch(
+         const QList<QSharedPointer<ChunkDownloader>>& chunkDownloaders,
+         PM::IPeer* peer,
+         OccupiedPeers& occupiedPeersDownloadingChunk,
+         PeerConcurrency& peerConcurrency,
+         Common::TransferRateCalculator& transferRateCalculator,
+         Common::BandwidthLimiter& bandwidthLimiter,
+         Common::ThreadPool& threadPool
+      );
+
+      bool start();
+      void stop();
+
+      PM::IPeer* getPeer() const;
+
+      void init(QThread* thread);
+      void run();
+      void finished();
+
+   signals:
+      /**
+        * Emitted in the main thread when the batch is terminated (or aborted).
+        * The peer is still occupied, the receiver must free it.
+        */
+      void batchFinished(ChunkBatch* batch);
+
+   private slots:
+      void result(const Protos::Core::GetChunksResult& result);
+      void stream(const QSharedPointer<PM::ISocket>& socket);
+      void getChunkTimeout();
+
+      void readBlock();
+      void bandwidthAvailable();
+      void socketTimeout();
+
+   private:
+      bool nextItem();
+      void writeBlock();
+      void end();
+
+      struct Item
+      {
+         QSharedPointer<ChunkDownloader> chunkDownloader;
+         int offset; // The first byte asked.
+         int end; // Exclusive, announced by the peer. Equal to 'offset' if the peer doesn't send the chunk.
+         Status status;
+         bool peerToRemove;
+      };
+
+      QList<Item> items;
+      PM::IPeer* peer;
+      OccupiedPeers& occupiedPeersDownloadingChunk;
+      PeerConcurrency& peerConcurrency;
+      Common::TransferRateCalculator& transferRateCalculator;
+      Common::BandwidthLimiter& bandwidthLimiter;
+      Common::ThreadPool& threadPool;
+
+      QSharedPointer<PM::ISocket> socket;
+      QSharedPointer<PM::IGetChunksResult> getChunksResult;
+      QElapsedTimer requestTimer; // To measure the round trip time of the 'GetChunks' request.
+      qint64 bytesReceived;
+
+      int current; // The index of the item being received.
+      int bytesToRead; // The remaining data of the current item.
+      QSharedPointer<FM::IDataWriter> writer; // Only used by the thread writing the data.
+      QByteArray buffer; // The data of the current item not yet written, see 'writeBlock()'.
+      int bytesInBuffer;
+
+      Common::BandwidthLimiter::Peer* limiterPeer;
+      QTimer socketTimer; // Started while waiting for data.
+      QElapsedTimer speedTimer;
+      int deltaRead;
+
+      bool active;
+      bool ended;
+      bool writing; // The buffer is being written by a thread of the pool.
+      bool waitingForBandwidth;
+      bool closeTheSocket;
+
+      QMutex mutex; // To protect 'active'.
+   };
+}
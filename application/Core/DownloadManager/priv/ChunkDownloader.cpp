@@ -19,12 +19,13 @@
 #include <priv/ChunkDownloader.h>
 using namespace DM;
 
-#include <QElapsedTimer>
+#include <algorithm>
 
 #include <Common/Settings.h>
 #include <Core/FileManager/Exceptions.h>
 #include <Core/PeerManager/IPeer.h>
 
+#include <priv/Constants.h>
 #include <priv/Log.h>
 
 /**
@@ -32,24 +33,57 @@ using namespace DM;
   *
   * A class to download a file chunk. A ChunkDownloader can exist only if we know its hash.
   * It can be created when a new FileDownload is added for each chunk known in the given entry or when a FileDownload receive a hash.
+  *
+  * When several free peers own the chunk it is split in ranges downloaded at the same time by 'ChunkStripe' objects, one per peer.
+  * When a stripe has finished its range it takes a range not downloaded yet or a part of the range of the slowest stripe.
+  * The downloaded ranges are kept in 'downloadedRanges' and the contiguous data is added to the known bytes of the chunk.
+  * The hash of the chunk is checked when all its data has been downloaded, see 'verifyStripedData()'.
+  *
+  * When only the last chunks of a file remain (the endgame, see 'FileDownload') the chunk is always downloaded by stripes
+  * and a free peer can download the same range as a slow stripe, see 'startARace()'. The first received data is kept
+  * and the chunk is verified as usual when all its data is known.
   */
 
 const int ChunkDownloader::MINIMUM_DELTA_TIME_TO_COMPUTE_SPEED(100); // [ms]
 
-ChunkDownloader::ChunkDownloader(LinkedPeers& linkedPeers, OccupiedPeers& occupiedPeersDownloadingChunk, Common::TransferRateCalculator& transferRateCalculator, Common::ThreadPool& threadPool, Common::Hash chunkHash) :
+ChunkDownloader::ChunkDownloader(LinkedPeers& linkedPeers, OccupiedPeers& occupiedPeersDownloadingChunk, PeerConcurrency& peerConcurrency, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool, Common::Hash chunkHash) :
    linkedPeers(linkedPeers),
    occupiedPeersDownloadingChunk(occupiedPeersDownloadingChunk),
+   peerConcurrency(peerConcurrency),
    transferRateCalculator(transferRateCalculator),
+   bandwidthLimiter(bandwidthLimiter),
    threadPool(threadPool),
    chunkHash(chunkHash),
    socket(0),
+   requestRTT(0),
+   bytesReceived(0),
+   bytesInBuffer(0),
+   bytesToRead(0),
+   limiterPeer(nullptr),
+   deltaRead(0),
+   nextChunkAsked(false),
+   receiving(false),
+   writing(false),
+   waitingForBandwidth(false),
+   switchingPeer(false),
    downloading(false),
+   batched(false),
    closeTheSocket(false),
    lastTransferStatus(QUEUED),
-   mainThread(QThread::currentThread()),
+   striping(false),
+   verifyingStripes(false),
+   lastStripePeer(nullptr),
+   copyingLocalChunk(false),
+   localCopyTried(false),
+   endgame(false),
    mutex(QMutex::Recursive)
 {
    Q_ASSERT(!chunkHash.isNull());
+
+   this->socketTimer.setSingleShot(true);
+   this->socketTimer.setInterval(SETTINGS.get<quint32>("socket_timeout"));
+   connect(&this->socketTimer, &QTimer::timeout, this, &ChunkDownloader::socketTimeout);
+
    L_DEBU(QString("New ChunkDownloader: %1").arg(this->chunkHash.toStr()));
 }
 
@@ -74,9 +108,45 @@ void ChunkDownloader::stop()
       this->downloading = false;
       this->mutex.unlock();
 
-      this->threadPool.wait(this->getWeakRef());
+      // The batch skips the data of this chunk and calls 'batchFinished(..)'.
+      if (this->batched)
+         return;
 
-      this->downloadingEnded();
+      if (this->copyingLocalChunk)
+      {
+         this->threadPool.wait(this->getWeakRef());
+         this->localCopyEnded();
+         return;
+      }
+
+      if (this->striping)
+      {
+         // The last stopped stripe calls 'stripingEnded(..)' or begins the verification of the data.
+         const QList<QSharedPointer<ChunkStripe>> stripesCopy = this->stripes + this->lostStripes;
+         for (QListIterator<QSharedPointer<ChunkStripe>> i(stripesCopy); i.hasNext();)
+            i.next()->stop();
+
+         this->threadPool.wait(this->getWeakRef());
+         if (this->verifyingStripes)
+            this->stripedDataVerified();
+         return;
+      }
+
+      if (this->writing)
+      {
+         this->threadPool.wait(this->getWeakRef());
+         this->writing = false;
+      }
+
+      if (this->receiving)
+      {
+         this->closeTheSocket = true; // The remote uploader must stop sending the rest of the data.
+         this->transferEnded();
+      }
+      else
+      {
+         this->downloadingEnded();
+      }
    }
 }
 
@@ -119,169 +189,42 @@ void ChunkDownloader::rmPeer(PM::IPeer* peer)
    }
 }
 
-void ChunkDownloader::init(QThread* thread)
+void ChunkDownloader::init(QThread*)
 {
-   this->socket->moveToThread(thread);
 }
 
+/**
+  * Called by the thread pool ('Common::ThreadPool') in another thread.
+  */
 void ChunkDownloader::run()
 {
-   int deltaRead = 0;
-   QElapsedTimer timer;
-   timer.start();
-   this->lastTransferStatus = QUEUED;
-
-   try
-   {
-      QSharedPointer<FM::IDataWriter> writer = this->chunk->getDataWriter();
-
-      static const int SOCKET_TIMEOUT = SETTINGS.get<quint32>("socket_timeout");
-      static const int TIME_PERIOD_CHOOSE_ANOTHER_PEER = 1000.0 * SETTINGS.get<double>("time_recheck_chunk_factor") * SETTINGS.get<quint32>("chunk_size") / SETTINGS.get<quint32>("lan_speed");
-
-      static const int BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_writing");
-      char buffer[BUFFER_SIZE];
-
-      const int initialKnownBytes = this->chunk->getKnownBytes();
-      int bytesToRead = this->chunkSize - initialKnownBytes;
-      int bytesToWrite = 0;
-      int bytesWritten = 0;
-
-      forever
-      {
-         this->mutex.lock();
-         if (!this->downloading)
-         {
-            L_DEBU(QString("Downloading aborted, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
-            this->closeTheSocket = true; // Because some garbage from the remote uploader will continue to come in this socket.
-            this->mutex.unlock();
-            break;
-         }
-         this->mutex.unlock();
-
-         int bytesRead = this->socket->read(buffer + bytesToWrite, bytesToRead < BUFFER_SIZE - bytesToWrite ? bytesToRead : BUFFER_SIZE - bytesToWrite);
-         bytesToRead -= bytesRead;
-
-         if (bytesRead == 0)
-         {
-            if (!this->socket->waitForReadyRead(SOCKET_TIMEOUT))
-            {
-               L_WARN(QString("Connection dropped, error = %1, bytesAvailable = %2").arg(socket->errorString()).arg(socket->bytesAvailable()));
-               this->closeTheSocket = true;
-               this->lastTransferStatus = TRANSFER_ERROR;
-               break;
-            }
-            continue;
-         }
-         else if (bytesRead == -1)
-         {
-            L_WARN(QString("Socket : cannot receive data: %1").arg(this->chunk->toStringLog()));
-            this->closeTheSocket = true;
-            this->lastTransferStatus = TRANSFER_ERROR;
-            break;
-         }
-
-         deltaRead += bytesRead;
-         bytesToWrite += bytesRead;
-
-         if (timer.elapsed() > TIME_PERIOD_CHOOSE_ANOTHER_PEER)
-         {
-            this->currentDownloadingPeer->setSpeed(deltaRead / timer.elapsed() * 1000);
-            L_DEBU(QString("Check for a better peer for the chunk: %1, current peer: %2 . . .").arg(this->chunk->toStringLog()).arg(this->currentDownloadingPeer->toStringLog()));
-            timer.start();
-            deltaRead = 0;
-
-            // If a another peer exists and its speed is greater than our by a factor 'switch_to_another_peer_factor'
-            // then we will try to switch to this peer.
-            static const double SWITCH_TO_ANOTHER_PEER_FACTOR = SETTINGS.get<double>("switch_to_another_peer_factor");
-            PM::IPeer* peer = this->getTheFastestFreePeer();
-            if (
-               peer &&
-               peer != this->currentDownloadingPeer &&
-               peer->getSpeed() / SWITCH_TO_ANOTHER_PEER_FACTOR > this->currentDownloadingPeer->getSpeed()
-            )
-            {
-               L_DEBU(QString("Switch to a better peer: %1").arg(peer->toStringLog()));
-
-               // Flush the buffer
-               if (bytesToWrite > 0)
-                  writer->write(buffer, bytesToWrite);
-
-               this->closeTheSocket = true; // We ask to close the socket to avoid to get garbage data.
-               break;
-            }
-         }
-
-         // If the buffer is full or there is no more byte to read.
-         if (bytesToWrite == BUFFER_SIZE || bytesToRead == 0)
-         {
-            writer->write(buffer, bytesToWrite);
-            bytesWritten += bytesToWrite;
-            bytesToWrite = 0;
-         }
-
-         this->transferRateCalculator.addData(bytesRead);
+   if (this->verifyingStripes)
+      this->verifyStripedData();
+   else if (this->copyingLocalChunk)
+      this->copyLocalChunk();
+   else
+      this->writeBlock();
+}
 
-         if (initialKnownBytes + bytesWritten >= this->chunkSize)
-            break;
-      }
-   }
-   catch (FM::FileResetException)
-   {
-      L_DEBU("FileResetException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = FILE_NON_EXISTENT;
-   }
-   catch (FM::ChunkDataUnknownException)
-   {
-      L_DEBU("ChunkDataUnknownException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = UNABLE_TO_OPEN_THE_FILE;
-   }
-   catch (FM::UnableToOpenFileInWriteModeException)
-   {
-      L_DEBU("UnableToOpenFileInWriteModeException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = UNABLE_TO_OPEN_THE_FILE;
-   }
-   catch (FM::IOErrorException&)
-   {
-      L_DEBU("IOErrorException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = FILE_IO_ERROR;
-   }
-   catch (FM::ChunkDeletedException&)
+void ChunkDownloader::finished()
+{
+   if (this->verifyingStripes)
    {
-      L_DEBU("ChunkDeletedException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = FILE_NON_EXISTENT;
+      this->stripedDataVerified();
    }
-   catch (FM::TryToWriteBeyondTheEndOfChunkException&)
+   else if (this->copyingLocalChunk)
    {
-      L_DEBU("TryToWriteBeyondTheEndOfChunkException");
-      this->closeTheSocket = true;
-      this->lastTransferStatus = GOT_TOO_MUCH_DATA;
+      this->localCopyEnded();
    }
-   catch (FM::hashMismatchException)
+   else if (this->writing)
    {
-      static const quint32 BLOCK_DURATION = SETTINGS.get<quint32>("block_duration_corrupted_data");
-      L_USER(QString(tr("Corrupted data received for the file \"%1\" from peer %2. Peer blocked for %3 ms")).arg(this->chunk->getFilePath()).arg(this->currentDownloadingPeer->getNick()).arg(BLOCK_DURATION));
-      /*: A reason why the user has been blocked */
-      this->currentDownloadingPeer->block(BLOCK_DURATION, tr("Has sent corrupted data"));
-      this->closeTheSocket = true;
-      this->lastTransferStatus = HASH_MISMATCH;
-   }
-
-   if (timer.elapsed() > MINIMUM_DELTA_TIME_TO_COMPUTE_SPEED)
-      this->currentDownloadingPeer->setSpeed(deltaRead / timer.elapsed() * 1000);
-
-   this->socket->setReadBufferSize(0);
-   this->socket->moveToThread(this->mainThread);
-}
+      this->writing = false;
 
-void ChunkDownloader::finished()
-{
-   if (this->downloading)
-      this->downloadingEnded();
+      if (this->lastTransferStatus != QUEUED)
+         this->transferEnded();
+      else
+         this->readBlock();
+   }
 }
 
 void ChunkDownloader::setChunk(const QSharedPointer<FM::IChunk>& chunk)
@@ -337,7 +280,7 @@ bool ChunkDownloader::isComplete() const
 
 bool ChunkDownloader::isPartiallyDownloaded() const
 {
-   return !this->chunk.isNull() && !this->chunk->isComplete() && this->chunk->getKnownBytes() > 0;
+   return !this->chunk.isNull() && !this->chunk->isComplete() && (this->chunk->getKnownBytes() > 0 || !this->downloadedRanges.isEmpty());
 }
 
 bool ChunkDownloader::hasAtLeastAPeer()
@@ -370,7 +313,52 @@ int ChunkDownloader::getDownloadedBytes() const
    if (this->chunk.isNull())
       return 0;
 
-   return this->chunk->getKnownBytes();
+   int downloadedBytes = this->chunk->getKnownBytes();
+
+   for (QMapIterator<int, int> i(this->downloadedRanges); i.hasNext();)
+   {
+      i.next();
+      downloadedBytes += i.value() - i.key();
+   }
+
+   // The ranges of two raced stripes overlap.
+   QList<QPair<int, int>> stripeRanges;
+   for (QListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+   {
+      const QSharedPointer<ChunkStripe>& stripe = i.next();
+      stripeRanges << qMakePair(stripe->getStart(), stripe->getOffset());
+   }
+   std::sort(stripeRanges.begin(), stripeRanges.end());
+
+   int position = 0;
+   for (QListIterator<QPair<int, int>> i(stripeRanges); i.hasNext();)
+   {
+      const QPair<int, int>& range = i.next();
+      const int start = qMax(position, range.first);
+      if (range.second > start)
+         downloadedBytes += range.second - start;
+      position = qMax(position, range.second);
+   }
+
+   return qMin(downloadedBytes, this->chunk->getChunkSize());
+}
+
+/**
+  * Return the ranges [start, end[ downloaded by the stripes after the known bytes of the chunk, persisted with the queue.
+  */
+QMap<int, int> ChunkDownloader::getDownloadedRanges() const
+{
+   return this->downloadedRanges;
+}
+
+/**
+  * Add a range saved with the queue, must be called before the download starts.
+  * The data isn't trusted, it will be verified with the hash of the chunk once complete.
+  */
+void ChunkDownloader::restoreDownloadedRange(int start, int end)
+{
+   if (start >= 0 && start < end)
+      this->addDownloadedRange(start, end);
 }
 
 /**
@@ -401,6 +389,43 @@ QList<PM::IPeer*> ChunkDownloader::getPeers()
    return peers;
 }
 
+/**
+  * Called by 'FileDownload' when its remaining data falls below 'endgame_threshold' or when it isn't downloaded anymore.
+  */
+void ChunkDownloader::setEndgame(bool endgame)
+{
+   QMutexLocker locker(&this->mutex);
+   this->endgame = endgame;
+}
+
+/**
+  * Return 'true' if the chunk is being downloaded during the endgame and one of its stripes can be raced by a free peer.
+  */
+bool ChunkDownloader::isRaceable() const
+{
+   return this->isRaceableWith(nullptr);
+}
+
+/**
+  * @param peer If given, the peer mustn't already download a stripe of the chunk.
+  */
+bool ChunkDownloader::isRaceableWith(PM::IPeer* peer) const
+{
+   static const int MAX_PEERS_PER_CHUNK = qMax(1u, SETTINGS.get<quint32>("max_peers_per_chunk"));
+
+   this->mutex.lock();
+   const bool endgame = this->endgame && this->downloading;
+   this->mutex.unlock();
+
+   if (!endgame || !this->striping || this->verifyingStripes || this->stripes.size() >= MAX_PEERS_PER_CHUNK)
+      return false;
+
+   if (peer && this->hasAStripe(peer))
+      return false;
+
+   return !this->getAStripeToRace(peer).isNull();
+}
+
 /**
   * Tell the ChunkDownloader to download the chunk from one of its peer.
   * @return the chosen peer if the downloading has been started else return 0.
@@ -413,6 +438,12 @@ PM::IPeer* ChunkDownloader::startDownloading()
       return nullptr;
    }
 
+   if (this->downloading)
+      return this->startARace();
+
+   if (this->isStripingUseful())
+      return this->startStriping();
+
    this->currentDownloadingPeer = this->getTheFastestFreePeer();
    if (!this->currentDownloadingPeer)
       return nullptr;
@@ -428,9 +459,12 @@ PM::IPeer* ChunkDownloader::startDownloading()
    L_DEBU(QString("Starting downloading a chunk: %1 from %2").arg(this->chunk->toStringLog()).arg(this->currentDownloadingPeer->getID().toStr()));
 
    this->downloading = true;
+   this->bytesReceived = 0;
    emit downloadStarted();
 
    this->occupiedPeersDownloadingChunk.setPeerAsOccupied(this->currentDownloadingPeer);
+   this->peerConcurrency.downloadStarted(this->currentDownloadingPeer);
+   this->requestTimer.start();
 
    connect(this->getChunksResult.data(), &PM::IGetChunksResult::result, this, &ChunkDownloader::result, Qt::DirectConnection);
    connect(this->getChunksResult.data(), &PM::IGetChunksResult::stream, this, &ChunkDownloader::stream, Qt::DirectConnection);
@@ -440,6 +474,77 @@ PM::IPeer* ChunkDownloader::startDownloading()
    return this->currentDownloadingPeer;
 }
 
+/**
+  * Copy the data of an identical chunk owned by a local file in a thread instead of downloading it, see 'FM::IChunk::copyFrom(..)'.
+  * No peer is occupied, 'downloadStarted' and 'downloadFinished' are emitted like for a download.
+  * @return 'false' if the copy has already been tried.
+  */
+bool ChunkDownloader::startLocalCopy(const QSharedPointer<FM::IChunk>& source)
+{
+   if (this->localCopyTried || this->downloading || this->chunk.isNull() || source.isNull())
+      return false;
+
+   this->localCopyTried = true;
+
+   L_DEBU(QString("Copying a chunk from a local file: %1, chunk: %2").arg(source->getFilePath()).arg(this->chunk->toStringLog()));
+
+   this->mutex.lock();
+   this->downloading = true;
+   this->mutex.unlock();
+
+   this->localSource = source;
+   this->copyingLocalChunk = true;
+   emit downloadStarted();
+
+   this->threadPool.run(this->getWeakRef());
+   return true;
+}
+
+/**
+  * The chunk is downloaded by a 'ChunkBatch' along with other chunks from the same peer.
+  * The batch occupies the peer, the chunk downloader only reflects the state of the download.
+  */
+void ChunkDownloader::batchStarted(PM::IPeer* peer)
+{
+   L_DEBU(QString("Starting downloading a chunk in a batch: %1 from %2").arg(this->chunk->toStringLog()).arg(peer->getID().toStr()));
+
+   this->mutex.lock();
+   this->downloading = true;
+   this->mutex.unlock();
+
+   this->batched = true;
+   this->currentDownloadingPeer = peer;
+   this->lastTransferStatus = QUEUED;
+   emit downloadStarted();
+}
+
+/**
+  * Called in the main thread by the batch when the data of the chunk has been received or when the batch is aborted.
+  * @param peerToRemove 'true' if the peer doesn't have the chunk.
+  */
+void ChunkDownloader::batchFinished(Status status, bool peerToRemove)
+{
+   if (!this->batched)
+      return;
+
+   L_DEBU(QString("Downloading ended, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+
+   if (peerToRemove)
+      this->rmPeer(this->currentDownloadingPeer);
+
+   this->lastTransferStatus = status;
+   this->batched = false;
+   this->currentDownloadingPeer = nullptr;
+
+   this->mutex.lock();
+   this->downloading = false;
+   this->mutex.unlock();
+   emit downloadFinished();
+
+   if (this->isComplete())
+      this->peers.clear();
+}
+
 void ChunkDownloader::tryToRemoveItsIncompleteFile()
 {
    if (!this->chunk.isNull())
@@ -449,13 +554,14 @@ void ChunkDownloader::tryToRemoveItsIncompleteFile()
 void ChunkDownloader::reset()
 {
    this->chunk.clear();
+   this->downloadedRanges.clear();
 }
 
 void ChunkDownloader::result(const Protos::Core::GetChunksResult& result)
 {
-   if (result.status() != Protos::Core::GetChunksResult::OK)
+   if (result.status() != Protos::Core::GetChunksResult::OK || (result.results_size() > 0 && result.results(0).status() != Protos::Core::GetChunksResult::ChunkResult::OK))
    {
-      L_WARN(QString("Status error from GetChunkResult: %1. Download aborted.").arg(result.status()));
+      L_WARN(QString("Status error from GetChunkResult: %1 (chunk status: %2). Download aborted.").arg(result.status()).arg(result.results_size() > 0 ? result.results(0).status() : 0));
       if (this->peers.removeOne(this->currentDownloadingPeer))
       {
          this->linkedPeers.rmLink(this->currentDownloadingPeer);
@@ -474,16 +580,34 @@ void ChunkDownloader::result(const Protos::Core::GetChunksResult& result)
       else
       {
          this->chunkSize = result.results(0).chunk_size();
+         this->requestRTT = this->requestTimer.elapsed();
+         this->peerConcurrency.newRTT(this->currentDownloadingPeer, this->requestRTT);
       }
    }
 }
 
 void ChunkDownloader::stream(const QSharedPointer<PM::ISocket>& socket)
 {
+   if (!this->downloading) // Aborted by 'result(..)'.
+      return;
+
    this->socket = socket;
-   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
-   this->socket->setReadBufferSize(SOCKET_BUFFER_SIZE);
-   this->threadPool.run(this->getWeakRef());
+
+   static const int BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_writing");
+
+   this->buffer.resize(BUFFER_SIZE);
+   this->bytesInBuffer = 0;
+   this->bytesToRead = this->chunkSize - this->chunk->getKnownBytes();
+   this->deltaRead = 0;
+   this->nextChunkAsked = false;
+   this->switchingPeer = false;
+   this->lastTransferStatus = QUEUED;
+   this->limiterPeer = this->bandwidthLimiter.transferStarted(this->currentDownloadingPeer->getID());
+   this->speedTimer.start();
+   this->receiving = true;
+
+   connect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkDownloader::readBlock);
+   this->readBlock(); // Some data may already be buffered.
 }
 
 void ChunkDownloader::getChunkTimeout()
@@ -492,58 +616,280 @@ void ChunkDownloader::getChunkTimeout()
    this->downloadingEnded();
 }
 
-void ChunkDownloader::downloadingEnded()
+/**
+  * Read the available data until the buffer is full or the chunk is received, the buffer is then written by the pool.
+  * Called each time the socket has new data, after a writing and after a delay imposed by the bandwidth limiter.
+  */
+void ChunkDownloader::readBlock()
 {
-   L_DEBU(QString("Downloading ended, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+   static const int TIME_PERIOD_CHOOSE_ANOTHER_PEER = 1000.0 * SETTINGS.get<double>("time_recheck_chunk_factor") * SETTINGS.get<quint32>("chunk_size") / SETTINGS.get<quint32>("lan_speed");
 
-   if (!this->socket.isNull())
-      this->socket.clear();
+   if (!this->receiving || this->writing || this->waitingForBandwidth)
+      return;
 
-   this->getChunksResult->setStatus(this->closeTheSocket);
-   this->closeTheSocket = false;
-   this->getChunksResult.clear();
+   forever
+   {
+      this->mutex.lock();
+      if (!this->downloading)
+      {
+         L_DEBU(QString("Downloading aborted, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+         this->closeTheSocket = true; // The remote uploader must stop sending the rest of the data.
+         this->mutex.unlock();
+         this->transferEnded();
+         return;
+      }
+      this->mutex.unlock();
 
-   this->downloading = false;
-   emit downloadFinished();
+      // The buffer is always written when the last byte is received or before switching to another peer.
+      if (this->bytesToRead == 0 || this->switchingPeer)
+      {
+         this->transferEnded();
+         return;
+      }
 
-   // occupiedPeersDownloadingChunk can relaunch the download, so we have to set this->currentDownloadingPeer to 0 before.
-   PM::IPeer* currentPeer = this->currentDownloadingPeer;
-   this->currentDownloadingPeer = 0;
+      const int bytesRead = this->socket->read(this->buffer.data() + this->bytesInBuffer, qMin(this->bytesToRead, this->buffer.size() - this->bytesInBuffer));
 
-   // When a chunk is finished we don't care to know the associated peers.
-   if (this->isComplete())
-      this->peers.clear();
+      if (bytesRead == 0)
+      {
+         this->socketTimer.start(); // Wait for the next 'readyRead()'.
+         return;
+      }
+      else if (bytesRead == -1)
+      {
+         L_WARN(QString("Socket : cannot receive data: %1").arg(this->chunk->toStringLog()));
+         this->closeTheSocket = true;
+         this->lastTransferStatus = TRANSFER_ERROR;
+         this->transferEnded();
+         return;
+      }
 
-   this->occupiedPeersDownloadingChunk.setPeerAsFree(currentPeer);
-}
+      this->socketTimer.stop();
 
-/**
-  * Get the fastest free peer, may remove dead peers.
-  */
-PM::IPeer* ChunkDownloader::getTheFastestFreePeer()
-{
-   QMutexLocker locker(&this->mutex);
+      this->bytesToRead -= bytesRead;
+      this->bytesInBuffer += bytesRead;
+      this->deltaRead += bytesRead;
+      this->transferRateCalculator.addData(bytesRead);
+      this->bytesReceived += bytesRead;
 
-   PM::IPeer* current = nullptr;
-   bool isTheNumberOfPeersHasChanged = false;
-   for (QMutableListIterator<PM::IPeer*> i(this->peers); i.hasNext();)
-   {
-      PM::IPeer* peer = i.next();
-      if (!peer->isAvailable())
+      if (this->speedTimer.elapsed() > TIME_PERIOD_CHOOSE_ANOTHER_PEER)
       {
-         i.remove();
-         this->linkedPeers.rmLink(peer);
-         isTheNumberOfPeersHasChanged = true;
+         this->currentDownloadingPeer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+         L_DEBU(QString("Check for a better peer for the chunk: %1, current peer: %2 . . .").arg(this->chunk->toStringLog()).arg(this->currentDownloadingPeer->toStringLog()));
+         this->speedTimer.start();
+         this->deltaRead = 0;
+
+         // If a another peer exists and its speed is greater than our by a factor 'switch_to_another_peer_factor'
+         // then we will try to switch to this peer.
+         // During the endgame any other free peer is taken: the chunk will be downloaded again with stripes which can be raced.
+         static const double SWITCH_TO_ANOTHER_PEER_FACTOR = SETTINGS.get<double>("switch_to_another_peer_factor");
+         PM::IPeer* peer = this->getTheFastestFreePeer();
+         this->mutex.lock();
+         const bool endgame = this->endgame;
+         this->mutex.unlock();
+         if (
+            peer &&
+            peer != this->currentDownloadingPeer &&
+            (endgame || peer->getExpectedSpeed() / SWITCH_TO_ANOTHER_PEER_FACTOR > this->currentDownloadingPeer->getExpectedSpeed())
+         )
+         {
+            L_DEBU(QString("Switch to a better peer: %1").arg(peer->toStringLog()));
+            this->closeTheSocket = true; // The stream is reset, the remaining data isn't sent.
+            this->switchingPeer = true;
+
+            // Flush the buffer.
+            this->writing = true;
+            this->threadPool.run(this->getWeakRef());
+            return;
+         }
       }
-      else if (this->occupiedPeersDownloadingChunk.isPeerFree(peer) && (!current || peer->getSpeed() > current->getSpeed()))
-         current = peer;
-   }
 
-   if (isTheNumberOfPeersHasChanged)
-      emit numberOfPeersChanged();
+      // The reading continues when both the writing and the delay are finished.
+      if (const int delay = this->bandwidthLimiter.reserve(this->limiterPeer, bytesRead))
+      {
+         this->waitingForBandwidth = true;
+         QTimer::singleShot(delay, this, &ChunkDownloader::bandwidthAvailable);
+      }
 
-   return current;
-}
+      // The next chunk is asked when the remaining data will be received in less than two round trips,
+      // thus the peer doesn't wait for our next request.
+      if (!this->nextChunkAsked && this->bytesReceived > 0 && this->requestTimer.elapsed() > 0)
+      {
+         const qint64 remainingTime = static_cast<qint64>(this->bytesToRead) * this->requestTimer.elapsed() / this->bytesReceived; // [ms].
+         if (remainingTime < qMax(PIPELINE_RTT_FACTOR * this->requestRTT, PIPELINE_MIN_TIME))
+         {
+            this->nextChunkAsked = true;
+            QMetaObject::invokeMethod(this, &ChunkDownloader::askTheNextChunk, Qt::QueuedConnection);
+         }
+      }
+
+      // If the buffer is full or there is no more byte to read.
+      if (this->bytesInBuffer == this->buffer.size() || this->bytesToRead == 0)
+      {
+         this->writing = true;
+         this->threadPool.run(this->getWeakRef());
+      }
+
+      if (this->writing || this->waitingForBandwidth)
+         return;
+   }
+}
+
+void ChunkDownloader::bandwidthAvailable()
+{
+   if (!this->waitingForBandwidth)
+      return;
+
+   this->waitingForBandwidth = false;
+   this->readBlock();
+}
+
+void ChunkDownloader::socketTimeout()
+{
+   L_WARN(QString("Connection dropped, error = %1, bytesAvailable = %2").arg(this->socket->errorString()).arg(this->socket->bytesAvailable()));
+   this->closeTheSocket = true;
+   this->lastTransferStatus = TRANSFER_ERROR;
+   this->transferEnded();
+}
+
+/**
+  * Called in a thread of the pool, write the buffer to the chunk.
+  */
+void ChunkDownloader::writeBlock()
+{
+   try
+   {
+      if (this->writer.isNull())
+         this->writer = this->chunk->getDataWriter();
+
+      if (this->bytesInBuffer > 0)
+         this->writer->write(this->buffer.constData(), this->bytesInBuffer);
+      this->bytesInBuffer = 0;
+   }
+   catch (FM::FileResetException)
+   {
+      L_DEBU("FileResetException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = FILE_NON_EXISTENT;
+   }
+   catch (FM::ChunkDataUnknownException)
+   {
+      L_DEBU("ChunkDataUnknownException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = UNABLE_TO_OPEN_THE_FILE;
+   }
+   catch (FM::UnableToOpenFileInWriteModeException)
+   {
+      L_DEBU("UnableToOpenFileInWriteModeException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = UNABLE_TO_OPEN_THE_FILE;
+   }
+   catch (FM::IOErrorException&)
+   {
+      L_DEBU("IOErrorException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = FILE_IO_ERROR;
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      L_DEBU("ChunkDeletedException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = FILE_NON_EXISTENT;
+   }
+   catch (FM::TryToWriteBeyondTheEndOfChunkException&)
+   {
+      L_DEBU("TryToWriteBeyondTheEndOfChunkException");
+      this->closeTheSocket = true;
+      this->lastTransferStatus = GOT_TOO_MUCH_DATA;
+   }
+   catch (FM::hashMismatchException)
+   {
+      static const quint32 BLOCK_DURATION = SETTINGS.get<quint32>("block_duration_corrupted_data");
+      L_USER(QString(tr("Corrupted data received for the file \"%1\" from peer %2. Peer blocked for %3 ms")).arg(this->chunk->getFilePath()).arg(this->currentDownloadingPeer->getNick()).arg(BLOCK_DURATION));
+      /*: A reason why the user has been blocked */
+      this->currentDownloadingPeer->block(BLOCK_DURATION, tr("Has sent corrupted data"));
+      this->closeTheSocket = true;
+      this->lastTransferStatus = HASH_MISMATCH;
+   }
+}
+
+/**
+  * Called in the main thread when the data isn't received anymore, no block is being written.
+  */
+void ChunkDownloader::transferEnded()
+{
+   if (!this->receiving)
+      return;
+   this->receiving = false;
+
+   this->socketTimer.stop();
+   this->waitingForBandwidth = false;
+   this->writer.clear();
+
+   if (this->speedTimer.elapsed() > MINIMUM_DELTA_TIME_TO_COMPUTE_SPEED)
+      this->currentDownloadingPeer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+
+   this->bandwidthLimiter.transferFinished(this->limiterPeer);
+   this->limiterPeer = nullptr;
+
+   disconnect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkDownloader::readBlock);
+
+   this->downloadingEnded();
+}
+
+void ChunkDownloader::downloadingEnded()
+{
+   L_DEBU(QString("Downloading ended, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+
+   this->peerConcurrency.downloadFinished(this->currentDownloadingPeer, this->bytesReceived, this->lastTransferStatus == TRANSFER_ERROR || this->getChunksResult->isTimedout());
+
+   if (!this->socket.isNull())
+      this->socket.clear();
+
+   this->getChunksResult->setStatus(this->closeTheSocket);
+   this->closeTheSocket = false;
+   this->getChunksResult.clear();
+
+   this->downloading = false;
+   emit downloadFinished();
+
+   // occupiedPeersDownloadingChunk can relaunch the download, so we have to set this->currentDownloadingPeer to 0 before.
+   PM::IPeer* currentPeer = this->currentDownloadingPeer;
+   this->currentDownloadingPeer = 0;
+
+   // When a chunk is finished we don't care to know the associated peers.
+   if (this->isComplete())
+      this->peers.clear();
+
+   this->occupiedPeersDownloadingChunk.setPeerAsFree(currentPeer);
+}
+
+/**
+  * Get the fastest free peer, may remove dead peers.
+  */
+PM::IPeer* ChunkDownloader::getTheFastestFreePeer()
+{
+   QMutexLocker locker(&this->mutex);
+
+   PM::IPeer* current = nullptr;
+   bool isTheNumberOfPeersHasChanged = false;
+   for (QMutableListIterator<PM::IPeer*> i(this->peers); i.hasNext();)
+   {
+      PM::IPeer* peer = i.next();
+      if (!peer->isAvailable())
+      {
+         i.remove();
+         this->linkedPeers.rmLink(peer);
+         isTheNumberOfPeersHasChanged = true;
+      }
+      else if (this->occupiedPeersDownloadingChunk.isPeerFree(peer) && (!current || peer->getExpectedSpeed() > current->getExpectedSpeed()))
+         current = peer;
+   }
+
+   if (isTheNumberOfPeersHasChanged)
+      emit numberOfPeersChanged();
+
+   return current;
+}
 
 int ChunkDownloader::getNumberOfFreePeer()
 {
@@ -569,3 +915,600 @@ int ChunkDownloader::getNumberOfFreePeer()
 
    return n;
 }
+
+/**
+  * Get the free peers sorted by speed, the fastest first. May remove dead peers.
+  */
+QList<PM::IPeer*> ChunkDownloader::getTheFreePeers()
+{
+   QMutexLocker locker(&this->mutex);
+
+   QList<PM::IPeer*> freePeers;
+   bool isTheNumberOfPeersHasChanged = false;
+   for (QMutableListIterator<PM::IPeer*> i(this->peers); i.hasNext();)
+   {
+      PM::IPeer* peer = i.next();
+      if (!peer->isAvailable())
+      {
+         i.remove();
+         this->linkedPeers.rmLink(peer);
+         isTheNumberOfPeersHasChanged = true;
+      }
+      else if (this->occupiedPeersDownloadingChunk.isPeerFree(peer))
+         freePeers << peer;
+   }
+
+   if (isTheNumberOfPeersHasChanged)
+      emit numberOfPeersChanged();
+
+   std::sort(freePeers.begin(), freePeers.end(), [](PM::IPeer* p1, PM::IPeer* p2) { return p1->getExpectedSpeed() > p2->getExpectedSpeed(); });
+   return freePeers;
+}
+
+/**
+  * The striping is used when at least two free peers own the chunk and there is enough data to download,
+  * when the chunk has already been partially downloaded by stripes or during the endgame.
+  */
+bool ChunkDownloader::isStripingUseful()
+{
+   if (!this->downloadedRanges.isEmpty())
+      return true;
+
+   static const int MAX_PEERS_PER_CHUNK = SETTINGS.get<quint32>("max_peers_per_chunk");
+   static const int MIN_STRIPE_SIZE = qMax(1u, SETTINGS.get<quint32>("min_stripe_size"));
+
+   // The stripes can be raced, not the download from a single peer.
+   this->mutex.lock();
+   const bool endgame = this->endgame;
+   this->mutex.unlock();
+   if (endgame)
+      return MAX_PEERS_PER_CHUNK > 1;
+
+   return MAX_PEERS_PER_CHUNK > 1 && this->getNbBytesToDownload() >= 2 * MIN_STRIPE_SIZE && this->getNumberOfFreePeer() > 1;
+}
+
+/**
+  * Split the data to download in ranges, one per free peer.
+  * @return One of the chosen peers or 0 if the downloading can't be started.
+  */
+PM::IPeer* ChunkDownloader::startStriping()
+{
+   static const int MAX_PEERS_PER_CHUNK = qMax(1u, SETTINGS.get<quint32>("max_peers_per_chunk"));
+   static const int MIN_STRIPE_SIZE = qMax(1u, SETTINGS.get<quint32>("min_stripe_size"));
+
+   const QList<PM::IPeer*> freePeers = this->getTheFreePeers();
+
+   // The ranges restored with the queue may cover all the data, it only has to be verified.
+   if (!this->downloadedRanges.isEmpty() && this->updateKnownBytesFromRanges())
+   {
+      if (freePeers.isEmpty())
+         return nullptr;
+
+      this->striping = true;
+      this->downloading = true;
+      this->verifyingStripes = true;
+      this->lastStripePeer = freePeers.first();
+      this->occupiedPeersDownloadingChunk.setPeerAsOccupied(this->lastStripePeer);
+      this->threadPool.run(this->getWeakRef());
+
+      emit downloadStarted();
+      return this->lastStripePeer;
+   }
+
+   const int nbBytesToDownload = this->getNbBytesToDownload();
+   const int nbStripes = qMin(qMin(freePeers.size(), MAX_PEERS_PER_CHUNK), qMax(1, nbBytesToDownload / MIN_STRIPE_SIZE));
+   if (nbStripes == 0)
+      return nullptr;
+
+   const int stripeSize = (nbBytesToDownload + nbStripes - 1) / nbStripes;
+
+   this->striping = true;
+   this->downloading = true;
+
+   for (int i = 0; i < nbStripes; i++)
+      this->startAStripe(freePeers[i], stripeSize);
+
+   if (this->stripes.isEmpty())
+   {
+      this->striping = false;
+      this->downloading = false;
+      return nullptr;
+   }
+
+   L_DEBU(QString("Starting downloading a chunk from %1 peers: %2").arg(this->stripes.size()).arg(this->chunk->toStringLog()));
+
+   emit downloadStarted();
+   return this->stripes.first()->getPeer();
+}
+
+/**
+  * Download the first range not downloaded and not being downloaded from the given peer.
+  * @return 'false' if there is no such range or if the peer can't be asked.
+  */
+bool ChunkDownloader::startAStripe(PM::IPeer* peer, int maxSize)
+{
+   const QPair<int, int> range = this->getAFreeRange(maxSize);
+   if (range.first >= range.second)
+      return false;
+
+   return this->startAStripe(peer, range.first, range.second, QSharedPointer<ChunkStripe::Race>());
+}
+
+/**
+  * Download the range [start, end[ from the given peer.
+  * @param race If not null, the range is also downloaded by another stripe.
+  */
+bool ChunkDownloader::startAStripe(PM::IPeer* peer, int start, int end, const QSharedPointer<ChunkStripe::Race>& race)
+{
+   QSharedPointer<ChunkStripe> stripe = (new ChunkStripe(this->chunk, peer, start, end, this->transferRateCalculator, this->bandwidthLimiter, this->threadPool))->grabStrongRef();
+   connect(stripe.data(), &ChunkStripe::stripeFinished, this, &ChunkDownloader::stripeFinished, Qt::DirectConnection);
+
+   if (!race.isNull())
+      stripe->joinARace(race);
+
+   if (!stripe->start())
+      return false;
+
+   this->stripes << stripe;
+   this->occupiedPeersDownloadingChunk.setPeerAsOccupied(peer);
+
+   if (this->endgame)
+      emit stripesChanged();
+
+   return true;
+}
+
+/**
+  * Take the end of the range of the stripe which will finish last and give it to the given peer.
+  * The remaining data of the stripe is split in proportion of the speed of the two peers.
+  * @return 'false' if all the remaining ranges are too small to be split.
+  */
+bool ChunkDownloader::stealARange(PM::IPeer* peer)
+{
+   static const int MIN_STRIPE_SIZE = qMax(1u, SETTINGS.get<quint32>("min_stripe_size"));
+
+   QSharedPointer<ChunkStripe> slowestStripe;
+   double slowestRemainingTime = 0.0;
+   for (QListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+   {
+      const QSharedPointer<ChunkStripe>& stripe = i.next();
+      const int remainingBytes = stripe->getRemainingBytes();
+      if (remainingBytes < 2 * MIN_STRIPE_SIZE || !stripe->getRace().isNull())
+         continue;
+
+      const double remainingTime = static_cast<double>(remainingBytes) / qMax(1u, stripe->getPeer()->getSpeed());
+      if (remainingTime > slowestRemainingTime)
+      {
+         slowestStripe = stripe;
+         slowestRemainingTime = remainingTime;
+      }
+   }
+
+   if (slowestStripe.isNull())
+      return false;
+
+   const qint64 slowestSpeed = qMax(1u, slowestStripe->getPeer()->getSpeed());
+   const qint64 speed = qMax(1u, peer->getSpeed());
+   const int offset = slowestStripe->getOffset();
+   const int end = slowestStripe->getEnd();
+   const int newEnd = qBound(offset + MIN_STRIPE_SIZE / 2, static_cast<int>(offset + (end - offset) * slowestSpeed / (slowestSpeed + speed)), end - MIN_STRIPE_SIZE);
+
+   if (!slowestStripe->shrink(newEnd))
+      return false;
+
+   L_DEBU(QString("Range [%1, %2[ of the chunk %3 given from %4 to %5").arg(newEnd).arg(end).arg(this->chunk->toStringLog()).arg(slowestStripe->getPeer()->toStringLog()).arg(peer->toStringLog()));
+
+   return this->startAStripe(peer, end - newEnd);
+}
+
+/**
+  * Download the remaining range of the stripe which will finish last from a free peer not already downloading this chunk.
+  * The two stripes write the data they receive first, see 'ChunkStripe'.
+  * @return The chosen peer or 0 if no race can be started.
+  */
+PM::IPeer* ChunkDownloader::startARace()
+{
+   const QList<PM::IPeer*> freePeers = this->getTheFreePeers();
+   for (QListIterator<PM::IPeer*> i(freePeers); i.hasNext();)
+   {
+      PM::IPeer* peer = i.next();
+      if (!this->isRaceableWith(peer))
+         continue;
+
+      QSharedPointer<ChunkStripe> slowestStripe = this->getAStripeToRace(peer);
+      QSharedPointer<ChunkStripe::Race> race = slowestStripe->startARace();
+      if (race.isNull())
+         continue;
+
+      race->mutex.lock();
+      const int start = race->frontier;
+      race->mutex.unlock();
+
+      L_DEBU(QString("Endgame: range [%1, %2[ of the chunk %3 raced between %4 and %5").arg(start).arg(slowestStripe->getEnd()).arg(this->chunk->toStringLog()).arg(slowestStripe->getPeer()->toStringLog()).arg(peer->toStringLog()));
+
+      if (this->startAStripe(peer, start, slowestStripe->getEnd(), race))
+         return peer;
+   }
+
+   return nullptr;
+}
+
+/**
+  * Return the not raced stripe which will finish last, the stripes of 'peer' are ignored.
+  */
+QSharedPointer<ChunkStripe> ChunkDownloader::getAStripeToRace(PM::IPeer* peer) const
+{
+   QSharedPointer<ChunkStripe> slowestStripe;
+   double slowestRemainingTime = -1.0;
+   for (QListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+   {
+      const QSharedPointer<ChunkStripe>& stripe = i.next();
+      const int remainingBytes = stripe->getRemainingBytes();
+      if (remainingBytes == 0 || stripe->getPeer() == peer || !stripe->getRace().isNull())
+         continue;
+
+      const double remainingTime = static_cast<double>(remainingBytes) / qMax(1u, stripe->getPeer()->getSpeed());
+      if (remainingTime > slowestRemainingTime)
+      {
+         slowestStripe = stripe;
+         slowestRemainingTime = remainingTime;
+      }
+   }
+   return slowestStripe;
+}
+
+bool ChunkDownloader::hasAStripe(PM::IPeer* peer) const
+{
+   for (QListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+      if (i.next()->getPeer() == peer)
+         return true;
+   return false;
+}
+
+/**
+  * The range of 'winner' has been entirely written, the other stripes of its race don't have to be waited:
+  * they are kept in 'lostStripes' until they end. The data before the race has been written by the losers themselves
+  * thus their whole range is known.
+  */
+void ChunkDownloader::dropTheLosers(ChunkStripe* winner)
+{
+   const QSharedPointer<ChunkStripe::Race> race = winner->getRace();
+   if (race.isNull())
+      return;
+
+   for (QMutableListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+   {
+      const QSharedPointer<ChunkStripe>& stripe = i.next();
+      if (stripe->getRace() == race && stripe->isRaceLost())
+      {
+         L_DEBU(QString("Endgame: %1 lost the race for the chunk %2").arg(stripe->getPeer()->toStringLog()).arg(this->chunk->toStringLog()));
+         this->addDownloadedRange(stripe->getStart(), stripe->getEnd());
+         this->lostStripes << stripe;
+         i.remove();
+      }
+   }
+}
+
+/**
+  * Return the first range [start, end[ of at most 'maxSize' bytes which isn't known, downloaded or assigned to a stripe.
+  * Return an empty range if there is none.
+  */
+QPair<int, int> ChunkDownloader::getAFreeRange(int maxSize) const
+{
+   QList<QPair<int, int>> usedRanges;
+   for (QMapIterator<int, int> i(this->downloadedRanges); i.hasNext();)
+   {
+      i.next();
+      usedRanges << qMakePair(i.key(), i.value());
+   }
+   for (QListIterator<QSharedPointer<ChunkStripe>> i(this->stripes); i.hasNext();)
+   {
+      const QSharedPointer<ChunkStripe>& stripe = i.next();
+      usedRanges << qMakePair(stripe->getStart(), stripe->getEnd());
+   }
+   std::sort(usedRanges.begin(), usedRanges.end());
+
+   int position = this->chunk->getKnownBytes();
+   for (QListIterator<QPair<int, int>> i(usedRanges); i.hasNext();)
+   {
+      const QPair<int, int>& range = i.next();
+      if (range.first > position)
+         return qMakePair(position, qMin(range.first, position + maxSize));
+      position = qMax(position, range.second);
+   }
+
+   return qMakePair(position, qMin(this->chunk->getChunkSize(), position + maxSize));
+}
+
+/**
+  * Add a range to 'downloadedRanges', the overlapping and adjacent ranges are merged.
+  */
+void ChunkDownloader::addDownloadedRange(int start, int end)
+{
+   auto i = this->downloadedRanges.lowerBound(start);
+   if (i != this->downloadedRanges.begin())
+   {
+      auto previous = i - 1;
+      if (previous.value() >= start)
+      {
+         start = previous.key();
+         end = qMax(end, previous.value());
+         i = this->downloadedRanges.erase(previous);
+      }
+   }
+
+   while (i != this->downloadedRanges.end() && i.key() <= end)
+   {
+      end = qMax(end, i.value());
+      i = this->downloadedRanges.erase(i);
+   }
+
+   this->downloadedRanges.insert(start, end);
+}
+
+/**
+  * Return the number of bytes neither known nor downloaded by a stripe.
+  */
+int ChunkDownloader::getNbBytesToDownload() const
+{
+   int nbBytes = this->chunk->getChunkSize() - this->chunk->getKnownBytes();
+   for (QMapIterator<int, int> i(this->downloadedRanges); i.hasNext();)
+   {
+      i.next();
+      nbBytes -= i.value() - i.key();
+   }
+   return nbBytes;
+}
+
+/**
+  * Add the downloaded ranges which follow the known bytes to the known bytes of the chunk.
+  * When all the data has been downloaded the last range is kept, it will be checked by 'verifyStripedData()'.
+  * @return 'true' if all the data has been downloaded.
+  */
+bool ChunkDownloader::updateKnownBytesFromRanges()
+{
+   const int initialKnownBytes = this->chunk->getKnownBytes();
+   int knownBytes = initialKnownBytes;
+
+   auto i = this->downloadedRanges.begin();
+   while (i != this->downloadedRanges.end() && i.key() <= knownBytes)
+   {
+      knownBytes = qMax(knownBytes, i.value());
+      i = this->downloadedRanges.erase(i);
+   }
+
+   if (knownBytes >= this->chunk->getChunkSize())
+   {
+      this->downloadedRanges.insert(initialKnownBytes, knownBytes);
+      return true;
+   }
+
+   try
+   {
+      this->chunk->setContiguousKnownBytes(knownBytes);
+   }
+   catch (FM::IOErrorException&)
+   {
+      this->lastTransferStatus = FILE_IO_ERROR;
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      this->lastTransferStatus = FILE_NON_EXISTENT;
+   }
+
+   return false;
+}
+
+/**
+  * Called in a thread of the pool when all the data has been downloaded by the stripes.
+  */
+void ChunkDownloader::verifyStripedData()
+{
+   try
+   {
+      this->chunk->setContiguousKnownBytes(this->chunk->getChunkSize());
+   }
+   catch (FM::hashMismatchException)
+   {
+      this->lastTransferStatus = HASH_MISMATCH;
+   }
+   catch (FM::IOErrorException&)
+   {
+      this->lastTransferStatus = FILE_IO_ERROR;
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      this->lastTransferStatus = FILE_NON_EXISTENT;
+   }
+}
+
+void ChunkDownloader::stripedDataVerified()
+{
+   this->verifyingStripes = false;
+
+   // We can't know which peer has sent the corrupted data, thus no one is blocked.
+   if (this->lastTransferStatus == HASH_MISMATCH)
+      L_USER(QString(tr("Corrupted data received for the file \"%1\", the chunk will be downloaded again")).arg(this->chunk->getFilePath()));
+
+   this->downloadedRanges.clear();
+   emit downloadedRangesChanged();
+   this->stripingEnded(this->lastStripePeer);
+}
+
+/**
+  * Called in the main thread when a stripe is terminated. The peer of the stripe is given a new range if there is one.
+  */
+void ChunkDownloader::stripeFinished(ChunkStripe* stripe)
+{
+   QSharedPointer<ChunkStripe> stripeRef; // The stripe must live until the end of this method.
+   for (int i = 0; i < this->stripes.size(); i++)
+      if (this->stripes[i].data() == stripe)
+      {
+         stripeRef = this->stripes.takeAt(i);
+         break;
+      }
+
+   PM::IPeer* peer = stripe->getPeer();
+
+   if (stripeRef.isNull())
+   {
+      // A stripe which has lost a race, its range has already been added by 'dropTheLosers(..)'.
+      for (int i = 0; i < this->lostStripes.size(); i++)
+         if (this->lostStripes[i].data() == stripe)
+         {
+            stripeRef = this->lostStripes.takeAt(i);
+            this->occupiedPeersDownloadingChunk.setPeerAsFree(peer);
+            break;
+         }
+      return;
+   }
+
+   if (stripe->isPeerToRemove())
+   {
+      this->mutex.lock();
+      const bool removed = this->peers.removeOne(peer);
+      this->mutex.unlock();
+
+      if (removed)
+      {
+         this->linkedPeers.rmLink(peer);
+         emit numberOfPeersChanged();
+      }
+   }
+
+   if (stripe->getStatus() == FILE_NON_EXISTENT) // The file has been reset.
+      this->downloadedRanges.clear();
+   else if (stripe->getOffset() > stripe->getStart())
+      this->addDownloadedRange(stripe->getStart(), qMin(stripe->getOffset(), this->chunk->getChunkSize()));
+
+   if (stripe->getStatus() != QUEUED)
+      this->lastTransferStatus = stripe->getStatus();
+   else if (stripe->getOffset() >= stripe->getEnd())
+      this->dropTheLosers(stripe);
+
+   if (this->endgame)
+      emit stripesChanged();
+
+   const bool allDataDownloaded = this->updateKnownBytesFromRanges();
+   emit downloadedRangesChanged();
+
+   if (this->downloading && !allDataDownloaded && stripe->getStatus() == QUEUED)
+   {
+      if (this->startAStripe(peer, this->chunk->getChunkSize()) || this->stealARange(peer))
+         return;
+   }
+
+   if (!this->stripes.isEmpty())
+   {
+      this->occupiedPeersDownloadingChunk.setPeerAsFree(peer);
+   }
+   else if (allDataDownloaded)
+   {
+      this->lastStripePeer = peer;
+      this->verifyingStripes = true;
+      this->threadPool.run(this->getWeakRef());
+   }
+   else
+   {
+      this->stripingEnded(peer);
+   }
+}
+
+/**
+  * Called when the last stripe is terminated, see 'downloadingEnded()'.
+  */
+void ChunkDownloader::stripingEnded(PM::IPeer* lastPeer)
+{
+   L_DEBU(QString("Downloading ended, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+
+   this->striping = false;
+   this->downloading = false;
+   emit downloadFinished();
+
+   // When a chunk is finished we don't care to know the associated peers.
+   if (this->isComplete())
+      this->peers.clear();
+
+   this->occupiedPeersDownloadingChunk.setPeerAsFree(lastPeer);
+}
+
+/**
+  * Called in a thread, see 'startLocalCopy(..)'. If the copy fails the chunk will be downloaded.
+  */
+void ChunkDownloader::copyLocalChunk()
+{
+   try
+   {
+      if (!this->chunk->copyFrom(this->localSource))
+         L_DEBU(QString("The local chunk can't be copied: %1").arg(this->localSource->getFilePath()));
+   }
+   catch (FM::UnableToOpenFileInReadModeException&)
+   {
+      L_DEBU("UnableToOpenFileInReadModeException");
+   }
+   catch (FM::FileResetException)
+   {
+      L_DEBU("FileResetException");
+   }
+   catch (FM::UnableToOpenFileInWriteModeException)
+   {
+      L_DEBU("UnableToOpenFileInWriteModeException");
+   }
+   catch (FM::IOErrorException&)
+   {
+      L_DEBU("IOErrorException");
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      L_DEBU("ChunkDeletedException");
+   }
+   catch (FM::ChunkDataUnknownException)
+   {
+      L_DEBU("ChunkDataUnknownException");
+   }
+   catch (FM::hashMismatchException)
+   {
+      L_WARN(QString("The local chunk doesn't match its hash: %1").arg(this->localSource->getFilePath()));
+   }
+}
+
+void ChunkDownloader::localCopyEnded()
+{
+   if (!this->copyingLocalChunk)
+      return;
+
+   L_DEBU(QString("Local copy ended, chunk: %1%2").arg(this->chunk->toStringLog()).arg(this->chunk->isComplete() ? "" : " Not complete!"));
+
+   this->copyingLocalChunk = false;
+   this->localSource.clear();
+
+   this->mutex.lock();
+   this->downloading = false;
+   this->mutex.unlock();
+   emit downloadFinished();
+
+   if (this->isComplete())
+   {
+      this->peers.clear();
+   }
+   else
+   {
+      // The peers weren't occupied, they may have nothing else to download.
+      const QList<PM::IPeer*> peers = this->getPeers();
+      for (QListIterator<PM::IPeer*> i(peers); i.hasNext();)
+         this->occupiedPeersDownloadingChunk.newPeer(i.next());
+   }
+}
+
+/**
+  * Called in the main thread when the current download is about to end. The peer is allowed to start
+  * one more download to avoid an idle time between the end of this download and the beginning of the next one.
+  */
+void ChunkDownloader::askTheNextChunk()
+{
+   if (!this->downloading || this->striping || !this->currentDownloadingPeer)
+      return;
+
+   this->peerConcurrency.addPipelineCredit(this->currentDownloadingPeer);
+   this->occupiedPeersDownloadingChunk.newPeer(this->currentDownloadingPeer);
+}
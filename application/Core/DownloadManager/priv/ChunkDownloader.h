@@ -20,13 +20,18 @@
 
 #include <QSharedPointer>
 #include <QList>
+#include <QMap>
+#include <QPair>
 #include <QThread>
+#include <QTimer>
+#include <QByteArray>
 #include <QElapsedTimer>
 
 #include <Protos/core_protocol.pb.h>
 
 #include <Common/SelfWeakPointer.h>
 #include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
 #include <Common/Hash.h>
 #include <Common/Uncopyable.h>
 #include <Common/IRunnable.h>
@@ -41,6 +46,8 @@
 
 #include <priv/OccupiedPeers.h>
 #include <priv/LinkedPeers.h>
+#include <priv/ChunkStripe.h>
+#include <priv/PeerConcurrency.h>
 
 namespace PM { class IPeer; }
 
@@ -52,7 +59,7 @@ namespace DM
 
       Q_OBJECT
    public:
-      ChunkDownloader(LinkedPeers& linkedPeers, OccupiedPeers& occupiedPeersDownloadingChunk, Common::TransferRateCalculator& transferRateCalculator, Common::ThreadPool& threadPool, Common::Hash chunkHash);
+      ChunkDownloader(LinkedPeers& linkedPeers, OccupiedPeers& occupiedPeersDownloadingChunk, PeerConcurrency& peerConcurrency, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool, Common::Hash chunkHash);
       ~ChunkDownloader();
 
       void stop();
@@ -80,9 +87,18 @@ namespace DM
       void resetLastTransferStatus();
 
       int getDownloadedBytes() const;
+      QMap<int, int> getDownloadedRanges() const;
+      void restoreDownloadedRange(int start, int end);
       QList<PM::IPeer*> getPeers();
 
+      void setEndgame(bool endgame);
+      bool isRaceable() const;
+      bool isRaceableWith(PM::IPeer* peer) const;
+
       PM::IPeer* startDownloading();
+      bool startLocalCopy(const QSharedPointer<FM::IChunk>& source);
+      void batchStarted(PM::IPeer* peer);
+      void batchFinished(Status status, bool peerToRemove);
       void tryToRemoveItsIncompleteFile();
       void reset();
 
@@ -94,20 +110,62 @@ namespace DM
       void downloadFinished();
       void numberOfPeersChanged();
 
+      /**
+        * Emitted during the endgame when a stripe starts or ends, see 'isRaceable()'.
+        */
+      void stripesChanged();
+
+      /**
+        * Emitted when the ranges downloaded by the stripes change, see 'getDownloadedRanges()'.
+        */
+      void downloadedRangesChanged();
+
    private slots:
       void result(const Protos::Core::GetChunksResult& result);
       void stream(const QSharedPointer<PM::ISocket>& socket);
       void getChunkTimeout();
 
+      void readBlock();
+      void bandwidthAvailable();
+      void socketTimeout();
+
       void downloadingEnded();
+      void askTheNextChunk();
+
+      void stripeFinished(ChunkStripe* stripe);
 
    private:
+      void writeBlock();
+      void transferEnded();
+
       PM::IPeer* getTheFastestFreePeer();
+      QList<PM::IPeer*> getTheFreePeers();
       int getNumberOfFreePeer();
 
+      bool isStripingUseful();
+      PM::IPeer* startStriping();
+      bool startAStripe(PM::IPeer* peer, int maxSize);
+      bool startAStripe(PM::IPeer* peer, int start, int end, const QSharedPointer<ChunkStripe::Race>& race);
+      bool stealARange(PM::IPeer* peer);
+      PM::IPeer* startARace();
+      QSharedPointer<ChunkStripe> getAStripeToRace(PM::IPeer* peer) const;
+      bool hasAStripe(PM::IPeer* peer) const;
+      void dropTheLosers(ChunkStripe* winner);
+      QPair<int, int> getAFreeRange(int maxSize) const;
+      void addDownloadedRange(int start, int end);
+      int getNbBytesToDownload() const;
+      bool updateKnownBytesFromRanges();
+      void verifyStripedData();
+      void stripedDataVerified();
+      void stripingEnded(PM::IPeer* lastPeer);
+      void copyLocalChunk();
+      void localCopyEnded();
+
       LinkedPeers& linkedPeers;
       OccupiedPeers& occupiedPeersDownloadingChunk; // The peers from where we downloading.
+      PeerConcurrency& peerConcurrency;
       Common::TransferRateCalculator& transferRateCalculator;
+      Common::BandwidthLimiter& bandwidthLimiter;
       Common::ThreadPool& threadPool;
 
       Common::Hash chunkHash;
@@ -120,13 +178,46 @@ namespace DM
 
       int chunkSize;
       QSharedPointer<PM::IGetChunksResult> getChunksResult;
+      QElapsedTimer requestTimer; // To measure the round trip time of the 'GetChunks' request.
+      int requestRTT; // [ms].
+      int bytesReceived; // During the current download.
+
+      // The socket is read in the main thread when it's ready and the buffer is written by a thread of the pool, see 'readBlock()'.
+      QSharedPointer<FM::IDataWriter> writer; // Only used by the thread writing the data.
+      QByteArray buffer;
+      int bytesInBuffer;
+      int bytesToRead;
+      Common::BandwidthLimiter::Peer* limiterPeer;
+      QTimer socketTimer; // Started while waiting for data.
+      QElapsedTimer speedTimer;
+      int deltaRead;
+      bool nextChunkAsked;
+      bool receiving; // Between 'stream(..)' and 'transferEnded()'.
+      bool writing; // The buffer is being written by a thread of the pool.
+      bool waitingForBandwidth;
+      bool switchingPeer; // A better peer has been found, the transfer ends once the buffer is written.
 
       bool downloading;
+      bool batched; // Downloaded with other chunks by a 'ChunkBatch'.
       bool closeTheSocket;
       Status lastTransferStatus;
 
-      QThread* mainThread;
+      // The chunk can be downloaded from several peers at once, see 'startStriping()'.
+      bool striping;
+      bool verifyingStripes; // The data of the stripes is checked in a thread by 'verifyStripedData()'.
+      PM::IPeer* lastStripePeer;
+      QList<QSharedPointer<ChunkStripe>> stripes;
+      QMap<int, int> downloadedRanges; // Start -> end of the data downloaded by the stripes after the known bytes of the chunk. Saved with the queue to resume the download after a restart.
+
+      // The data can be copied from an identical local chunk instead of being downloaded, see 'startLocalCopy(..)'.
+      QSharedPointer<FM::IChunk> localSource;
+      bool copyingLocalChunk;
+      bool localCopyTried; // Only one try, after a failure the chunk is downloaded.
+
+      // During the endgame the range of a slow stripe is also downloaded by a free peer, see 'startARace()'.
+      bool endgame;
+      QList<QSharedPointer<ChunkStripe>> lostStripes; // The stripes whose range has been downloaded by another one, they don't write anymore.
 
-      mutable QMutex mutex; // To protect 'peers' and 'downloading'.
+      mutable QMutex mutex; // To protect 'peers', 'downloading' and 'endgame'.
    };
 }
@@ -0,0 +1,224 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/ChunkScheduler.h>
+using namespace DM;
+
+#include <QRandomGenerator>
+
+#include <priv/FileDownload.h>
+#include <priv/ChunkDownloader.h>
+
+/**
+  * @class DM::ChunkScheduler
+  *
+  * Index the chunks ready to be downloaded to avoid scanning the whole queue each time a peer becomes free.
+  * A chunk is ready when its file can be downloaded, it isn't complete nor being downloaded and it has at least one peer.
+  * During the endgame of a file a chunk being downloaded is also ready if one of its stripes can be raced by another peer.
+  * The ready chunks are indexed by each of their peers and sorted by:
+  *  1) The chunks not being downloaded first, thus a peer races a chunk only if it has nothing else to download.
+  *  2) The position of their file in the queue.
+  *  3) The partially downloaded chunks first.
+  *  4) The rarest chunks first (the ones with the fewest peers).
+  * Thus the best chunk for a given peer is found in O(log n). The index is updated when a chunk downloader emits
+  * one of its signals and when the status or the position of a file changes, see 'FileDownload'.
+  * The index may be slightly out of date, a chunk is always checked before being returned by 'getAChunkToDownload(..)'.
+  */
+
+bool ChunkScheduler::Key::operator<(const Key& other) const
+{
+   if (this->racing != other.racing)
+      return this->racing < other.racing;
+   if (this->fileRank != other.fileRank)
+      return this->fileRank < other.fileRank;
+   if (this->notPartial != other.notPartial)
+      return this->notPartial < other.notPartial;
+   if (this->nbPeers != other.nbPeers)
+      return this->nbPeers < other.nbPeers;
+   if (this->random != other.random)
+      return this->random < other.random;
+   return this->chunkDownloader < other.chunkDownloader;
+}
+
+ChunkScheduler::ChunkScheduler() :
+   nbReadyChunks(0)
+{
+}
+
+void ChunkScheduler::add(FileDownload* fileDownload, const QSharedPointer<ChunkDownloader>& chunkDownloader)
+{
+   if (this->items.contains(chunkDownloader.data()))
+      return;
+
+   Item& item = this->items[chunkDownloader.data()];
+   item.fileDownload = fileDownload;
+   item.chunkDownloader = chunkDownloader;
+   item.random = QRandomGenerator::global()->generate();
+   item.ready = false;
+
+   // These signals may be emitted from a downloading thread, in this case they are queued.
+   connect(chunkDownloader.data(), &ChunkDownloader::downloadStarted, this, &ChunkScheduler::chunkDownloaderChanged);
+   connect(chunkDownloader.data(), &ChunkDownloader::downloadFinished, this, &ChunkScheduler::chunkDownloaderChanged);
+   connect(chunkDownloader.data(), &ChunkDownloader::numberOfPeersChanged, this, &ChunkScheduler::chunkDownloaderChanged);
+   connect(chunkDownloader.data(), &ChunkDownloader::stripesChanged, this, &ChunkScheduler::chunkDownloaderChanged);
+
+   this->update(chunkDownloader.data());
+}
+
+void ChunkScheduler::remove(ChunkDownloader* chunkDownloader)
+{
+   auto i = this->items.find(chunkDownloader);
+   if (i == this->items.end())
+      return;
+
+   this->unindex(i.value());
+   chunkDownloader->disconnect(this);
+   this->items.erase(i);
+}
+
+/**
+  * Recompute the state and the key of a chunk, it is removed from the index if it isn't ready anymore.
+  */
+void ChunkScheduler::update(ChunkDownloader* chunkDownloader)
+{
+   auto i = this->items.find(chunkDownloader);
+   if (i == this->items.end())
+      return;
+
+   Item& item = i.value();
+   this->unindex(item);
+
+   if (!this->isReady(item, chunkDownloader))
+      return;
+
+   item.peers = chunkDownloader->getPeers();
+   item.key = Key { chunkDownloader->isDownloading() ? 1 : 0, item.fileDownload->getQueueRank(), chunkDownloader->isPartiallyDownloaded() ? 0 : 1, item.peers.size(), item.random, chunkDownloader };
+
+   for (QListIterator<PM::IPeer*> j(item.peers); j.hasNext();)
+      this->readyChunksByPeer[j.next()].insert(item.key, chunkDownloader);
+
+   item.ready = true;
+   this->nbReadyChunks++;
+}
+
+/**
+  * Return the best chunk to download from the given peer or a null pointer if there is none.
+  * @param fileDownload [out] The file of the returned chunk.
+  */
+QSharedPointer<ChunkDownloader> ChunkScheduler::getAChunkToDownload(PM::IPeer* peer, FileDownload*& fileDownload)
+{
+   for (auto i = this->readyChunksByPeer.find(peer); i != this->readyChunksByPeer.end(); i = this->readyChunksByPeer.find(peer))
+   {
+      ChunkDownloader* chunkDownloader = i.value().first();
+      Item& item = this->items[chunkDownloader];
+
+      if (!this->isReady(item, chunkDownloader))
+      {
+         this->update(chunkDownloader); // The index wasn't up to date, the chunk is removed.
+      }
+      else if (chunkDownloader->isDownloading() && !chunkDownloader->isRaceableWith(peer))
+      {
+         // The peer already downloads a stripe of this chunk, it's indexed again at the next update.
+         item.peers.removeOne(peer);
+         i.value().remove(item.key);
+         if (i.value().isEmpty())
+            this->readyChunksByPeer.erase(i);
+      }
+      else
+      {
+         fileDownload = item.fileDownload;
+         return item.chunkDownloader.toStrongRef();
+      }
+   }
+
+   return QSharedPointer<ChunkDownloader>();
+}
+
+/**
+  * Return at most 'n' chunks of small files, not being downloaded, to download from the given peer along with 'first', see 'ChunkBatch'.
+  * The chunks are taken in the same order as 'getAChunkToDownload(..)', the index isn't modified.
+  */
+QList<QPair<FileDownload*, QSharedPointer<ChunkDownloader>>> ChunkScheduler::getChunksToBatch(PM::IPeer* peer, ChunkDownloader* first, int n) const
+{
+   QList<QPair<FileDownload*, QSharedPointer<ChunkDownloader>>> chunks;
+
+   auto chunksOfThePeer = this->readyChunksByPeer.find(peer);
+   if (chunksOfThePeer == this->readyChunksByPeer.end())
+      return chunks;
+
+   for (auto i = chunksOfThePeer.value().begin(); i != chunksOfThePeer.value().end() && chunks.size() < n; ++i)
+   {
+      ChunkDownloader* chunkDownloader = i.value();
+      if (chunkDownloader == first)
+         continue;
+
+      if (i.key().racing) // The following chunks are all being downloaded.
+         break;
+
+      const Item& item = this->items[chunkDownloader];
+      if (item.fileDownload->isSmall() && this->isReady(item, chunkDownloader) && !chunkDownloader->isDownloading())
+         chunks << qMakePair(item.fileDownload, item.chunkDownloader.toStrongRef());
+   }
+
+   return chunks;
+}
+
+/**
+  * Return the peers owning at least one ready chunk.
+  */
+QList<PM::IPeer*> ChunkScheduler::getPeers() const
+{
+   return this->readyChunksByPeer.keys();
+}
+
+int ChunkScheduler::getNbReadyChunks() const
+{
+   return this->nbReadyChunks;
+}
+
+void ChunkScheduler::chunkDownloaderChanged()
+{
+   // The chunk downloader may have been removed before a queued signal is received, 'update(..)' ignores the unknown ones.
+   this->update(static_cast<ChunkDownloader*>(this->sender()));
+}
+
+bool ChunkScheduler::isReady(const Item& item, ChunkDownloader* chunkDownloader) const
+{
+   return item.fileDownload->isSchedulable() && (!chunkDownloader->isDownloading() || chunkDownloader->isRaceable()) && !chunkDownloader->isComplete() && chunkDownloader->hasAtLeastAPeer();
+}
+
+void ChunkScheduler::unindex(Item& item)
+{
+   if (!item.ready)
+      return;
+
+   for (QListIterator<PM::IPeer*> i(item.peers); i.hasNext();)
+   {
+      auto chunks = this->readyChunksByPeer.find(i.next());
+      if (chunks == this->readyChunksByPeer.end())
+         continue;
+
+      chunks.value().remove(item.key);
+      if (chunks.value().isEmpty())
+         this->readyChunksByPeer.erase(chunks);
+   }
+
+   item.peers.clear();
+   item.ready = false;
+   this->nbReadyChunks--;
+}
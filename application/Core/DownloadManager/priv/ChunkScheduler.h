@@ -0,0 +1,88 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QList>
+#include <QPair>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+#include <Common/Uncopyable.h>
+#include <Core/PeerManager/IPeer.h>
+
+namespace DM
+{
+   class FileDownload;
+   class ChunkDownloader;
+
+   class ChunkScheduler : public QObject, Common::Uncopyable
+   {
+      Q_OBJECT
+   public:
+      ChunkScheduler();
+
+      void add(FileDownload* fileDownload, const QSharedPointer<ChunkDownloader>& chunkDownloader);
+      void remove(ChunkDownloader* chunkDownloader);
+      void update(ChunkDownloader* chunkDownloader);
+
+      QSharedPointer<ChunkDownloader> getAChunkToDownload(PM::IPeer* peer, FileDownload*& fileDownload);
+      QList<QPair<FileDownload*, QSharedPointer<ChunkDownloader>>> getChunksToBatch(PM::IPeer* peer, ChunkDownloader* first, int n) const;
+      QList<PM::IPeer*> getPeers() const;
+      int getNbReadyChunks() const;
+
+   private slots:
+      void chunkDownloaderChanged();
+
+   private:
+      /**
+        * The chunks are downloaded in ascending order of their key.
+        */
+      struct Key
+      {
+         int racing; // 1 if the chunk is being downloaded and can be raced during the endgame, see 'ChunkDownloader::startARace()'.
+         quint64 fileRank; // See 'Download::getQueueRank()'.
+         int notPartial; // 0 if the chunk has already been partially downloaded.
+         int nbPeers; // The rarest chunks first.
+         quint32 random; // To choose randomly between two equivalent chunks.
+         ChunkDownloader* chunkDownloader;
+
+         bool operator<(const Key& other) const;
+      };
+
+      struct Item
+      {
+         FileDownload* fileDownload;
+         QWeakPointer<ChunkDownloader> chunkDownloader;
+         quint32 random;
+         bool ready;
+         Key key;
+         QList<PM::IPeer*> peers; // The peers where the chunk is indexed.
+      };
+
+      bool isReady(const Item& item, ChunkDownloader* chunkDownloader) const;
+      void unindex(Item& item);
+
+      QHash<ChunkDownloader*, Item> items;
+      QHash<PM::IPeer*, QMap<Key, ChunkDownloader*>> readyChunksByPeer;
+      int nbReadyChunks;
+   };
+}
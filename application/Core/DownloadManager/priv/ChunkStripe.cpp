@@ -0,0 +1,521 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/ChunkStripe.h>
+using namespace DM;
+
+#include <QMutexLocker>
+
+#include <Common/Settings.h>
+#include <Core/FileManager/Exceptions.h>
+
+#include <priv/Log.h>
+
+/**
+  * @class DM::ChunkStripe
+  *
+  * Download a range of a chunk from one peer, used by 'ChunkDownloader' to download a chunk from several peers at once.
+  * The range begins at 'start' and ends at 'end' (exclusive). The peer sends the data from 'start' up to the end of the chunk,
+  * thus the socket is closed when 'end' is reached before the end of the chunk.
+  * The end of the range can be reduced by 'shrink(..)' while downloading, the removed part is given to another stripe.
+  * The data isn't checked here, see 'FM::IChunk::setContiguousKnownBytes(..)'.
+  *
+  * The socket stays in the main thread, the stripe reads it when it's ready (see 'readBlock()') and only the writing of
+  * each received block is done by a thread of the pool, see 'run()'.
+  *
+  * During the endgame the remaining range of a slow stripe can also be downloaded by another stripe, see 'startARace()'.
+  * The two stripes share a frontier: a received byte is written only if it's beyond the frontier, thus each byte
+  * of the '.unfinished' file is written once, by the first peer sending it. The loser stops when the frontier reaches the end.
+  */
+
+ChunkStripe::ChunkStripe(const QSharedPointer<FM::IChunk>& chunk, PM::IPeer* peer, int start, int end, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool) :
+   chunk(chunk),
+   peer(peer),
+   transferRateCalculator(transferRateCalculator),
+   bandwidthLimiter(bandwidthLimiter),
+   threadPool(threadPool),
+   startOffset(start),
+   offset(start),
+   endOffset(end),
+   writerOffset(-1),
+   bytesInBuffer(0),
+   limiterPeer(nullptr),
+   deltaRead(0),
+   active(false),
+   ended(false),
+   writing(false),
+   waitingForBandwidth(false),
+   closeTheSocket(false),
+   peerToRemove(false),
+   status(QUEUED)
+{
+   this->socketTimer.setSingleShot(true);
+   this->socketTimer.setInterval(SETTINGS.get<quint32>("socket_timeout"));
+   connect(&this->socketTimer, &QTimer::timeout, this, &ChunkStripe::socketTimeout);
+}
+
+/**
+  * Send the request to the peer.
+  * @return 'false' if the request can't be sent, in this case 'stripeFinished' isn't emitted.
+  */
+bool ChunkStripe::start()
+{
+   Protos::Core::GetChunks getChunksMess;
+   Protos::Core::GetChunks::Chunk* chunk = getChunksMess.add_chunks();
+   chunk->mutable_hash()->set_hash(this->chunk->getHash().getData(), Common::Hash::HASH_SIZE);
+   chunk->set_offset(this->startOffset);
+   this->getChunksResult = this->peer->getChunks(getChunksMess);
+   if (this->getChunksResult.isNull())
+      return false;
+
+   L_DEBU(QString("Starting downloading a stripe [%1, %2[ of a chunk: %3 from %4").arg(this->startOffset).arg(this->endOffset).arg(this->chunk->toStringLog()).arg(this->peer->getID().toStr()));
+
+   this->active = true;
+
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::result, this, &ChunkStripe::result, Qt::DirectConnection);
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::stream, this, &ChunkStripe::stream, Qt::DirectConnection);
+   connect(this->getChunksResult.data(), &PM::IGetChunksResult::timeout, this, &ChunkStripe::getChunkTimeout, Qt::DirectConnection);
+
+   this->getChunksResult->start();
+   return true;
+}
+
+/**
+  * Abort the download, 'stripeFinished' is emitted.
+  * If a block is being written we wait for the end of the writing.
+  */
+void ChunkStripe::stop()
+{
+   this->mutex.lock();
+   this->active = false;
+   this->mutex.unlock();
+
+   if (this->writing)
+   {
+      this->threadPool.wait(this->getWeakRef());
+      this->writing = false;
+   }
+
+   this->closeTheSocket = true; // The peer may still be sending data.
+   this->end();
+}
+
+PM::IPeer* ChunkStripe::getPeer() const
+{
+   return this->peer;
+}
+
+int ChunkStripe::getStart() const
+{
+   return this->startOffset;
+}
+
+int ChunkStripe::getOffset() const
+{
+   QMutexLocker locker(&this->mutex);
+   return this->offset;
+}
+
+int ChunkStripe::getEnd() const
+{
+   QMutexLocker locker(&this->mutex);
+   return this->endOffset;
+}
+
+int ChunkStripe::getRemainingBytes() const
+{
+   QMutexLocker locker(&this->mutex);
+   return qMax(0, this->endOffset - this->offset);
+}
+
+/**
+  * Reduce the range, the part after 'newEnd' can be downloaded by another stripe.
+  * @return 'false' if the data before 'newEnd' has already been downloaded.
+  */
+bool ChunkStripe::shrink(int newEnd)
+{
+   QMutexLocker locker(&this->mutex);
+   if (!this->active || !this->race.isNull() || newEnd <= this->offset || newEnd >= this->endOffset)
+      return false;
+
+   this->endOffset = newEnd;
+   return true;
+}
+
+/**
+  * The remaining range will also be downloaded by another stripe, which must call 'joinARace(..)' before being started.
+  * A raced stripe can't be shrunk.
+  * @return A null pointer if the stripe isn't active or is already raced.
+  */
+QSharedPointer<ChunkStripe::Race> ChunkStripe::startARace()
+{
+   QMutexLocker locker(&this->mutex);
+   if (!this->active || !this->race.isNull() || this->offset >= this->endOffset)
+      return QSharedPointer<Race>();
+
+   this->race = QSharedPointer<Race>(new Race(this->offset));
+   return this->race;
+}
+
+void ChunkStripe::joinARace(const QSharedPointer<Race>& race)
+{
+   QMutexLocker locker(&this->mutex);
+   this->race = race;
+}
+
+QSharedPointer<ChunkStripe::Race> ChunkStripe::getRace() const
+{
+   QMutexLocker locker(&this->mutex);
+   return this->race;
+}
+
+/**
+  * Return 'true' if the range has been entirely written by another stripe.
+  */
+bool ChunkStripe::isRaceLost() const
+{
+   QMutexLocker locker(&this->mutex);
+   if (this->race.isNull())
+      return false;
+
+   QMutexLocker raceLocker(&this->race->mutex);
+   return this->offset < this->endOffset && this->race->frontier >= this->endOffset;
+}
+
+/**
+  * May return one of this status:
+  * QUEUED (all is ok)
+  * TRANSFER_ERROR
+  * UNABLE_TO_OPEN_THE_FILE
+  * FILE_IO_ERROR
+  * FILE_NON_EXISTENT
+  * GOT_TOO_MUCH_DATA
+  */
+Status ChunkStripe::getStatus() const
+{
+   return this->status;
+}
+
+/**
+  * Return 'true' if the peer doesn't have the chunk anymore.
+  */
+bool ChunkStripe::isPeerToRemove() const
+{
+   return this->peerToRemove;
+}
+
+void ChunkStripe::init(QThread*)
+{
+}
+
+/**
+  * Called by the thread pool ('Common::ThreadPool') in another thread.
+  */
+void ChunkStripe::run()
+{
+   this->writeBlock();
+}
+
+/**
+  * Called in the main thread when the buffer has been written.
+  */
+void ChunkStripe::finished()
+{
+   this->writing = false;
+
+   if (this->ended)
+      return;
+
+   if (this->status != QUEUED)
+      this->end();
+   else
+      this->readBlock();
+}
+
+void ChunkStripe::result(const Protos::Core::GetChunksResult& result)
+{
+   if (result.status() != Protos::Core::GetChunksResult::OK || (result.results_size() > 0 && result.results(0).status() != Protos::Core::GetChunksResult::ChunkResult::OK))
+   {
+      L_WARN(QString("Status error from GetChunkResult: %1 (chunk status: %2). Stripe download aborted.").arg(result.status()).arg(result.results_size() > 0 ? result.results(0).status() : 0));
+      this->peerToRemove = true;
+      this->status = TRANSFER_ERROR;
+      this->end();
+   }
+   else if (result.results_size() == 0 || result.results(0).chunk_size() == 0)
+   {
+      L_ERRO(QString("Message 'GetChunkResult' doesn't contain the size of the chunk: %1. Stripe download aborted.").arg(this->chunk->getHash().toStr()));
+      this->closeTheSocket = true;
+      this->status = TRANSFER_ERROR;
+      this->end();
+   }
+}
+
+void ChunkStripe::stream(const QSharedPointer<PM::ISocket>& socket)
+{
+   static const int BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_writing");
+
+   if (this->ended) // Aborted by 'result(..)'.
+      return;
+
+   this->socket = socket;
+   this->buffer.resize(BUFFER_SIZE);
+   this->limiterPeer = this->bandwidthLimiter.transferStarted(this->peer->getID());
+   this->speedTimer.start();
+
+   connect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkStripe::readBlock);
+   this->readBlock(); // Some data may already be buffered.
+}
+
+void ChunkStripe::getChunkTimeout()
+{
+   L_WARN("Timeout from GetChunkResult, stripe download aborted.");
+   this->status = TRANSFER_ERROR;
+   this->end();
+}
+
+/**
+  * Read the available data until the buffer is full or the range is received, the buffer is then written by the pool.
+  * Called each time the socket has new data, after a writing and after a delay imposed by the bandwidth limiter.
+  */
+void ChunkStripe::readBlock()
+{
+   static const int SPEED_UPDATE_PERIOD = 1000; // [ms].
+
+   if (this->ended || this->writing || this->waitingForBandwidth)
+      return;
+
+   forever
+   {
+      this->mutex.lock();
+      if (!this->active)
+      {
+         this->closeTheSocket = true; // The remote uploader must stop sending the rest of the data.
+         this->mutex.unlock();
+         this->end();
+         return;
+      }
+      const int bytesToRead = qMin(this->endOffset - this->offset - this->bytesInBuffer, this->buffer.size() - this->bytesInBuffer);
+      const QSharedPointer<Race> race = this->race;
+      this->mutex.unlock();
+
+      if (!race.isNull() && bytesToRead > 0)
+      {
+         QMutexLocker raceLocker(&race->mutex);
+         if (race->frontier >= this->endOffset)
+         {
+            L_DEBU(QString("The range [%1, %2[ of the chunk %3 has been downloaded by another peer").arg(this->startOffset).arg(this->endOffset).arg(this->chunk->toStringLog()));
+            this->closeTheSocket = true;
+            this->end();
+            return;
+         }
+      }
+
+      if (bytesToRead <= 0)
+      {
+         // The range may have been shrunk during the reading, the data after the new end is written anyway.
+         if (this->bytesInBuffer > 0)
+         {
+            this->writing = true;
+            this->threadPool.run(this->getWeakRef());
+            return;
+         }
+
+         // The uploader sends the data up to the end of the chunk.
+         if (this->offset < this->chunk->getChunkSize())
+            this->closeTheSocket = true;
+         this->end();
+         return;
+      }
+
+      const int bytesRead = this->socket->read(this->buffer.data() + this->bytesInBuffer, bytesToRead);
+
+      if (bytesRead == 0)
+      {
+         this->socketTimer.start(); // Wait for the next 'readyRead()'.
+         return;
+      }
+      else if (bytesRead == -1)
+      {
+         L_WARN(QString("Socket : cannot receive data: %1").arg(this->chunk->toStringLog()));
+         this->closeTheSocket = true;
+         this->status = TRANSFER_ERROR;
+         this->end();
+         return;
+      }
+
+      this->socketTimer.stop();
+
+      this->bytesInBuffer += bytesRead;
+      this->deltaRead += bytesRead;
+      this->transferRateCalculator.addData(bytesRead);
+
+      if (this->speedTimer.elapsed() > SPEED_UPDATE_PERIOD)
+      {
+         this->peer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+         this->speedTimer.start();
+         this->deltaRead = 0;
+      }
+
+      // The reading continues when both the writing and the delay are finished.
+      if (const int delay = this->bandwidthLimiter.reserve(this->limiterPeer, bytesRead))
+      {
+         this->waitingForBandwidth = true;
+         QTimer::singleShot(delay, this, &ChunkStripe::bandwidthAvailable);
+      }
+
+      if (this->bytesInBuffer == this->buffer.size())
+      {
+         this->writing = true;
+         this->threadPool.run(this->getWeakRef());
+      }
+
+      if (this->writing || this->waitingForBandwidth)
+         return;
+   }
+}
+
+void ChunkStripe::bandwidthAvailable()
+{
+   if (!this->waitingForBandwidth)
+      return;
+
+   this->waitingForBandwidth = false;
+   this->readBlock();
+}
+
+void ChunkStripe::socketTimeout()
+{
+   L_WARN(QString("Connection dropped, error = %1, bytesAvailable = %2").arg(this->socket->errorString()).arg(this->socket->bytesAvailable()));
+   this->closeTheSocket = true;
+   this->status = TRANSFER_ERROR;
+   this->end();
+}
+
+/**
+  * Called in a thread of the pool, write the buffer at 'offset'.
+  */
+void ChunkStripe::writeBlock()
+{
+   try
+   {
+      this->write(this->buffer.constData(), this->bytesInBuffer);
+
+      this->mutex.lock();
+      this->offset += this->bytesInBuffer;
+      this->mutex.unlock();
+      this->bytesInBuffer = 0;
+   }
+   catch (FM::FileResetException)
+   {
+      L_DEBU("FileResetException");
+      this->closeTheSocket = true;
+      this->status = FILE_NON_EXISTENT;
+   }
+   catch (FM::UnableToOpenFileInWriteModeException)
+   {
+      L_DEBU("UnableToOpenFileInWriteModeException");
+      this->closeTheSocket = true;
+      this->status = UNABLE_TO_OPEN_THE_FILE;
+   }
+   catch (FM::IOErrorException&)
+   {
+      L_DEBU("IOErrorException");
+      this->closeTheSocket = true;
+      this->status = FILE_IO_ERROR;
+   }
+   catch (FM::ChunkDeletedException&)
+   {
+      L_DEBU("ChunkDeletedException");
+      this->closeTheSocket = true;
+      this->status = FILE_NON_EXISTENT;
+   }
+   catch (FM::TryToWriteBeyondTheEndOfChunkException&)
+   {
+      L_DEBU("TryToWriteBeyondTheEndOfChunkException");
+      this->closeTheSocket = true;
+      this->status = GOT_TOO_MUCH_DATA;
+   }
+}
+
+void ChunkStripe::end()
+{
+   static const int SPEED_UPDATE_PERIOD = 1000; // [ms].
+
+   if (this->ended)
+      return;
+   this->ended = true;
+
+   this->mutex.lock();
+   this->active = false;
+   this->mutex.unlock();
+
+   this->socketTimer.stop();
+   this->waitingForBandwidth = false;
+   this->writer.clear();
+
+   if (this->limiterPeer)
+   {
+      if (this->speedTimer.elapsed() > SPEED_UPDATE_PERIOD / 10)
+         this->peer->setSpeed(this->deltaRead / this->speedTimer.elapsed() * 1000);
+
+      this->bandwidthLimiter.transferFinished(this->limiterPeer);
+      this->limiterPeer = nullptr;
+   }
+
+   if (!this->socket.isNull())
+   {
+      disconnect(this->socket->getDevice(), &QIODevice::readyRead, this, &ChunkStripe::readBlock);
+      this->socket.clear();
+   }
+
+   if (!this->getChunksResult.isNull())
+   {
+      this->getChunksResult->setStatus(this->closeTheSocket);
+      this->getChunksResult.clear();
+   }
+
+   emit stripeFinished(this);
+}
+
+/**
+  * Write the data received at 'offset'. When the stripe is raced only the data beyond the frontier is written.
+  * @return 'false' if nothing has been written.
+  */
+bool ChunkStripe::write(const char* buffer, int nbBytes)
+{
+   this->mutex.lock();
+   const QSharedPointer<Race> race = this->race;
+   this->mutex.unlock();
+
+   QMutexLocker raceLocker(race.isNull() ? nullptr : &race->mutex);
+
+   const int skip = race.isNull() ? 0 : qBound(0, race->frontier - this->offset, nbBytes);
+   if (skip == nbBytes)
+      return false;
+
+   if (this->writer.isNull() || this->writerOffset != this->offset + skip)
+      this->writer = this->chunk->getDataWriter(this->offset + skip);
+
+   this->writer->write(buffer + skip, nbBytes - skip);
+   this->writerOffset = this->offset + nbBytes;
+
+   if (!race.isNull())
+      race->frontier = this->offset + nbBytes;
+
+   return true;
+}
@@ -0,0 +1,140 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include <Protos/core_protocol.pb.h>
+
+#include <Common/SelfWeakPointer.h>
+#include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
+#include <Common/Uncopyable.h>
+#include <Common/IRunnable.h>
+#include <Common/ThreadPool.h>
+#include <Core/FileManager/IChunk.h>
+#include <Core/FileManager/IDataWriter.h>
+#include <Core/PeerManager/IPeer.h>
+#include <Core/PeerManager/IGetChunksResult.h>
+
+#include <IDownload.h>
+
+namespace DM
+{
+   class ChunkStripe : public QObject, public Common::SelfWeakPointer<ChunkStripe>, public Common::IRunnable, Common::Uncopyable
+   {
+      Q_OBJECT
+   public:
+      /**
+        * Shared by the stripes downloading the same range, see 'startARace()'.
+        */
+      struct Race
+      {
+         Race(int frontier) : frontier(frontier) {}
+
+         QMutex mutex;
+         int frontier; // The data before has been written by one of the stripes.
+      };
+
+      ChunkStripe(const QSharedPointer<FM::IChunk>& chunk, PM::IPeer* peer, int start, int end, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool);
+
+      bool start();
+      void stop();
+
+      PM::IPeer* getPeer() const;
+      int getStart() const;
+      int getOffset() const;
+      int getEnd() const;
+      int getRemainingBytes() const;
+      bool shrink(int newEnd);
+
+      QSharedPointer<Race> startARace();
+      void joinARace(const QSharedPointer<Race>& race);
+      QSharedPointer<Race> getRace() const;
+      bool isRaceLost() const;
+
+      Status getStatus() const;
+      bool isPeerToRemove() const;
+
+      void init(QThread* thread);
+      void run();
+      void finished();
+
+   signals:
+      /**
+        * Emitted in the main thread when the stripe is terminated (or aborted).
+        */
+      void stripeFinished(ChunkStripe* stripe);
+
+   private slots:
+      void result(const Protos::Core::GetChunksResult& result);
+      void stream(const QSharedPointer<PM::ISocket>& socket);
+      void getChunkTimeout();
+
+      void readBlock();
+      void bandwidthAvailable();
+      void socketTimeout();
+
+   private:
+      void writeBlock();
+      void end();
+      bool write(const char* buffer, int nbBytes);
+
+      QSharedPointer<FM::IChunk> chunk;
+      PM::IPeer* peer;
+      Common::TransferRateCalculator& transferRateCalculator;
+      Common::BandwidthLimiter& bandwidthLimiter;
+      Common::ThreadPool& threadPool;
+
+      const int startOffset;
+      int offset; // The next byte to write, relative to the beginning of the chunk.
+      int endOffset; // Exclusive, can be reduced by 'shrink(..)'.
+
+      QSharedPointer<FM::IDataWriter> writer;
+      int writerOffset; // Where 'writer' writes the next byte.
+      QSharedPointer<Race> race;
+
+      QSharedPointer<PM::ISocket> socket;
+      QSharedPointer<PM::IGetChunksResult> getChunksResult;
+
+      QByteArray buffer; // The data received after 'offset', written by a thread of the pool when full, see 'writeBlock()'.
+      int bytesInBuffer;
+
+      Common::BandwidthLimiter::Peer* limiterPeer;
+      QTimer socketTimer; // Started while waiting for data.
+      QElapsedTimer speedTimer;
+      int deltaRead;
+
+      bool active;
+      bool ended;
+      bool writing; // The buffer is being written by a thread of the pool.
+      bool waitingForBandwidth;
+      bool closeTheSocket;
+      bool peerToRemove;
+      Status status;
+
+      mutable QMutex mutex; // To protect 'offset', 'endOffset', 'active' and 'race'.
+   };
+}
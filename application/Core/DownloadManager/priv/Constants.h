@@ -26,7 +26,25 @@ namespace DM
    const int RETRY_GET_ENTRIES_PERIOD = 10000; // [ms]. If a directory can't be browsed, we wait 10s before retrying.
    const int RESTART_DOWNLOADS_PERIOD_IF_ERROR = 10000; // [ms]. If one or more download has a status >= 0x20 then it will be restarted periodically.
 
+   const quint64 QUEUE_RANK_GAP = Q_UINT64_C(1) << 32; // The space between the ranks of two downloads appended to the queue.
+   const quint64 QUEUE_RANK_STEP = Q_UINT64_C(1) << 16; // The space between the ranks of two downloads inserted one after the other in the queue.
+
+   // See 'PeerConcurrency'.
+   const int CONCURRENCY_SAMPLING_PERIOD = 1000; // [ms]. The throughput of a peer is measured during at least this period before changing its number of downloads.
+   const double CONCURRENCY_THROUGHPUT_GAIN_FACTOR = 1.05; // The number of downloads is increased while the throughput grows by at least 5 %.
+   const double CONCURRENCY_THROUGHPUT_DROP_FACTOR = 0.8; // The number of downloads is decreased if the throughput drops by more than 20 %.
+   const double CONCURRENCY_DECREASE_FACTOR = 0.5;
+   const double CONCURRENCY_RTT_INFLATION_FACTOR = 2.0; // The number of downloads is decreased if the round trip time is more than twice the minimum measured.
+   const int CONCURRENCY_RTT_TOLERANCE = 5; // [ms]. Added to the minimum round trip time, to not react to the noise on a LAN.
+   const int PIPELINE_RTT_FACTOR = 2; // The next chunk is asked when the current one will be received in less than two round trips.
+   const int PIPELINE_MIN_TIME = 20; // [ms].
+
+   const int HASHES_PREFETCH_SCAN_FACTOR = 4; // To find the next files whose hashes are prefetched, at most 4 times the number of wanted files are examined in the queue.
+
+   const qint64 QUEUE_JOURNAL_MIN_SIZE_TO_COMPACT = 1024 * 1024; // [byte]. The journal is merged into the queue file when it's bigger than this and than the queue file.
+
    // 2 -> 3 : BLAKE -> Sha-1
    // 3 -> 4 : Replace Entry::complete by a status.
-   const int FILE_QUEUE_VERSION = 4;
+   // 4 -> 5 : The queue is completed by a journal and the chunk hashes are stored in a separate table. The version 4 can still be loaded.
+   const int FILE_QUEUE_VERSION = 5;
 }
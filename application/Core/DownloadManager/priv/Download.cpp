@@ -35,7 +35,7 @@ Download::Download(
    const Protos::Common::Entry& remoteEntry,
    const Protos::Common::Entry& localEntry
 ) :
-   fileManager(fileManager), ID(currentID++), peerSource(peerSource), remoteEntry(remoteEntry), localEntry(localEntry), status(QUEUED)
+   fileManager(fileManager), ID(currentID++), peerSource(peerSource), remoteEntry(remoteEntry), localEntry(localEntry), status(QUEUED), queueRank(0)
 {
    // Special case when downloading the root of a drive like "C:/". In this case "C:" is the name of the entry and it becomes a part of the local entry path.
    std::replace(this->localEntry.mutable_path()->begin(), this->localEntry.mutable_path()->end(), ':', '_');
@@ -101,6 +101,11 @@ void Download::remove()
    delete this;
 }
 
+void Download::setQueueRank(quint64 rank)
+{
+   this->queueRank = rank;
+}
+
 /**
   * Update the status depending of it's internal state.
   * @return 'true' if the status can't be change.
@@ -122,7 +127,14 @@ void Download::setStatus(Status newStatus)
 
    L_DEBU(QString("Download (%1) status change from %2 to %3").arg(Common::ProtoHelper::getPath(this->localEntry)).arg(Utils::getStatusStr(this->status)).arg(Utils::getStatusStr(newStatus)));
 
+   // Only these statuses are persisted, the other ones are saved as QUEUED.
+   const auto persistedStatus = [](Status status) { return status == COMPLETE || status == PAUSED ? status : QUEUED; };
+   const bool persistedStatusChanged = persistedStatus(this->status) != persistedStatus(newStatus);
+
    this->status = newStatus;
+
+   if (persistedStatusChanged)
+      emit entryChanged();
 }
 
 bool Download::hasAValidPeerSource()
@@ -67,6 +67,12 @@ namespace DM
 
       inline bool isStatusErroneous() const { return this->status >= 0x20; }
 
+      /**
+        * The downloads are sorted by their rank in the queue, see 'DownloadQueue::updateRank(..)'.
+        */
+      inline quint64 getQueueRank() const { return this->queueRank; }
+      virtual void setQueueRank(quint64 rank);
+
       virtual quint64 getDownloadedBytes() const;
       PM::IPeer* getPeerSource() const;
       QSet<PM::IPeer*> getPeers() const;
@@ -79,6 +85,7 @@ namespace DM
 
    signals:
       void becomeErroneous(Download*);
+      void entryChanged(); // The persisted part of the download has changed, see 'populateQueueEntry(..)'.
 
    public slots:
       virtual bool updateStatus();
@@ -102,5 +109,7 @@ namespace DM
       Protos::Common::Entry localEntry; ///< To.
 
       Status status;
+
+      quint64 queueRank;
    };
 }
@@ -40,12 +40,12 @@ DownloadManager::DownloadManager(QSharedPointer<FM::IFileManager> fileManager, Q
    NUMBER_OF_DOWNLOADER(static_cast<int>(SETTINGS.get<quint32>("number_of_downloader"))),
    fileManager(fileManager),
    peerManager(peerManager),
+   occupiedPeersDownloadingChunk(&this->peerConcurrency),
    threadPool(NUMBER_OF_DOWNLOADER),
-   numberOfDownloadThreadRunning(0),
-   queueChanged(false),
-   queueLoaded(false)
+   numberOfDownloadThreadRunning(0)
 {
-   this->threadPool.setStackSize(MIN_DOWNLOAD_THREAD_STACK_SIZE + SETTINGS.get<quint32>("buffer_size_writing"));
+   this->threadPool.setStackSize(MIN_DOWNLOAD_THREAD_STACK_SIZE); // The buffers aren't on the stack, see 'ChunkDownloader::readBlock()'.
+   this->bandwidthLimiter.setLimits(SETTINGS.get<quint32>("download_rate_limit"), SETTINGS.get<quint32>("download_rate_limit_per_peer"));
 
    connect(&this->occupiedPeersAskingForHashes, &OccupiedPeers::newFreePeer, this, &DownloadManager::peerNoLongerAskingForHashes);
    connect(&this->occupiedPeersAskingForEntries, &OccupiedPeers::newFreePeer, this, &DownloadManager::peerNoLongerAskingForEntries);
@@ -58,16 +58,19 @@ DownloadManager::DownloadManager(QSharedPointer<FM::IFileManager> fileManager, Q
    this->startErroneousDownloadTimer.setSingleShot(true);
    connect(&this->startErroneousDownloadTimer, &QTimer::timeout, this, &DownloadManager::restartErroneousDownloads);
 
-   this->saveTimer.setInterval(SETTINGS.get<quint32>("save_queue_period"));
-   connect(&this->saveTimer, &QTimer::timeout, this, &DownloadManager::saveQueueToFile);
-
    connect(this->peerManager.data(), &PM::IPeerManager::peerBecomesAvailable, this, &DownloadManager::peerBecomesAvailable);
 }
 
 DownloadManager::~DownloadManager()
 {
-   this->queueChanged = true;
-   this->saveQueueToFile();
+   // The batches are stopped before the downloads, no other download is started.
+   this->occupiedPeersDownloadingChunk.disconnect(this);
+   for (QListIterator<QSharedPointer<ChunkBatch>> i(this->chunkBatches); i.hasNext();)
+   {
+      const QSharedPointer<ChunkBatch>& batch = i.next();
+      batch->disconnect(this);
+      batch->stop();
+   }
 
    L_DEBU("DownloadManager deleted");
 }
@@ -167,15 +170,17 @@ Download* DownloadManager::addDownload(const Protos::Common::Entry& remoteEntry,
             this->linkedPeers,
             this->occupiedPeersAskingForHashes,
             this->occupiedPeersDownloadingChunk,
+            this->peerConcurrency,
+            this->chunkScheduler,
             this->threadPool,
             peerSource,
             remoteEntry,
             localEntry,
             this->transferRateCalculator,
+            this->bandwidthLimiter,
             status
          );
          newDownload = fileDownload;
-         connect(fileDownload, &FileDownload::newHashKnown, this, &DownloadManager::setQueueChanged, Qt::DirectConnection);
       }
       break;
 
@@ -187,8 +192,6 @@ Download* DownloadManager::addDownload(const Protos::Common::Entry& remoteEntry,
    this->downloadQueue.insert(position, newDownload);
    newDownload->start();
 
-   this->setQueueChanged();
-
    return newDownload;
 }
 
@@ -198,9 +201,9 @@ QList<IDownload*> DownloadManager::getDownloads() const
 
    // A bit heavy . . .
    listDownloads.reserve(this->downloadQueue.size());
-   for (int i = 0; i < this->downloadQueue.size(); i++)
+   for (QListIterator<Download*> i(this->downloadQueue.toList()); i.hasNext();)
    {
-      Download* download = this->downloadQueue[i];
+      Download* download = i.next();
       if (download->getStatus() != DELETED)
          listDownloads << download;
    }
@@ -211,8 +214,6 @@ QList<IDownload*> DownloadManager::getDownloads() const
 void DownloadManager::moveDownloads(const QList<quint64>& downloadIDRefs, const QList<quint64>& downloadIDs, Protos::GUI::MoveDownloads::Position position)
 {
    this->downloadQueue.moveDownloads(downloadIDRefs, downloadIDs, position);
-
-   this->setQueueChanged();
 }
 
 /**
@@ -221,8 +222,7 @@ void DownloadManager::moveDownloads(const QList<quint64>& downloadIDRefs, const
 void DownloadManager::removeAllCompleteDownloads()
 {
    IsComplete isComplete;
-   if (this->downloadQueue.removeDownloads(isComplete))
-      this->setQueueChanged();
+   this->downloadQueue.removeDownloads(isComplete);
 }
 
 void DownloadManager::removeDownloads(QList<quint64> IDs)
@@ -230,9 +230,7 @@ void DownloadManager::removeDownloads(QList<quint64> IDs)
    if (IDs.isEmpty())
       return;
 
-   IsContainedInAList isContainedInAList(IDs);
-   if (this->downloadQueue.removeDownloads(isContainedInAList))
-      this->setQueueChanged();
+   this->downloadQueue.removeDownloads(IDs);
 }
 
 void DownloadManager::pauseDownloads(QList<quint64> IDs, bool pause)
@@ -240,8 +238,7 @@ void DownloadManager::pauseDownloads(QList<quint64> IDs, bool pause)
    if (IDs.isEmpty())
       return;
 
-   if (this->downloadQueue.pauseDownloads(IDs, pause))
-      this->setQueueChanged();
+   this->downloadQueue.pauseDownloads(IDs, pause);
 
    if (!pause)
       this->scanTheQueue();
@@ -271,6 +268,11 @@ int DownloadManager::getDownloadRate()
    return this->transferRateCalculator.getTransferRate();
 }
 
+void DownloadManager::setRateLimits(quint32 rate, quint32 ratePerPeer)
+{
+   this->bandwidthLimiter.setLimits(rate, ratePerPeer);
+}
+
 void DownloadManager::peerBecomesAvailable(PM::IPeer* peer)
 {
    this->downloadQueue.peerBecomesAvailable(peer);
@@ -331,11 +333,17 @@ void DownloadManager::peerNoLongerAskingForHashes(PM::IPeer* peer)
    if (!this->downloadQueue.isAPeerSource(peer))
       return;
 
+   static const int NB_NEXT_FILES = SETTINGS.get<quint32>("get_hashes_nb_next_files");
+
    // We can't use 'downloadsIndexedBySourcePeerID' because the order matters.
    DownloadQueue::ScanningIterator<IsDownloadable> i(this->downloadQueue);
    while (FileDownload* fileDownload = static_cast<FileDownload*>(i.next()))
-      if (!fileDownload->isStatusErroneous() && fileDownload->retrieveHashes())
-         break;
+      if (!fileDownload->isStatusErroneous() && fileDownload->hashesNeeded() && this->occupiedPeersAskingForHashes.isPeerFree(fileDownload->getPeerSource()))
+      {
+         // The hashes of the following files of the same peer are prefetched with the same request.
+         if (fileDownload->retrieveHashes(this->downloadQueue.getNextDownloadsWithoutHashes(fileDownload, NB_NEXT_FILES)))
+            break;
+      }
 }
 
 /**
@@ -357,52 +365,103 @@ void DownloadManager::peerNoLongerAskingForEntries(PM::IPeer* peer)
 void DownloadManager::peerNoLongerDownloadingChunk(PM::IPeer* peer)
 {
    L_DEBU(QString("A peer is free from downloading: %1, number of downloading thread: %2").arg(peer->toStringLog()).arg(this->numberOfDownloadThreadRunning));
-   this->scanTheQueue();
+   this->startDownloading(QList<PM::IPeer*> { peer });
 }
 
 /**
-  * Search a chunk to download.
+  * Search a chunk to download for each free peer.
   */
 void DownloadManager::scanTheQueue()
 {
-   L_DEBU("Scanning the queue . . .");
-
-   int numberOfDownloadThreadRunningCopy = this->numberOfDownloadThreadRunning;
-
-   QSharedPointer<ChunkDownloader> chunkDownloader;
-   FileDownload* fileDownload = nullptr;
-
-   // To know the number of peers not occupied that own at least one chunk in the queue.
-   auto peers = this->linkedPeers.getPeers();
-   QSet<PM::IPeer*> linkedPeersNotOccupied(peers.begin(), peers.end());
-   linkedPeersNotOccupied -= this->occupiedPeersDownloadingChunk.getOccupiedPeers();
-
-   DownloadQueue::ScanningIterator<IsDownloadable> i(this->downloadQueue);
+   L_DEBU(QString("Scanning the queue, number of ready chunks: %1").arg(this->chunkScheduler.getNbReadyChunks()));
+   this->startDownloading(this->chunkScheduler.getPeers());
+}
 
-   while (numberOfDownloadThreadRunningCopy < NUMBER_OF_DOWNLOADER && !linkedPeersNotOccupied.isEmpty())
+/**
+  * Start downloading the best chunks of the given peers. A peer is kept until it is occupied or has no more chunk to download.
+  * Each chunk is given by 'ChunkScheduler' in O(log n).
+  * 'numberOfDownloadThreadRunning' counts the chunks being downloaded, a peer joining a chunk during the endgame isn't counted.
+  */
+void DownloadManager::startDownloading(QList<PM::IPeer*> freePeers)
+{
+   while (this->numberOfDownloadThreadRunning < NUMBER_OF_DOWNLOADER && !freePeers.isEmpty())
    {
-      if (chunkDownloader.isNull()) // We can ask many chunks to download from the same file.
-         if (!(fileDownload = static_cast<FileDownload*>(i.next())))
-             break;
+      PM::IPeer* peer = freePeers.first();
+      if (!peer->isAvailable() || !this->occupiedPeersDownloadingChunk.isPeerFree(peer))
+      {
+         freePeers.removeFirst();
+         continue;
+      }
 
-      if (fileDownload->isStatusErroneous())
+      FileDownload* fileDownload = nullptr;
+      QSharedPointer<ChunkDownloader> chunkDownloader = this->chunkScheduler.getAChunkToDownload(peer, fileDownload);
+      if (chunkDownloader.isNull())
+      {
+         freePeers.removeFirst();
          continue;
+      }
 
-      chunkDownloader = fileDownload->getAChunkToDownload();
+      if (!fileDownload->prepareToDownload(chunkDownloader))
+         continue; // The file status or the chunk has changed or the chunk is copied from a local file, thus the scheduler has been updated.
 
-      if (chunkDownloader.isNull())
+      // During the endgame the peer may join a chunk already being downloaded, see 'ChunkDownloader::startARace()'.
+      const bool racing = chunkDownloader->isDownloading();
+
+      if (!racing && fileDownload->isSmall() && this->startABatch(peer, chunkDownloader))
+      {
+         this->numberOfDownloadThreadRunning++;
          continue;
+      }
 
-      if (PM::IPeer* currentPeer = chunkDownloader->startDownloading())
+      if (chunkDownloader->startDownloading())
       {
+         if (racing)
+            continue;
+
          connect(chunkDownloader.data(), &ChunkDownloader::downloadFinished, this, &DownloadManager::chunkDownloaderFinished, Qt::DirectConnection);
-         linkedPeersNotOccupied -= currentPeer;
          this->numberOfDownloadThreadRunning++;
-         numberOfDownloadThreadRunningCopy = this->numberOfDownloadThreadRunning;
+      }
+      else
+      {
+         // The chunk will be tried again the next time one of its peers becomes free.
+         this->chunkScheduler.update(chunkDownloader.data());
+         freePeers.removeFirst();
       }
    }
+}
 
-   L_DEBU("Scanning terminated");
+/**
+  * Download the chunk of a small file with the ones of other small files owned by the same peer.
+  * Their files are created in one pass before sending a single 'GetChunks' request, see 'ChunkBatch'.
+  * @return 'false' if there is no other chunk to download from the peer, in this case 'first' must be downloaded alone.
+  */
+bool DownloadManager::startABatch(PM::IPeer* peer, const QSharedPointer<ChunkDownloader>& first)
+{
+   static const int BATCH_MAX_CHUNKS = static_cast<int>(SETTINGS.get<quint32>("batch_max_chunks"));
+   if (BATCH_MAX_CHUNKS < 2)
+      return false;
+
+   QList<QSharedPointer<ChunkDownloader>> chunkDownloaders { first };
+
+   const auto chunksToBatch = this->chunkScheduler.getChunksToBatch(peer, first.data(), BATCH_MAX_CHUNKS - 1);
+   for (QListIterator<QPair<FileDownload*, QSharedPointer<ChunkDownloader>>> i(chunksToBatch); i.hasNext();)
+   {
+      const auto& chunk = i.next();
+      if (!chunk.second.isNull() && chunk.first->prepareToDownload(chunk.second))
+         chunkDownloaders << chunk.second;
+   }
+
+   if (chunkDownloaders.size() < 2)
+      return false;
+
+   QSharedPointer<ChunkBatch> batch = (new ChunkBatch(chunkDownloaders, peer, this->occupiedPeersDownloadingChunk, this->peerConcurrency, this->transferRateCalculator, this->bandwidthLimiter, this->threadPool))->grabStrongRef();
+   connect(batch.data(), &ChunkBatch::batchFinished, this, &DownloadManager::chunkBatchFinished, Qt::DirectConnection);
+
+   if (!batch->start())
+      return false;
+
+   this->chunkBatches << batch;
+   return true;
 }
 
 /**
@@ -432,6 +491,22 @@ void DownloadManager::chunkDownloaderFinished()
    this->numberOfDownloadThreadRunning--;
 }
 
+void DownloadManager::chunkBatchFinished(ChunkBatch* batch)
+{
+   QSharedPointer<ChunkBatch> batchRef; // The batch must live until the end of this method.
+   for (int i = 0; i < this->chunkBatches.size(); i++)
+      if (this->chunkBatches[i].data() == batch)
+      {
+         batchRef = this->chunkBatches.takeAt(i);
+         break;
+      }
+
+   L_DEBU(QString("DownloadManager::chunkBatchFinished, numberOfDownloadThreadRunning = %1").arg(this->numberOfDownloadThreadRunning));
+   this->numberOfDownloadThreadRunning--;
+
+   this->occupiedPeersDownloadingChunk.setPeerAsFree(batch->getPeer());
+}
+
 /**
   * When a download status become erroneous a timer is activated. This will check
   * the erroneous downloads periodically.
@@ -446,46 +521,27 @@ void DownloadManager::downloadStatusBecomeErroneous(Download* download)
 
 /**
   * Load the queue, called once at the beginning of the program.
-  * Will start the timer to save periodically the queue.
+  * The changes of the queue are then journaled, see 'QueueJournal'.
   */
 void DownloadManager::loadQueueFromFile()
 {
-   Protos::Queue::Queue savedQueue = DownloadQueue::loadFromFile();
+   Protos::Queue::Queue savedQueue = this->downloadQueue.loadFromFile();
 
    for (int i = 0; i < savedQueue.entry_size(); i++)
    {
       const Protos::Queue::Queue_Entry& entry = savedQueue.entry(i);
-      this->addDownload(
+      Download* download = this->addDownload(
          entry.remote_entry(),
          entry.local_entry(),
          this->peerManager->createPeer(entry.peer_source_id().hash(), Common::ProtoHelper::getStr(entry, &Protos::Queue::Queue::Entry::peer_source_nick)),
          entry.status()
       );
-   }
-
-   this->queueLoaded = true;
-   this->saveTimer.start();
-}
 
-void DownloadManager::saveQueueToFile()
-{
-   if (this->queueChanged && this->queueLoaded)
-   {
-      L_DEBU("Persisting queue . . .");
-
-      this->downloadQueue.saveToFile();
-      this->queueChanged = false;
-
-      L_DEBU("Persisting queue finished");
+      if (FileDownload* fileDownload = dynamic_cast<FileDownload*>(download))
+         fileDownload->restoreDownloadedRanges(entry);
    }
-}
 
-/**
-  * Called each time the queue is modified.
-  */
-void DownloadManager::setQueueChanged()
-{
-   this->queueChanged = true;
+   this->downloadQueue.startJournaling();
 }
 
 const quint32 DownloadManager::MIN_DOWNLOAD_THREAD_STACK_SIZE(64 * 1024);
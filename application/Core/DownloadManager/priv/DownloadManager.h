@@ -25,6 +25,7 @@
 #include <QMultiHash>
 
 #include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
 #include <Common/ThreadPool.h>
 
 #include <Core/FileManager/IFileManager.h>
@@ -35,6 +36,9 @@
 #include <priv/DownloadPredicate.h>
 #include <priv/OccupiedPeers.h>
 #include <priv/LinkedPeers.h>
+#include <priv/ChunkScheduler.h>
+#include <priv/ChunkBatch.h>
+#include <priv/PeerConcurrency.h>
 #include <priv/Log.h>
 
 namespace PM
@@ -76,6 +80,7 @@ namespace DM
       QList<QSharedPointer<IChunkDownloader>> getTheOldestUnfinishedChunks(int n);
 
       int getDownloadRate();
+      void setRateLimits(quint32 rate, quint32 ratePerPeer);
 
    private slots:
       void peerBecomesAvailable(PM::IPeer* peer);
@@ -91,15 +96,14 @@ namespace DM
       void scanTheQueue();
       void restartErroneousDownloads();
       void chunkDownloaderFinished();
+      void chunkBatchFinished(ChunkBatch* batch);
       void downloadStatusBecomeErroneous(Download* download);
 
    private:
+      void startDownloading(QList<PM::IPeer*> freePeers);
+      bool startABatch(PM::IPeer* peer, const QSharedPointer<ChunkDownloader>& first);
       void loadQueueFromFile();
 
-   private slots:
-      void saveQueueToFile();
-      void setQueueChanged();
-
    private:
       LOG_INIT_H("DownloadManager")
 
@@ -111,6 +115,9 @@ namespace DM
       LinkedPeers linkedPeers; // Number of 'ChunkDownloader' each peer owns.
 
       Common::TransferRateCalculator transferRateCalculator;
+      Common::BandwidthLimiter bandwidthLimiter;
+
+      PeerConcurrency peerConcurrency; // The number of chunks downloaded simultaneously from each peer.
 
       OccupiedPeers occupiedPeersAskingForHashes;
       OccupiedPeers occupiedPeersAskingForEntries;
@@ -118,14 +125,13 @@ namespace DM
 
       Common::ThreadPool threadPool;
 
+      ChunkScheduler chunkScheduler; // Must be deleted after the downloads.
       DownloadQueue downloadQueue;
 
+      QList<QSharedPointer<ChunkBatch>> chunkBatches; // Each batch counts as one download thread.
+
       int numberOfDownloadThreadRunning;
 
       QTimer startErroneousDownloadTimer; // When one or more downloads are in error state, we try to relaunch them periodically.
-
-      QTimer saveTimer; // To know when to save the queue, for example each 5min.
-      bool queueChanged;
-      bool queueLoaded;
    };
 }
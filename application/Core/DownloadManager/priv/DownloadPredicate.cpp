@@ -39,13 +39,3 @@ bool IsComplete::operator() (const Download* download) const
 {
    return download->getStatus() == COMPLETE;
 }
-
-IsContainedInAList::IsContainedInAList(const QList<quint64>& downloadIDs) :
-   downloadIDs(downloadIDs.begin(), downloadIDs.end())
-{
-}
-
-bool IsContainedInAList::operator() (const Download* download) const
-{
-   return this->downloadIDs.contains(download->getID());
-}
@@ -18,9 +18,6 @@
 
 #pragma once
 
-#include <QSet>
-#include <QList>
-
 namespace DM
 {
    class Download;
@@ -45,13 +42,4 @@ namespace DM
    {
       bool operator() (const Download* download) const;
    };
-
-   struct IsContainedInAList : public DownloadPredicate
-   {
-      IsContainedInAList(const QList<quint64>& downloadIDs);
-      bool operator() (const Download* download) const;
-
-   private:
-      QSet<quint64> downloadIDs; // We us a QSet to decrease the complexity.
-   };
 }
@@ -21,8 +21,9 @@ using namespace DM;
 
 #include <QSet>
 
-#include <Common/PersistentData.h>
-#include <Common/Constants.h>
+#include <limits>
+#include <algorithm>
+
 #include <Common/ProtoHelper.h>
 
 #include <priv/Download.h>
@@ -35,19 +36,25 @@ using namespace DM;
   *
   * Goals:
   *  - Manage a queue of downloads.
-  *  - Index queue by download peers to improve performance.
+  *  - Keep the downloads in a tree sorted by rank, thus the access by position, insertions, removals and moves are in O(log n).
+  *  - Index queue by download IDs and download peers to improve performance.
   *  - Save some positions (markers) to improve iterating performance (see the 'ScanningIterator' class).
-  *  - Persist/load the queue to/from a file.
+  *  - Give to each download a rank which follows the order of the queue (see 'insertWithRank(..)').
+  *  - Persist/load the queue to/from a file, each change is journaled (see 'QueueJournal').
   */
 
 DownloadQueue::DownloadQueue()
 {
+   this->downloads.setSortedFunction([](Download* d1, Download* d2) { return d1->getQueueRank() < d2->getQueueRank(); });
 }
 
 DownloadQueue::~DownloadQueue()
 {
-   while (!this->downloads.isEmpty())
-      delete this->downloads.takeFirst();
+   this->journal.deactivate(); // The downloads are only deleted from memory, the queue is kept as is.
+
+   const QList<Download*> downloads = this->downloads.toList();
+   this->downloads.clear();
+   qDeleteAll(downloads);
 
    for (QListIterator<Marker> i(this->markers); i.hasNext();)
       delete i.next().predicate;
@@ -62,20 +69,25 @@ void DownloadQueue::insert(int position, Download* download)
 {
    this->updateMarkersInsert(position, download);
 
-   this->downloads.insert(position, download);
+   this->insertWithRank(position, download);
+   this->downloadsIndexedByID.insert(download->getID(), download);
    this->downloadsIndexedBySourcePeer.insert(download->getPeerSource(), download);
+   this->journal.downloadAdded(download);
+   connect(download, &Download::entryChanged, this, &DownloadQueue::downloadEntryChanged, Qt::DirectConnection);
 
    if (FileDownload* fileDownload = dynamic_cast<FileDownload*>(download))
    {
       this->downloadsIndexedByName.insert(download->getLocalEntry().name(), download);
       this->downloadsSortedByTime.insert(QTime(), fileDownload);
       connect(fileDownload, &FileDownload::lastTimeGetAllUnfinishedChunksChanged, this, &DownloadQueue::fileDownloadTimeChanged, Qt::QueuedConnection);
+      connect(fileDownload, &FileDownload::newHashKnown, this, &DownloadQueue::newHashKnown, Qt::DirectConnection);
+      connect(fileDownload, &FileDownload::downloadedRangesChanged, this, &DownloadQueue::downloadedRangesChanged, Qt::DirectConnection);
    }
 }
 
 Download* DownloadQueue::operator[] (int position) const
 {
-   return this->downloads[position];
+   return this->downloads.getFromIndex(position);
 }
 
 int DownloadQueue::find(Download* download) const
@@ -88,14 +100,14 @@ void DownloadQueue::remove(int position)
    this->updateMarkersRemove(position);
 
    Download* download = (*this)[position];
+   this->removeFromIndexes(download);
+   this->downloads.removeFromIndex(position);
+   this->journal.downloadsRemoved({ download->getID() });
+}
 
-   if (FileDownload* fileDownload = dynamic_cast<FileDownload*>(download))
-      this->downloadsSortedByTime.remove(fileDownload->getLastTimeGetAllUnfinishedChunks(), fileDownload);
-
-   this->downloadsIndexedByName.remove(download->getLocalEntry().name(), download);
-   this->downloadsIndexedBySourcePeer.remove(download->getPeerSource(), download);
-   this->downloads.removeAt(position);
-   this->erroneousDownloads.removeOne(download);
+QList<Download*> DownloadQueue::toList() const
+{
+   return this->downloads.toList();
 }
 
 void DownloadQueue::peerBecomesAvailable(PM::IPeer* peer)
@@ -109,132 +121,118 @@ bool DownloadQueue::isAPeerSource(PM::IPeer* peer) const
    return this->downloadsIndexedBySourcePeer.contains(peer);
 }
 
-void DownloadQueue::moveDownloads(const QList<quint64>& downloadIDRefs, const QList<quint64>& downloadIDs, Protos::GUI::MoveDownloads::Position position)
+/**
+  * Return the first 'n' file downloads following the given one which have the same peer source and whose hashes must be asked.
+  * The scan is bounded (see 'HASHES_PREFETCH_SCAN_FACTOR') to stay cheap when the downloads of several peers are mixed.
+  */
+QList<FileDownload*> DownloadQueue::getNextDownloadsWithoutHashes(FileDownload* fileDownload, int n) const
 {
-   if (downloadIDRefs.isEmpty() || downloadIDs.isEmpty())
-      return;
+   QList<FileDownload*> nextDownloads;
 
-   QList<quint64> downloadIDsCopy(downloadIDs);
-   QList<quint64> downloadIDRefsCopy(downloadIDRefs);
+   const int position = this->downloads.indexOf(fileDownload);
+   if (n <= 0 || position == -1)
+      return nextDownloads;
 
-   quint64 downloadIDRef = downloadIDRefsCopy.size() == 1 ? downloadIDRefsCopy.first() : 0;
-   int iRef = -1; // Index of the download reference, -1 if unknown.
-   QList<int> iToMove;
+   int nbToScan = n * HASHES_PREFETCH_SCAN_FACTOR;
+   for (Common::SortedArray<Download*>::iterator i = this->downloads.iteratorOfIndex(position + 1); i != this->downloads.end() && nextDownloads.size() < n && nbToScan-- > 0; ++i)
+   {
+      FileDownload* nextDownload = dynamic_cast<FileDownload*>(*i);
+      if (nextDownload && nextDownload->getPeerSource() == fileDownload->getPeerSource() && nextDownload->hashesNeeded())
+         nextDownloads << nextDownload;
+   }
 
-   for (int i = 0; i < this->downloads.size(); i++)
+   return nextDownloads;
+}
+
+/**
+  * Move the given downloads before the first reference or after the last one, the moved downloads keep their order.
+  * Each download is found by its ID then removed and reinserted with a new rank, the complexity is O(k log n).
+  */
+void DownloadQueue::moveDownloads(const QList<quint64>& downloadIDRefs, const QList<quint64>& downloadIDs, Protos::GUI::MoveDownloads::Position position)
+{
+   Download* downloadRef = nullptr;
+   for (QListIterator<quint64> i(downloadIDRefs); i.hasNext();)
    {
-      int j;
-      if ((j = downloadIDsCopy.indexOf(this->downloads[i]->getID())) != -1)
-      {
-         if (iRef != -1)
-         {
-            const int whereToInsert = position == Protos::GUI::MoveDownloads::BEFORE ? iRef++ : ++iRef;
-            const int whereToRemove = i + 1;
+      Download* download = this->downloadsIndexedByID.value(i.next());
+      if (download && (!downloadRef || (position == Protos::GUI::MoveDownloads::BEFORE) == (download->getQueueRank() < downloadRef->getQueueRank())))
+         downloadRef = download;
+   }
 
-            this->updateMarkersMove(whereToInsert, whereToRemove, this->downloads[i]);
+   if (!downloadRef)
+      return;
 
-            this->downloads.insert(whereToInsert, this->downloads[i]);
-            this->downloads.removeAt(whereToRemove);
-            continue;
-         }
-         else
-            iToMove << i;
+   // The reference stays in place.
+   QSet<Download*> downloadsToMoveSet;
+   for (QListIterator<quint64> i(downloadIDs); i.hasNext();)
+      if (Download* download = this->downloadsIndexedByID.value(i.next()))
+         if (download != downloadRef)
+            downloadsToMoveSet.insert(download);
 
-         downloadIDsCopy.removeAt(j);
-      }
+   QList<Download*> downloadsToMove(downloadsToMoveSet.begin(), downloadsToMoveSet.end());
+   std::sort(downloadsToMove.begin(), downloadsToMove.end(), [](Download* d1, Download* d2) { return d1->getQueueRank() < d2->getQueueRank(); });
 
-      // If the download reference isn't defined we have to search one among 'downloadIDRefsCopy'.
-      int k;
-      if (downloadIDRef == 0 && (k = downloadIDRefsCopy.indexOf(this->downloads[i]->getID())) != -1)
-      {
-         if (position == Protos::GUI::MoveDownloads::BEFORE)
-         {
-            downloadIDRef = this->downloads[i]->getID();
-         }
-         else
-         {
-            if (downloadIDRefsCopy.size() == 1)
-               downloadIDRef = downloadIDRefsCopy.first();
-            else
-               downloadIDRefsCopy.removeAt(k);
-         }
-      }
+   for (QListIterator<Download*> i(downloadsToMove); i.hasNext();)
+   {
+      const int whereToRemove = this->downloads.indexOf(i.next());
+      this->updateMarkersRemove(whereToRemove);
+      this->downloads.removeFromIndex(whereToRemove);
+   }
 
-      if (this->downloads[i]->getID() == downloadIDRef)
-      {
-         iRef = i;
-         int shift = 0;
-         for (int j = 0; j < iToMove.size(); j++)
-         {
-            if (iToMove[j] == iRef && position == Protos::GUI::MoveDownloads::BEFORE)
-               iRef++;
-            else
-            {
-               const int whereToInsert = position == Protos::GUI::MoveDownloads::AFTER ? iRef + 1 : iRef;
-               const int whereToRemove = iToMove[j] + shift;
-
-               this->updateMarkersMove(whereToInsert, whereToRemove, this->downloads[whereToRemove]);
-
-               this->downloads.insert(whereToInsert, this->downloads[whereToRemove]);
-               this->downloads.removeAt(whereToRemove);
-               shift--;
-            }
-         }
-         iToMove.clear();
-      }
+   int whereToInsert = this->downloads.indexOf(downloadRef) + (position == Protos::GUI::MoveDownloads::AFTER ? 1 : 0);
+   for (QListIterator<Download*> i(downloadsToMove); i.hasNext(); whereToInsert++)
+   {
+      Download* download = i.next();
+      this->updateMarkersInsert(whereToInsert, download);
+      this->insertWithRank(whereToInsert, download);
+      this->journal.downloadRankChanged(download);
    }
 }
 
 /**
   * Remove all download for which the given predicate is true.
-  * It uses QList::erase(iterator begin, iterator end) to improve the performance.
   * @return Returns 'true' is the list has been altered.
   */
 bool DownloadQueue::removeDownloads(const DownloadPredicate& predicate)
 {
-   bool queueChanged = false;
+   QList<quint64> IDsToDelete;
+   for (Common::SortedArray<Download*>::iterator i = this->downloads.begin(), end = this->downloads.end(); i != end; ++i)
+      if (predicate(*i))
+         IDsToDelete << (*i)->getID();
+
+   return this->removeDownloads(IDsToDelete);
+}
+
+/**
+  * Remove the downloads having the given IDs, the complexity is O(k log n).
+  * @return Returns 'true' is the list has been altered.
+  */
+bool DownloadQueue::removeDownloads(const QList<quint64>& IDs)
+{
    QList<Download*> downloadsToDelete;
-   QList<Download*>::iterator i = this->downloads.begin();
-   QList<Download*>::iterator j = i;
-   int position = 0; // Only used to update the markers.
-   while (j != this->downloads.end())
+   QList<quint64> IDsToDelete;
+   for (QListIterator<quint64> i(IDs); i.hasNext();)
    {
-      if (predicate(*j))
-      {
-         queueChanged = true;
-         (*j)->setAsDeleted();
-         if (FileDownload* fileDownload = dynamic_cast<FileDownload*>(*j))
-         {
-            this->downloadsIndexedByName.remove((*j)->getLocalEntry().name(), *j);
-            this->downloadsSortedByTime.remove(fileDownload->getLastTimeGetAllUnfinishedChunks(), fileDownload);
-         }
-         this->downloadsIndexedBySourcePeer.remove((*j)->getPeerSource(), *j);
-         downloadsToDelete << *j;
-         this->erroneousDownloads.removeOne(*j);
-         ++j;
-
-         this->updateMarkersRemove(position);
-      }
-      else if (i != j)
-      {
-         j = this->downloads.erase(i, j);
-         i = j;
-      }
-      else
-      {
-         ++j;
-         ++i;
-         position++;
-      }
+      Download* download = this->downloadsIndexedByID.value(i.next());
+      if (!download)
+         continue;
+
+      download->setAsDeleted();
+
+      const int position = this->downloads.indexOf(download);
+      this->updateMarkersRemove(position);
+      this->removeFromIndexes(download);
+      this->downloads.removeFromIndex(position);
+
+      downloadsToDelete << download;
+      IDsToDelete << download->getID();
    }
 
-   if (i != j)
-      this->downloads.erase(i, j);
+   this->journal.downloadsRemoved(IDsToDelete);
 
-   for (QListIterator<Download*> k(downloadsToDelete); k.hasNext();)
-      k.next()->remove();
+   for (QListIterator<Download*> i(downloadsToDelete); i.hasNext();)
+      i.next()->remove();
 
-   return queueChanged;
+   return !downloadsToDelete.isEmpty();
 }
 
 /**
@@ -242,18 +240,13 @@ bool DownloadQueue::removeDownloads(const DownloadPredicate& predicate)
   */
 bool DownloadQueue::pauseDownloads(QList<quint64> IDs, bool pause)
 {
-   QSet<quint64> IDsRemaining(IDs.begin(), IDs.end());
-
    bool stateChanged = false;
 
-   for (QListIterator<Download*> i(this->downloads); i.hasNext() && !IDsRemaining.isEmpty();)
+   for (QListIterator<quint64> i(IDs); i.hasNext();)
    {
-      Download* download = i.next();
-      if (IDsRemaining.remove(download->getID()))
-      {
-         if (download->pause(pause))
-            stateChanged = true;
-      }
+      Download* download = this->downloadsIndexedByID.value(i.next());
+      if (download && download->pause(pause))
+         stateChanged = true;
    }
 
    return stateChanged;
@@ -282,7 +275,7 @@ bool DownloadQueue::isEntryAlreadyQueued(const Protos::Common::Entry& localEntry
 
 void DownloadQueue::setDownloadAsErroneous(Download* download)
 {
-   this->erroneousDownloads << download;
+   this->erroneousDownloads.append(download);
 }
 
 /**
@@ -316,50 +309,15 @@ QList<QSharedPointer<IChunkDownloader>> DownloadQueue::getTheOldestUnfinishedChu
   */
 Protos::Queue::Queue DownloadQueue::loadFromFile()
 {
-   Protos::Queue::Queue savedQueue;
-
-   try
-   {
-      Common::PersistentData::getValue(Common::Constants::FILE_QUEUE, savedQueue, Common::Global::DataFolderType::LOCAL);
-      if (static_cast<int>(savedQueue.version()) != FILE_QUEUE_VERSION)
-      {
-         L_USER(QString(QObject::tr("The version (%1) of the queue file \"%2\" doesn't match the current version (%3). Queue will be reset.")).arg(savedQueue.version()).arg(Common::Constants::FILE_QUEUE).arg(FILE_QUEUE_VERSION));
-         Common::PersistentData::rmValue(Common::Constants::FILE_QUEUE, Common::Global::DataFolderType::LOCAL);
-         savedQueue.Clear();
-      }
-   }
-   catch (Common::UnknownValueException& e)
-   {
-      L_WARN(QString("The download queue file cache cannot be retrieved (the file doesn't exist): %1").arg(Common::Constants::FILE_QUEUE));
-   }
-   catch (...)
-   {
-      L_WARN(QString("The download queue file cache cannot be retrieved (Unknown exception): %1").arg(Common::Constants::FILE_QUEUE));
-   }
-
-   return savedQueue;
+   return this->journal.load();
 }
 
-void DownloadQueue::saveToFile() const
+/**
+  * Called once the loaded downloads have been inserted, the queue is saved then each change is journaled.
+  */
+void DownloadQueue::startJournaling()
 {
-   Protos::Queue::Queue savedQueue;
-   savedQueue.set_version(FILE_QUEUE_VERSION);
-
-   for (QListIterator<Download*> i(this->downloads); i.hasNext();)
-   {
-      Protos::Queue::Queue::Entry* queueEntry = savedQueue.add_entry();
-      Download* download = i.next();
-      download->populateQueueEntry(queueEntry);
-   }
-
-   try
-   {
-      Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, savedQueue, Common::Global::DataFolderType::LOCAL);
-   }
-   catch (Common::PersistentDataIOException& err)
-   {
-      L_ERRO(err.message);
-   }
+   this->journal.rebase(this->downloads.toList());
 }
 
 void DownloadQueue::fileDownloadTimeChanged(QTime oldTime)
@@ -369,6 +327,21 @@ void DownloadQueue::fileDownloadTimeChanged(QTime oldTime)
    this->downloadsSortedByTime.insert(fileDownload->getLastTimeGetAllUnfinishedChunks(), fileDownload);
 }
 
+void DownloadQueue::downloadEntryChanged()
+{
+   this->journal.downloadChanged(static_cast<Download*>(this->sender()));
+}
+
+void DownloadQueue::newHashKnown(int num, const Common::Hash& hash)
+{
+   this->journal.newHash(static_cast<Download*>(this->sender()), num, hash);
+}
+
+void DownloadQueue::downloadedRangesChanged(int num, const QMap<int, int>& ranges)
+{
+   this->journal.downloadedRangesChanged(static_cast<Download*>(this->sender()), num, ranges);
+}
+
 void DownloadQueue::updateMarkersInsert(int position, Download* download)
 {
    for (QMutableListIterator<Marker> i(this->markers); i.hasNext();)
@@ -397,24 +370,55 @@ void DownloadQueue::updateMarkersRemove(int position)
    }
 }
 
-void DownloadQueue::updateMarkersMove(int insertPosition, int removePosition, Download* download)
+/**
+  * Give to the download a rank between the ones of the downloads around the given position and insert it in the queue.
+  * The downloads appended to the queue are spaced by 'QUEUE_RANK_GAP', the ones inserted one after the other
+  * between two downloads are spaced by 'QUEUE_RANK_STEP'. All the ranks are recomputed when there is no room left.
+  */
+void DownloadQueue::insertWithRank(int position, Download* download)
 {
-   for (QMutableListIterator<Marker> i(this->markers); i.hasNext();)
+   for (;;)
    {
-      Marker& m = i.next();
-      if (!(*m.predicate)(download))
-      {
-         if (insertPosition <= m.position)
-            m.position++;
-         if (removePosition < m.position)
-            m.position--;
-      }
-      else
+      const quint64 lower = position > 0 ? this->downloads.getFromIndex(position - 1)->getQueueRank() : 0;
+      const bool isLast = position == this->downloads.size();
+      const quint64 upper = isLast ? std::numeric_limits<quint64>::max() : this->downloads.getFromIndex(position)->getQueueRank();
+
+      const quint64 rank = lower + qMin(isLast ? QUEUE_RANK_GAP : QUEUE_RANK_STEP, (upper - lower) / 2);
+      if (upper > lower && rank != lower)
       {
-         if (removePosition > m.position && insertPosition < m.position)
-            m.position = insertPosition;
-         if (removePosition < m.position && insertPosition > m.position)
-            m.position--;
+         download->setQueueRank(rank);
+         this->downloads.insert(download);
+         return;
       }
+
+      this->renumberRanks();
+   }
+}
+
+void DownloadQueue::removeFromIndexes(Download* download)
+{
+   if (FileDownload* fileDownload = dynamic_cast<FileDownload*>(download))
+   {
+      this->downloadsIndexedByName.remove(download->getLocalEntry().name(), download);
+      this->downloadsSortedByTime.remove(fileDownload->getLastTimeGetAllUnfinishedChunks(), fileDownload);
+   }
+
+   this->downloadsIndexedByID.remove(download->getID());
+   this->downloadsIndexedBySourcePeer.remove(download->getPeerSource(), download);
+   this->erroneousDownloads.removeOne(download);
+}
+
+/**
+  * The order of the downloads is kept thus the tree stays valid.
+  */
+void DownloadQueue::renumberRanks()
+{
+   L_DEBU("Renumbering the ranks of the queue");
+
+   quint64 rank = 0;
+   for (Common::SortedArray<Download*>::iterator i = this->downloads.begin(), end = this->downloads.end(); i != end; ++i)
+   {
+      (*i)->setQueueRank(rank += QUEUE_RANK_GAP);
+      this->journal.downloadRankChanged(*i);
    }
 }
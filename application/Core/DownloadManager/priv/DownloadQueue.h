@@ -21,6 +21,7 @@
 #include <typeinfo>
 
 #include <QList>
+#include <QHash>
 #include <QMultiHash>
 #include <QMultiMap>
 #include <QTime>
@@ -30,10 +31,13 @@
 #include <Protos/queue.pb.h>
 
 #include <Common/Hash.h>
+#include <Common/Containers/SortedArray.h>
+#include <Common/Containers/IndexedList.h>
 
 #include <IDownload.h>
 #include <IChunkDownloader.h>
 #include <priv/DownloadPredicate.h>
+#include <priv/QueueJournal.h>
 
 namespace PM { class IPeer; }
 
@@ -54,12 +58,14 @@ namespace DM
       Download* operator[] (int position) const;
       int find(Download* download) const;
       void remove(int position);
+      QList<Download*> toList() const;
 
       void peerBecomesAvailable(PM::IPeer* peer);
       bool isAPeerSource(PM::IPeer* peer) const;
 
       void moveDownloads(const QList<quint64>& downloadIDRefs, const QList<quint64>& downloadIDs, Protos::GUI::MoveDownloads::Position position);
       bool removeDownloads(const DownloadPredicate& predicate);
+      bool removeDownloads(const QList<quint64>& IDs);
       bool pauseDownloads(QList<quint64> IDs, bool pause = true);
       bool isEntryAlreadyQueued(const Protos::Common::Entry& localEntry);
 
@@ -67,12 +73,16 @@ namespace DM
       Download* getAnErroneousDownload();
 
       QList<QSharedPointer<IChunkDownloader>> getTheOldestUnfinishedChunks(int n);
+      QList<FileDownload*> getNextDownloadsWithoutHashes(FileDownload* fileDownload, int n) const;
 
-      static Protos::Queue::Queue loadFromFile();
-      void saveToFile() const;
+      Protos::Queue::Queue loadFromFile();
+      void startJournaling();
 
    private slots:
       void fileDownloadTimeChanged(QTime oldTime);
+      void downloadEntryChanged();
+      void newHashKnown(int num, const Common::Hash& hash);
+      void downloadedRangesChanged(int num, const QMap<int, int>& ranges);
 
    private:
       struct Marker;
@@ -87,23 +97,33 @@ namespace DM
 
       private:
          Marker* marker;
-         DownloadQueue& queue;
          int position;
+         Common::SortedArray<Download*>::iterator current;
+         const Common::SortedArray<Download*>::iterator end;
       };
 
    private:
+      template <typename P>
+      Marker* getMarker();
+
       void updateMarkersInsert(int position, Download* download);
       void updateMarkersRemove(int position);
-      void updateMarkersMove(int insertPosition, int removePosition, Download* download);
+
+      void insertWithRank(int position, Download* download);
+      void removeFromIndexes(Download* download);
+      void renumberRanks();
 
       struct Marker { Marker(DownloadPredicate* p) : predicate(p), position(0) {} DownloadPredicate* predicate; int position; };
       QList<Marker> markers; ///< Saved some positions like the first downloadable file or the first directory. The goal is to speed up the scan. See the class 'ScanningIterator'.
 
-      QList<Download*> downloads; ///< All downloads, it also includes erroneous downloads.
-      QList<Download*> erroneousDownloads;
+      Common::SortedArray<Download*> downloads; ///< All downloads sorted by their rank, it also includes erroneous downloads.
+      QHash<quint64, Download*> downloadsIndexedByID;
+      Common::IndexedList<Download*> erroneousDownloads;
       QMultiMap<QTime, FileDownload*> downloadsSortedByTime; // See 'FileDownload::lastTimeGetAllUnfinishedChunks'.
       QMultiHash<PM::IPeer*, Download*> downloadsIndexedBySourcePeer;
       QMultiMap<std::string, Download*> downloadsIndexedByName;
+
+      QueueJournal journal; // Persists each change of the queue.
    };
 }
 
@@ -111,24 +131,15 @@ namespace DM
   * @class DM::DownloadQueue::ScanningIterator
   *
   * To iterate over the queue for all downloads which match a predicate 'P'.
+  * The queue must not be modified during the iteration.
   */
 template <typename P>
 DM::DownloadQueue::ScanningIterator<P>::ScanningIterator(DM::DownloadQueue& queue) :
-   queue(queue)
+   marker(queue.getMarker<P>()),
+   position(this->marker->position),
+   current(queue.downloads.iteratorOfIndex(this->position)),
+   end(queue.downloads.end())
 {
-   // Search if a marker of type 'P' already exists.
-   for (QMutableListIterator<Marker> i(this->queue.markers); i.hasNext();)
-   {
-      this->marker = &i.next();
-      this->position = this->marker->position;
-      if (typeid(P) == typeid(*this->marker->predicate))
-         return;
-   }
-
-   // No marker found, we create a new one.
-   this->queue.markers << Marker(new P);
-   this->marker = &this->queue.markers.last();
-   this->position = this->marker->position;
 }
 
 /**
@@ -137,9 +148,12 @@ DM::DownloadQueue::ScanningIterator<P>::ScanningIterator(DM::DownloadQueue& queu
 template <typename P>
 DM::Download* DM::DownloadQueue::ScanningIterator<P>::next()
 {
-   while (this->position < this->queue.size())
+   while (this->current != this->end)
    {
-      Download* download = this->queue[this->position++];
+      Download* download = *this->current;
+      ++this->current;
+      this->position++;
+
       if (!(*this->marker->predicate)(download))
       {
          if (this->position - 1 == this->marker->position)
@@ -151,3 +165,20 @@ DM::Download* DM::DownloadQueue::ScanningIterator<P>::next()
    }
    return 0;
 }
+
+/**
+  * Return the marker of the predicate 'P', a new one is created if it doesn't exist.
+  */
+template <typename P>
+DM::DownloadQueue::Marker* DM::DownloadQueue::getMarker()
+{
+   for (QMutableListIterator<Marker> i(this->markers); i.hasNext();)
+   {
+      Marker* marker = &i.next();
+      if (typeid(P) == typeid(*marker->predicate))
+         return marker;
+   }
+
+   this->markers << Marker(new P);
+   return &this->markers.last();
+}
@@ -21,9 +21,6 @@ using namespace DM;
 
 #include <QTimer>
 #include <QSet>
-#include <QRandomGenerator64>
-
-#include <limits>
 
 #include <Common/Settings.h>
 #include <Common/ProtoHelper.h>
@@ -40,22 +37,30 @@ FileDownload::FileDownload(
    LinkedPeers& linkedPeers,
    OccupiedPeers& occupiedPeersAskingForHashes,
    OccupiedPeers& occupiedPeersDownloadingChunk,
+   PeerConcurrency& peerConcurrency,
+   ChunkScheduler& chunkScheduler,
    Common::ThreadPool& threadPool,
    PM::IPeer* peerSource,
    const Protos::Common::Entry& remoteEntry,
    const Protos::Common::Entry& localEntry,
    Common::TransferRateCalculator& transferRateCalculator,
+   Common::BandwidthLimiter& bandwidthLimiter,
    Protos::Queue::Queue::Entry::Status status
 ) :
    Download(fileManager, peerSource, remoteEntry, localEntry),
    linkedPeers(linkedPeers),
    NB_CHUNK(this->remoteEntry.size() / Common::Constants::CHUNK_SIZE + (this->remoteEntry.size() % Common::Constants::CHUNK_SIZE == 0 ? 0 : 1)),
    nbChunkAsked(0),
+   endgame(false),
    occupiedPeersAskingForHashes(occupiedPeersAskingForHashes),
    occupiedPeersDownloadingChunk(occupiedPeersDownloadingChunk),
+   peerConcurrency(peerConcurrency),
+   chunkScheduler(chunkScheduler),
    threadPool(threadPool),
    nbHashesKnown(0),
-   transferRateCalculator(transferRateCalculator)
+   nbNextHashesToReceive(0),
+   transferRateCalculator(transferRateCalculator),
+   bandwidthLimiter(bandwidthLimiter)
 {
    L_DEBU(QString("New FileDownload: peer source = %1, remoteEntry: \n%2\nlocalEntry: \n%3").
       arg(this->peerSource->toStringLog()).
@@ -69,7 +74,7 @@ FileDownload::FileDownload(
    for (int i = 0; i < this->NB_CHUNK; i++)
    {
       QSharedPointer<ChunkDownloader> chunkDownloader = (i < this->remoteEntry.chunk_size() && this->remoteEntry.chunk(i).hash().size() > 0) ?
-         (new ChunkDownloader(this->linkedPeers, this->occupiedPeersDownloadingChunk, this->transferRateCalculator, this->threadPool, Common::Hash(this->remoteEntry.chunk(i).hash())))->grabStrongRef()
+         (new ChunkDownloader(this->linkedPeers, this->occupiedPeersDownloadingChunk, this->peerConcurrency, this->transferRateCalculator, this->bandwidthLimiter, this->threadPool, Common::Hash(this->remoteEntry.chunk(i).hash())))->grabStrongRef()
          : QSharedPointer<ChunkDownloader>();
 
       this->chunkDownloaders << chunkDownloader;
@@ -78,6 +83,7 @@ FileDownload::FileDownload(
       {
          this->nbHashesKnown++;
          this->connectChunkDownloaderSignals(this->chunkDownloaders.last());
+         this->chunkScheduler.add(this, chunkDownloader);
       }
    }
 }
@@ -92,6 +98,13 @@ FileDownload::~FileDownload()
       this->occupiedPeersAskingForHashes.setPeerAsFree(this->peerSource);
    }
 
+   for (QListIterator<QSharedPointer<ChunkDownloader>> i(this->chunkDownloaders); i.hasNext();)
+   {
+      auto chunkDownloader = i.next();
+      if (!chunkDownloader.isNull())
+         this->chunkScheduler.remove(chunkDownloader.data());
+   }
+
    this->chunksWithoutDownloader.clear();
    this->chunkDownloaders.clear();
 }
@@ -164,7 +177,7 @@ void FileDownload::peerSourceBecomesAvailable()
 }
 
 /**
-  * Add the known hashes.
+  * Add the known hashes and the ranges downloaded by the stripes.
   */
 void FileDownload::populateQueueEntry(Protos::Queue::Queue::Entry* entry) const
 {
@@ -173,6 +186,39 @@ void FileDownload::populateQueueEntry(Protos::Queue::Queue::Entry* entry) const
    for (int i = 0; i < this->chunkDownloaders.size() && i < entry->remote_entry().chunk_size(); i++)
       if (entry->remote_entry().chunk(i).hash().size() == 0 && !this->chunkDownloaders[i].isNull())
          entry->mutable_remote_entry()->mutable_chunk(i)->set_hash(this->chunkDownloaders[i]->getHash().getData(), Common::Hash::HASH_SIZE);
+
+   for (int i = 0; i < this->chunkDownloaders.size(); i++)
+   {
+      if (this->chunkDownloaders[i].isNull())
+         continue;
+
+      for (QMapIterator<int, int> j(this->chunkDownloaders[i]->getDownloadedRanges()); j.hasNext();)
+      {
+         j.next();
+         Protos::Queue::Queue::Entry::DownloadedRange* range = entry->add_downloaded_range();
+         range->set_chunk(i);
+         range->set_start(j.key());
+         range->set_end(j.value());
+      }
+   }
+}
+
+/**
+  * Give back the ranges downloaded by the stripes before the queue was saved, see 'populateQueueEntry(..)'.
+  * The chunks already being downloaded are left as they are, their data will be downloaded again.
+  */
+void FileDownload::restoreDownloadedRanges(const Protos::Queue::Queue::Entry& entry)
+{
+   for (int i = 0; i < entry.downloaded_range_size(); i++)
+   {
+      const Protos::Queue::Queue::Entry::DownloadedRange& range = entry.downloaded_range(i);
+      const int num = range.chunk();
+      if (num >= this->chunkDownloaders.size() || this->chunkDownloaders[num].isNull() || this->chunkDownloaders[num]->isDownloading())
+         continue;
+
+      const quint64 chunkSize = qMin<quint64>(Common::Constants::CHUNK_SIZE, this->remoteEntry.size() - quint64(num) * Common::Constants::CHUNK_SIZE);
+      this->chunkDownloaders[num]->restoreDownloadedRange(range.start(), qMin<quint64>(range.end(), chunkSize));
+   }
 }
 
 quint64 FileDownload::getDownloadedBytes() const
@@ -206,73 +252,55 @@ QSet<PM::IPeer*> FileDownload::getPeers() const
 }
 
 /**
-  * If there is a ChunkDownloader with a free peer (we do not already download from this peer) the return the chunk.
-  * The file is created on the fly with IFileManager::newFile(..) if we don't have the IChunks.
-  * @return The chunk to download, can return a null pointer if an error occurs.
+  * A chunk of the file can be given by the 'ChunkScheduler' only if the download isn't complete, paused, deleted or in error.
   */
-QSharedPointer<ChunkDownloader> FileDownload::getAChunkToDownload()
+bool FileDownload::isSchedulable() const
 {
-   if (this->status == COMPLETE || this->status == DELETED || this->status == PAUSED)
-      return QSharedPointer<ChunkDownloader>();
-
-   // Choose a chunk with the less number of peer. (rarest first).
-   // Choose first a partially downloaded chunk.
-   QList<QSharedPointer<ChunkDownloader>> chunksReadyToDownload;
-   int bestNbPeer = std::numeric_limits<int>::max();
-   for (QListIterator<QSharedPointer<ChunkDownloader>> i(this->chunkDownloaders); i.hasNext();)
-   {
-      auto chunkDownloader = i.next();
-      if (chunkDownloader.isNull())
-         continue;
-
-      const int nbPeer = chunkDownloader->isReadyToDownload();
+   return this->status != COMPLETE && this->status != DELETED && this->status != PAUSED && !this->isStatusErroneous();
+}
 
-      if (nbPeer == 0)
-      {
-         continue;
-      }
-      else
-      {
-         if (chunkDownloader->isPartiallyDownloaded())
-         {
-            chunksReadyToDownload.clear();
-            chunksReadyToDownload << chunkDownloader;
-            break;
-         }
-         else if (nbPeer == bestNbPeer)
-            chunksReadyToDownload << chunkDownloader;
-         else if (nbPeer < bestNbPeer)
-         {
-            chunksReadyToDownload.clear();
-            chunksReadyToDownload << chunkDownloader;
-            bestNbPeer = nbPeer;
-         }
-      }
-   }
+void FileDownload::setQueueRank(quint64 rank)
+{
+   Download::setQueueRank(rank);
+   this->updateChunkScheduler();
+}
 
-   if (chunksReadyToDownload.isEmpty())
-      return QSharedPointer<ChunkDownloader>();
+/**
+  * Called before downloading a chunk given by the 'ChunkScheduler'.
+  * The file is created on the fly with IFileManager::newFile(..) if we don't have the IChunks.
+  * @return 'false' if the chunk can't be downloaded, for instance if an error occurs.
+  */
+/**
+  * A small file has only one chunk, its chunk can be downloaded in a batch with other ones, see 'ChunkBatch'.
+  */
+bool FileDownload::isSmall() const
+{
+   return this->NB_CHUNK == 1;
+}
 
-   // If there is many chunk with the same number of peer we choose randomly one of them.
-   QSharedPointer<ChunkDownloader> chunkDownloader =
-         chunksReadyToDownload.size() == 1
-            ? chunksReadyToDownload.first()
-            : chunksReadyToDownload[QRandomGenerator64::global()->bounded(chunksReadyToDownload.size())];
+bool FileDownload::prepareToDownload(const QSharedPointer<ChunkDownloader>& chunkDownloader)
+{
+   if (!this->isSchedulable())
+      return false;
 
    if (!this->localEntry.exists())
    {
       if (!this->createFile())
-         return QSharedPointer<ChunkDownloader>();
+         return false;
 
       // 'newFile(..)' above can return some completed chunks.
       if (!chunkDownloader->getChunk().isNull() && chunkDownloader->getChunk()->isComplete())
       {
          this->updateStatus(); // Maybe all the file is complete, so we update the status.
-         return QSharedPointer<ChunkDownloader>();
+         return false;
       }
    }
 
-   return chunkDownloader;
+   // An identical chunk may already be owned by another local file, it's copied instead of being downloaded.
+   if (chunkDownloader->startLocalCopy(this->fileManager->getCompleteChunk(chunkDownloader->getHash())))
+      return false;
+
+   return true;
 }
 
 /**
@@ -326,23 +354,36 @@ void FileDownload::remove()
 }
 
 /**
-  * Send a request to the source peer of the download to ask it the hashes. Only sent if needed.
-  * Return true if a 'GetHashes' request has been sent to the peer.
+  * Return true if some chunk hashes are unknown and can be asked.
   */
-bool FileDownload::retrieveHashes()
+bool FileDownload::hashesNeeded() const
 {
    // If we've already got all the chunk hashes it's unnecessary to re-ask them.
-   if (
+   return !(
       this->nbHashesKnown == this->NB_CHUNK ||
       this->status == COMPLETE ||
       this->status == DELETED ||
       this->status == PAUSED ||
       this->status == GETTING_THE_HASHES ||
       this->status == ENTRY_NOT_FOUND
-   )
+   );
+}
+
+/**
+  * Send a request to the source peer of the download to ask it the hashes. Only sent if needed.
+  * The known hashes of 'nextDownloads' are asked in the same request, they must have the same peer source.
+  * Return true if a 'GetHashes' request has been sent to the peer.
+  */
+bool FileDownload::retrieveHashes(const QList<FileDownload*>& nextDownloads)
+{
+   if (!this->hashesNeeded())
       return false;
 
-   this->getHashesResult = this->peerSource->getHashes(this->remoteEntry);
+   QList<Protos::Common::Entry> nextFiles;
+   for (QListIterator<FileDownload*> i(nextDownloads); i.hasNext();)
+      nextFiles << i.next()->remoteEntry;
+
+   this->getHashesResult = this->peerSource->getHashes(this->remoteEntry, nextFiles);
 
    if (this->getHashesResult.isNull())
    {
@@ -356,6 +397,11 @@ bool FileDownload::retrieveHashes()
       return false;
    }
 
+   this->nextDownloads.clear();
+   for (QListIterator<FileDownload*> i(nextDownloads); i.hasNext();)
+      this->nextDownloads << i.next();
+   this->nbNextHashesToReceive = 0;
+
    this->setStatus(GETTING_THE_HASHES);
    connect(this->getHashesResult.data(), &PM::IGetHashesResult::result, this, &FileDownload::result);
    connect(this->getHashesResult.data(), &PM::IGetHashesResult::nextHash, this, &FileDownload::nextHash);
@@ -448,6 +494,7 @@ void FileDownload::result(const Protos::Core::GetHashesResult& result)
    {
       if (this->nbHashesKnown + static_cast<int>(result.nb_hash()) != this->NB_CHUNK)
          L_WARN(QString("The received hashes (%1) plus the known hashes (%2) is not equal to the number of chunks (%3)").arg(result.nb_hash()).arg(this->nbHashesKnown).arg(this->NB_CHUNK));
+      this->nbNextHashesToReceive = result.nb_next_hash();
    }
    else
    {
@@ -467,17 +514,37 @@ void FileDownload::result(const Protos::Core::GetHashesResult& result)
    }
 }
 
+/**
+  * The hashes of the next downloads are given to them, the request is released when all the expected hashes are received.
+  */
 void FileDownload::nextHash(const Protos::Core::HashResult& hashResult)
 {
    if (hashResult.hash().hash().size() == 0)
-   {
       L_DEBU("The received hash contains no data");
-      return;
+   else if (hashResult.next_file() == 0)
+      this->addHash(hashResult.num(), Common::Hash(hashResult.hash().hash()));
+   else if (hashResult.next_file() <= static_cast<quint32>(this->nextDownloads.size()))
+   {
+      FileDownload* nextDownload = this->nextDownloads[hashResult.next_file() - 1];
+      if (nextDownload && nextDownload->hashesNeeded())
+         nextDownload->addHash(hashResult.num(), Common::Hash(hashResult.hash().hash()));
    }
 
-   Common::Hash hash { hashResult.hash().hash() };
-   quint32 num = hashResult.num();
+   if (hashResult.next_file() > 0)
+      this->nbNextHashesToReceive--;
 
+   // If we have all the chunk hashes and no more hash is expected for the next downloads.
+   if (this->nbHashesKnown == this->NB_CHUNK && this->nbNextHashesToReceive <= 0 && !this->getHashesResult.isNull())
+   {
+      this->getHashesResult.clear();
+      this->nextDownloads.clear();
+      this->occupiedPeersAskingForHashes.setPeerAsFree(this->peerSource);
+      this->updateStatus();
+   }
+}
+
+void FileDownload::addHash(quint32 num, const Common::Hash& hash)
+{
    L_DEBU(QString("New Hash received %2 num %1").arg(num).arg(hash.toStr()));
 
    if (num >= static_cast<quint32>(this->chunkDownloaders.size()))
@@ -500,7 +567,7 @@ void FileDownload::nextHash(const Protos::Core::HashResult& hashResult)
       return;
    }
 
-   QSharedPointer<ChunkDownloader> chunkDownloader = (new ChunkDownloader(this->linkedPeers, this->occupiedPeersDownloadingChunk, this->transferRateCalculator, this->threadPool, hash))->grabStrongRef();
+   QSharedPointer<ChunkDownloader> chunkDownloader = (new ChunkDownloader(this->linkedPeers, this->occupiedPeersDownloadingChunk, this->peerConcurrency, this->transferRateCalculator, this->bandwidthLimiter, this->threadPool, hash))->grabStrongRef();
    this->chunkDownloaders[num] = chunkDownloader;
 
    // If the file has already been created, the chunks are known.
@@ -508,40 +575,112 @@ void FileDownload::nextHash(const Protos::Core::HashResult& hashResult)
    if (!chunk.isNull())
       chunkDownloader->setChunk(chunk);
 
-   // If we have all the chunk hashes.
    if (++this->nbHashesKnown >= this->NB_CHUNK)
-   {
       this->nbHashesKnown = this->NB_CHUNK;
-      this->getHashesResult.clear();
-      this->occupiedPeersAskingForHashes.setPeerAsFree(this->peerSource);
-      this->updateStatus();
-   }
 
    this->connectChunkDownloaderSignals(chunkDownloader);
+   this->chunkScheduler.add(this, chunkDownloader);
    chunkDownloader->setPeerSource(this->peerSource); // May start a download.
 
    if (num < static_cast<quint32>(this->remoteEntry.chunk_size()))
       this->remoteEntry.mutable_chunk(num)->set_hash(hash.getData(), Common::Hash::HASH_SIZE); // Used during the saving of the queue, see Download::populateEntry(..).
 
-   emit newHashKnown();
+   emit newHashKnown(num, hash);
 }
 
 void FileDownload::getHashTimeout()
 {
    L_DEBU("Unable to retrieve the hashes: timeout");
    this->getHashesResult.clear();
-   this->setStatus(UNABLE_TO_RETRIEVE_THE_HASHES);
+   this->nextDownloads.clear();
+
+   // Only the hashes of the next downloads are missing.
+   if (this->nbHashesKnown == this->NB_CHUNK)
+      this->updateStatus();
+   else
+      this->setStatus(UNABLE_TO_RETRIEVE_THE_HASHES);
    this->occupiedPeersAskingForHashes.setPeerAsFree(this->peerSource);
 }
 
 void FileDownload::chunkDownloaderStarted()
 {
    this->setStatus(DOWNLOADING);
+   this->updateEndgame();
 }
 
 void FileDownload::chunkDownloaderFinished()
 {
    this->updateStatus();
+   this->updateEndgame();
+}
+
+void FileDownload::chunkDownloaderRangesChanged()
+{
+   ChunkDownloader* chunkDownloader = static_cast<ChunkDownloader*>(this->sender());
+   for (int i = 0; i < this->chunkDownloaders.size(); i++)
+      if (this->chunkDownloaders[i].data() == chunkDownloader)
+      {
+         emit downloadedRangesChanged(i, chunkDownloader->getDownloadedRanges());
+         return;
+      }
+}
+
+/**
+  * The chunks are removed from or added to the 'ChunkScheduler' when the download can't or can be downloaded anymore.
+  */
+void FileDownload::setStatus(Status newStatus)
+{
+   const bool wasSchedulable = this->isSchedulable();
+
+   Download::setStatus(newStatus);
+
+   if (this->isSchedulable() != wasSchedulable)
+   {
+      this->updateEndgame();
+      this->updateChunkScheduler();
+   }
+}
+
+void FileDownload::updateChunkScheduler()
+{
+   for (QListIterator<QSharedPointer<ChunkDownloader>> i(this->chunkDownloaders); i.hasNext();)
+   {
+      auto chunkDownloader = i.next();
+      if (!chunkDownloader.isNull())
+         this->chunkScheduler.update(chunkDownloader.data());
+   }
+}
+
+/**
+  * The endgame begins when all the hashes are known and the remaining data falls below 'endgame_threshold'.
+  * The chunks are then downloaded by stripes which can be raced by the free peers, see 'ChunkDownloader::startARace()'.
+  */
+void FileDownload::updateEndgame()
+{
+   static const quint64 ENDGAME_THRESHOLD = SETTINGS.get<quint32>("endgame_threshold");
+
+   const bool endgame =
+      ENDGAME_THRESHOLD > 0 &&
+      this->isSchedulable() &&
+      this->nbHashesKnown == this->NB_CHUNK &&
+      static_cast<quint64>(this->remoteEntry.size()) <= this->getDownloadedBytes() + ENDGAME_THRESHOLD;
+
+   if (endgame == this->endgame)
+      return;
+
+   this->endgame = endgame;
+   if (endgame)
+      L_DEBU(QString("Endgame for the file %1").arg(Common::ProtoHelper::getStr(this->remoteEntry, &Protos::Common::Entry::name)));
+
+   for (QListIterator<QSharedPointer<ChunkDownloader>> i(this->chunkDownloaders); i.hasNext();)
+   {
+      auto chunkDownloader = i.next();
+      if (!chunkDownloader.isNull())
+      {
+         chunkDownloader->setEndgame(endgame);
+         this->chunkScheduler.update(chunkDownloader.data());
+      }
+   }
 }
 
 /**
@@ -570,7 +709,10 @@ bool FileDownload::tryToLinkToAnExistingFile()
       }
 
       if (!this->chunksWithoutDownloader.isEmpty())
+      {
          this->localEntry.set_exists(true);
+         emit entryChanged();
+      }
 
       this->giveChunksToDownloaders();
    }
@@ -583,6 +725,7 @@ void FileDownload::connectChunkDownloaderSignals(const QSharedPointer<ChunkDownl
    connect(chunkDownloader.data(), &ChunkDownloader::downloadStarted, this, &FileDownload::chunkDownloaderStarted, Qt::DirectConnection);
    connect(chunkDownloader.data(), &ChunkDownloader::downloadFinished, this, &FileDownload::chunkDownloaderFinished, Qt::DirectConnection);
    connect(chunkDownloader.data(), &ChunkDownloader::numberOfPeersChanged, this, &FileDownload::updateStatus, Qt::DirectConnection);
+   connect(chunkDownloader.data(), &ChunkDownloader::downloadedRangesChanged, this, &FileDownload::chunkDownloaderRangesChanged, Qt::DirectConnection);
 }
 
 /**
@@ -600,6 +743,8 @@ bool FileDownload::createFile()
          this->chunksWithoutDownloader.insert(chunk->getNum(), chunk);
       }
 
+      emit entryChanged(); // The local entry is completed by the file manager.
+
       this->giveChunksToDownloaders();
    }
    catch (FM::NoWriteableDirectoryException&)
@@ -638,6 +783,7 @@ void FileDownload::giveChunksToDownloaders()
       if (chunk.key() < this->chunkDownloaders.size() && !this->chunkDownloaders[chunk.key()].isNull())
       {
          this->chunkDownloaders[chunk.key()]->setChunk(chunk.value());
+         this->chunkScheduler.update(this->chunkDownloaders[chunk.key()].data()); // The chunk may be complete.
          i.remove();
       }
    }
@@ -653,4 +799,6 @@ void FileDownload::reset()
       i.next()->reset();
    this->localEntry.set_exists(false);
    this->localEntry.clear_shared_entry();
+
+   emit entryChanged();
 }
@@ -21,6 +21,7 @@
 #include <QList>
 #include <QMap>
 #include <QSharedPointer>
+#include <QPointer>
 #include <QTime>
 
 #include <Common/ThreadPool.h>
@@ -35,6 +36,7 @@
 #include <priv/LinkedPeers.h>
 #include <priv/Download.h>
 #include <priv/ChunkDownloader.h>
+#include <priv/ChunkScheduler.h>
 
 namespace DM
 {
@@ -48,11 +50,14 @@ namespace DM
          LinkedPeers& linkedPeers,
          OccupiedPeers& occupiedPeersAskingForHashes,
          OccupiedPeers& occupiedPeersDownloadingChunk,
+         PeerConcurrency& peerConcurrency,
+         ChunkScheduler& chunkScheduler,
          Common::ThreadPool& threadPool,
          PM::IPeer* peerSource,
          const Protos::Common::Entry& remoteEntry,
          const Protos::Common::Entry& localEntry,
          Common::TransferRateCalculator& transferRateCalculator,
+         Common::BandwidthLimiter& bandwidthLimiter,
          Protos::Queue::Queue::Entry::Status status = Protos::Queue::Queue::Entry::QUEUED
       );
       ~FileDownload();
@@ -65,11 +70,15 @@ namespace DM
       void peerSourceBecomesAvailable();
 
       void populateQueueEntry(Protos::Queue::Queue::Entry* entry) const;
+      void restoreDownloadedRanges(const Protos::Queue::Queue::Entry& entry);
 
       quint64 getDownloadedBytes() const;
       QSet<PM::IPeer*> getPeers() const;
 
-      QSharedPointer<ChunkDownloader> getAChunkToDownload();
+      bool isSchedulable() const;
+      bool isSmall() const;
+      void setQueueRank(quint64 rank);
+      bool prepareToDownload(const QSharedPointer<ChunkDownloader>& chunkDownloader);
 
       void getUnfinishedChunks(QList<QSharedPointer<IChunkDownloader>>& chunks, int nMax, bool notAlreadyAsked = true);
 
@@ -77,11 +86,14 @@ namespace DM
 
       void remove();
 
+      bool hashesNeeded() const;
+
    public slots:
-      bool retrieveHashes();
+      bool retrieveHashes(const QList<FileDownload*>& nextDownloads = QList<FileDownload*>());
 
    signals:
-      void newHashKnown();
+      void newHashKnown(int num, const Common::Hash& hash);
+      void downloadedRangesChanged(int num, const QMap<int, int>& ranges);
       void lastTimeGetAllUnfinishedChunksChanged(QTime oldTime);
 
    private slots:
@@ -92,11 +104,18 @@ namespace DM
 
       void chunkDownloaderStarted();
       void chunkDownloaderFinished();
+      void chunkDownloaderRangesChanged();
+
+   protected:
+      void setStatus(Status newStatus);
 
    private:
+      void updateChunkScheduler();
+      void updateEndgame();
       bool tryToLinkToAnExistingFile();
       void connectChunkDownloaderSignals(const QSharedPointer<ChunkDownloader>& chunkDownload);
       bool createFile();
+      void addHash(quint32 num, const Common::Hash& hash);
       void giveChunksToDownloaders();
       void reset();
 
@@ -110,15 +129,22 @@ namespace DM
 
       int nbChunkAsked;
 
+      bool endgame; // See 'updateEndgame()'.
+
       OccupiedPeers& occupiedPeersAskingForHashes;
       OccupiedPeers& occupiedPeersDownloadingChunk;
+      PeerConcurrency& peerConcurrency;
+      ChunkScheduler& chunkScheduler;
 
       Common::ThreadPool& threadPool;
 
       int nbHashesKnown;
       QSharedPointer<PM::IGetHashesResult> getHashesResult;
+      QList<QPointer<FileDownload>> nextDownloads; // The downloads whose hashes are prefetched with 'getHashesResult'.
+      int nbNextHashesToReceive;
 
       Common::TransferRateCalculator& transferRateCalculator;
+      Common::BandwidthLimiter& bandwidthLimiter;
 
       QTime lastTimeGetAllUnfinishedChunks; // Updated when ALL hashes are send via the method 'getTheFirstUnfinishedChunks(..)'. Null if never.
    };
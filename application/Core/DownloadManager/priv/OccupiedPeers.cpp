@@ -21,14 +21,24 @@ using namespace DM;
 
 #include <QMutexLocker>
 
-OccupiedPeers::OccupiedPeers()
+#include <priv/PeerConcurrency.h>
+
+/**
+  * @class DM::OccupiedPeers
+  *
+  * Count the number of tasks (downloads, requests) running with each peer. A peer is free while its number of tasks
+  * is below its capacity: one or the value given by a 'PeerConcurrency' object.
+  */
+
+OccupiedPeers::OccupiedPeers(const PeerConcurrency* peerConcurrency) :
+   peerConcurrency(peerConcurrency)
 {
 }
 
 bool OccupiedPeers::isPeerFree(PM::IPeer* peer) const
 {
    QMutexLocker locker(&this->mutex);
-   return !this->occupiedPeers.contains(peer);
+   return this->occupiedPeers.value(peer) < this->getCapacity(peer);
 }
 
 bool OccupiedPeers::setPeerAsOccupied(PM::IPeer* peer)
@@ -37,10 +47,15 @@ bool OccupiedPeers::setPeerAsOccupied(PM::IPeer* peer)
       return false;
 
    QMutexLocker locker(&this->mutex);
-   if (this->occupiedPeers.contains(peer))
+   int& nbTasks = this->occupiedPeers[peer];
+   if (nbTasks >= this->getCapacity(peer))
+   {
+      if (nbTasks == 0)
+         this->occupiedPeers.remove(peer);
       return false;
+   }
 
-   this->occupiedPeers.insert(peer);
+   nbTasks++;
    return true;
 }
 
@@ -51,24 +66,23 @@ void OccupiedPeers::setPeerAsFree(PM::IPeer* peer)
 
    {
       QMutexLocker locker(&this->mutex);
-      this->occupiedPeers.remove(peer);
+      auto nbTasks = this->occupiedPeers.find(peer);
+      if (nbTasks != this->occupiedPeers.end() && --nbTasks.value() <= 0)
+         this->occupiedPeers.erase(nbTasks);
    }
    emit newFreePeer(peer);
 }
 
+/**
+  * Emit 'newFreePeer' if the peer is free.
+  */
 void OccupiedPeers::newPeer(PM::IPeer* peer)
 {
    if (!peer)
       return;
 
-   this->mutex.lock();
-   if (!this->occupiedPeers.contains(peer))
-   {
-      this->mutex.unlock();
+   if (this->isPeerFree(peer))
       emit newFreePeer(peer);
-   }
-   else
-      this->mutex.unlock();
 }
 
 int OccupiedPeers::nbOccupiedPeers() const
@@ -77,9 +91,7 @@ int OccupiedPeers::nbOccupiedPeers() const
    return this->occupiedPeers.size();
 }
 
-const QSet<PM::IPeer*>& OccupiedPeers::getOccupiedPeers() const
+int OccupiedPeers::getCapacity(PM::IPeer* peer) const
 {
-   QMutexLocker locker(&this->mutex);
-   return this->occupiedPeers;
+   return this->peerConcurrency ? this->peerConcurrency->getMaxNbDownloads(peer) : 1;
 }
-
@@ -19,7 +19,7 @@
 #pragma once
 
 #include <QObject>
-#include <QSet>
+#include <QHash>
 #include <QMutex>
 
 #include <Common/Uncopyable.h>
@@ -31,24 +31,29 @@ namespace PM
 
 namespace DM
 {
+   class PeerConcurrency;
+
    class OccupiedPeers : public QObject, Common::Uncopyable
    {
       Q_OBJECT
    public:
-      OccupiedPeers();
+      OccupiedPeers(const PeerConcurrency* peerConcurrency = nullptr);
 
       bool isPeerFree(PM::IPeer* peer) const;
       bool setPeerAsOccupied(PM::IPeer* peer);
       void setPeerAsFree(PM::IPeer* peer);
       void newPeer(PM::IPeer* peer);
       int nbOccupiedPeers() const;
-      const QSet<PM::IPeer*>& getOccupiedPeers() const;
 
    signals:
       void newFreePeer(PM::IPeer*);
 
    private:
-      QSet<PM::IPeer*> occupiedPeers; // Peers currently occupied.
+      int getCapacity(PM::IPeer* peer) const;
+
+      const PeerConcurrency* peerConcurrency;
+
+      QHash<PM::IPeer*, int> occupiedPeers; // The number of tasks of each occupied peer.
       mutable QMutex mutex;
    };
 }
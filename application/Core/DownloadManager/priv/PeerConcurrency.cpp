@@ -0,0 +1,149 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/PeerConcurrency.h>
+using namespace DM;
+
+#include <QMutexLocker>
+
+#include <Common/Settings.h>
+
+#include <priv/Constants.h>
+
+/**
+  * @class DM::PeerConcurrency
+  *
+  * Choose the number of chunks downloaded simultaneously from each peer, between 1 and 'max_downloads_per_peer'.
+  * It works like the congestion control of TCP (AIMD): the number of downloads is increased by one while it makes
+  * the throughput of the peer grow and is halved when the throughput drops, when the round trip time of the
+  * requests inflates (the peer or the network is overloaded) or when a transfer fails.
+  * A pipeline credit allows one more download until the end of the current one, it is used to ask the next chunk
+  * before the end of the current stream, see 'ChunkDownloader::run()'.
+  */
+
+PeerConcurrency::State::State() :
+   window(1.0), pipelineCredits(0), minRTT(-1), smoothedRTT(0.0), sampledBytes(0), lastThroughput(0.0)
+{
+}
+
+PeerConcurrency::PeerConcurrency() :
+   MAX_NB_DOWNLOADS(qMax(1u, SETTINGS.get<quint32>("max_downloads_per_peer")))
+{
+}
+
+int PeerConcurrency::getMaxNbDownloads(PM::IPeer* peer) const
+{
+   QMutexLocker locker(&this->mutex);
+
+   auto state = this->states.find(peer);
+   if (state == this->states.end())
+      return 1;
+
+   return static_cast<int>(state.value().window) + state.value().pipelineCredits;
+}
+
+/**
+  * Return the smoothed round trip time [ms] of the 'GetChunks' requests, -1 if unknown.
+  */
+int PeerConcurrency::getRTT(PM::IPeer* peer) const
+{
+   QMutexLocker locker(&this->mutex);
+
+   auto state = this->states.find(peer);
+   if (state == this->states.end() || state.value().minRTT == -1)
+      return -1;
+
+   return static_cast<int>(state.value().smoothedRTT);
+}
+
+/**
+  * Allow one more download until the end of the next download from this peer.
+  */
+void PeerConcurrency::addPipelineCredit(PM::IPeer* peer)
+{
+   QMutexLocker locker(&this->mutex);
+   State& state = this->states[peer];
+   if (state.pipelineCredits == 0)
+      state.pipelineCredits = 1;
+}
+
+void PeerConcurrency::downloadStarted(PM::IPeer* peer)
+{
+   QMutexLocker locker(&this->mutex);
+
+   State& state = this->states[peer];
+   if (!state.samplingTimer.isValid())
+      state.samplingTimer.start();
+}
+
+/**
+  * @param rtt [ms] The time between the sending of a 'GetChunks' request and the reception of its result.
+  */
+void PeerConcurrency::newRTT(PM::IPeer* peer, int rtt)
+{
+   QMutexLocker locker(&this->mutex);
+
+   State& state = this->states[peer];
+   if (state.minRTT == -1)
+   {
+      state.minRTT = rtt;
+      state.smoothedRTT = rtt;
+   }
+   else
+   {
+      state.minRTT = qMin(state.minRTT, rtt);
+      state.smoothedRTT = 0.875 * state.smoothedRTT + 0.125 * rtt;
+   }
+}
+
+/**
+  * @param bytes The number of bytes received during the download.
+  * @param error 'true' if the transfer has failed.
+  */
+void PeerConcurrency::downloadFinished(PM::IPeer* peer, qint64 bytes, bool error)
+{
+   QMutexLocker locker(&this->mutex);
+
+   State& state = this->states[peer];
+   state.pipelineCredits = 0;
+
+   if (error)
+   {
+      state.window = qMax(1.0, state.window * CONCURRENCY_DECREASE_FACTOR);
+      state.samplingTimer.invalidate();
+      state.sampledBytes = 0;
+      return;
+   }
+
+   state.sampledBytes += bytes;
+
+   if (!state.samplingTimer.isValid() || state.samplingTimer.elapsed() < CONCURRENCY_SAMPLING_PERIOD)
+      return;
+
+   const double throughput = 1000.0 * state.sampledBytes / state.samplingTimer.elapsed();
+   const bool rttInflated = state.minRTT != -1 && state.smoothedRTT > CONCURRENCY_RTT_INFLATION_FACTOR * state.minRTT + CONCURRENCY_RTT_TOLERANCE;
+
+   if (rttInflated || throughput < CONCURRENCY_THROUGHPUT_DROP_FACTOR * state.lastThroughput)
+      state.window = qMax(1.0, state.window * CONCURRENCY_DECREASE_FACTOR);
+   else if (throughput > CONCURRENCY_THROUGHPUT_GAIN_FACTOR * state.lastThroughput)
+      state.window = qMin(static_cast<double>(this->MAX_NB_DOWNLOADS), state.window + 1.0);
+
+   state.lastThroughput = throughput;
+   state.sampledBytes = 0;
+   state.samplingTimer.start();
+}
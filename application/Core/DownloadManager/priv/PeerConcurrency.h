@@ -0,0 +1,69 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include <Common/Uncopyable.h>
+
+namespace PM
+{
+   class IPeer;
+}
+
+namespace DM
+{
+   class PeerConcurrency : Common::Uncopyable
+   {
+   public:
+      PeerConcurrency();
+
+      int getMaxNbDownloads(PM::IPeer* peer) const;
+      int getRTT(PM::IPeer* peer) const;
+
+      void addPipelineCredit(PM::IPeer* peer);
+
+      void downloadStarted(PM::IPeer* peer);
+      void newRTT(PM::IPeer* peer, int rtt);
+      void downloadFinished(PM::IPeer* peer, qint64 bytes, bool error);
+
+   private:
+      struct State
+      {
+         State();
+
+         double window; // The number of simultaneous downloads allowed.
+         int pipelineCredits;
+
+         int minRTT; // [ms], -1 if unknown.
+         double smoothedRTT; // [ms].
+
+         QElapsedTimer samplingTimer;
+         qint64 sampledBytes;
+         double lastThroughput; // [B/s].
+      };
+
+      const int MAX_NB_DOWNLOADS;
+
+      QHash<PM::IPeer*, State> states;
+      mutable QMutex mutex; // 'getMaxNbDownloads(..)' is called by the downloading threads.
+   };
+}
@@ -0,0 +1,670 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <priv/QueueJournal.h>
+using namespace DM;
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDeadlineTimer>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+#include <google/protobuf/arena.h>
+
+#include <Common/PersistentData.h>
+#include <Common/Constants.h>
+#include <Common/Settings.h>
+
+#include <priv/Download.h>
+#include <priv/Log.h>
+#include <priv/Constants.h>
+
+/**
+  * @class DM::QueueJournal
+  *
+  * Persists the queue without rewriting it each time it changes. The queue is stored in three files:
+  *  - The snapshot 'Common::Constants::FILE_QUEUE', the whole queue at a given time.
+  *  - The journal 'Common::Constants::FILE_QUEUE_JOURNAL', each change since the snapshot is appended as a 'Protos::Queue::JournalRecord'
+  *    prefixed by its size. A record partially written is ignored when the journal is read.
+  *  - The hash table 'Common::Constants::FILE_QUEUE_HASHES', the chunk hashes are appended to it once and referenced by their index.
+  *
+  * The journal and the hash table are numbered, the snapshot references the ones completing it. New files are always written before
+  * the snapshot referencing them, thus a crash at any time leaves a coherent queue.
+  *
+  * The records are built by the main thread and written by batch by a dedicated thread, at most once per 'save_queue_period'.
+  * If a file can't be written the data is kept and written again with the next batch, nothing is dropped before the exit.
+  * This thread merges the journal into a new snapshot when the journal becomes bigger than the snapshot.
+  * The hash table is rebuilt from the current downloads only by 'rebase(..)', once at start.
+  */
+
+const quint32 QueueJournal::NO_HASH_REF(std::numeric_limits<quint32>::max());
+
+QueueJournal::QueueJournal() :
+   active(false),
+   toStop(false),
+   journalNumber(0),
+   hashTableNumber(0),
+   journalSize(0),
+   snapshotSize(0)
+{
+}
+
+QueueJournal::~QueueJournal()
+{
+   this->mutex.lock();
+   this->toStop = true;
+   this->waitCondition.wakeOne();
+   this->mutex.unlock();
+
+   this->wait(); // The pending records are written before the thread ends.
+}
+
+/**
+  * Load the snapshot and apply the journal, the chunk hashes are put back into the entries.
+  * The entries are sorted by their rank. Do not create the downloads itself.
+  */
+Protos::Queue::Queue QueueJournal::load()
+{
+   Protos::Queue::Queue savedQueue;
+
+   try
+   {
+      this->dataFolder = Common::Global::getDataFolder(Common::Global::DataFolderType::LOCAL);
+
+      Common::PersistentData::getValue(Common::Constants::FILE_QUEUE, savedQueue, Common::Global::DataFolderType::LOCAL);
+
+      // The version 4 is the whole queue with the hashes inline, it will be replaced by 'rebase(..)'.
+      if (static_cast<int>(savedQueue.version()) == FILE_QUEUE_VERSION - 1)
+         return savedQueue;
+
+      if (static_cast<int>(savedQueue.version()) != FILE_QUEUE_VERSION)
+      {
+         L_USER(QString(QObject::tr("The version (%1) of the queue file \"%2\" doesn't match the current version (%3). Queue will be reset.")).arg(savedQueue.version()).arg(Common::Constants::FILE_QUEUE).arg(FILE_QUEUE_VERSION));
+         Common::PersistentData::rmValue(Common::Constants::FILE_QUEUE, Common::Global::DataFolderType::LOCAL);
+         savedQueue.Clear();
+      }
+   }
+   catch (Common::Global::UnableToGetFolder& e)
+   {
+      L_ERRO(e.errorMessage);
+   }
+   catch (Common::UnknownValueException& e)
+   {
+      L_WARN(QString("The download queue file cache cannot be retrieved (the file doesn't exist): %1").arg(Common::Constants::FILE_QUEUE));
+   }
+   catch (...)
+   {
+      L_WARN(QString("The download queue file cache cannot be retrieved (Unknown exception): %1").arg(Common::Constants::FILE_QUEUE));
+   }
+
+   this->journalNumber = savedQueue.journal_number();
+   this->hashTableNumber = savedQueue.hash_table_number();
+   this->snapshotSize = savedQueue.ByteSizeLong();
+
+   Entries entries;
+   for (int i = 0; i < savedQueue.entry_size(); i++)
+      entries.insert(savedQueue.entry(i).id(), savedQueue.entry(i));
+
+   const QString journalFilepath = this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, this->journalNumber);
+   this->journalSize = readJournal(journalFilepath, entries);
+   if (this->journalSize < QFileInfo(journalFilepath).size())
+      QFile::resize(journalFilepath, this->journalSize);
+
+   const QList<Common::Hash> hashes = readHashTable(this->getFilepath(Common::Constants::FILE_QUEUE_HASHES, this->hashTableNumber));
+
+   Protos::Queue::Queue queue;
+   queue.set_version(FILE_QUEUE_VERSION);
+   sortByRank(entries, queue);
+
+   for (int i = 0; i < queue.entry_size(); i++)
+   {
+      Protos::Queue::Queue::Entry* entry = queue.mutable_entry(i);
+      for (int j = 0; j < entry->chunk_hash_ref_size() && j < entry->remote_entry().chunk_size(); j++)
+      {
+         const quint32 ref = entry->chunk_hash_ref(j);
+         if (ref < static_cast<quint32>(hashes.size()))
+            entry->mutable_remote_entry()->mutable_chunk(j)->set_hash(hashes[ref].getData(), Common::Hash::HASH_SIZE);
+      }
+      entry->clear_chunk_hash_ref();
+   }
+
+   L_DEBU(QString("Queue loaded: %1 entries, %2 bytes of journal, %3 hashes").arg(queue.entry_size()).arg(this->journalSize).arg(hashes.size()));
+
+   return queue;
+}
+
+/**
+  * Replace the snapshot by the given downloads, the journal is emptied and the hash table is rebuilt.
+  * Must be called once the loaded downloads have been created, the changes are journaled only after this call.
+  */
+void QueueJournal::rebase(const QList<Download*>& downloads)
+{
+   QSharedPointer<Protos::Queue::Queue> snapshot(new Protos::Queue::Queue());
+   snapshot->set_version(FILE_QUEUE_VERSION);
+
+   this->hashRefs.clear();
+   this->newHashes.clear();
+
+   for (QListIterator<Download*> i(downloads); i.hasNext();)
+   {
+      Download* download = i.next();
+      Protos::Queue::Queue::Entry* entry = snapshot->add_entry();
+      download->populateQueueEntry(entry);
+      entry->set_id(download->getID());
+      entry->set_rank(download->getQueueRank());
+      this->moveHashesToTheTable(*entry);
+   }
+
+   QMutexLocker locker(&this->mutex);
+   this->snapshotToWrite = snapshot;
+   this->hashTableToWrite = this->newHashes;
+   this->recordsToWrite.clear();
+   this->hashesToWrite.clear();
+   this->newHashes.clear();
+   this->active = true;
+   this->waitCondition.wakeOne();
+   locker.unlock();
+
+   if (!this->isRunning())
+      this->start(QThread::LowPriority);
+}
+
+/**
+  * The changes aren't journaled anymore, the pending records are still written.
+  * Must be called before deleting the downloads at exit, their status becomes 'DELETED' and it must not be persisted.
+  */
+void QueueJournal::deactivate()
+{
+   this->active = false;
+}
+
+void QueueJournal::downloadAdded(Download* download)
+{
+   if (!this->active)
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::ADD);
+   Protos::Queue::Queue::Entry* entry = record.mutable_entry();
+   download->populateQueueEntry(entry);
+   entry->set_id(download->getID());
+   entry->set_rank(download->getQueueRank());
+   this->moveHashesToTheTable(*entry);
+   this->append(record);
+}
+
+/**
+  * The entry or the status of the download has changed, its rank and its chunk hashes are journaled separately.
+  */
+void QueueJournal::downloadChanged(Download* download)
+{
+   if (!this->active)
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::UPDATE);
+   Protos::Queue::Queue::Entry* entry = record.mutable_entry();
+   download->populateQueueEntry(entry);
+   entry->set_id(download->getID());
+   for (int i = 0; i < entry->remote_entry().chunk_size(); i++)
+      entry->mutable_remote_entry()->mutable_chunk(i)->clear_hash();
+   this->append(record);
+}
+
+void QueueJournal::downloadRankChanged(Download* download)
+{
+   if (!this->active)
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::MOVE);
+   record.add_id(download->getID());
+   record.add_rank(download->getQueueRank());
+   this->append(record);
+}
+
+void QueueJournal::downloadsRemoved(const QList<quint64>& IDs)
+{
+   if (!this->active || IDs.isEmpty())
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::REMOVE);
+   for (QListIterator<quint64> i(IDs); i.hasNext();)
+      record.add_id(i.next());
+   this->append(record);
+}
+
+void QueueJournal::newHash(Download* download, int num, const Common::Hash& hash)
+{
+   if (!this->active)
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::NEW_HASHES);
+   record.add_id(download->getID());
+   record.set_first_chunk(num);
+   record.add_chunk_hash_ref(this->getHashRef(hash));
+   this->append(record);
+}
+
+/**
+  * The ranges downloaded by the stripes of the chunk 'num' have changed, the previous ones are replaced.
+  */
+void QueueJournal::downloadedRangesChanged(Download* download, int num, const QMap<int, int>& ranges)
+{
+   if (!this->active)
+      return;
+
+   Protos::Queue::JournalRecord record;
+   record.set_type(Protos::Queue::JournalRecord::RANGES);
+   record.add_id(download->getID());
+   record.set_first_chunk(num);
+   for (QMapIterator<int, int> i(ranges); i.hasNext();)
+   {
+      i.next();
+      Protos::Queue::Queue::Entry::DownloadedRange* range = record.add_range();
+      range->set_chunk(num);
+      range->set_start(i.key());
+      range->set_end(i.value());
+   }
+   this->append(record);
+}
+
+void QueueJournal::run()
+{
+   const unsigned long WRITE_PERIOD = SETTINGS.get<quint32>("save_queue_period");
+
+   QMutexLocker locker(&this->mutex);
+   forever
+   {
+      while (!this->toStop && this->recordsToWrite.isEmpty() && this->snapshotToWrite.isNull())
+         this->waitCondition.wait(&this->mutex);
+
+      // Waits for the other records of the batch.
+      QDeadlineTimer deadline(WRITE_PERIOD);
+      while (!this->toStop && this->waitCondition.wait(&this->mutex, deadline));
+
+      const bool toStop = this->toStop;
+      QSharedPointer<Protos::Queue::Queue> snapshot;
+      snapshot.swap(this->snapshotToWrite);
+      QByteArray hashTable, records, hashes;
+      hashTable.swap(this->hashTableToWrite);
+      records.swap(this->recordsToWrite);
+      hashes.swap(this->hashesToWrite);
+      locker.unlock();
+
+      const bool written = this->write(snapshot, hashTable, records, hashes);
+
+      if (toStop)
+      {
+         if (!written)
+            L_ERRO(QString("Some changes of the queue can't be written and are lost: %1 bytes").arg(records.size()));
+         return;
+      }
+
+      locker.relock();
+
+      // The data not written is put back in front of the next batch, except if a new snapshot from 'rebase(..)' replaces it.
+      if (!written && this->snapshotToWrite.isNull())
+      {
+         this->snapshotToWrite = snapshot;
+         this->hashTableToWrite = hashTable;
+         this->hashesToWrite.prepend(hashes);
+         this->recordsToWrite.prepend(records);
+      }
+   }
+}
+
+/**
+  * Idempotent, a record can be applied more than once.
+  */
+void QueueJournal::apply(Entries& entries, const Protos::Queue::JournalRecord& record)
+{
+   switch (record.type())
+   {
+   case Protos::Queue::JournalRecord::ADD:
+      entries.insert(record.entry().id(), record.entry());
+      break;
+
+   case Protos::Queue::JournalRecord::UPDATE:
+      {
+         Entries::iterator i = entries.find(record.entry().id());
+         if (i == entries.end())
+            break;
+         Protos::Queue::Queue::Entry entry(record.entry());
+         entry.set_rank(i->rank());
+         entry.mutable_chunk_hash_ref()->Swap(i->mutable_chunk_hash_ref());
+         i->Swap(&entry);
+      }
+      break;
+
+   case Protos::Queue::JournalRecord::MOVE:
+      for (int j = 0; j < record.id_size() && j < record.rank_size(); j++)
+      {
+         Entries::iterator i = entries.find(record.id(j));
+         if (i != entries.end())
+            i->set_rank(record.rank(j));
+      }
+      break;
+
+   case Protos::Queue::JournalRecord::REMOVE:
+      for (int j = 0; j < record.id_size(); j++)
+         entries.remove(record.id(j));
+      break;
+
+   case Protos::Queue::JournalRecord::NEW_HASHES:
+      {
+         Entries::iterator i = record.id_size() > 0 ? entries.find(record.id(0)) : entries.end();
+         if (i == entries.end())
+            break;
+         const int end = record.first_chunk() + record.chunk_hash_ref_size();
+         while (i->chunk_hash_ref_size() < end)
+            i->add_chunk_hash_ref(NO_HASH_REF);
+         for (int j = 0; j < record.chunk_hash_ref_size(); j++)
+            i->set_chunk_hash_ref(record.first_chunk() + j, record.chunk_hash_ref(j));
+      }
+      break;
+
+   case Protos::Queue::JournalRecord::RANGES:
+      {
+         Entries::iterator i = record.id_size() > 0 ? entries.find(record.id(0)) : entries.end();
+         if (i == entries.end())
+            break;
+         google::protobuf::RepeatedPtrField<Protos::Queue::Queue::Entry::DownloadedRange> ranges;
+         for (int j = 0; j < i->downloaded_range_size(); j++)
+            if (i->downloaded_range(j).chunk() != record.first_chunk())
+               ranges.Add()->CopyFrom(i->downloaded_range(j));
+         ranges.MergeFrom(record.range());
+         i->mutable_downloaded_range()->Swap(&ranges);
+      }
+      break;
+
+   default:;
+   }
+}
+
+/**
+  * @return The size of the valid part of the journal, the rest can be removed.
+  */
+qint64 QueueJournal::readJournal(const QString& filepath, Entries& entries)
+{
+   QFile file(filepath);
+   if (!file.open(QIODevice::ReadOnly))
+      return 0;
+
+   const QByteArray data = file.readAll();
+   const int HEADER_SIZE = sizeof(quint32);
+
+   int position = 0;
+   Protos::Queue::JournalRecord record;
+   while (position + HEADER_SIZE <= data.size())
+   {
+      const quint32 size = qFromLittleEndian<quint32>(data.constData() + position);
+      if (size > static_cast<quint32>(data.size() - position - HEADER_SIZE) || !record.ParseFromArray(data.constData() + position + HEADER_SIZE, size))
+         break;
+
+      apply(entries, record);
+      position += HEADER_SIZE + size;
+   }
+
+   if (position < data.size())
+      L_WARN(QString("The end of the queue journal is invalid and will be ignored: %1 bytes").arg(data.size() - position));
+
+   return position;
+}
+
+QList<Common::Hash> QueueJournal::readHashTable(const QString& filepath)
+{
+   QList<Common::Hash> hashes;
+
+   QFile file(filepath);
+   if (!file.open(QIODevice::ReadOnly))
+      return hashes;
+
+   const QByteArray data = file.readAll();
+   hashes.reserve(data.size() / Common::Hash::HASH_SIZE);
+   for (int i = 0; i + Common::Hash::HASH_SIZE <= data.size(); i += Common::Hash::HASH_SIZE)
+      hashes << Common::Hash(data.constData() + i);
+
+   return hashes;
+}
+
+void QueueJournal::sortByRank(const Entries& entries, Protos::Queue::Queue& queue)
+{
+   QList<const Protos::Queue::Queue::Entry*> sortedEntries;
+   sortedEntries.reserve(entries.size());
+   for (Entries::const_iterator i = entries.constBegin(); i != entries.constEnd(); ++i)
+      sortedEntries << &i.value();
+
+   std::sort(sortedEntries.begin(), sortedEntries.end(), [](const Protos::Queue::Queue::Entry* e1, const Protos::Queue::Queue::Entry* e2) { return e1->rank() < e2->rank(); });
+
+   for (QListIterator<const Protos::Queue::Queue::Entry*> i(sortedEntries); i.hasNext();)
+      queue.add_entry()->CopyFrom(*i.next());
+}
+
+/**
+  * If the data can't be entirely written the file is restored to its previous size,
+  * a record partially written would hide the following ones, see 'readJournal(..)'.
+  */
+bool QueueJournal::writeFile(const QString& filepath, const QByteArray& data, QIODevice::OpenMode mode)
+{
+   QFile file(filepath);
+   if (!file.open(QIODevice::WriteOnly | mode))
+   {
+      L_ERRO(QString("Unable to open the queue file %1: %2").arg(filepath).arg(file.errorString()));
+      return false;
+   }
+
+   const qint64 previousSize = file.size();
+   if (file.write(data) != data.size() || !file.flush())
+   {
+      L_ERRO(QString("Unable to write the queue file %1: %2").arg(filepath).arg(file.errorString()));
+      file.resize(previousSize);
+      return false;
+   }
+
+   return true;
+}
+
+/**
+  * Called by the main thread.
+  */
+void QueueJournal::append(const Protos::Queue::JournalRecord& record)
+{
+   const int size = record.ByteSizeLong();
+   QByteArray data(sizeof(quint32) + size, Qt::Uninitialized);
+   qToLittleEndian<quint32>(size, data.data());
+   record.SerializeToArray(data.data() + sizeof(quint32), size);
+
+   QMutexLocker locker(&this->mutex);
+   this->hashesToWrite.append(this->newHashes); // The hashes must be written before the records referencing them.
+   this->recordsToWrite.append(data);
+   this->waitCondition.wakeOne();
+   locker.unlock();
+
+   this->newHashes.clear();
+}
+
+/**
+  * Replace the hashes of the chunks by their reference in the hash table.
+  */
+void QueueJournal::moveHashesToTheTable(Protos::Queue::Queue::Entry& entry)
+{
+   entry.clear_chunk_hash_ref();
+   for (int i = 0; i < entry.remote_entry().chunk_size(); i++)
+   {
+      Protos::Common::Hash* chunk = entry.mutable_remote_entry()->mutable_chunk(i);
+      if (chunk->hash().size() == static_cast<size_t>(Common::Hash::HASH_SIZE))
+      {
+         entry.add_chunk_hash_ref(this->getHashRef(Common::Hash(chunk->hash())));
+         chunk->clear_hash();
+      }
+      else
+         entry.add_chunk_hash_ref(NO_HASH_REF);
+   }
+}
+
+quint32 QueueJournal::getHashRef(const Common::Hash& hash)
+{
+   QHash<Common::Hash, quint32>::const_iterator i = this->hashRefs.constFind(hash);
+   if (i != this->hashRefs.constEnd())
+      return i.value();
+
+   const quint32 ref = this->hashRefs.size();
+   this->hashRefs.insert(hash, ref);
+   this->newHashes.append(hash.getData(), Common::Hash::HASH_SIZE);
+   return ref;
+}
+
+/**
+  * Called by the writing thread. The written data is cleared, the rest must be given again to the next call.
+  * The records are written only after the snapshot and the hashes they depend on.
+  * @return 'false' if some data can't be written.
+  */
+bool QueueJournal::write(QSharedPointer<Protos::Queue::Queue>& snapshot, QByteArray& hashTable, QByteArray& records, QByteArray& hashes)
+{
+   if (!snapshot.isNull())
+   {
+      // The previous files stay valid until the new snapshot replaces the old one, they are still used if the writing fails.
+      const quint32 number = qMax(this->journalNumber, this->hashTableNumber) + 1;
+
+      if (!writeFile(this->getFilepath(Common::Constants::FILE_QUEUE_HASHES, number), hashTable, QIODevice::Truncate) ||
+          !writeFile(this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, number), QByteArray(), QIODevice::Truncate))
+         return false;
+
+      snapshot->set_journal_number(number);
+      snapshot->set_hash_table_number(number);
+
+      try
+      {
+         Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, *snapshot, Common::Global::DataFolderType::LOCAL);
+      }
+      catch (Common::PersistentDataIOException& err)
+      {
+         L_ERRO(err.message);
+         return false;
+      }
+
+      this->journalNumber = this->hashTableNumber = number;
+      this->journalSize = 0;
+      this->snapshotSize = snapshot->ByteSizeLong();
+      snapshot.clear();
+      hashTable.clear();
+
+      this->removeUnusedFiles(Common::Constants::FILE_QUEUE_JOURNAL, number);
+      this->removeUnusedFiles(Common::Constants::FILE_QUEUE_HASHES, number);
+   }
+
+   if (!hashes.isEmpty())
+   {
+      if (!writeFile(this->getFilepath(Common::Constants::FILE_QUEUE_HASHES, this->hashTableNumber), hashes, QIODevice::Append))
+         return false;
+      hashes.clear();
+   }
+
+   if (!records.isEmpty())
+   {
+      if (!writeFile(this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, this->journalNumber), records, QIODevice::Append))
+         return false;
+      this->journalSize += records.size();
+      records.clear();
+   }
+
+   if (this->journalSize > qMax(QUEUE_JOURNAL_MIN_SIZE_TO_COMPACT, this->snapshotSize))
+      this->compact();
+
+   return true;
+}
+
+/**
+  * Merge the journal into a new snapshot, the hash table is kept as is.
+  */
+void QueueJournal::compact()
+{
+   L_DEBU(QString("Compacting the queue journal (%1 bytes)").arg(this->journalSize));
+
+   // Both snapshots are allocated in an arena, they can contain thousands of entries.
+   google::protobuf::Arena arena;
+   Protos::Queue::Queue& snapshot = *google::protobuf::Arena::CreateMessage<Protos::Queue::Queue>(&arena);
+   try
+   {
+      Common::PersistentData::getValue(Common::Constants::FILE_QUEUE, snapshot, Common::Global::DataFolderType::LOCAL);
+   }
+   catch (...)
+   {
+      L_WARN(QString("Unable to compact the queue journal, the queue file cannot be read: %1").arg(Common::Constants::FILE_QUEUE));
+      return;
+   }
+
+   Entries entries;
+   for (int i = 0; i < snapshot.entry_size(); i++)
+      entries.insert(snapshot.entry(i).id(), snapshot.entry(i));
+   readJournal(this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, this->journalNumber), entries);
+
+   Protos::Queue::Queue& compactedSnapshot = *google::protobuf::Arena::CreateMessage<Protos::Queue::Queue>(&arena);
+   compactedSnapshot.set_version(FILE_QUEUE_VERSION);
+   sortByRank(entries, compactedSnapshot);
+
+   const quint32 number = this->journalNumber + 1;
+   if (!writeFile(this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, number), QByteArray(), QIODevice::Truncate))
+      return;
+
+   compactedSnapshot.set_journal_number(number);
+   compactedSnapshot.set_hash_table_number(this->hashTableNumber);
+
+   try
+   {
+      Common::PersistentData::setValue(Common::Constants::FILE_QUEUE, compactedSnapshot, Common::Global::DataFolderType::LOCAL);
+   }
+   catch (Common::PersistentDataIOException& err)
+   {
+      L_ERRO(err.message);
+      return;
+   }
+
+   QFile::remove(this->getFilepath(Common::Constants::FILE_QUEUE_JOURNAL, this->journalNumber));
+   this->journalNumber = number;
+   this->journalSize = 0;
+   this->snapshotSize = compactedSnapshot.ByteSizeLong();
+}
+
+QString QueueJournal::getFilepath(const QString& pattern, quint32 number) const
+{
+   return this->dataFolder + '/' + pattern.arg(number);
+}
+
+/**
+  * Remove the files left by a previous snapshot.
+  */
+void QueueJournal::removeUnusedFiles(const QString& pattern, quint32 number) const
+{
+   const QString currentFilename = pattern.arg(number);
+   QDir dir(this->dataFolder);
+   for (QStringListIterator i(dir.entryList(QStringList { pattern.arg('*') }, QDir::Files)); i.hasNext();)
+   {
+      const QString filename = i.next();
+      if (filename != currentFilename)
+         dir.remove(filename);
+   }
+}
@@ -0,0 +1,101 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QIODevice>
+#include <QByteArray>
+#include <QSharedPointer>
+
+#include <Protos/queue.pb.h>
+
+#include <Common/Hash.h>
+#include <Common/Uncopyable.h>
+
+namespace DM
+{
+   class Download;
+
+   class QueueJournal : public QThread, Common::Uncopyable
+   {
+      static const quint32 NO_HASH_REF;
+
+   public:
+      QueueJournal();
+      ~QueueJournal();
+
+      Protos::Queue::Queue load();
+      void rebase(const QList<Download*>& downloads);
+      void deactivate();
+
+      void downloadAdded(Download* download);
+      void downloadChanged(Download* download);
+      void downloadRankChanged(Download* download);
+      void downloadsRemoved(const QList<quint64>& IDs);
+      void newHash(Download* download, int num, const Common::Hash& hash);
+      void downloadedRangesChanged(Download* download, int num, const QMap<int, int>& ranges);
+
+   protected:
+      void run();
+
+   private:
+      typedef QHash<quint64, Protos::Queue::Queue::Entry> Entries;
+
+      static void apply(Entries& entries, const Protos::Queue::JournalRecord& record);
+      static qint64 readJournal(const QString& filepath, Entries& entries);
+      static QList<Common::Hash> readHashTable(const QString& filepath);
+      static void sortByRank(const Entries& entries, Protos::Queue::Queue& queue);
+      static bool writeFile(const QString& filepath, const QByteArray& data, QIODevice::OpenMode mode);
+
+      void append(const Protos::Queue::JournalRecord& record);
+      void moveHashesToTheTable(Protos::Queue::Queue::Entry& entry);
+      quint32 getHashRef(const Common::Hash& hash);
+
+      bool write(QSharedPointer<Protos::Queue::Queue>& snapshot, QByteArray& hashTable, QByteArray& records, QByteArray& hashes);
+      void compact();
+      QString getFilepath(const QString& pattern, quint32 number) const;
+      void removeUnusedFiles(const QString& pattern, quint32 number) const;
+
+      // Only used by the main thread.
+      bool active; // The records are written after the call to 'rebase(..)'.
+      QHash<Common::Hash, quint32> hashRefs; // The content-addressed hash table.
+      QByteArray newHashes; // Added to 'hashRefs' and not yet given to the writing thread.
+
+      // Shared with the writing thread.
+      QMutex mutex;
+      QWaitCondition waitCondition;
+      bool toStop;
+      QByteArray recordsToWrite;
+      QByteArray hashesToWrite;
+      QSharedPointer<Protos::Queue::Queue> snapshotToWrite; // Set by 'rebase(..)', replaces the snapshot, the journal and the hash table.
+      QByteArray hashTableToWrite;
+
+      // Set by 'load()' then only used by the writing thread.
+      QString dataFolder;
+      quint32 journalNumber;
+      quint32 hashTableNumber;
+      qint64 journalSize;
+      qint64 snapshotSize;
+   };
+}
@@ -29,6 +29,11 @@ unix {
       priv/FileUpdater/DirWatcherLinux.h
 }
 
+linux {
+   SOURCES += priv/FileUpdater/DirWatcherFanotify.cpp
+   HEADERS += priv/FileUpdater/DirWatcherFanotify.h
+}
+
 macx {
    SOURCES += priv/FileUpdater/WaitConditionDarwin.cpp
    HEADERS += priv/FileUpdater/WaitConditionDarwin.h \
@@ -39,6 +44,8 @@ SOURCES += priv/Builder.cpp \
     priv/FileManager.cpp \
     priv/FileUpdater/FileUpdater.cpp \
     priv/FileUpdater/DirWatcher.cpp \
+    priv/FileUpdater/DirScanner.cpp \
+    priv/FileUpdater/HashScheduler.cpp \
     priv/Cache/Entry.cpp \
     priv/Cache/File.cpp \
     priv/Cache/Directory.cpp \
@@ -57,7 +64,8 @@ SOURCES += priv/Builder.cpp \
     priv/Cache/FileHasher.cpp \
     priv/GetEntriesResult.cpp \
     priv/SizeIndexEntries.cpp \
-    priv/Cache/SharedEntry.cpp
+    priv/Cache/SharedEntry.cpp \
+    priv/Finder.cpp
 HEADERS += IGetHashesResult.h \
     IFileManager.h \
     IChunk.h \
@@ -66,6 +74,8 @@ HEADERS += IGetHashesResult.h \
     priv/FileManager.h \
     priv/FileUpdater/FileUpdater.h \
     priv/FileUpdater/DirWatcher.h \
+    priv/FileUpdater/DirScanner.h \
+    priv/FileUpdater/HashScheduler.h \
     priv/Cache/Entry.h \
     priv/Cache/File.h \
     priv/Cache/Directory.h \
@@ -93,5 +103,6 @@ HEADERS += IGetHashesResult.h \
     priv/GetEntriesResult.h \
     priv/ExtensionIndex.h \
     priv/SizeIndexEntries.h \
-    priv/Cache/SharedEntry.h
+    priv/Cache/SharedEntry.h \
+    priv/Finder.h
 OTHER_FILES +=
@@ -76,6 +76,38 @@ namespace FM
         */
       virtual QSharedPointer<IDataWriter> getDataWriter() = 0;
 
+      /**
+        * Return a writer which writes from 'offset', used to download several parts of a chunk at the same time.
+        * The data isn't checked and the known bytes aren't modified, see 'setContiguousKnownBytes(..)'.
+        * @exception FileResetException
+        * @exception UnableToOpenFileInWriteMode
+        */
+      virtual QSharedPointer<IDataWriter> getDataWriter(int offset) = 0;
+
+      /**
+        * Tell the chunk that all the data before 'bytes' has been written with the writers returned by 'getDataWriter(offset)'.
+        * When the chunk becomes complete its hash is checked if the setting 'check_received_data_integrity' is true,
+        * the chunk isn't complete (and its last bytes aren't known) before the end of this check.
+        * @exception IOErrorException
+        * @exception ChunkDeletedException
+        * @exception hashMismatchException The known bytes are reset to 0.
+        * @return 'true' if the chunk is complete.
+        */
+      virtual bool setContiguousKnownBytes(int bytes) = 0;
+
+      /**
+        * Copy the data of a complete chunk having the same hash and size, usually from another file, instead of downloading it.
+        * The data is shared with a reflink when the file system supports it, otherwise it's copied and checked like the received data.
+        * @exception UnableToOpenFileInReadModeException
+        * @exception FileResetException
+        * @exception UnableToOpenFileInWriteModeException
+        * @exception IOErrorException
+        * @exception ChunkDeletedException
+        * @exception hashMismatchException The known bytes are reset to 0.
+        * @return 'true' if the chunk is complete.
+        */
+      virtual bool copyFrom(const QSharedPointer<IChunk>& source) = 0;
+
       /**
         * Number of the chunk, start at 0.
         * The chunk number 0 is the first data chunk in a file and the chunk number 'getNbTotalChunk() - 1' is the last one.
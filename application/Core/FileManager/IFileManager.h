@@ -83,6 +83,12 @@ namespace FM
         */
       virtual QSharedPointer<IChunk> getChunk(const Common::Hash& hash) const = 0;
 
+      /**
+        * Returns a complete chunk having the given hash or an empty pointer if there is none.
+        * Used to copy the data of an identical chunk instead of downloading it, see 'IChunk::copyFrom(..)'.
+        */
+      virtual QSharedPointer<IChunk> getCompleteChunk(const Common::Hash& hash) const = 0;
+
       /**
         * Get all chunks from the file which owns the given hashes.
         * The name and the path of the owner of the returned chunk must match the given entry.
@@ -114,13 +120,17 @@ namespace FM
       /**
         * Return the hashes from a FileEntry. If the hashes don't exist they will be computed on the fly. However this
         * Method is non-blocking, when the hashes are ready a signal will be emitted by the IGetHashesResult object.
+        * The files in 'nextFiles' will be asked later, they are hashed sooner. If 'sendNextHashes' is true their already known hashes
+        * are also emitted, see 'Protos::Core::HashResult::next_file'.
         */
-      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file) = 0;
+      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles = QList<Protos::Common::Entry>(), bool sendNextHashes = false) = 0;
 
       /**
         * Returns the directories and files contained in the given directory. It may wait a while ('get_entries_timeout') if the directory is being scanned.
+        * The result has the status 'NOT_MODIFIED' and no entry if the directory version is still 'knownVersion' (0 means unknown).
+        * Only the entries from 'entriesOffset' to 'entriesOffset + nbMaxEntries' are returned, 'nbMaxEntries' = 0 means no limit.
         */
-      virtual QSharedPointer<IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max()) = 0;
+      virtual QSharedPointer<IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max(), quint64 knownVersion = 0, quint32 entriesOffset = 0, quint32 nbMaxEntries = 0) = 0;
 
       /**
         * Returns the directories and files contained in the given directory.
@@ -146,12 +156,26 @@ namespace FM
       virtual QList<Protos::Common::FindResult> find(const QString& words, int maxNbResult, int maxSize) = 0;
       virtual QList<Protos::Common::FindResult> find(const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize) = 0;
 
+      /**
+        * Same as 'find(..)' but the search is queued and done later by a thread of the file manager, the result is given by 'findDone(..)'.
+        * Thread-safe.
+        * @param requesterID Given back with the result.
+        * @param tag Given back with the result.
+        * @return false if there is too many waiting searches, the search is dropped.
+        */
+      virtual bool findAsync(const Common::Hash& requesterID, quint64 tag, const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize) = 0;
+
       /**
         * Ask if we have the given hashes. For each hashes a bit is set (1 if the hash is known or 0 otherwise) into the returned QBitArray.
         * Returns a null QBitArray if we own any of the given hashes.
         */
       virtual QBitArray haveChunks(const QList<Common::Hash>& hashes) = 0;
 
+      /**
+        * Same as 'haveChunks(..)' but with the hash prefixes given by 'Common::Hash::getPrefix()'.
+        */
+      virtual QBitArray haveChunksByPrefix(const QList<quint64>& hashPrefixes) = 0;
+
       /**
         * Return the amount of shared data.
         */
@@ -171,6 +195,25 @@ namespace FM
         */
       virtual int getProgress() const = 0;
 
+      struct CacheQueuesStats
+      {
+         int nbEntriesToScan;
+         int nbFilesToHash;
+         int nbPrioritizedFilesToHash;
+         quint32 oldestEntryToScanWaitTime; // [ms].
+         quint32 oldestFileToHashWaitTime; // [ms].
+
+         // Time between the first request of a file by a peer and the computation of its first hash.
+         int nbAskedFilesHashed;
+         quint32 averageTimeToFirstHash; // [ms].
+         quint32 maxTimeToFirstHash; // [ms].
+      };
+
+      /**
+        * Return the size of the scanning and hashing queues and the time the oldest item of each queue has been waiting.
+        */
+      virtual CacheQueuesStats getCacheQueuesStats() const = 0;
+
       /**
         * Dump the word index as text in the warning logger.
         * Use only for debugging purpose.
@@ -188,5 +231,10 @@ namespace FM
         * Emitted when the file cache has been loaded: all files and directories from shared entries has been scanned and added to the cache. Guaranteed to be emitted once.
         */
       void fileCacheLoaded();
+
+      /**
+        * Emitted by the search thread for each search asked with 'findAsync(..)'.
+        */
+      void findDone(const Common::Hash& requesterID, quint64 tag, const QList<Protos::Common::FindResult>& results);
    };
 }
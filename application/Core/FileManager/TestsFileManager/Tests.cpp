@@ -29,6 +29,8 @@ using namespace std;
 #include <QDataStream>
 #include <QStringList>
 #include <QDirIterator>
+#include <QScopedPointer>
+#include <QSet>
 
 #include <Protos/core_settings.pb.h>
 
@@ -379,6 +381,21 @@ void Tests::removeADirectory()
    QTest::qSleep(100);
 }
 
+/**
+  * A burst of events to check the coalescing of the watcher events and the recovery when its event queue overflows.
+  */
+void Tests::createAndRemoveManyFiles()
+{
+   qDebug() << "===== createAndRemoveManyFiles() =====";
+
+   for (int i = 0; i < 20000; i++)
+      Common::Global::createFile(QString("sharedDirs/share1/many/%1/%2.txt").arg(i / 1000).arg(i));
+   QTest::qSleep(1000);
+
+   Common::Global::recursiveDeleteDirectory("sharedDirs/share1/many");
+   QTest::qSleep(1000);
+}
+
 void Tests::createAnEmptyFile()
 {
    qDebug() << "===== createAnEmptyFile() =====";
@@ -721,6 +738,23 @@ void Tests::haveChunks()
    }
 }
 
+void Tests::haveChunksByPrefix()
+{
+   qDebug() << "===== haveChunksByPrefix() =====";
+
+   QList<quint64> hashPrefixes;
+   hashPrefixes
+      << Common::Hash::fromStr("f6126deaa5e1d9692d54e3bef0507721372ee7f8").getPrefix() // "/sharedDirs/share3/aaaa bbbb cccc.txt"
+      << Common::Hash::fromStr("954531aef8ac193ad62f4de783da9d7e6ebd59dd").getPrefix() // "/sharedDirs/share1/y.txt" (deleted)
+      << Common::Hash::fromStr("8374d82e993012aa23b293f319eef2c21d2da3b9").getPrefix(); // Random hash
+
+   QBitArray result = this->fileManager->haveChunksByPrefix(hashPrefixes);
+   QCOMPARE(result.size(), hashPrefixes.size());
+   QVERIFY(result[0]);
+   QVERIFY(!result[1]);
+   QVERIFY(!result[2]);
+}
+
 void Tests::printAmount()
 {
    qDebug() << "===== printAmount() =====";
@@ -915,6 +949,65 @@ void Tests::extensionIndexSearchWithSomeExtensions()
    }
 }
 
+#include <priv/FileUpdater/DirWatcher.h>
+
+/**
+  * Produce more events than the inotify queue can hold in a sub directory of the first root.
+  * All the roots must be rescanned, not only the one where the events come from.
+  */
+void Tests::dirWatcherQueueOverflow()
+{
+   qDebug() << "===== dirWatcherQueueOverflow() =====";
+
+#ifdef Q_OS_LINUX
+   QFile maxQueuedEventsFile("/proc/sys/fs/inotify/max_queued_events");
+   if (!maxQueuedEventsFile.open(QIODevice::ReadOnly))
+      QSKIP("Unable to read the size of the inotify queue");
+   const int maxQueuedEvents = QString(maxQueuedEventsFile.readAll()).trimmed().toInt();
+
+   Common::Global::recursiveDeleteDirectory("watchedDirs");
+   QVERIFY(Common::Global::createFile("watchedDirs/root1/a/b/"));
+   QVERIFY(Common::Global::createFile("watchedDirs/root2/"));
+   const QString root1 = QDir::current().absoluteFilePath("watchedDirs/root1");
+   const QString root2 = QDir::current().absoluteFilePath("watchedDirs/root2");
+
+   QScopedPointer<DirWatcher> dirWatcher(DirWatcher::getNewWatcher());
+   QVERIFY(!dirWatcher.isNull());
+   QVERIFY(dirWatcher->addPath(root1));
+   QVERIFY(dirWatcher->addPath(root2));
+
+   // Each iteration produces three events: IN_CREATE, IN_CLOSE_WRITE and IN_DELETE.
+   for (int i = 0; i <= maxQueuedEvents / 3; i++)
+   {
+      QVERIFY(Common::Global::createFile("watchedDirs/root1/a/b/x.txt"));
+      QVERIFY(QFile::remove("watchedDirs/root1/a/b/x.txt"));
+   }
+
+   QSet<QString> rescannedPaths;
+   forever
+   {
+      const QList<WatcherEvent>& events = dirWatcher->waitEvent(200);
+      if (events.isEmpty() || events.first().type == WatcherEvent::TIMEOUT)
+         break;
+
+      for (QListIterator<WatcherEvent> i(events); i.hasNext();)
+      {
+         const WatcherEvent& event = i.next();
+         if (event.type == WatcherEvent::RESCAN)
+            rescannedPaths << event.path1;
+      }
+   }
+
+   QVERIFY(rescannedPaths.contains(root1));
+   QVERIFY(rescannedPaths.contains(root2));
+
+   dirWatcher.reset();
+   Common::Global::recursiveDeleteDirectory("watchedDirs");
+#else
+   QSKIP("The queue overflow is only tested with inotify");
+#endif
+}
+
 void Tests::cleanupTestCase()
 {
    qDebug() << "===== cleanupTestCase() =====";
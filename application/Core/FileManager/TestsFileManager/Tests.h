@@ -67,6 +67,7 @@ private slots:
    void moveAnEmptyDirectory();
    void moveADirectoryContainingFiles();
    void removeADirectory();
+   void createAndRemoveManyFiles();
    void createAnEmptyFile();
 
    /***** Ask for chunks by hash *****/
@@ -96,6 +97,7 @@ private slots:
 
    /***** Ask if the given hashes are known *****/
    void haveChunks();
+   void haveChunksByPrefix();
 
    /***** Ask for the amount of shared byte *****/
    void printAmount();
@@ -115,6 +117,9 @@ private slots:
    void extensionIndexSearchWithOneExtension();
    void extensionIndexSearchWithSomeExtensions();
 
+   /***** The directory watcher *****/
+   void dirWatcherQueueOverflow();
+
    void cleanupTestCase();
 
 private:
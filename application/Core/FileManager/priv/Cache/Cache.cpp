@@ -721,6 +721,11 @@ void Cache::onEntryResized(Entry* entry, qint64 oldSize)
 
 void Cache::onChunkHashKnown(const QSharedPointer<Chunk>& chunk)
 {
+   // The hashes are part of the entries sent to the peers.
+   if (File* file = chunk->getFile())
+      if (Directory* dir = file->getDirectory())
+         dir->contentChanged();
+
    emit chunkHashKnown(chunk);
 }
 
@@ -734,8 +739,12 @@ void Cache::onScanned(Directory* dir)
    emit directoryScanned(dir);
 }
 
+/**
+  * Wait for the readers of the entries, like 'FileManager::find(..)', which may still hold a pointer to 'entry'.
+  */
 void Cache::deleteEntry(Entry* entry)
 {
+   QWriteLocker deletionLocker(&this->deletionLock);
    delete entry;
 }
 
@@ -25,6 +25,7 @@
 #include <QList>
 #include <QStringList>
 #include <QMutex>
+#include <QReadWriteLock>
 #include <QSharedPointer>
 
 #include <Protos/core_protocol.pb.h>
@@ -82,6 +83,7 @@ namespace FM
       quint64 getAmount() const;
 
       FilePool& getFilePool() { return this->filePool; }
+      QReadWriteLock& getDeletionLock() const { return this->deletionLock; }
 
       void onEntryAdded(Entry* entry);
       void onEntryRemoved(Entry* entry);
@@ -130,5 +132,6 @@ namespace FM
       const quint32 MINIMUM_FREE_SPACE;
 
       mutable QMutex mutex; ///< To protect all the data into the cache, files and directories.
+      mutable QReadWriteLock deletionLock; ///< The entries aren't deleted while it's locked for reading, see 'deleteEntry(..)'.
    };
 }
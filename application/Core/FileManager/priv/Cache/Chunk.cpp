@@ -88,6 +88,11 @@ QString Chunk::getFilePath() const
    return QString();
 }
 
+File* Chunk::getFile() const
+{
+   return this->file;
+}
+
 QSharedPointer<IDataReader> Chunk::getDataReader()
 {
    return QSharedPointer<IDataReader>(new DataReader(*this));
@@ -98,6 +103,49 @@ QSharedPointer<IDataWriter> Chunk::getDataWriter()
    return QSharedPointer<IDataWriter>(new DataWriter(*this));
 }
 
+QSharedPointer<IDataWriter> Chunk::getDataWriter(int offset)
+{
+   return QSharedPointer<IDataWriter>(new DataWriter(*this, offset));
+}
+
+/**
+  * Add the known data to 'hasher'.
+  * @exception IOErrorException
+  * @exception ChunkDeletedException
+  * @exception UnableToOpenFileInReadModeException
+  */
+void Chunk::hashKnownData(Common::Hasher& hasher)
+{
+   this->hashData(hasher, this->knownBytes);
+}
+
+/**
+  * Hash the 'nbBytes' first bytes of the chunk, they don't have to be known, see 'setContiguousKnownBytes(..)'.
+  * @exception UnableToOpenFileInReadModeException
+  * @exception IOErrorException
+  * @exception ChunkDeletedException
+  */
+void Chunk::hashData(Common::Hasher& hasher, int nbBytes)
+{
+   static const quint32 BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_reading");
+   char buffer[BUFFER_SIZE];
+
+   if (!this->file)
+      throw ChunkDeletedException();
+
+   DataReader reader(*this); // To open the file in read mode.
+   int offset = 0;
+
+   while (offset < nbBytes)
+   {
+      const qint64 bytesRead = this->file->read(buffer, offset + static_cast<qint64>(this->num) * CHUNK_SIZE, qMin(static_cast<int>(BUFFER_SIZE), nbBytes - offset));
+      if (bytesRead <= 0)
+         break;
+      hasher.addData(buffer, bytesRead);
+      offset += bytesRead;
+   }
+}
+
 void Chunk::newDataWriterCreated()
 {
    if (this->file)
@@ -182,6 +230,88 @@ void Chunk::setKnownBytes(int bytes)
    this->knownBytes = bytes;
 }
 
+bool Chunk::setContiguousKnownBytes(int bytes)
+{
+   if (!this->file)
+      throw ChunkDeletedException();
+
+   const int CURRENT_CHUNK_SIZE = this->getChunkSize();
+   if (bytes > CURRENT_CHUNK_SIZE)
+      bytes = CURRENT_CHUNK_SIZE;
+
+   if (bytes <= this->knownBytes)
+      return this->isComplete();
+
+   if (bytes < CURRENT_CHUNK_SIZE)
+   {
+      this->knownBytes = bytes;
+      return false;
+   }
+
+   // The last bytes become known only once the data is checked, before that the chunk mustn't be seen as complete:
+   // it would be sent to the other peers, announced as owned and used as a copy source (see 'copyFrom(..)').
+   if (SETTINGS.get<bool>("check_received_data_integrity"))
+   {
+      Common::Hasher hasher;
+      try
+      {
+         this->hashData(hasher, CURRENT_CHUNK_SIZE);
+      }
+      catch (UnableToOpenFileInReadModeException&)
+      {
+         this->knownBytes = 0;
+         throw IOErrorException();
+      }
+
+      if (hasher.getResult() != this->hash)
+      {
+         this->knownBytes = 0;
+         throw hashMismatchException();
+      }
+
+      if (!this->file) // The file may have been deleted during the hashing.
+         throw ChunkDeletedException();
+   }
+
+   this->knownBytes = CURRENT_CHUNK_SIZE;
+   this->file->chunkComplete(this);
+   return true;
+}
+
+bool Chunk::copyFrom(const QSharedPointer<IChunk>& source)
+{
+   if (!this->file)
+      throw ChunkDeletedException();
+
+   const QSharedPointer<Chunk> sourceChunk = source.dynamicCast<Chunk>();
+   const int CURRENT_CHUNK_SIZE = this->getChunkSize();
+
+   if (sourceChunk.isNull() || sourceChunk.data() == this || sourceChunk->getHash() != this->hash || !sourceChunk->isComplete() || sourceChunk->getChunkSize() != CURRENT_CHUNK_SIZE)
+      return false;
+
+   DataReader reader(*sourceChunk);
+
+   if (this->knownBytes == 0)
+   {
+      DataWriter writer(*this, 0); // To open the file in write mode.
+      if (this->file->cloneRange(*sourceChunk->file, static_cast<qint64>(sourceChunk->num) * CHUNK_SIZE, static_cast<qint64>(this->num) * CHUNK_SIZE, CURRENT_CHUNK_SIZE))
+      {
+         L_DEBU(QString("Chunk[%1] cloned from %2").arg(this->num).arg(sourceChunk->getFilePath()));
+         return this->setContiguousKnownBytes(CURRENT_CHUNK_SIZE);
+      }
+   }
+
+   static const quint32 BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_reading");
+   QByteArray buffer(BUFFER_SIZE, 0); // Not on the stack, the method is called by a download thread.
+
+   DataWriter writer(*this);
+   int bytesRead = 0;
+   while (!this->isComplete() && (bytesRead = reader.read(buffer.data(), this->knownBytes)))
+      writer.write(buffer.constData(), bytesRead);
+
+   return this->isComplete();
+}
+
 int Chunk::getChunkSize() const
 {
    if (!this->file)
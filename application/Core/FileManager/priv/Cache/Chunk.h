@@ -57,9 +57,11 @@ namespace FM
       bool populateEntry(Protos::Common::Entry* entry) const;
 
       QString getFilePath() const;
+      File* getFile() const;
 
       QSharedPointer<IDataReader> getDataReader();
       QSharedPointer<IDataWriter> getDataWriter();
+      QSharedPointer<IDataWriter> getDataWriter(int offset);
 
       void newDataWriterCreated();
       void newDataReaderCreated();
@@ -71,6 +73,10 @@ namespace FM
 
       inline int read(char* buffer, int offset);
       inline bool write(const char* buffer, int nbBytes);
+      inline int write(const char* buffer, int nbBytes, int offset);
+
+      void hashKnownData(Common::Hasher& hasher);
+      void hashData(Common::Hasher& hasher, int nbBytes);
 
       int getNum() const;
       int getNbTotalChunk() const;
@@ -82,6 +88,8 @@ namespace FM
 
       int getKnownBytes() const;
       void setKnownBytes(int bytes);
+      bool setContiguousKnownBytes(int bytes);
+      bool copyFrom(const QSharedPointer<IChunk>& source);
 
       int getChunkSize() const;
       bool isComplete() const;
@@ -159,3 +167,21 @@ inline bool FM::Chunk::write(const char* buffer, int nbBytes)
 
    return COMPLETE;
 }
+
+/**
+  * Write the given buffer at 'offset', 'knownBytes' isn't modified.
+  * @exception IOErrorException
+  * @exception ChunkDeletedException
+  * @exception TryToWriteBeyondTheEndOfChunkException
+  * @return The number of bytes written.
+  */
+inline int FM::Chunk::write(const char* buffer, int nbBytes, int offset)
+{
+   if (!this->file)
+      throw ChunkDeletedException();
+
+   if (offset + nbBytes > this->getChunkSize())
+      throw TryToWriteBeyondTheEndOfChunkException();
+
+   return this->file->write(buffer, nbBytes, offset + static_cast<qint64>(this->num) * CHUNK_SIZE);
+}
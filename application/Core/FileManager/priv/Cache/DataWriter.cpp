@@ -32,12 +32,23 @@ using namespace FM;
   * @exception ChunkDataUnknownException
   */
 DataWriter::DataWriter(Chunk& chunk) :
-   CHECK_DATA_INTEGRITY(SETTINGS.get<bool>("check_received_data_integrity")), chunk(chunk)
+   CHECK_DATA_INTEGRITY(SETTINGS.get<bool>("check_received_data_integrity")), chunk(chunk), offset(-1)
 {
    this->computeChunkHash();
    this->chunk.newDataWriterCreated();
 }
 
+/**
+  * Write the data from 'offset', the data is checked by 'Chunk::setContiguousKnownBytes(..)'.
+  * @exception FileResetException
+  * @exception UnableToOpenFileInWriteModeException
+  */
+DataWriter::DataWriter(Chunk& chunk, int offset) :
+   CHECK_DATA_INTEGRITY(false), chunk(chunk), offset(offset)
+{
+   this->chunk.newDataWriterCreated();
+}
+
 DataWriter::~DataWriter()
 {
    this->chunk.dataWriterDeleted();
@@ -45,6 +56,12 @@ DataWriter::~DataWriter()
 
 bool DataWriter::write(const char* buffer, int nbBytes)
 {
+   if (this->offset >= 0)
+   {
+      this->offset += this->chunk.write(buffer, nbBytes, this->offset);
+      return this->offset == this->chunk.getChunkSize();
+   }
+
    if (this->CHECK_DATA_INTEGRITY)
    {
       this->hasher.addData(buffer, nbBytes);
@@ -67,18 +84,7 @@ void DataWriter::computeChunkHash()
    {
       try
       {
-         static const quint32 BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_reading");
-         char buffer[BUFFER_SIZE];
-
-         DataReader reader(this->chunk);
-         int offset = 0;
-         int bytesRead = 0;
-
-         while (bytesRead = reader.read(buffer, offset))
-         {
-            this->hasher.addData(buffer, bytesRead);
-            offset += bytesRead;
-         }
+         this->chunk.hashKnownData(this->hasher);
       }
       // If the file can't be read it may be created later.
       catch (UnableToOpenFileInReadModeException&)
@@ -30,6 +30,7 @@ namespace FM
    {
    public:
       DataWriter(Chunk& chunk);
+      DataWriter(Chunk& chunk, int offset);
       ~DataWriter();
 
       bool write(const char* buffer, int nbBytes);
@@ -41,5 +42,6 @@ namespace FM
 
       Common::Hasher hasher;
       Chunk& chunk;
+      int offset; ///< -1 if the data is written after the known bytes.
    };
 }
@@ -20,6 +20,7 @@
 using namespace FM;
 
 #include <QDir>
+#include <QRandomGenerator64>
 
 #include <Common/ProtoHelper.h>
 #include <Common/Global.h>
@@ -39,7 +40,8 @@ Directory::Directory(SharedEntry* root, const QString& name, Directory* parent,
    parent(parent),
    subDirs(&Directory::entrySortingFun),
    files(&Directory::entrySortingFun),
-   scanned(true)
+   scanned(true),
+   version(QRandomGenerator64::global()->generate64()) // Random to not reuse the versions known by the peers after a restart.
 {
    QMutexLocker locker(&this->mutex);
    L_DEBU(QString("New Directory: %1, createPhysically = %2").arg(this->getFullPath()).arg(createPhysically));
@@ -217,12 +219,14 @@ void Directory::fileDeleted(File* file)
 
    (*this) -= file->getSize();
    this->files.removeOne(file);
+   this->contentChanged();
 }
 
 void Directory::subDirDeleted(Directory* dir)
 {
    QMutexLocker locker(&this->mutex);
    this->subDirs.removeOne(dir);
+   this->contentChanged();
 }
 
 Common::Path Directory::getPath() const
@@ -355,6 +359,7 @@ void Directory::add(File* file)
    QMutexLocker locker(&this->mutex);
    this->files.insert(file);
    (*this) += file->getSize();
+   this->contentChanged();
 }
 
 void Directory::fileSizeChanged(qint64 oldSize, qint64 newSize)
@@ -393,12 +398,16 @@ void Directory::stealContent(Directory* dir)
 
    dir->subDirs.clear();
    dir->files.clear();
+
+   this->contentChanged();
+   dir->contentChanged();
 }
 
 void Directory::add(Directory* dir)
 {
    QMutexLocker locker(&this->mutex);
    this->subDirs.insert(dir);
+   this->contentChanged();
 }
 
 bool Directory::isScanned() const
@@ -419,6 +428,23 @@ void Directory::setScanned(bool value)
       this->cache->onScanned(this);
 }
 
+quint64 Directory::getVersion() const
+{
+   return this->version.loadAcquire();
+}
+
+/**
+  * Must be called each time the entries of this directory change. The parent lists this directory
+  * with its size and its emptiness so its version changes too.
+  * Lock-free because it may be called while a file is locked.
+  */
+void Directory::contentChanged()
+{
+   this->version.fetchAndAddOrdered(1);
+   if (Directory* parent = this->parent)
+      parent->version.fetchAndAddOrdered(1);
+}
+
 /**
   * Must be called only by a file.
   */
@@ -426,6 +452,7 @@ void Directory::fileNameChanged(File* file)
 {
    QMutexLocker locker(&this->mutex);
    this->files.itemChanged(file);
+   this->contentChanged();
 }
 
 void Directory::deleteSubDirs()
@@ -438,6 +465,7 @@ void Directory::subdirNameChanged(Directory* dir)
 {
    QMutexLocker locker(&this->mutex);
    this->subDirs.itemChanged(dir);
+   this->contentChanged();
 }
 
 /**
@@ -449,6 +477,7 @@ Directory& Directory::operator+=(qint64 size)
    QMutexLocker locker(&this->mutex);
 
    this->setSize(this->getSize() + size);
+   this->contentChanged();
 
    if (this->parent)
       (*this->parent) += size;
@@ -461,6 +490,7 @@ Directory& Directory::operator-=(qint64 size)
    QMutexLocker locker(&this->mutex);
 
    this->setSize(this->getSize() - size);
+   this->contentChanged();
 
    if (this->parent)
       (*this->parent) -= size;
@@ -24,6 +24,7 @@
 #include <QFileInfo>
 #include <QMutex>
 #include <QMap>
+#include <QAtomicInteger>
 
 #include <Protos/common.pb.h>
 
@@ -85,6 +86,9 @@ namespace FM
       bool isScanned() const;
       void setScanned(bool value);
 
+      quint64 getVersion() const;
+      void contentChanged();
+
       void fileNameChanged(File* file);
 
    protected:
@@ -104,6 +108,8 @@ namespace FM
       Common::SortedList<File*> files; ///< Sorted by name.
 
       bool scanned;
+
+      QAtomicInteger<quint64> version; ///< Changes each time an entry returned by 'GetEntriesResult' may change, see 'contentChanged()'.
    };
 
    class DirIterator
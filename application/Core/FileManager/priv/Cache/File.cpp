@@ -25,6 +25,11 @@ using namespace FM;
    #include <WinIoCtl.h>
 #endif
 
+#ifdef Q_OS_LINUX
+   #include <sys/ioctl.h>
+   #include <linux/fs.h>
+#endif
+
 #include <QString>
 #include <QFile>
 
@@ -255,7 +260,15 @@ bool File::matchesEntry(const Protos::Common::Entry& entry) const
   */
 bool File::correspondTo(const QFileInfo& fileInfo, bool checkTheDateToo)
 {
-   return this->getSize() == fileInfo.size() && (!checkTheDateToo || this->getDateLastModified() == fileInfo.lastModified());
+   return this->correspondTo(fileInfo.size(), fileInfo.lastModified(), checkTheDateToo);
+}
+
+/**
+  * Return true if the size and the last modification date correspond to the given ones.
+  */
+bool File::correspondTo(qint64 size, const QDateTime& dateLastModified, bool checkTheDateToo)
+{
+   return this->getSize() == size && (!checkTheDateToo || this->getDateLastModified() == dateLastModified);
 }
 
 Common::Path File::getPath() const
@@ -429,6 +442,37 @@ qint64 File::read(char* buffer, qint64 offset, int maxBytesToRead)
    return bytesRead;
 }
 
+/**
+  * Share the data of 'source' from 'sourceOffset' with this file at 'offset' without copying it (reflink, copy-on-write).
+  * The source must be opened in read mode and this file in write mode, see 'newDataReaderCreated()' and 'newDataWriterCreated()'.
+  * @return 'false' if the file system doesn't support it (or not for the given range), the data must then be copied.
+  */
+bool File::cloneRange(File& source, qint64 sourceOffset, qint64 offset, qint64 length)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONERANGE)
+   QMutexLocker locker(&this->writeLock);
+   QMutexLocker sourceLocker(&source.readLock);
+
+   if (!this->fileInWriteMode || !source.fileInReadMode || offset + length > this->getSize() || sourceOffset + length > source.getSize())
+      return false;
+
+   // The offsets and the length must be aligned on the block size of the file system, except if the range ends at the end of the source file.
+   file_clone_range range;
+   range.src_fd = source.fileInReadMode->handle();
+   range.src_offset = sourceOffset;
+   range.src_length = length;
+   range.dest_offset = offset;
+
+   return ioctl(this->fileInWriteMode->handle(), FICLONERANGE, &range) == 0;
+#else
+   Q_UNUSED(source);
+   Q_UNUSED(sourceOffset);
+   Q_UNUSED(offset);
+   Q_UNUSED(length);
+   return false;
+#endif
+}
+
 QVector<QSharedPointer<Chunk>> File::getChunks() const
 {
    return this->chunks;
@@ -549,6 +593,11 @@ void File::changeDirectory(Directory* dir)
    this->dir = dir;
 }
 
+Directory* File::getDirectory() const
+{
+   return this->dir;
+}
+
 /**
   * If dir is a parent dir of the file return true.
   */
@@ -601,6 +650,8 @@ void File::setAsComplete()
          this->dateLastModified = QFileInfo(newPath).lastModified();
          this->name = Global::removeUnfinishedSuffix(this->name);
          this->cache->onEntryAdded(this); // To add the name to the index. (a bit tricky).
+         if (this->dir)
+            this->dir->contentChanged();
       }
    }
 }
@@ -72,6 +72,7 @@ namespace FM
       bool matchesEntry(const Protos::Common::Entry& entry) const;
 
       bool correspondTo(const QFileInfo& fileInfo, bool checkTheDateToo = true);
+      bool correspondTo(qint64 size, const QDateTime& dateLastModified, bool checkTheDateToo = true);
 
       Common::Path getPath() const;
       Common::Path getFullPath() const;
@@ -86,6 +87,7 @@ namespace FM
 
       qint64 write(const char* buffer, int nbBytes, qint64 offset);
       qint64 read(char* buffer, qint64 offset, int maxBytesToRead);
+      bool cloneRange(File& source, qint64 sourceOffset, qint64 offset, qint64 length);
 
       QVector<QSharedPointer<Chunk>> getChunks() const;
       bool hasAllHashes();
@@ -102,6 +104,7 @@ namespace FM
       void moveInto(Directory* directory);
 
       void changeDirectory(Directory* dir);
+      Directory* getDirectory() const;
       bool hasAParentDir(Directory* dir);
 
    private:
@@ -46,6 +46,7 @@ void Chunks::add(const QSharedPointer<Chunk>& chunk)
 
    QMutexLocker locker(&this->mutex);
    this->insert(chunk->getHash(), chunk);
+   this->prefixes[chunk->getHash().getPrefix()]++;
 #ifdef BLOOM_FILTER_ON
    this->bloomFilter.add(chunk->getHash());
 #endif
@@ -57,7 +58,13 @@ void Chunks::rm(const QSharedPointer<Chunk>& chunk)
       return;
 
    QMutexLocker locker(&this->mutex);
-   this->remove(chunk->getHash(), chunk);
+   const int nbRemoved = this->remove(chunk->getHash(), chunk);
+   if (nbRemoved > 0)
+   {
+      QHash<quint64, int>::iterator i = this->prefixes.find(chunk->getHash().getPrefix());
+      if (i != this->prefixes.end() && (*i -= nbRemoved) <= 0)
+         this->prefixes.erase(i);
+   }
 #ifdef BLOOM_FILTER_ON
    if (this->isEmpty())
       this->bloomFilter.reset();
@@ -103,3 +110,12 @@ bool Chunks::contains(const Common::Hash& hash) const
 #endif
    return QMultiHash<Common::Hash, QSharedPointer<Chunk>>::contains(hash);
 }
+
+/**
+  * Returns 'true' if we know at least one chunk whose hash begins with the given prefix.
+  */
+bool Chunks::containsPrefix(quint64 prefix) const
+{
+   QMutexLocker locker(&this->mutex);
+   return this->prefixes.contains(prefix);
+}
@@ -44,10 +44,13 @@ namespace FM
       QSharedPointer<Chunk> value(const Common::Hash& hash) const;
       QList<QSharedPointer<Chunk>> values(const Common::Hash& hash) const;
       bool contains(const Common::Hash& hash) const;
+      bool containsPrefix(quint64 prefix) const;
 
    private:
       mutable QMutex mutex; // From the documentation : "they (containers) are thread-safe in situations where they are used as read-only containers by all threads used to access them.".
 
+      QHash<quint64, int> prefixes; // The number of chunks for each hash prefix, see 'Common::Hash::getPrefix()'.
+
 #ifdef BLOOM_FILTER_ON
       BloomFilter bloomFilter;
 #endif
@@ -25,4 +25,7 @@ namespace FM
    // When searching we don't want to send all the hashes of entries
    // because it may take a lot of memory (UDP datagram are very small).
    const int NB_MAX_HASHES_PER_ENTRY_SEARCH = 8;
+
+   // The searches asked by the other peers beyond this number are dropped, see 'Finder'.
+   const int MAX_NB_WAITING_SEARCHES = 32;
 }
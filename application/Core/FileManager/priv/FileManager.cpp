@@ -28,6 +28,7 @@ using namespace FM;
 #include <QVector>
 #include <QDir>
 #include <QMutableListIterator>
+#include <QReadWriteLock>
 
 #include <google/protobuf/text_format.h>
 
@@ -57,6 +58,7 @@ LOG_INIT_CPP(FileManager)
 FileManager::FileManager(QSharedPointer<HC::IHashCache> hashCache) :
    fileUpdater(this),
    cache(hashCache),
+   finder(this),
    cacheLoading(true)
 {
    Chunk::CHUNK_SIZE = Common::Constants::CHUNK_SIZE;
@@ -80,10 +82,13 @@ FileManager::FileManager(QSharedPointer<HC::IHashCache> hashCache) :
 
    // TODO: call addRoot for each shared entry in settings.
    this->fileUpdater.start();
+   this->finder.start();
 }
 
 FileManager::~FileManager()
 {
+   L_DEBU("~FileManager: Stopping the finder . . .");
+   this->finder.stop();
    L_DEBU("~FileManager: Stopping the file updater . . .");
    this->fileUpdater.stop();
    this->cache.disconnect(this);
@@ -125,6 +130,21 @@ QSharedPointer<IChunk> FileManager::getChunk(const Common::Hash& hash) const
    return this->chunks.value(hash);
 }
 
+QSharedPointer<IChunk> FileManager::getCompleteChunk(const Common::Hash& hash) const
+{
+   // Chunks from different files, usually one chunk.
+   const QList<QSharedPointer<Chunk>>& chunks = this->chunks.values(hash);
+
+   for (QListIterator<QSharedPointer<Chunk>> i(chunks); i.hasNext();)
+   {
+      QSharedPointer<Chunk> chunk = i.next();
+      if (chunk->isComplete())
+         return chunk;
+   }
+
+   return QSharedPointer<IChunk>();
+}
+
 QList<QSharedPointer<IChunk>> FileManager::getAllChunks(const Protos::Common::Entry& localEntry, const Common::Hashes& hashes) const
 {
    for (QListIterator<Common::Hash> h(hashes); h.hasNext();)
@@ -167,14 +187,14 @@ void FileManager::newDirectory(Protos::Common::Entry& entry)
    this->cache.newDirectory(entry);
 }
 
-QSharedPointer<IGetHashesResult> FileManager::getHashes(const Protos::Common::Entry& file)
+QSharedPointer<IGetHashesResult> FileManager::getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, bool sendNextHashes)
 {
-   return QSharedPointer<IGetHashesResult>(new GetHashesResult(file, this->cache, this->fileUpdater));
+   return QSharedPointer<IGetHashesResult>(new GetHashesResult(file, nextFiles, sendNextHashes, this->cache, this->fileUpdater));
 }
 
-QSharedPointer<IGetEntriesResult> FileManager::getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry)
+QSharedPointer<IGetEntriesResult> FileManager::getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry, quint64 knownVersion, quint32 entriesOffset, quint32 nbMaxEntries)
 {
-   return QSharedPointer<IGetEntriesResult>(new GetEntriesResult(this->cache.getDirectory(dir), maxNbHashesPerEntry));
+   return QSharedPointer<IGetEntriesResult>(new GetEntriesResult(this->cache.getDirectory(dir), maxNbHashesPerEntry, knownVersion, entriesOffset, nbMaxEntries));
 }
 
 Protos::Common::Entries FileManager::getEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry)
@@ -187,8 +207,13 @@ Protos::Common::Entries FileManager::getEntries()
    return this->cache.getProtoSharedEntries();
 }
 
+/**
+  * Thread-safe, the entries returned by the indexes can't be deleted while the cache deletion lock is held.
+  */
 QList<Protos::Common::FindResult> FileManager::find(const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize)
 {
+   QReadLocker deletionLocker(&this->cache.getDeletionLock());
+
    bool filterBySizeOn = minFileSize > 0 || maxFileSize != std::numeric_limits<qint64>::max();
    bool filterByExtensionsOn = !extensions.isEmpty();
    bool filterByCategoryOn = category != Protos::Common::FindPattern::FILE_DIR;
@@ -263,7 +288,11 @@ QList<Protos::Common::FindResult> FileManager::find(const QString& words, const
 
       File* file = dynamic_cast<File*>(entry.value);
       if (file)
+      {
          file->populateEntry(entryLevel->mutable_entry(), true, NB_MAX_HASHES_PER_ENTRY_SEARCH);
+         if (!file->hasAllHashes())
+            this->fileUpdater.fileAsked(file);
+      }
       else
          entry.value->populateEntry(entryLevel->mutable_entry(), true);
 
@@ -290,6 +319,15 @@ QList<Protos::Common::FindResult> FileManager::find(const QString& words, const
    return findResults;
 }
 
+bool FileManager::findAsync(const Common::Hash& requesterID, quint64 tag, const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize)
+{
+   if (this->finder.add(Finder::Search { requesterID, tag, words, extensions, minFileSize, maxFileSize, category, maxNbResult, maxSize }))
+      return true;
+
+   L_WARN(QString("Too many waiting searches, the search from %1 is dropped").arg(requesterID.toStr()));
+   return false;
+}
+
 QBitArray FileManager::haveChunks(const QList<Common::Hash>& hashes)
 {
    QBitArray result(hashes.size()); // All bits to 0 by default.
@@ -307,6 +345,23 @@ QBitArray FileManager::haveChunks(const QList<Common::Hash>& hashes)
    return result;
 }
 
+QBitArray FileManager::haveChunksByPrefix(const QList<quint64>& hashPrefixes)
+{
+   QBitArray result(hashPrefixes.size());
+   bool ownsAtLeastOneChunk = false;
+   for (int i = 0; i < hashPrefixes.size(); i++)
+      if (this->chunks.containsPrefix(hashPrefixes[i]))
+      {
+         result.setBit(i, true);
+         ownsAtLeastOneChunk = true;
+      }
+
+   if (!ownsAtLeastOneChunk)
+      return QBitArray();
+
+   return result;
+}
+
 quint64 FileManager::getAmount()
 {
    return this->cache.getAmount();
@@ -328,6 +383,11 @@ int FileManager::getProgress() const
    return this->fileUpdater.getProgress();
 }
 
+IFileManager::CacheQueuesStats FileManager::getCacheQueuesStats() const
+{
+   return this->fileUpdater.getCacheQueuesStats();
+}
+
 void FileManager::dumpWordIndex() const
 {
    L_WARN(this->wordIndex.toStringLog());
@@ -43,6 +43,7 @@
 #include <priv/WordIndex/WordIndex.h>
 #include <priv/ExtensionIndex.h>
 #include <priv/SizeIndexEntries.h>
+#include <priv/Finder.h>
 
 namespace FM
 {
@@ -65,21 +66,25 @@ namespace FM
       QString getSharedEntry(const Common::Hash& ID) const;
 
       QSharedPointer<IChunk> getChunk(const Common::Hash& hash) const;
+      QSharedPointer<IChunk> getCompleteChunk(const Common::Hash& hash) const;
       QList<QSharedPointer<IChunk>> getAllChunks(const Protos::Common::Entry& localEntry, const Common::Hashes& hashes) const;
       QList<QSharedPointer<IChunk>> newFile(Protos::Common::Entry& entry);
       void newDirectory(Protos::Common::Entry& entry);
-      QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file);
+      QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, bool sendNextHashes);
 
-      QSharedPointer<IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max());
+      QSharedPointer<IGetEntriesResult> getScannedEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max(), quint64 knownVersion = 0, quint32 entriesOffset = 0, quint32 nbMaxEntries = 0);
       Protos::Common::Entries getEntries(const Protos::Common::Entry& dir, int maxNbHashesPerEntry = std::numeric_limits<int>::max());
       Protos::Common::Entries getEntries();
 
       inline QList<Protos::Common::FindResult> find(const QString& words, int maxNbResult, int maxSize) { return this->find(words, QList<QString>(), 0, std::numeric_limits<qint64>::max(), Protos::Common::FindPattern::FILE_DIR, maxNbResult, maxSize); }
       QList<Protos::Common::FindResult> find(const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize);
+      bool findAsync(const Common::Hash& requesterID, quint64 tag, const QString& words, const QList<QString>& extensions, qint64 minFileSize, qint64 maxFileSize, Protos::Common::FindPattern_Category category, int maxNbResult, int maxSize);
       QBitArray haveChunks(const QList<Common::Hash>& hashes);
+      QBitArray haveChunksByPrefix(const QList<quint64>& hashPrefixes);
       quint64 getAmount();
       CacheStatus getCacheStatus() const;
       int getProgress() const;
+      CacheQueuesStats getCacheQueuesStats() const;
 
       void dumpWordIndex() const;
       void printSimilarFiles() const;
@@ -115,6 +120,8 @@ namespace FM
       ExtensionIndex<Entry*> extensionIndex;
       SizeIndexEntries sizeIndex;
 
+      Finder finder; ///< Does the searches asked by 'findAsync(..)'.
+
       QMutex mutexCacheChanged;
       bool cacheLoading;
       bool cacheChanged;
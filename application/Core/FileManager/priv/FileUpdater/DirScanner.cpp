@@ -0,0 +1,340 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/FileUpdater/DirScanner.h>
+using namespace FM;
+
+#include <algorithm>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#if defined(Q_OS_LINUX)
+   #include <unistd.h>
+   #include <fcntl.h>
+   #include <dirent.h>
+   #include <sys/stat.h>
+   #include <sys/syscall.h>
+#endif
+
+#include <priv/Log.h>
+
+/**
+  * @class FM::DirScanner
+  *
+  * Read the content of a directory tree with several threads. Used by 'FileUpdater::scan(..)'.
+  * Each thread owns a queue of directories to read, the sub-directories it finds are put in its own queue
+  * and when its queue is empty it steals a directory from the queue of another thread.
+  *
+  * The read directories are returned by 'next(..)' in any order, a directory may be returned before its parent.
+  * Only the information needed by 'File::correspondTo(..)' is read (size and date of last modification).
+  * On Linux the entries are read with 'getdents64' and the directory type given by 'd_type' avoids to stat them,
+  * the files are stat with 'statx' which also gives their device and inode, see 'HashScheduler::Location'.
+  */
+
+namespace
+{
+#if defined(Q_OS_LINUX)
+   struct linux_dirent64
+   {
+      ino64_t d_ino;
+      off64_t d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[];
+   };
+#endif
+
+   template <typename T>
+   bool lowerNameLesserThan(const T& e1, const T& e2)
+   {
+      return e1.lowerName < e2.lowerName;
+   }
+}
+
+DirScanner::DirScanner(int nbThreads) :
+   nbThreads(qMax(1, nbThreads)), nbQueuedTasks(0), nbPendingTasks(0), aborted(false), toStop(false)
+{
+}
+
+DirScanner::~DirScanner()
+{
+   this->mutex.lock();
+   this->toStop = true;
+   this->taskAdded.wakeAll();
+   this->mutex.unlock();
+
+   for (QListIterator<Worker*> i(this->workers); i.hasNext();)
+   {
+      Worker* worker = i.next();
+      worker->wait();
+      delete worker;
+   }
+}
+
+/**
+  * Begin to read the given directory and its sub-directories. The result must be read with 'next(..)'.
+  * The threads are created the first time.
+  */
+void DirScanner::start(const QString& path)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (this->workers.isEmpty())
+      for (int i = 0; i < this->nbThreads; i++)
+      {
+         Worker* worker = new Worker(this, i);
+         this->workers << worker;
+         worker->start();
+      }
+
+   QString cleanedPath = QDir::cleanPath(path);
+   if (cleanedPath.endsWith('/') && cleanedPath.size() > 1)
+      cleanedPath.chop(1);
+
+   this->aborted = false;
+   this->results.clear();
+   this->nextId = 1;
+
+   Worker* worker = this->workers.first();
+   worker->tasksMutex.lock();
+   worker->tasks << Task { cleanedPath, 0 };
+   worker->tasksMutex.unlock();
+
+   this->nbQueuedTasks++;
+   this->nbPendingTasks++;
+   this->taskAdded.wakeOne();
+}
+
+/**
+  * Wait for the next read directory.
+  * @return 'false' when all the directories have been returned.
+  */
+bool DirScanner::next(ScannedDir& scannedDir)
+{
+   QMutexLocker locker(&this->mutex);
+
+   while (this->results.isEmpty() && this->nbPendingTasks > 0)
+      this->taskFinished.wait(&this->mutex);
+
+   if (this->results.isEmpty())
+      return false;
+
+   scannedDir = this->results.takeFirst();
+   return true;
+}
+
+/**
+  * Stop the current reading. Wait for the directories being read.
+  */
+void DirScanner::abort()
+{
+   QMutexLocker locker(&this->mutex);
+
+   this->aborted = true;
+
+   for (QListIterator<Worker*> i(this->workers); i.hasNext();)
+   {
+      Worker* worker = i.next();
+      QMutexLocker tasksLocker(&worker->tasksMutex);
+      this->nbPendingTasks -= worker->tasks.size();
+      worker->tasks.clear();
+   }
+   this->nbQueuedTasks = 0;
+
+   while (this->nbPendingTasks > 0)
+      this->taskFinished.wait(&this->mutex);
+
+   this->results.clear();
+}
+
+/**
+  * Take the last task of the worker queue or the first task of another worker queue.
+  * Wait if there is no task.
+  * @return 'false' if the scanner is stopping.
+  */
+bool DirScanner::takeTask(int workerNum, Task& task)
+{
+   QMutexLocker locker(&this->mutex);
+
+   forever
+   {
+      if (this->toStop)
+         return false;
+
+      if (this->nbQueuedTasks > 0)
+      {
+         for (int i = 0; i < this->workers.size(); i++)
+         {
+            Worker* worker = this->workers[(workerNum + i) % this->workers.size()];
+            QMutexLocker tasksLocker(&worker->tasksMutex);
+            if (!worker->tasks.isEmpty())
+            {
+               task = i == 0 ? worker->tasks.takeLast() : worker->tasks.takeFirst();
+               this->nbQueuedTasks--;
+               return true;
+            }
+         }
+      }
+
+      this->taskAdded.wait(&this->mutex);
+   }
+}
+
+void DirScanner::taskDone(int workerNum, ScannedDir&& scannedDir, const QList<Task>& subTasks)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (!this->aborted)
+   {
+      if (!subTasks.isEmpty())
+      {
+         Worker* worker = this->workers[workerNum];
+         worker->tasksMutex.lock();
+         for (QListIterator<Task> i(subTasks); i.hasNext();)
+            worker->tasks << i.next();
+         worker->tasksMutex.unlock();
+
+         this->nbQueuedTasks += subTasks.size();
+         this->nbPendingTasks += subTasks.size();
+
+         // The worker will take one task, the others may be stolen.
+         if (subTasks.size() > 1)
+            this->taskAdded.wakeAll();
+      }
+
+      this->results << std::move(scannedDir);
+   }
+
+   this->nbPendingTasks--;
+   this->taskFinished.wakeAll();
+}
+
+/**
+  * Read the content of the directory 'path', the hidden entries and the symlinks are ignored.
+  * A sub-task is created for each sub-directory.
+  */
+void DirScanner::readDir(const QString& path, ScannedDir& scannedDir, QList<Task>& subTasks, QAtomicInt& nextId)
+{
+   const QString pathPrefix = path.endsWith('/') ? path : path + '/';
+
+   auto addDir = [&](const QString& name) {
+      const int id = nextId.fetchAndAddRelaxed(1);
+      scannedDir.dirs << ScannedSubDir { name, name.toLower(), id };
+      subTasks << Task { pathPrefix + name, id };
+   };
+
+#if defined(Q_OS_LINUX)
+   const int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      L_DEBU(QString("DirScanner::readDir: unable to open %1").arg(path));
+      return;
+   }
+
+   char buffer[32 * 1024];
+   forever
+   {
+      const long nbBytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+      if (nbBytes <= 0)
+         break;
+
+      for (long i = 0; i < nbBytes;)
+      {
+         const linux_dirent64* dirent = reinterpret_cast<const linux_dirent64*>(buffer + i);
+         i += dirent->d_reclen;
+
+         // '.', '..' and the hidden entries.
+         if (dirent->d_name[0] == '.')
+            continue;
+
+         if (dirent->d_type == DT_DIR)
+         {
+            addDir(QFile::decodeName(dirent->d_name));
+            continue;
+         }
+
+         // The symlinks and the special files are ignored.
+         if (dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN)
+            continue;
+
+         struct statx stx;
+         const unsigned int mask = STATX_SIZE | STATX_MTIME | STATX_INO | (dirent->d_type == DT_UNKNOWN ? STATX_TYPE : 0);
+         if (statx(fd, dirent->d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &stx) < 0)
+            continue;
+
+         if (dirent->d_type == DT_UNKNOWN)
+         {
+            if (S_ISDIR(stx.stx_mode))
+            {
+               addDir(QFile::decodeName(dirent->d_name));
+               continue;
+            }
+            else if (!S_ISREG(stx.stx_mode))
+               continue;
+         }
+
+         const QString name = QFile::decodeName(dirent->d_name);
+         scannedDir.files << ScannedFile {
+            name,
+            name.toLower(),
+            static_cast<qint64>(stx.stx_size),
+            QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(stx.stx_mtime.tv_sec) * 1000 + stx.stx_mtime.tv_nsec / 1000000),
+            static_cast<quint64>(stx.stx_dev_major) << 32 | stx.stx_dev_minor,
+            static_cast<quint64>(stx.stx_ino)
+         };
+      }
+   }
+
+   close(fd);
+#else
+   foreach (QFileInfo fileInfo, QDir(path).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::NoSymLinks)) // TODO: Add an option to follow or not symlinks.
+   {
+      if (fileInfo.isDir())
+         addDir(fileInfo.fileName());
+      else
+         scannedDir.files << ScannedFile { fileInfo.fileName(), fileInfo.fileName().toLower(), fileInfo.size(), fileInfo.lastModified(), 0, 0 };
+   }
+#endif
+
+   std::sort(scannedDir.dirs.begin(), scannedDir.dirs.end(), &lowerNameLesserThan<ScannedSubDir>);
+   std::sort(scannedDir.files.begin(), scannedDir.files.end(), &lowerNameLesserThan<ScannedFile>);
+}
+
+/////
+
+DirScanner::Worker::Worker(DirScanner* scanner, int num) :
+   scanner(scanner), num(num)
+{
+}
+
+void DirScanner::Worker::run()
+{
+   QThread::currentThread()->setObjectName(QString("DirScanner_%1").arg(this->num));
+
+   Task task;
+   while (this->scanner->takeTask(this->num, task))
+   {
+      ScannedDir scannedDir { task.id, QList<ScannedSubDir>(), QList<ScannedFile>() };
+      QList<Task> subTasks;
+      readDir(task.path, scannedDir, subTasks, this->scanner->nextId);
+      this->scanner->taskDone(this->num, std::move(scannedDir), subTasks);
+   }
+}
@@ -0,0 +1,158 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QList>
+#include <QLinkedList>
+#include <QDateTime>
+
+#include <Common/Uncopyable.h>
+
+namespace FM
+{
+   class DirScanner : Common::Uncopyable
+   {
+   public:
+      struct ScannedFile
+      {
+         QString name;
+         QString lowerName; // To be sorted like the cached entries, see 'Directory::entrySortingFun(..)'.
+         qint64 size;
+         QDateTime dateLastModified;
+         quint64 device; // 0 if unknown.
+         quint64 inode; // 0 if unknown.
+      };
+
+      struct ScannedSubDir
+      {
+         QString name;
+         QString lowerName;
+         int id; // The id of its 'ScannedDir'.
+      };
+
+      struct ScannedDir
+      {
+         int id; // The root has the id 0.
+         QList<ScannedSubDir> dirs; // Sorted by lower case name.
+         QList<ScannedFile> files; // Sorted by lower case name.
+      };
+
+      DirScanner(int nbThreads);
+      ~DirScanner();
+
+      void start(const QString& path);
+      bool next(ScannedDir& scannedDir);
+      void abort();
+
+      template <typename CachedList, typename ScannedList, typename MatchedFun, typename UnmatchedFun>
+      static void merge(const CachedList& cachedEntries, const ScannedList& scannedEntries, MatchedFun matched, UnmatchedFun unmatched);
+
+   private:
+      struct Task
+      {
+         QString path;
+         int id;
+      };
+
+      class Worker : public QThread
+      {
+      public:
+         Worker(DirScanner* scanner, int num);
+
+         QLinkedList<Task> tasks; // The owner takes the last one (depth first), the thieves take the first one.
+         QMutex tasksMutex;
+
+      protected:
+         void run();
+
+      private:
+         DirScanner* scanner;
+         const int num;
+      };
+
+      bool takeTask(int workerNum, Task& task);
+      void taskDone(int workerNum, ScannedDir&& scannedDir, const QList<Task>& subTasks);
+
+      static void readDir(const QString& path, ScannedDir& scannedDir, QList<Task>& subTasks, QAtomicInt& nextId);
+
+      const int nbThreads;
+      QList<Worker*> workers;
+
+      QMutex mutex;
+      QWaitCondition taskAdded;
+      QWaitCondition taskFinished;
+
+      int nbQueuedTasks; // Tasks waiting in the worker queues.
+      int nbPendingTasks; // Queued tasks + tasks being read.
+      QAtomicInt nextId;
+      QLinkedList<ScannedDir> results;
+      bool aborted;
+      bool toStop;
+   };
+}
+
+/**
+  * Match the scanned entries of a directory with the cached ones. The two lists must be sorted by lower case name
+  * ('Directory::entrySortingFun(..)') thus they are traversed only once.
+  * 'matched' is called for each scanned entry with its cached entry or 'nullptr' if there is none.
+  * 'unmatched' is called for each cached entry without scanned entry.
+  */
+template <typename CachedList, typename ScannedList, typename MatchedFun, typename UnmatchedFun>
+void FM::DirScanner::merge(const CachedList& cachedEntries, const ScannedList& scannedEntries, MatchedFun matched, UnmatchedFun unmatched)
+{
+   typedef typename CachedList::value_type CachedEntry;
+
+   auto c = cachedEntries.constBegin();
+   auto s = scannedEntries.constBegin();
+
+   while (s != scannedEntries.constEnd())
+   {
+      const QString& key = s->lowerName;
+
+      while (c != cachedEntries.constEnd() && (*c)->getName().toLower() < key)
+         unmatched(*c++);
+
+      // The entries with the same lower case name, usually there is only one.
+      QList<CachedEntry> sameKeyEntries;
+      while (c != cachedEntries.constEnd() && (*c)->getName().toLower() == key)
+         sameKeyEntries << *c++;
+
+      for (; s != scannedEntries.constEnd() && s->lowerName == key; ++s)
+      {
+         CachedEntry entry = nullptr;
+         for (int i = 0; i < sameKeyEntries.size(); i++)
+            if (sameKeyEntries[i]->getName() == s->name)
+            {
+               entry = sameKeyEntries.takeAt(i);
+               break;
+            }
+         matched(*s, entry);
+      }
+
+      for (QListIterator<CachedEntry> i(sameKeyEntries); i.hasNext();)
+         unmatched(i.next());
+   }
+
+   while (c != cachedEntries.constEnd())
+      unmatched(*c++);
+}
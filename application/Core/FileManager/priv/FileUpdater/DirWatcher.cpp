@@ -20,6 +20,7 @@
 using namespace FM;
 
 #include <QtCore/QtDebug>
+#include <QHash>
 
 #include <priv/Log.h>
 
@@ -27,6 +28,7 @@ using namespace FM;
    #include <priv/FileUpdater/DirWatcherWin.h>
 #elif defined(Q_OS_LINUX)
    #include <priv/FileUpdater/DirWatcherLinux.h>
+   #include <priv/FileUpdater/DirWatcherFanotify.h>
 #endif
 
 DirWatcher* DirWatcher::getNewWatcher()
@@ -34,6 +36,16 @@ DirWatcher* DirWatcher::getNewWatcher()
 #if defined(Q_OS_WIN32)
    return new DirWatcherWin();
 #elif defined(Q_OS_LINUX)
+   #ifdef FANOTIFY_FID_AVAILABLE
+      // The fanotify implementation is preferred because it doesn't need a watch per directory.
+      DirWatcherFanotify* fanotifyWatcher = new DirWatcherFanotify();
+      if (fanotifyWatcher->isInitialized())
+      {
+         L_DEBU("Use the fanotify directory watcher");
+         return fanotifyWatcher;
+      }
+      delete fanotifyWatcher;
+   #endif
    return new DirWatcherLinux();
 #else
    L_WARN("Cannot create a watcher for the current platform, no implementation.");
@@ -41,6 +53,76 @@ DirWatcher* DirWatcher::getNewWatcher()
 #endif
 }
 
+/**
+  * Merge the redundant events of a same path, the order of the remaining events is kept. For example
+  * when a big file is written there is a lot of 'IN_MODIFY' which are reduced to one 'CONTENT_CHANGED'.
+  * Rules:
+  *  - Many 'CONTENT_CHANGED' -> the first 'CONTENT_CHANGED'.
+  *  - 'NEW' followed by 'CONTENT_CHANGED' -> 'NEW'.
+  *  - 'NEW' or 'CONTENT_CHANGED' followed by 'DELETED' -> 'DELETED'.
+  *  - Many 'RESCAN' -> the first 'RESCAN'.
+  *  - A 'MOVE' is never merged and breaks the sequence of the two involved paths.
+  */
+void DirWatcher::coalesceEvents(QList<WatcherEvent>& events)
+{
+   if (events.size() < 2)
+      return;
+
+   QHash<QString, int> pendingEvents; // The last mergeable event index for each path.
+   QList<WatcherEvent> coalescedEvents;
+   coalescedEvents.reserve(events.size());
+
+   for (QListIterator<WatcherEvent> i(events); i.hasNext();)
+   {
+      const WatcherEvent& event = i.next();
+      switch (event.type)
+      {
+      case WatcherEvent::NEW:
+      case WatcherEvent::CONTENT_CHANGED:
+      case WatcherEvent::RESCAN:
+         {
+            const int pendingIndex = pendingEvents.value(event.path1, -1);
+            if (pendingIndex != -1)
+            {
+               const WatcherEvent::Type pendingType = coalescedEvents[pendingIndex].type;
+               if (event.type == WatcherEvent::CONTENT_CHANGED && (pendingType == WatcherEvent::NEW || pendingType == WatcherEvent::CONTENT_CHANGED) || event.type == pendingType)
+                  continue;
+            }
+            pendingEvents.insert(event.path1, coalescedEvents.size());
+            coalescedEvents << event;
+         }
+         break;
+
+      case WatcherEvent::DELETED:
+         {
+            const int pendingIndex = pendingEvents.value(event.path1, -1);
+            pendingEvents.remove(event.path1);
+            if (pendingIndex != -1 && coalescedEvents[pendingIndex].type != WatcherEvent::RESCAN)
+               coalescedEvents[pendingIndex].type = WatcherEvent::UNKNOWN; // Will be removed below.
+            coalescedEvents << event;
+         }
+         break;
+
+      case WatcherEvent::MOVE:
+         pendingEvents.remove(event.path1);
+         pendingEvents.remove(event.path2);
+         coalescedEvents << event;
+         break;
+
+      default:
+         coalescedEvents << event;
+      }
+   }
+
+   events.clear();
+   for (QListIterator<WatcherEvent> i(coalescedEvents); i.hasNext();)
+   {
+      const WatcherEvent& event = i.next();
+      if (event.type != WatcherEvent::UNKNOWN)
+         events << event;
+   }
+}
+
 WatcherEvent::WatcherEvent() :
    type(WatcherEvent::UNKNOWN)
 {}
@@ -74,6 +156,7 @@ QString WatcherEvent::toStr() const
    case NEW: str += "NEW"; break;
    case DELETED: str += "DELETED"; break;
    case CONTENT_CHANGED: str += "CONTENT_CHANGED"; break;
+   case RESCAN: str += "RESCAN"; break;
    case TIMEOUT: str += "TIMEOUT"; break;
    case UNKNOWN: default : str += "UNKNOWN"; break;
    }
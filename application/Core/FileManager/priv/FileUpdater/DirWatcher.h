@@ -48,6 +48,7 @@ namespace FM
      *    can use the events 'DELETED' following by 'NEW' or the event 'MOVE' alone, the last one is preferred.
      *  - When a shared directory is deleted in the file system, the watcher should send a 'DELETE' event. If it does, the 'rmDir(..)' will be
      *    Automatically called for this directory.
+     *  - If the watcher loses some events it should send a 'RESCAN' event for the smallest directory containing the lost events.
      */
    class DirWatcher
    {
@@ -95,6 +96,9 @@ namespace FM
         * @param timeout A timeout in milliseconds. -1 means forever.
         */
       virtual const QList<WatcherEvent> waitEvent(int timeout, QList<WaitCondition*> ws = QList<WaitCondition*>()) = 0;
+
+   protected:
+      static void coalesceEvents(QList<WatcherEvent>& events);
    };
 
    /**
@@ -122,6 +126,8 @@ namespace FM
          NEW,
          DELETED,
          CONTENT_CHANGED,
+         // Some events have been lost (the queue of the watcher has overflowed for example), 'path1' and all its content must be rescanned.
+         RESCAN,
          TIMEOUT,
          UNKNOWN
       };
@@ -0,0 +1,481 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/FileUpdater/DirWatcherFanotify.h>
+
+#ifdef FANOTIFY_FID_AVAILABLE
+
+using namespace FM;
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <priv/FileUpdater/WaitConditionLinux.h>
+#include <priv/Log.h>
+
+/**
+  * @class FM::DirWatcherFanotify
+  *
+  * Implementation of 'DirWatcher' for the linux platform with fanotify.
+  * Contrary to 'DirWatcherLinux' (inotify) there is no watch per directory: the whole filesystem containing a watched path
+  * is marked ('FAN_MARK_FILESYSTEM'), thus the number of watched directories is not bounded by 'max_user_watches'.
+  * The events identify the directory by a file handle ('FAN_REPORT_DFID_NAME') which is resolved to a path with 'open_by_handle_at(..)',
+  * the events outside the watched paths are ignored.
+  *
+  * Requires the capabilities CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH, they are probed by the constructor. If the core doesn't have them
+  * 'isInitialized()' returns false and 'DirWatcher::getNewWatcher()' falls back to 'DirWatcherLinux'.
+  */
+
+const size_t DirWatcherFanotify::BUF_LEN = 64 * 1024;
+
+#ifdef FAN_RENAME
+   const uint64_t DirWatcherFanotify::EVENTS_OBS = FAN_CREATE | FAN_DELETE | FAN_RENAME | FAN_CLOSE_WRITE | FAN_ONDIR;
+#else
+   const uint64_t DirWatcherFanotify::EVENTS_OBS = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR;
+#endif
+
+DirWatcherFanotify::DirWatcherFanotify() :
+   mutex(QMutex::Recursive)
+{
+   this->fileDescriptor = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+   if (this->fileDescriptor < 0)
+   {
+      L_DEBU(QString("Unable to initialize fanotify (errno: %1), inotify will be used instead").arg(errno));
+      return;
+   }
+
+   // 'fanotify_init(..)' may succeed for an unprivileged user but not the marks of a whole filesystem.
+   if (!this->canMarkFilesystems())
+   {
+      L_DEBU("Not allowed to mark a filesystem with fanotify, inotify will be used instead");
+      close(this->fileDescriptor);
+      this->fileDescriptor = -1;
+   }
+}
+
+DirWatcherFanotify::~DirWatcherFanotify()
+{
+   QMutexLocker locker(&this->mutex);
+
+   for (QListIterator<Filesystem*> i(this->filesystems); i.hasNext();)
+   {
+      Filesystem* filesystem = i.next();
+      close(filesystem->mountFd);
+      delete filesystem;
+   }
+
+   if (this->fileDescriptor >= 0 && close(this->fileDescriptor) < 0)
+      L_WARN(QString("DirWatcherFanotify::~DirWatcherFanotify: Unable to close file descriptor (fanotify)"));
+}
+
+bool DirWatcherFanotify::isInitialized() const
+{
+   return this->fileDescriptor >= 0;
+}
+
+/**
+  * @copydoc FM::DirWatcher::addPath(..)
+  */
+bool DirWatcherFanotify::addPath(const QString& path)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (!this->isInitialized())
+      return false;
+
+   const QString cleanedPath = QDir::cleanPath(path);
+   const QString canonicalPath = QFileInfo(cleanedPath).canonicalFilePath();
+   if (canonicalPath.isEmpty())
+   {
+      L_ERRO(QString("DirWatcherFanotify::addPath: The path doesn't exist: %1").arg(cleanedPath));
+      return false;
+   }
+   const QByteArray& pathArray = canonicalPath.toUtf8();
+
+   struct statfs stat;
+   if (statfs(pathArray.constData(), &stat) < 0)
+   {
+      L_ERRO(QString("DirWatcherFanotify::addPath: Unable to stat the filesystem of: %1").arg(cleanedPath));
+      return false;
+   }
+   const QByteArray fsid(reinterpret_cast<const char*>(&stat.f_fsid), sizeof(stat.f_fsid));
+
+   Filesystem* filesystem = nullptr;
+   for (QListIterator<Filesystem*> i(this->filesystems); i.hasNext();)
+   {
+      Filesystem* f = i.next();
+      if (f->fsid == fsid)
+      {
+         filesystem = f;
+         break;
+      }
+   }
+
+   if (!filesystem)
+   {
+      if (fanotify_mark(this->fileDescriptor, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, EVENTS_OBS, AT_FDCWD, pathArray.constData()) < 0)
+      {
+         L_WARN(QString("DirWatcherFanotify::addPath: Unable to mark the filesystem of: %1 (errno: %2)").arg(cleanedPath).arg(errno));
+         return false;
+      }
+
+      const QString mountPath = QFileInfo(canonicalPath).isDir() ? canonicalPath : QFileInfo(canonicalPath).path();
+      const int mountFd = open(mountPath.toUtf8().constData(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+      if (mountFd < 0)
+      {
+         fanotify_mark(this->fileDescriptor, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, EVENTS_OBS, AT_FDCWD, pathArray.constData());
+         L_ERRO(QString("DirWatcherFanotify::addPath: Unable to open: %1").arg(mountPath));
+         return false;
+      }
+
+      filesystem = new Filesystem { fsid, mountFd, QStringList() };
+      this->filesystems << filesystem;
+   }
+
+   filesystem->paths << cleanedPath;
+   this->watchedPaths << WatchedPath { cleanedPath, canonicalPath };
+   return true;
+}
+
+/**
+  * @copydoc FM::DirWatcher::rmPath(..)
+  * The filesystem mark is removed with its last watched path.
+  */
+void DirWatcherFanotify::rmPath(const QString& path)
+{
+   QMutexLocker locker(&this->mutex);
+
+   const QString cleanedPath = QDir::cleanPath(path);
+
+   bool removed = false;
+   for (QMutableListIterator<WatchedPath> i(this->watchedPaths); i.hasNext();)
+      if (i.next().path == cleanedPath)
+      {
+         i.remove();
+         removed = true;
+         break;
+      }
+   if (!removed)
+      return;
+
+   for (QMutableListIterator<Filesystem*> i(this->filesystems); i.hasNext();)
+   {
+      Filesystem* filesystem = i.next();
+      if (filesystem->paths.removeOne(cleanedPath))
+      {
+         if (filesystem->paths.isEmpty())
+         {
+            // The path may not exist anymore, the mark is removed through the mount directory.
+            if (fanotify_mark(this->fileDescriptor, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, EVENTS_OBS, filesystem->mountFd, nullptr) < 0)
+               L_WARN(QString("DirWatcherFanotify::rmPath: Unable to remove the filesystem mark of: %1").arg(cleanedPath));
+            close(filesystem->mountFd);
+            delete filesystem;
+            i.remove();
+         }
+         break;
+      }
+   }
+}
+
+/**
+  * @copydoc FM::DirWatcher::nbWatchedPath()
+  */
+int DirWatcherFanotify::nbWatchedPath()
+{
+   QMutexLocker locker(&this->mutex);
+   return this->watchedPaths.size();
+}
+
+/**
+  * @copydoc FM::DirWatcher::waitEvent(QList<WaitCondition*>)
+  */
+const QList<WatcherEvent> DirWatcherFanotify::waitEvent(QList<WaitCondition*> ws)
+{
+   return this->waitEvent(-1, ws);
+}
+
+/**
+  * @copydoc FM::DirWatcher::waitEvent(int, QList<WaitCondition*>)
+  */
+const QList<WatcherEvent> DirWatcherFanotify::waitEvent(int timeout, QList<WaitCondition*> ws)
+{
+   QMutexLocker locker(&this->mutex);
+
+   fd_set fds;
+   struct timeval time;
+   time.tv_sec = timeout / 1000;
+   time.tv_usec = (timeout % 1000) * 1000;
+
+   FD_ZERO(&fds);
+   FD_SET(this->fileDescriptor, &fds);
+   int fd_max = this->fileDescriptor;
+
+   for (int i = 0; i < ws.size(); i++)
+   {
+      int wcfd = dynamic_cast<WaitConditionLinux*>(ws[i])->getFd();
+      FD_SET(wcfd, &fds);
+      if (wcfd > fd_max)
+         fd_max = wcfd;
+   }
+
+   locker.unlock();
+   int sel = select(fd_max + 1, &fds, NULL, NULL, (timeout == -1 ? 0 : &time));
+   locker.relock();
+
+   if (sel < 0)
+   {
+      L_ERRO(QString("DirWatcherFanotify::waitEvent: select error."));
+      return QList<WatcherEvent>();
+   }
+   else if (!sel)
+   {
+      QList<WatcherEvent> events;
+      events << WatcherEvent(WatcherEvent::TIMEOUT);
+      return events;
+   }
+
+   for (int i = 0; i < ws.size(); i++)
+   {
+      int wcfd = dynamic_cast<WaitConditionLinux*>(ws[i])->getFd();
+      if (FD_ISSET(wcfd, &fds))
+      {
+         static char dummy[4096];
+         while (read(wcfd, dummy, sizeof(dummy)) > 0);
+         return QList<WatcherEvent>();
+      }
+   }
+
+   QList<WatcherEvent> events;
+   QHash<QByteArray, QString> resolvedHandles; // Many events come from the same directory.
+   bool queueOverflowed = false;
+
+   // The descriptor is non-blocking, all the pending events are read.
+   QByteArray buffer(BUF_LEN, Qt::Uninitialized);
+   forever
+   {
+      ssize_t len = read(this->fileDescriptor, buffer.data(), buffer.size());
+      if (len <= 0)
+      {
+         if (len < 0 && errno != EAGAIN && errno != EINTR)
+            L_ERRO(QString("DirWatcherFanotify::waitEvent: read fanotify event failed (errno: %1).").arg(errno));
+         break;
+      }
+
+      for (const fanotify_event_metadata* metadata = reinterpret_cast<const fanotify_event_metadata*>(buffer.constData()); FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len))
+      {
+         if (metadata->fd >= 0)
+            close(metadata->fd);
+
+         if (metadata->vers != FANOTIFY_METADATA_VERSION)
+         {
+            L_ERRO("DirWatcherFanotify::waitEvent: mismatch of fanotify metadata version");
+            continue;
+         }
+
+         if (metadata->mask & FAN_Q_OVERFLOW)
+         {
+            L_WARN("DirWatcherFanotify::waitEvent: the fanotify event queue has overflowed, some events are lost");
+            queueOverflowed = true;
+            continue;
+         }
+
+         QString path; // The path of the entry or the old path for a renaming.
+         QString newPath;
+
+         const char* info = reinterpret_cast<const char*>(metadata) + metadata->metadata_len;
+         const char* infoEnd = reinterpret_cast<const char*>(metadata) + metadata->event_len;
+         while (info < infoEnd)
+         {
+            const fanotify_event_info_header* header = reinterpret_cast<const fanotify_event_info_header*>(info);
+            if (header->len == 0)
+               break;
+
+            if (
+               header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME
+#ifdef FAN_RENAME
+               || header->info_type == FAN_EVENT_INFO_TYPE_OLD_DFID_NAME || header->info_type == FAN_EVENT_INFO_TYPE_NEW_DFID_NAME
+#endif
+            )
+            {
+               const fanotify_event_info_fid* fid = reinterpret_cast<const fanotify_event_info_fid*>(info);
+               const file_handle* handle = reinterpret_cast<const file_handle*>(fid->handle);
+               const QByteArray fsid(reinterpret_cast<const char*>(&fid->fsid), sizeof(fid->fsid));
+
+               Filesystem* filesystem = nullptr;
+               for (QListIterator<Filesystem*> i(this->filesystems); i.hasNext();)
+               {
+                  Filesystem* f = i.next();
+                  if (f->fsid == fsid)
+                  {
+                     filesystem = f;
+                     break;
+                  }
+               }
+
+               if (filesystem)
+               {
+                  const QByteArray handleData(reinterpret_cast<const char*>(handle), sizeof(file_handle) + handle->handle_bytes);
+                  const QString dirPath = this->resolveDirHandle(filesystem, handleData, resolvedHandles);
+                  if (!dirPath.isNull())
+                  {
+                     const QString entryPath = QString(dirPath).append('/').append(QString::fromUtf8(reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes)));
+#ifdef FAN_RENAME
+                     if (header->info_type == FAN_EVENT_INFO_TYPE_NEW_DFID_NAME)
+                        newPath = entryPath;
+                     else
+#endif
+                        path = entryPath;
+                  }
+               }
+            }
+
+            info += header->len;
+         }
+
+         path = this->toWatchedPath(path);
+         newPath = this->toWatchedPath(newPath);
+         const bool pathWatched = !path.isNull();
+         const bool newPathWatched = !newPath.isNull();
+
+#ifdef FAN_RENAME
+         if (metadata->mask & FAN_RENAME)
+         {
+            if (pathWatched && newPathWatched)
+               events << WatcherEvent(WatcherEvent::MOVE, path, newPath);
+            else if (pathWatched)
+               events << WatcherEvent(WatcherEvent::DELETED, path);
+            else if (newPathWatched)
+               events << WatcherEvent(WatcherEvent::NEW, newPath);
+            continue;
+         }
+#endif
+
+         if (!pathWatched)
+            continue;
+
+         // Without 'FAN_RENAME' there is no way to link the two parts of a move, the events 'DELETED' and 'NEW' are used instead.
+         if (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM))
+            events << WatcherEvent(WatcherEvent::DELETED, path);
+         if (metadata->mask & (FAN_CREATE | FAN_MOVED_TO))
+            events << WatcherEvent(WatcherEvent::NEW, path);
+         if (metadata->mask & FAN_CLOSE_WRITE)
+            events << WatcherEvent(WatcherEvent::CONTENT_CHANGED, path);
+      }
+   }
+
+   // There is no information about the lost events, all the watched paths are rescanned.
+   if (queueOverflowed)
+      for (QListIterator<WatchedPath> i(this->watchedPaths); i.hasNext();)
+         events << WatcherEvent(WatcherEvent::RESCAN, i.next().path);
+
+   coalesceEvents(events);
+
+   return events;
+}
+
+/**
+  * Return the path of the directory identified by the given file handle or a null string if the directory doesn't exist anymore.
+  * 'resolvedHandles' is used as a cache during the processing of a set of events.
+  */
+QString DirWatcherFanotify::resolveDirHandle(Filesystem* filesystem, const QByteArray& handle, QHash<QByteArray, QString>& resolvedHandles) const
+{
+   auto resolved = resolvedHandles.constFind(handle);
+   if (resolved != resolvedHandles.constEnd())
+      return resolved.value();
+
+   QString path;
+
+   QByteArray handleCopy(handle); // 'open_by_handle_at(..)' doesn't take a const handle.
+   const int fd = open_by_handle_at(filesystem->mountFd, reinterpret_cast<file_handle*>(handleCopy.data()), O_PATH | O_DIRECTORY | O_CLOEXEC);
+   if (fd >= 0)
+   {
+      char pathBuffer[PATH_MAX];
+      const ssize_t n = readlink(QString("/proc/self/fd/%1").arg(fd).toLatin1().constData(), pathBuffer, sizeof(pathBuffer));
+      if (n > 0)
+      {
+         path = QString::fromUtf8(pathBuffer, n);
+         if (path.endsWith(" (deleted)"))
+            path = QString();
+      }
+      close(fd);
+   }
+
+   resolvedHandles.insert(handle, path);
+   return path;
+}
+
+/**
+  * Try to mark the filesystem of the home directory and to open a directory by its handle,
+  * it requires the capabilities CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH.
+  */
+bool DirWatcherFanotify::canMarkFilesystems() const
+{
+   const QByteArray& homePath = QDir::homePath().toUtf8();
+
+   if (fanotify_mark(this->fileDescriptor, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, EVENTS_OBS, AT_FDCWD, homePath.constData()) < 0)
+      return false;
+   fanotify_mark(this->fileDescriptor, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, EVENTS_OBS, AT_FDCWD, homePath.constData());
+
+   QByteArray handleData(sizeof(file_handle) + MAX_HANDLE_SZ, 0);
+   file_handle* handle = reinterpret_cast<file_handle*>(handleData.data());
+   handle->handle_bytes = MAX_HANDLE_SZ;
+   int mountId;
+   if (name_to_handle_at(AT_FDCWD, homePath.constData(), handle, &mountId, 0) < 0)
+      return false;
+
+   const int homeFd = open(homePath.constData(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+   if (homeFd < 0)
+      return false;
+
+   const int fd = open_by_handle_at(homeFd, handle, O_PATH | O_DIRECTORY | O_CLOEXEC);
+   close(homeFd);
+   if (fd < 0)
+      return false;
+
+   close(fd);
+   return true;
+}
+
+/**
+  * Return the given resolved path translated to its watched path (as given to 'addPath(..)') or a null string if it isn't watched.
+  */
+QString DirWatcherFanotify::toWatchedPath(const QString& path) const
+{
+   if (path.isNull())
+      return path;
+
+   for (QListIterator<WatchedPath> i(this->watchedPaths); i.hasNext();)
+   {
+      const WatchedPath& watchedPath = i.next();
+      const QString& canonicalPath = watchedPath.canonicalPath;
+      if (path.startsWith(canonicalPath) && (path.size() == canonicalPath.size() || path[canonicalPath.size()] == '/'))
+         return QString(watchedPath.path).append(path.midRef(canonicalPath.size()));
+   }
+   return QString();
+}
+
+#endif
@@ -0,0 +1,91 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <sys/fanotify.h>
+
+// Filesystem marks and the directory file identifiers are available since Linux 5.9.
+#if defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM)
+   #define FANOTIFY_FID_AVAILABLE
+#endif
+
+#ifdef FANOTIFY_FID_AVAILABLE
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QByteArray>
+#include <QStringList>
+
+#include <priv/FileUpdater/DirWatcher.h>
+
+namespace FM
+{
+   class DirWatcherFanotify : public DirWatcher
+   {
+   public:
+      DirWatcherFanotify();
+      ~DirWatcherFanotify();
+
+      bool isInitialized() const;
+
+      bool addPath(const QString& path);
+      void rmPath(const QString& path);
+      int nbWatchedPath();
+      const QList<WatcherEvent> waitEvent(QList<WaitCondition*> ws = QList<WaitCondition*>());
+      const QList<WatcherEvent> waitEvent(int timeout, QList<WaitCondition*> ws = QList<WaitCondition*>());
+
+   private:
+      static const size_t BUF_LEN;
+      static const uint64_t EVENTS_OBS; // Fanotify events caught for a whole filesystem.
+
+      /**
+        * A marked filesystem, shared by all the watched paths it contains.
+        */
+      struct Filesystem
+      {
+         QByteArray fsid;
+         int mountFd; // Used to open the file handles of the events.
+         QStringList paths; // The watched paths which are in this filesystem.
+      };
+
+      /**
+        * The event paths are resolved by the kernel, they are compared to the canonical paths
+        * and translated back to the paths given to 'addPath(..)'.
+        */
+      struct WatchedPath
+      {
+         QString path;
+         QString canonicalPath;
+      };
+
+      bool canMarkFilesystems() const;
+      QString resolveDirHandle(Filesystem* filesystem, const QByteArray& handle, QHash<QByteArray, QString>& resolvedHandles) const;
+      QString toWatchedPath(const QString& path) const;
+
+      QList<Filesystem*> filesystems;
+      QList<WatchedPath> watchedPaths;
+
+      QMutex mutex;
+
+      int fileDescriptor;
+   };
+}
+
+#endif
@@ -28,6 +28,7 @@ using namespace FM;
 
 #include <sys/select.h>
 #include <sys/inotify.h>
+#include <sys/ioctl.h>
 #include <errno.h>
 
 /**
@@ -35,6 +36,10 @@ using namespace FM;
   * @author Hervé Martinet
   *
   * Implementation of 'DirWatcher' for the linux platform with inotify.
+  *
+  * Each watched directory and file is indexed by its watch descriptor ('dirsByWd' and 'filesByWd') thus
+  * an inotify event can be bound to its node in constant time.
+  * The events read in one call of 'waitEvent(..)' are coalesced by path, see 'DirWatcher::coalesceEvents(..)'.
   */
 
 const int DirWatcherLinux::EVENT_SIZE = (sizeof (struct inotify_event));
@@ -121,10 +126,15 @@ bool DirWatcherLinux::addPath(const QString& path)
   */
 DirWatcherLinux::File* DirWatcherLinux::getFile(int wd) const
 {
-   for (auto i = this->files.begin(); i != this->files.end(); ++i)
-      if (i.value()->wd == wd)
-         return i.value();
-   return nullptr;
+   return this->filesByWd.value(wd);
+}
+
+/**
+  * Return 'nullptr' if not found.
+  */
+DirWatcherLinux::Dir* DirWatcherLinux::getDir(int wd) const
+{
+   return this->dirsByWd.value(wd);
 }
 
 /**
@@ -180,11 +190,7 @@ QString DirWatcherLinux::getEventPath(inotify_event* event)
    // Event for a watched file.
    File* file = this->getFile(event->wd);
    if (file)
-   {
-      for (auto i = this->files.constBegin(); i != this->files.constEnd(); ++i)
-         if (i.value()->wd == event->wd)
-            return i.key();
-   }
+      return file->path;
 
    return QString();
 }
@@ -273,8 +279,14 @@ const QList<WatcherEvent> DirWatcherLinux::waitEvent(int timeout, QList<WaitCond
 
    L_DEBU("DirWatcherLinux::waitEvent: exit select by inotify");
 
-   char buf[BUF_LEN];
-   int len = read(this->fileDescriptor, buf, BUF_LEN);
+   // Read all the pending events at once to coalesce as much events as possible.
+   int nbBytesAvailable = 0;
+   if (ioctl(this->fileDescriptor, FIONREAD, &nbBytesAvailable) < 0 || nbBytesAvailable < static_cast<int>(BUF_LEN))
+      nbBytesAvailable = BUF_LEN;
+   QByteArray buffer(nbBytesAvailable, Qt::Uninitialized);
+   char* buf = buffer.data();
+
+   int len = read(this->fileDescriptor, buf, buffer.size());
    if (len < 0)
    {
       if (errno == EINTR)
@@ -290,6 +302,7 @@ const QList<WatcherEvent> DirWatcherLinux::waitEvent(int timeout, QList<WaitCond
 
    QList<WatcherEvent> events;
    QList<inotify_event*> movedFromEvents;
+   bool queueOverflowed = false;
 
    for (int i = 0; i < len;)
    {
@@ -299,8 +312,13 @@ const QList<WatcherEvent> DirWatcherLinux::waitEvent(int timeout, QList<WaitCond
       Dir* dir = nullptr;
       File* file = nullptr;
 
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+         L_WARN("DirWatcherLinux::waitEvent: the inotify event queue has overflowed, some events are lost");
+         queueOverflowed = true;
+      }
       // Watched directories.
-      if (dir = this->getDir(event->wd))
+      else if (dir = this->getDir(event->wd))
       {
          if (event->mask & IN_MOVED_FROM)
          {
@@ -326,7 +344,8 @@ const QList<WatcherEvent> DirWatcherLinux::waitEvent(int timeout, QList<WaitCond
                   {
                      // Retrieve moved directory by child map of from directory,
                      // because actually the name hasn't changed.
-                     Dir* movedDir = this->getDir(fromEvent->wd)->children.value(fromEvent->name); // TODO: check if the dir exists!?
+                     Dir* fromDir = this->getDir(fromEvent->wd);
+                     Dir* movedDir = fromDir ? fromDir->children.value(fromEvent->name) : nullptr;
 
                      // If the name of moved directory has changed, rename it.
                      if (movedDir && fromEvent->name != event->name)
@@ -425,6 +444,36 @@ const QList<WatcherEvent> DirWatcherLinux::waitEvent(int timeout, QList<WaitCond
       events << WatcherEvent(WatcherEvent::DELETED, this->getEventPath(e));
    }
 
+   if (queueOverflowed)
+      events << this->getOverflowEvents();
+
+   coalesceEvents(events);
+
+   return events;
+}
+
+/**
+  * When the inotify queue overflows we don't know which events are lost nor which directories they come from:
+  * the events of any watched directory may have been dropped. Thus all the watched roots and files are rescanned.
+  */
+QList<WatcherEvent> DirWatcherLinux::getOverflowEvents()
+{
+   QList<WatcherEvent> events;
+
+   for (QListIterator<Dir*> i(this->dirs); i.hasNext();)
+   {
+      const QString& path = i.next()->getFullPath();
+      L_DEBU(QString("DirWatcherLinux::getOverflowEvents: rescan %1").arg(path));
+      events << WatcherEvent(WatcherEvent::RESCAN, path);
+   }
+
+   for (QHashIterator<QString, File*> i(this->files); i.hasNext();)
+   {
+      const QString& path = i.next().key();
+      L_DEBU(QString("DirWatcherLinux::getOverflowEvents: rescan %1").arg(path));
+      events << WatcherEvent(WatcherEvent::RESCAN, path);
+   }
+
    return events;
 }
 
@@ -483,6 +532,7 @@ DirWatcherLinux::Dir::Dir(DirWatcherLinux* dwl, Dir* parent, const QString& name
    dwl(dwl), parent(parent), name(name)
 {
    this->wd = addWatch(dwl->fileDescriptor, this->getFullPath(), (this->parent ? EVENTS_OBS : ROOT_EVENTS_OBS));
+   this->dwl->dirsByWd.insert(this->wd, this);
 
    for (QListIterator<QString> i(QDir(this->getFullPath()).entryList(QDir::Dirs | QDir::NoDotAndDotDot)); i.hasNext();)
       try
@@ -497,6 +547,8 @@ DirWatcherLinux::Dir::Dir(DirWatcherLinux* dwl, Dir* parent, const QString& name
             child.value()->parent = nullptr;
             delete child.value();
          }
+         inotify_rm_watch(this->dwl->fileDescriptor, this->wd);
+         this->dwl->dirsByWd.remove(this->wd);
          throw;
       }
 
@@ -515,6 +567,8 @@ DirWatcherLinux::Dir::~Dir()
       if (inotify_rm_watch(this->dwl->fileDescriptor, this->wd))
          L_WARN(QString("Dir::~Dir: Unable to remove an inotify watcher."));
 
+      this->dwl->dirsByWd.remove(this->wd);
+
       if (this->parent)
          this->parent->children.remove(this->name);
 
@@ -566,9 +620,11 @@ void DirWatcherLinux::Dir::move(Dir* to)
 /**
   * @exception UnableToWatchException
   */
-DirWatcherLinux::File::File(DirWatcherLinux* dwl, const QString& path)
+DirWatcherLinux::File::File(DirWatcherLinux* dwl, const QString& path) :
+   dwl(dwl), path(path)
 {
    this->wd = addWatch(dwl->fileDescriptor, path, EVENTS_FILE);
+   this->dwl->filesByWd.insert(this->wd, this);
 }
 
 DirWatcherLinux::File::~File()
@@ -577,5 +633,7 @@ DirWatcherLinux::File::~File()
    {
       if (inotify_rm_watch(this->dwl->fileDescriptor, this->wd))
          L_WARN(QString("File::~File: Unable to remove an inotify watcher."));
+
+      this->dwl->filesByWd.remove(this->wd);
    }
 }
@@ -77,11 +77,14 @@ namespace FM
       QList<Dir*> dirs; // The watched root dirs, indexed by full path.
       QHash<QString, File*> files; // Files indexed by their path.
 
+      QHash<int, Dir*> dirsByWd; // All the watched directories (roots and sub-directories) indexed by their watch descriptor.
+      QHash<int, File*> filesByWd; // Files indexed by their watch descriptor.
+
       File* getFile(int wd) const;
       Dir* getDir(int wd) const;
 
-      void rmWatcher(int watcher);
       QString getEventPath(inotify_event *event);
+      QList<WatcherEvent> getOverflowEvents();
 
       QMutex mutex;
 
@@ -20,8 +20,11 @@
 using namespace FM;
 
 #include <QLinkedList>
+#include <QHash>
+#include <QPair>
 #include <QDir>
 #include <QElapsedTimer>
+#include <QDateTime>
 
 #include <Common/Settings.h>
 
@@ -50,8 +53,13 @@ FileUpdater::FileUpdater(FileManager* fileManager) :
    progress(0),
    mutex(QMutex::Recursive),
    currentScanningEntry(nullptr),
+   dirScanner(SETTINGS.get<quint32>("number_of_scanning_threads")),
    toStopHashing(false),
-   remainingSizeToHash(0)
+   filesWithoutHashes(HashScheduler::createPolicy(SETTINGS.get<quint32>("hash_scheduling_policy"))),
+   remainingSizeToHash(0),
+   nbAskedFilesHashed(0),
+   totalTimeToFirstHash(0),
+   maxTimeToFirstHash(0)
 {
    this->dirEvent = WaitCondition::getNewWaitCondition();
 }
@@ -137,8 +145,8 @@ void FileUpdater::rmRoot(SharedEntry* sharedEntry, Directory* dir2)
          dir2->stealContent(rootDirectory);
 
       this->removeFromFilesWithoutHashes(sharedEntry->getRootEntry());
-      this->removeFromDirsToScan(dir);
-      this->unwatchableEntries.removeOne(dir);
+      this->removeFromEntriesToScan(sharedEntry->getRootEntry());
+      this->unwatchableEntries.removeOne(sharedEntry->getRootEntry());
       this->entriesToRemove << sharedEntry->getRootEntry();
    }
 
@@ -160,11 +168,10 @@ void FileUpdater::prioritizeAFileToHash(File* file)
          this->remainingSizeToHash -= file->getSize();
       }
 
-      if (!this->filesWithoutHashesPrioritized.contains(file))
-      {
-         this->filesWithoutHashesPrioritized << file;
+      if (this->filesWithoutHashesPrioritized.append(file))
          this->remainingSizeToHash += file->getSize();
-      }
+
+      this->startTimeToFirstHash(file);
 
       // Commented to avoid this behavior:
       // When a lot of unhashed tiny file are asked the hashing process will constantly abort the current hashing file
@@ -178,6 +185,19 @@ void FileUpdater::prioritizeAFileToHash(File* file)
 
 }
 
+/**
+  * Called when a file is returned to a peer by a search. If the file isn't hashed yet it will be hashed sooner
+  * depending of the policy of 'filesWithoutHashes'.
+  */
+void FileUpdater::fileAsked(File* file)
+{
+   QMutexLocker locker(&this->mutex);
+   QMutexLocker lockerHashing(&this->hashingMutex);
+
+   if (this->filesWithoutHashes.addDemand(file))
+      this->startTimeToFirstHash(file);
+}
+
 bool FileUpdater::isScanning() const
 {
    QMutexLocker scanningLocker(&this->scanningMutex);
@@ -196,6 +216,26 @@ int FileUpdater::getProgress() const
    return this->progress;
 }
 
+/**
+  * The lists are modified under 'mutex' or 'hashingMutex', we lock both to have a coherent view.
+  */
+IFileManager::CacheQueuesStats FileUpdater::getCacheQueuesStats() const
+{
+   QMutexLocker locker(&this->mutex);
+   QMutexLocker lockerHashing(&this->hashingMutex);
+
+   IFileManager::CacheQueuesStats stats;
+   stats.nbEntriesToScan = this->entriesToScan.size();
+   stats.nbFilesToHash = this->filesWithoutHashes.size();
+   stats.nbPrioritizedFilesToHash = this->filesWithoutHashesPrioritized.size();
+   stats.oldestEntryToScanWaitTime = this->entriesToScan.getOldestWaitTime();
+   stats.oldestFileToHashWaitTime = qMax(this->filesWithoutHashes.getOldestWaitTime(), this->filesWithoutHashesPrioritized.getOldestWaitTime());
+   stats.nbAskedFilesHashed = this->nbAskedFilesHashed;
+   stats.averageTimeToFirstHash = this->nbAskedFilesHashed == 0 ? 0 : this->totalTimeToFirstHash / this->nbAskedFilesHashed;
+   stats.maxTimeToFirstHash = this->maxTimeToFirstHash;
+   return stats;
+}
+
 void FileUpdater::run()
 {
    this->timerScanUnwatchable.start();
@@ -233,8 +273,9 @@ void FileUpdater::run()
 
       this->mutex.lock();
 
-      foreach (Entry* entry, this->entriesToRemove)
+      for (Common::IndexedList<Entry*>::const_iterator i = this->entriesToRemove.begin(); i != this->entriesToRemove.end(); ++i)
       {
+         Entry* entry = *i;
          L_DEBU(QString("Stop watching this path: %1").arg(entry->getFullPath()));
          if (this->dirWatcher)
             this->dirWatcher->rmPath(entry->getFullPath());
@@ -246,9 +287,9 @@ void FileUpdater::run()
 
       // If there is no watcher capability or no directory to watch then
       // we wait for an added directory.
-      if (!this->dirWatcher || this->dirWatcher->nbWatchedPath() == 0 || !this->dirsToScan.empty())
+      if (!this->dirWatcher || this->dirWatcher->nbWatchedPath() == 0 || !this->entriesToScan.isEmpty())
       {
-         if (this->dirsToScan.isEmpty() && this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
+         if (this->entriesToScan.isEmpty() && this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
          {
             L_DEBU("Waiting for a new shared directory added..");
             this->mutex.unlock();
@@ -257,23 +298,21 @@ void FileUpdater::run()
          else
             this->mutex.unlock();
 
-         Directory* addedDir = nullptr;
+         Entry* addedEntry = nullptr;
          this->mutex.lock();
-         if (!this->dirsToScan.isEmpty())
-            addedDir = this->dirsToScan.takeLast();
+         if (!this->entriesToScan.isEmpty())
+            addedEntry = this->entriesToScan.takeFirst();
          this->mutex.unlock();
 
-         // Synchronize the new directory.
-         if (addedDir)
-         {
-            this->scan(addedDir);
-         }
+         // Synchronize the new entry.
+         if (addedEntry)
+            this->scan(addedEntry);
       }
       else // Wait for filesystem modifications.
       {
          // If we have no dir to scan and no file to hash we wait for a new shared file
          // or a filesystem event.
-         if (this->dirsToScan.isEmpty() && this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
+         if (this->entriesToScan.isEmpty() && this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
          {
             this->mutex.unlock();
             this->processEvents(this->dirWatcher->waitEvent(this->unwatchableEntries.isEmpty() ? -1 : SCAN_PERIOD_UNWATCHABLE_DIRS, QList<WaitCondition*>() << this->dirEvent));
@@ -288,15 +327,12 @@ void FileUpdater::run()
       if (timerScanUnwatchable.elapsed() >= SCAN_PERIOD_UNWATCHABLE_DIRS)
       {
          this->mutex.lock();
-         QList<Directory*> unwatchableEntriesCopy = this->unwatchableEntries;
+         const QList<Entry*> unwatchableEntriesCopy = this->unwatchableEntries.toList();
          this->mutex.unlock();
 
          // Synchronize the new directory.
-         for (QListIterator<Directory*> i(unwatchableEntriesCopy); i.hasNext();)
-         {
-            Directory* dir = i.next();
-               this->scan(dir);
-         }
+         for (QListIterator<Entry*> i(unwatchableEntriesCopy); i.hasNext();)
+            this->scan(i.next());
       }
 
       if (this->toStop)
@@ -330,58 +366,62 @@ void FileUpdater::computeSomeHashes()
    timer.start();
 
    // We take the file from the prioritized list first.
-   QList<QList<File*>*> fileLists { &this->filesWithoutHashesPrioritized, &this->filesWithoutHashes };
-   for (QMutableListIterator<QList<File*>*> i(fileLists); i.hasNext();)
+   while (!this->filesWithoutHashesPrioritized.isEmpty() || !this->filesWithoutHashes.isEmpty())
    {
-      QList<File*>* fileList = i.next();
-      while (!fileList->empty())
-      {
-         File* nextFileToHash = fileList->first();
+      const bool prioritized = !this->filesWithoutHashesPrioritized.isEmpty();
+      File* nextFileToHash = prioritized ? this->filesWithoutHashesPrioritized.first() : this->filesWithoutHashes.first();
 
-         if (nextFileToHash->isComplete()) // A file can change its state from 'completed' to 'unfinished' if it's redownloaded.
+      if (nextFileToHash->isComplete()) // A file can change its state from 'completed' to 'unfinished' if it's redownloaded.
+      {
+         locker.unlock();
+         bool gotAllHashes;
+         int hashedAmount = 0;
+         try
          {
-            locker.unlock();
-            bool gotAllHashes;
-            try
-            {
-               int hashedAmount = 0;
-               gotAllHashes = this->fileHasher.start(nextFileToHash->asFileForHasher(), 1, &hashedAmount); // Be careful of methods 'prioritizeAFileToHash(..)' and 'rmRoot(..)' called concurrently here.
-               this->remainingSizeToHash -= hashedAmount;
-               this->updateHashingProgress();
-            }
-            catch (IOErrorException&)
-            {
-               gotAllHashes = true; // The hashes may be recomputed when a peer ask the hashes with a GET_HASHES request.
-            }
-            locker.relock();
-
-            // The current hashing file may have been removed from 'filesWithoutHashes' or 'filesWithoutHashesPrioritized' by 'rmRoot(..)'.
-            if (gotAllHashes && !fileList->isEmpty() && fileList->first() == nextFileToHash)
-               fileList->removeFirst();
-
-            // Special case for the prioritized list, we put the file at the end after the computation of a hash.
-            else if (fileList == &this->filesWithoutHashesPrioritized && fileList->size() > 1 && fileList->first() == nextFileToHash)
-               fileList->move(0, fileList->size() - 1);
+            gotAllHashes = this->fileHasher.start(nextFileToHash->asFileForHasher(), 1, &hashedAmount); // Be careful of methods 'prioritizeAFileToHash(..)' and 'rmRoot(..)' called concurrently here.
+            this->remainingSizeToHash -= hashedAmount;
+            this->updateHashingProgress();
          }
-         else
+         catch (IOErrorException&)
          {
-            this->remainingSizeToHash -= fileList->first()->getSize();
-            fileList->removeFirst();
+            gotAllHashes = true; // The hashes may be recomputed when a peer ask the hashes with a GET_HASHES request.
          }
+         locker.relock();
+
+         if (hashedAmount > 0)
+            this->firstHashComputed(nextFileToHash);
 
-         if (this->toStopHashing)
+         // The current hashing file may have been removed from 'filesWithoutHashes' or 'filesWithoutHashesPrioritized' by 'rmRoot(..)'.
+         if (gotAllHashes)
          {
-            this->toStopHashing = false;
-            goto end;
+            this->filesWithoutHashesPrioritized.removeOne(nextFileToHash);
+            this->filesWithoutHashes.removeOne(nextFileToHash);
+            this->firstDemandTimes.remove(nextFileToHash);
          }
 
-         static const quint32 MINIMUM_DURATION_WHEN_HASHING = SETTINGS.get<quint32>("minimum_duration_when_hashing");
-         if (static_cast<quint32>(timer.elapsed()) >= MINIMUM_DURATION_WHEN_HASHING)
-            goto end;
+         // Special case for the prioritized list, we put the file at the end after the computation of a hash.
+         else if (prioritized)
+            this->filesWithoutHashesPrioritized.moveToBack(nextFileToHash);
       }
+      else
+      {
+         this->remainingSizeToHash -= nextFileToHash->getSize();
+         this->filesWithoutHashesPrioritized.removeOne(nextFileToHash);
+         this->filesWithoutHashes.removeOne(nextFileToHash);
+         this->firstDemandTimes.remove(nextFileToHash);
+      }
+
+      if (this->toStopHashing)
+      {
+         this->toStopHashing = false;
+         break;
+      }
+
+      static const quint32 MINIMUM_DURATION_WHEN_HASHING = SETTINGS.get<quint32>("minimum_duration_when_hashing");
+      if (static_cast<quint32>(timer.elapsed()) >= MINIMUM_DURATION_WHEN_HASHING)
+         break;
    }
 
-end:
    L_DEBU(QString("Computing some hashes ended. this->filesWithoutHashes.size(): %1, this->filesWithoutHashesPrioritized.size(): %2").arg(this->filesWithoutHashes.size()).arg(this->filesWithoutHashesPrioritized.size()));
 
    if (this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
@@ -398,6 +438,34 @@ void FileUpdater::updateHashingProgress()
    this->progress = totalAmountOfData == 0 ? 0 : 10000LL * (totalAmountOfData - this->remainingSizeToHash) / totalAmountOfData;
 }
 
+/**
+  * Remember when a file without hash has been asked for the first time, see 'firstHashComputed(..)'.
+  */
+void FileUpdater::startTimeToFirstHash(File* file)
+{
+   if (!this->firstDemandTimes.contains(file) && !file->hasOneOrMoreHashes())
+      this->firstDemandTimes.insert(file, QDateTime::currentMSecsSinceEpoch());
+}
+
+/**
+  * Update the time-to-first-hash statistics if the file has been asked by a peer.
+  */
+void FileUpdater::firstHashComputed(File* file)
+{
+   auto demandTime = this->firstDemandTimes.find(file);
+   if (demandTime == this->firstDemandTimes.end())
+      return;
+
+   const qint64 timeToFirstHash = QDateTime::currentMSecsSinceEpoch() - demandTime.value();
+   this->firstDemandTimes.erase(demandTime);
+
+   this->nbAskedFilesHashed++;
+   this->totalTimeToFirstHash += timeToFirstHash;
+   this->maxTimeToFirstHash = qMax(this->maxTimeToFirstHash, timeToFirstHash);
+
+   L_DEBU(QString("Time to first hash for an asked file: %1 ms (%2)").arg(timeToFirstHash).arg(file->getFullPath()));
+}
+
 /**
   * Stop the current hashing process or the next hashing process.
   * The file is re-queued.
@@ -419,108 +487,67 @@ void FileUpdater::stopHashing()
   * in entry (if 'entry' is a directory). Create the associated cached tree structure under a
   * given 'Directory*'.
   * The directories may already exist in the cache.
+  * The file system is read in parallel by 'dirScanner'.
   */
 void FileUpdater::scan(Entry* entry, bool addUnfinished)
 {
    L_DEBU("Start scanning a shared entry: " + entry->getFullPath());
 
+   Directory* dir = dynamic_cast<Directory*>(entry);
+   if (!dir)
+      return;
+
    this->scanningMutex.lock();
    this->currentScanningEntry = entry;
    this->scanningMutex.unlock();
 
-   QLinkedList<Directory*> dirsToVisit;
-   dirsToVisit << dir;
+   // The directories are read by 'dirScanner' in parallel and in any order, a directory is
+   // reconciled with the cache when its parent has been reconciled, see 'DirScanner::ScannedDir::id'.
+   this->dirScanner.start(dir->getFullPath().getPath());
 
-   while (!dirsToVisit.isEmpty())
-   {
-      Directory* currentDir = dirsToVisit.takeFirst();
+   QHash<int, Directory*> dirsToReconcile; // The cached directories waiting for their scanned content.
+   dirsToReconcile.insert(0, dir);
+   QHash<int, DirScanner::ScannedDir> scannedDirsWaitingParent;
 
-      QLinkedList<Directory*> currentSubDirs = currentDir->getSubDirs();
-      QList<File*> currentFiles = currentDir->getCompleteFiles(); // We don't care about the unfinished files.
-
-      foreach (QFileInfo fileInfo, QDir(currentDir->getFullPath()).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::NoSymLinks)) // TODO: Add an option to follow or not symlinks.
+   DirScanner::ScannedDir scannedDir;
+   while (this->dirScanner.next(scannedDir))
+   {
       {
          QMutexLocker locker(&this->scanningMutex);
-
          if (!this->currentScanningEntry || this->toStop)
          {
             L_DEBU("Scanning aborted: " + entry->getFullPath());
+            this->dirScanner.abort();
             this->currentScanningEntry = nullptr;
             this->scanningStopped.wakeOne();
             return;
          }
+      }
 
-         if (fileInfo.isDir())
-         {
-            Directory* dir = currentDir->createSubDir(fileInfo.fileName());
-            dir->setScanned(false);
-            dirsToVisit << dir;
+      Directory* currentDir = dirsToReconcile.take(scannedDir.id);
+      if (!currentDir)
+      {
+         scannedDirsWaitingParent.insert(scannedDir.id, std::move(scannedDir));
+         continue;
+      }
 
-            currentSubDirs.removeOne(dir);
-         }
-         else if (addUnfinished || !Global::isFileUnfinished(fileInfo.fileName()))
+      QList<QPair<Directory*, DirScanner::ScannedDir>> toReconcile { qMakePair(currentDir, std::move(scannedDir)) };
+      while (!toReconcile.isEmpty())
+      {
+         auto current = toReconcile.takeLast();
+         for (QListIterator<QPair<int, Directory*>> i(this->reconcile(current.first, current.second, addUnfinished)); i.hasNext();)
          {
-            File* file = currentDir->getFile(fileInfo.fileName());
-            QMutexLocker locker(&this->mutex);
-
-            // Only used when loading the cache to compute the progress.
-            if (this->fileCacheInformation)
-            {
-               this->fileCacheInformation->newFile();
-               this->progress = this->fileCacheInformation->getProgress();
-            }
-
-            if (file)
-            {
-               if (
-                   !this->filesWithoutHashes.contains(file) && // The case where a file is being copied and a lot of modification event is thrown (thus the file is in this->filesWithoutHashes).
-                   !this->filesWithoutHashesPrioritized.contains(file) &&
-                   file->isComplete() &&
-                   !file->correspondTo(fileInfo, file->hasAllHashes()) // If the hashes of a file can't be computed (IO error, the file is being written for example) we only compare their sizes.
-               )
-               {
-                  currentFiles.removeOne(file);
-                  this->deleteEntry(file);
-                  file = nullptr;
-               }
-               else
-               {
-                  currentFiles.removeOne(file);
-               }
-            }
-
-            if (!file)
-            {
-               // Very special case : there is a file 'a' without File* in cache and a file 'a.unfinished'.
-               // This case occurs when a file is redownloaded, the File* 'a' is renamed as 'a.unfinished' but the physical file 'a'
-               // is not deleted.
-               File* unfinishedFile = currentDir->getFile(fileInfo.fileName().append(Global::getUnfinishedSuffix()));
-               if (!unfinishedFile)
-                  file = new File(currentDir, fileInfo.fileName(), fileInfo.size(), fileInfo.lastModified());
-               else
-               {
-                  currentFiles.removeOne(unfinishedFile);
-                  continue;
-               }
-            }
-
-            // If a file is incomplete (unfinished) we can't compute its hashes because we don't have all data.
-            if (file->getSize() > 0 && !file->hasAllHashes() && file->isComplete() && !this->filesWithoutHashes.contains(file) && !this->filesWithoutHashesPrioritized.contains(file))
+            const auto& subDir = i.next();
+            auto scannedSubDir = scannedDirsWaitingParent.find(subDir.first);
+            if (scannedSubDir != scannedDirsWaitingParent.end())
             {
-               this->filesWithoutHashes << file;
-               this->remainingSizeToHash += file->getSize();
+               toReconcile << qMakePair(subDir.second, std::move(scannedSubDir.value()));
+               scannedDirsWaitingParent.erase(scannedSubDir);
             }
+            else
+               dirsToReconcile.insert(subDir.first, subDir.second);
          }
       }
-
-      // Deletes all the files and directories which doesn't exist on the file system.
-      foreach (File* f, currentFiles)
-         this->deleteEntry(f);
-
-      foreach (Directory* d, currentSubDirs)
-         this->deleteEntry(d);
-
-      currentDir->setScanned(true);
    }
 
    this->scanningMutex.lock();
@@ -536,6 +563,78 @@ void FileUpdater::scan(Entry* entry, bool addUnfinished)
    L_DEBU("Scanning terminated: " + dir->getFullPath());
 }
 
+/**
+  * Synchronize a cached directory with its scanned content. The two are traversed once, see 'DirScanner::merge(..)'.
+  * @return The sub-directories and the id of their 'DirScanner::ScannedDir'.
+  */
+QList<QPair<int, Directory*>> FileUpdater::reconcile(Directory* currentDir, const DirScanner::ScannedDir& scannedDir, bool addUnfinished)
+{
+   QList<QPair<int, Directory*>> subDirs;
+
+   DirScanner::merge(currentDir->getSubDirs(), scannedDir.dirs,
+      [&](const DirScanner::ScannedSubDir& scannedSubDir, Directory* subDir) {
+         if (!subDir)
+            subDir = currentDir->createSubDir(scannedSubDir.name);
+         subDir->setScanned(false);
+         subDirs << qMakePair(scannedSubDir.id, subDir);
+      },
+      [&](Directory* subDir) {
+         this->deleteEntry(subDir);
+      }
+   );
+
+   DirScanner::merge(currentDir->getFiles(), scannedDir.files,
+      [&](const DirScanner::ScannedFile& scannedFile, File* file) {
+         if (!addUnfinished && Global::isFileUnfinished(scannedFile.name))
+            return;
+
+         QMutexLocker locker(&this->mutex);
+
+         // Only used when loading the cache to compute the progress.
+         if (this->fileCacheInformation)
+         {
+            this->fileCacheInformation->newFile();
+            this->progress = this->fileCacheInformation->getProgress();
+         }
+
+         if (
+             file &&
+             !this->filesWithoutHashes.contains(file) && // The case where a file is being copied and a lot of modification event is thrown (thus the file is in this->filesWithoutHashes).
+             !this->filesWithoutHashesPrioritized.contains(file) &&
+             file->isComplete() &&
+             !file->correspondTo(scannedFile.size, scannedFile.dateLastModified, file->hasAllHashes()) // If the hashes of a file can't be computed (IO error, the file is being written for example) we only compare their sizes.
+         )
+         {
+            this->deleteEntry(file);
+            file = nullptr;
+         }
+
+         if (!file)
+         {
+            // Very special case : there is a file 'a' without File* in cache and a file 'a.unfinished'.
+            // This case occurs when a file is redownloaded, the File* 'a' is renamed as 'a.unfinished' but the physical file 'a'
+            // is not deleted.
+            if (currentDir->getFile(QString(scannedFile.name).append(Global::getUnfinishedSuffix())))
+               return;
+            file = new File(currentDir, scannedFile.name, scannedFile.size, scannedFile.dateLastModified);
+         }
+
+         // If a file is incomplete (unfinished) we can't compute its hashes because we don't have all data.
+         if (file->getSize() > 0 && !file->hasAllHashes() && file->isComplete() && !this->filesWithoutHashesPrioritized.contains(file) && this->filesWithoutHashes.add(file, HashScheduler::Location { scannedFile.device, scannedFile.inode }))
+            this->remainingSizeToHash += file->getSize();
+      },
+      [&](File* file) {
+         // Deletes all the files which don't exist on the file system. We don't care about the unfinished files.
+         if (file->isComplete())
+            this->deleteEntry(file);
+      }
+   );
+
+   currentDir->setScanned(true);
+
+   return subDirs;
+}
+
 /**
   * If you omit 'sharedEntry' then all scanning will be removed
   * from the queue.
@@ -559,7 +658,7 @@ void FileUpdater::stopScanning(Entry* entry)
 }
 
 /**
-  * Delete an entry and if it's a directory remove it and its sub children from 'this->dirsToScan'.
+  * Delete an entry and if it's a directory remove it and its sub children from 'this->entriesToScan'.
   * It can't be used to remove a 'SharedDirectory', only the 'Cache' is able to do that.
   */
 void FileUpdater::deleteEntry(Entry* entry)
@@ -577,7 +676,7 @@ void FileUpdater::deleteEntry(Entry* entry)
 }
 
 /**
-  * Remove a directory and its sub directories from 'this->dirsToScan'.
+  * Remove a directory and its sub directories from 'this->entriesToScan'.
   */
 void FileUpdater::removeFromEntriesToScan(Entry* entry)
 {
@@ -592,39 +691,33 @@ void FileUpdater::removeFromEntriesToScan(Entry* entry)
 }
 
 /**
-  * Remove all the pending files owned by 'dir'.
+  * Remove all the pending files owned by 'entry'.
+  * The files of a directory are removed one by one, the cost depends on the size of the directory and not on the size of the queues.
   */
 void FileUpdater::removeFromFilesWithoutHashes(Entry* entry)
 {
+   auto removeFile = [this](File* file) {
+      bool fileInAList = this->filesWithoutHashes.removeOne(file);
+      fileInAList |= this->filesWithoutHashesPrioritized.removeOne(file);
+      this->firstDemandTimes.remove(file);
+
+      if (fileInAList)
+         this->remainingSizeToHash -= file->getSize();
+   };
+
    if (Directory* dir = dynamic_cast<Directory*>(entry))
    {
-      for (QMutableListIterator<File*> i(this->filesWithoutHashes); i.hasNext();)
-      {
-         File* f = i.next();
-         if (f->hasAParentDir(dir))
-         {
-            this->remainingSizeToHash -= f->getSize();
-            i.remove();
-         }
-      }
+      if (this->filesWithoutHashes.isEmpty() && this->filesWithoutHashesPrioritized.isEmpty())
+         return;
 
-      for (QMutableListIterator<File*> i(this->filesWithoutHashesPrioritized); i.hasNext();)
-      {
-         File* f = i.next();
-         if (f->hasAParentDir(dir))
-         {
-            this->remainingSizeToHash -= f->getSize();
-            i.remove();
-         }
-      }
+      DirIterator i(dir, true);
+      while (Directory* currentDir = i.next())
+         foreach (File* file, currentDir->getFiles())
+            removeFile(file);
    }
    else if (File* file = dynamic_cast<File*>(entry))
    {
-      bool fileInAList = this->filesWithoutHashes.removeOne(file);
-      fileInAList |= this->filesWithoutHashesPrioritized.removeOne(file);
-
-      if (fileInAList)
-         this->remainingSizeToHash -= file->getSize();
+      removeFile(file);
    }
 }
 
@@ -738,10 +831,14 @@ bool FileUpdater::processEvents(const QList<WatcherEvent>& events)
 
       case WatcherEvent::NEW:
       case WatcherEvent::CONTENT_CHANGED:
+      case WatcherEvent::RESCAN:
          {
             Directory* dir = this->fileManager->getFittestDirectory(event.path1);
-            if (dir && !this->dirsToScan.contains(dir))
-               this->dirsToScan << dir;
+            if (dir)
+            {
+               QMutexLocker locker(&this->mutex);
+               this->entriesToScan << dir;
+            }
             break;
          }
 
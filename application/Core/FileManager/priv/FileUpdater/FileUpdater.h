@@ -23,9 +23,15 @@
 #include <QMutex>
 #include <QString>
 #include <QList>
+#include <QPair>
 #include <QElapsedTimer>
 
+#include <Common/Containers/IndexedList.h>
+
+#include <IFileManager.h>
 #include <priv/FileUpdater/DirWatcher.h>
+#include <priv/FileUpdater/DirScanner.h>
+#include <priv/FileUpdater/HashScheduler.h>
 #include <priv/Cache/FileHasher.h>
 
 namespace FM
@@ -47,10 +53,12 @@ namespace FM
 
       void stop();
       void prioritizeAFileToHash(File* file);
+      void fileAsked(File* file);
 
       bool isScanning() const;
       bool isHashing() const;
       int getProgress() const;
+      IFileManager::CacheQueuesStats getCacheQueuesStats() const;
 
       void addRoot(SharedEntry* sharedEntry);
       void rmRoot(SharedEntry* sharedEntry, Directory* dir2 = nullptr);
@@ -65,10 +73,13 @@ namespace FM
    private:
       void computeSomeHashes();
       void updateHashingProgress();
+      void startTimeToFirstHash(File* file);
+      void firstHashComputed(File* file);
 
       void stopHashing();
 
       void scan(Entry* entry, bool addUnfinished = false);
+      QList<QPair<int, Directory*>> reconcile(Directory* currentDir, const DirScanner::ScannedDir& scannedDir, bool addUnfinished);
       // void addScannedFile(const FileInfo& fileInfo, File* fileCache = nullptr); TODO: To remove
 
       void stopScanning(Entry* entry = nullptr);
@@ -112,10 +123,11 @@ namespace FM
       WaitCondition* dirEvent; ///< Using to wait when a sharing directory is added or deleted.
       mutable QMutex mutex; ///< Prevent the access from many thread to the internal data like 'filesWithoutHashes' for example.
 
-      QList<Entry*> unwatchableEntries;
+      Common::IndexedList<Entry*> unwatchableEntries;
       QElapsedTimer timerScanUnwatchable;
-      QList<Entry*> entriesToScan; ///< When something change in a directory or in a file we put it in this list until it is scanned.
+      Common::IndexedList<Entry*> entriesToScan; ///< When something change in a directory or in a file we put it in this list until it is scanned.
       Entry* currentScanningEntry;
+      DirScanner dirScanner;
       QWaitCondition scanningStopped;
       mutable QMutex scanningMutex;
 
@@ -123,10 +135,16 @@ namespace FM
       bool toStopHashing;
       FileHasher fileHasher;
 
-      QList<Entry*> entriesToRemove;
+      Common::IndexedList<Entry*> entriesToRemove;
 
-      QList<File*> filesWithoutHashes;
-      QList<File*> filesWithoutHashesPrioritized;
+      HashScheduler filesWithoutHashes;
+      Common::IndexedList<File*> filesWithoutHashesPrioritized; ///< The files asked by 'GetHashes', they are hashed before 'filesWithoutHashes'.
       qint64 remainingSizeToHash;
+
+      // Time between the first time a peer asks for a file and the computation of its first hash.
+      QHash<File*, qint64> firstDemandTimes; ///< [ms] since epoch.
+      int nbAskedFilesHashed;
+      qint64 totalTimeToFirstHash; ///< [ms].
+      qint64 maxTimeToFirstHash; ///< [ms].
    };
 }
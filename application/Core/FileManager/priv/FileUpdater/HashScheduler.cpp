@@ -0,0 +1,184 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/FileUpdater/HashScheduler.h>
+using namespace FM;
+
+#include <limits>
+
+#include <priv/Cache/File.h>
+
+/**
+  * @class FM::HashScheduler
+  *
+  * The queue of the files waiting to be hashed by 'FileUpdater'. The order is defined by a 'Policy':
+  *  - 'DiscoveryOrderPolicy': the files are hashed in the order they have been found by the scanning.
+  *  - 'DemandSizeLocalityPolicy': the files asked by the peers first, then the smallest files to maximize
+  *    the number of searchable hashes per second, then the files of a same device sorted by inode to reduce the seeks.
+  * The key of a file is recomputed when its demand changes, the access to the first file is in O(log n).
+  */
+
+bool HashScheduler::Key::operator<(const Key& other) const
+{
+   if (this->k1 != other.k1)
+      return this->k1 < other.k1;
+   if (this->k2 != other.k2)
+      return this->k2 < other.k2;
+   if (this->k3 != other.k3)
+      return this->k3 < other.k3;
+   if (this->k4 != other.k4)
+      return this->k4 < other.k4;
+   return this->seq < other.seq;
+}
+
+HashScheduler::Key HashScheduler::DiscoveryOrderPolicy::getKey(const File* file, const Location& location, int demand) const
+{
+   Q_UNUSED(file);
+   Q_UNUSED(location);
+   Q_UNUSED(demand);
+
+   return Key { 0, 0, 0, 0, 0 };
+}
+
+HashScheduler::Key HashScheduler::DemandSizeLocalityPolicy::getKey(const File* file, const Location& location, int demand) const
+{
+   // The files are grouped by the order of magnitude of their size, the locality is used inside a group.
+   quint64 sizeClass = 0;
+   for (quint64 size = file->getSize(); size > 0; size >>= 1)
+      sizeClass++;
+
+   return Key { std::numeric_limits<quint64>::max() - static_cast<quint64>(demand), sizeClass, location.device, location.inode, 0 };
+}
+
+/**
+  * @param policyNum See the setting 'hash_scheduling_policy'.
+  */
+HashScheduler::Policy* HashScheduler::createPolicy(quint32 policyNum)
+{
+   switch (policyNum)
+   {
+   case 0:
+      return new DiscoveryOrderPolicy();
+   default:
+      return new DemandSizeLocalityPolicy();
+   }
+}
+
+/**
+  * Take the ownership of 'policy'.
+  */
+HashScheduler::HashScheduler(Policy* policy) :
+   policy(policy), nextSeq(0)
+{
+}
+
+HashScheduler::~HashScheduler()
+{
+   delete this->policy;
+}
+
+/**
+  * Take the ownership of 'policy', the files are reordered.
+  */
+void HashScheduler::setPolicy(Policy* policy)
+{
+   delete this->policy;
+   this->policy = policy;
+
+   this->orderedFiles.clear();
+   for (QMutableHashIterator<File*, Item> i(this->items); i.hasNext();)
+   {
+      i.next();
+      this->insert(i.key(), i.value());
+   }
+}
+
+/**
+  * @return 'false' if the file is already in the queue.
+  */
+bool HashScheduler::add(File* file, const Location& location)
+{
+   if (this->items.contains(file))
+      return false;
+
+   Item& item = this->items[file];
+   item.location = location;
+   item.demand = 0;
+   item.seq = this->nextSeq++;
+   this->insert(file, item);
+   this->filesByInsertion.append(file);
+   return true;
+}
+
+bool HashScheduler::removeOne(File* file)
+{
+   auto item = this->items.find(file);
+   if (item == this->items.end())
+      return false;
+
+   this->orderedFiles.remove(item.value().key);
+   this->filesByInsertion.removeOne(file);
+   this->items.erase(item);
+   return true;
+}
+
+void HashScheduler::clear()
+{
+   this->items.clear();
+   this->orderedFiles.clear();
+   this->filesByInsertion.clear();
+}
+
+/**
+  * The queue must not be empty.
+  */
+File* HashScheduler::first() const
+{
+   return this->orderedFiles.first();
+}
+
+/**
+  * Called when a peer asks for 'file', the file is moved forward depending of the policy.
+  * @return 'false' if the file isn't in the queue.
+  */
+bool HashScheduler::addDemand(File* file)
+{
+   auto item = this->items.find(file);
+   if (item == this->items.end())
+      return false;
+
+   this->orderedFiles.remove(item.value().key);
+   item.value().demand++;
+   this->insert(file, item.value());
+   return true;
+}
+
+/**
+  * Return the time [ms] since the insertion of the oldest file, 0 if the queue is empty.
+  */
+qint64 HashScheduler::getOldestWaitTime() const
+{
+   return this->filesByInsertion.getOldestWaitTime();
+}
+
+void HashScheduler::insert(File* file, Item& item)
+{
+   item.key = this->policy->getKey(file, item.location, item.demand);
+   item.key.seq = item.seq;
+   this->orderedFiles.insert(item.key, file);
+}
@@ -0,0 +1,117 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <QHash>
+#include <QMap>
+
+#include <Common/Uncopyable.h>
+#include <Common/Containers/IndexedList.h>
+
+namespace FM
+{
+   class File;
+
+   class HashScheduler : Common::Uncopyable
+   {
+   public:
+      /**
+        * Where the file is stored, used to read the files of a same device in the order of their inode.
+        * Both are 0 if unknown.
+        */
+      struct Location
+      {
+         quint64 device;
+         quint64 inode;
+      };
+
+      /**
+        * The files are hashed in ascending order of their key. Files with the same key are hashed in the order they were added.
+        */
+      struct Key
+      {
+         quint64 k1, k2, k3, k4;
+         quint64 seq; // Insertion order, set by the scheduler.
+
+         bool operator<(const Key& other) const;
+      };
+
+      class Policy
+      {
+      public:
+         virtual ~Policy() {}
+
+         /**
+           * @param demand The number of times a peer has asked for 'file' (search results).
+           */
+         virtual Key getKey(const File* file, const Location& location, int demand) const = 0;
+      };
+
+      class DiscoveryOrderPolicy : public Policy
+      {
+      public:
+         Key getKey(const File* file, const Location& location, int demand) const;
+      };
+
+      class DemandSizeLocalityPolicy : public Policy
+      {
+      public:
+         Key getKey(const File* file, const Location& location, int demand) const;
+      };
+
+      static Policy* createPolicy(quint32 policyNum);
+
+      HashScheduler(Policy* policy);
+      ~HashScheduler();
+
+      void setPolicy(Policy* policy);
+
+      inline int size() const { return this->items.size(); }
+      inline bool isEmpty() const { return this->items.isEmpty(); }
+      inline bool contains(File* file) const { return this->items.contains(file); }
+
+      bool add(File* file, const Location& location = Location { 0, 0 });
+      bool removeOne(File* file);
+      void clear();
+
+      File* first() const;
+
+      bool addDemand(File* file);
+
+      qint64 getOldestWaitTime() const;
+
+   private:
+      struct Item
+      {
+         Location location;
+         int demand;
+         quint64 seq;
+         Key key;
+      };
+
+      void insert(File* file, Item& item);
+
+      Policy* policy;
+
+      QHash<File*, Item> items;
+      QMap<Key, File*> orderedFiles;
+      Common::IndexedList<File*> filesByInsertion; // To know the oldest file.
+      quint64 nextSeq;
+   };
+}
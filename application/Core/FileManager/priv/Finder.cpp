@@ -0,0 +1,84 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+#include <priv/Finder.h>
+using namespace FM;
+
+#include <priv/Constants.h>
+#include <priv/FileManager.h>
+
+Finder::Finder(FileManager* fileManager) :
+   fileManager(fileManager),
+   toStop(false)
+{
+}
+
+/**
+  * Thread-safe.
+  * @return false if there is already too many waiting searches, the search is dropped.
+  */
+bool Finder::add(const Search& search)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (this->toStop || this->searches.size() >= MAX_NB_WAITING_SEARCHES)
+      return false;
+
+   this->searches.enqueue(search);
+   this->searchAdded.wakeOne();
+   return true;
+}
+
+/**
+  * Wait for the current search to finish, the waiting ones are dropped.
+  */
+void Finder::stop()
+{
+   {
+      QMutexLocker locker(&this->mutex);
+      this->toStop = true;
+      this->searches.clear();
+      this->searchAdded.wakeOne();
+   }
+
+   this->wait();
+}
+
+void Finder::run()
+{
+   QThread::currentThread()->setObjectName("Finder");
+
+   forever
+   {
+      Search search;
+      {
+         QMutexLocker locker(&this->mutex);
+         while (this->searches.isEmpty() && !this->toStop)
+            this->searchAdded.wait(&this->mutex);
+
+         if (this->toStop)
+            return;
+
+         search = this->searches.dequeue();
+      }
+
+      const QList<Protos::Common::FindResult>& results =
+         this->fileManager->find(search.words, search.extensions, search.minFileSize, search.maxFileSize, search.category, search.maxNbResult, search.maxSize);
+
+      emit this->fileManager->findDone(search.requesterID, search.tag, results);
+   }
+}
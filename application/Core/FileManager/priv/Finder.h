@@ -0,0 +1,72 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+#pragma once
+
+#include <QThread>
+#include <QWaitCondition>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QList>
+
+#include <Protos/common.pb.h>
+
+#include <Common/Hash.h>
+
+namespace FM
+{
+   class FileManager;
+
+   /**
+     * Does the searches asked by 'FileManager::findAsync(..)' one after the other in its own thread.
+     * The new searches are dropped when too many are waiting.
+     */
+   class Finder : public QThread
+   {
+      Q_OBJECT
+   public:
+      struct Search
+      {
+         Common::Hash requesterID;
+         quint64 tag;
+         QString words;
+         QList<QString> extensions;
+         qint64 minFileSize;
+         qint64 maxFileSize;
+         Protos::Common::FindPattern_Category category;
+         int maxNbResult;
+         int maxSize;
+      };
+
+      Finder(FileManager* fileManager);
+
+      bool add(const Search& search);
+      void stop();
+
+   protected:
+      void run();
+
+   private:
+      FileManager* fileManager;
+
+      QMutex mutex; ///< Protects 'searches' and 'toStop'.
+      QWaitCondition searchAdded;
+      QQueue<Search> searches;
+      bool toStop;
+   };
+}
@@ -23,8 +23,8 @@ using namespace FM;
 
 #include <priv/Log.h>
 
-GetEntriesResult::GetEntriesResult(Directory* dir, int maxNbHashesPerEntry) :
-   IGetEntriesResult(SETTINGS.get<quint32>("get_entries_timeout")), dir(dir), maxNbHashesPerEntry(maxNbHashesPerEntry)
+GetEntriesResult::GetEntriesResult(Directory* dir, int maxNbHashesPerEntry, quint64 knownVersion, quint32 entriesOffset, quint32 nbMaxEntries) :
+   IGetEntriesResult(SETTINGS.get<quint32>("get_entries_timeout")), dir(dir), maxNbHashesPerEntry(maxNbHashesPerEntry), knownVersion(knownVersion), entriesOffset(entriesOffset), nbMaxEntries(nbMaxEntries)
 {
 }
 
@@ -74,14 +74,43 @@ void GetEntriesResult::sendResult()
    emit result(res);
 }
 
+/**
+  * Only the entries of the asked page are populated. Nothing is populated if the directory hasn't changed since 'knownVersion'.
+  */
 void GetEntriesResult::buildResult()
 {
+   // Read before the entries: a change made during the building will give a new version.
+   const quint64 version = this->dir->getVersion();
+   this->res.set_version(version);
+
+   if (this->knownVersion != 0 && this->knownVersion == version)
+   {
+      this->res.set_status(Protos::Core::GetEntriesResult::EntryResult::NOT_MODIFIED);
+      return;
+   }
+
    this->res.set_status(Protos::Core::GetEntriesResult::EntryResult::OK);
 
-   foreach (Directory* dir, this->dir->getSubDirs())
-      dir->populateEntry(this->res.mutable_entries()->add_entry());
+   const QLinkedList<Directory*> subDirs = this->dir->getSubDirs();
+   const QList<File*> files = this->dir->getCompleteFiles();
+   const quint32 nbTotalEntries = static_cast<quint32>(subDirs.size() + files.size());
+   this->res.set_nb_total_entries(nbTotalEntries);
 
-   foreach (File* file, this->dir->getFiles())
-      if (file->isComplete())
+   const quint32 begin = qMin(this->entriesOffset, nbTotalEntries);
+   const quint32 end = this->nbMaxEntries == 0 ? nbTotalEntries : static_cast<quint32>(qMin<quint64>(static_cast<quint64>(begin) + this->nbMaxEntries, nbTotalEntries));
+
+   quint32 i = 0;
+   for (QLinkedListIterator<Directory*> j(subDirs); j.hasNext() && i < end; i++)
+   {
+      Directory* dir = j.next();
+      if (i >= begin)
+         dir->populateEntry(this->res.mutable_entries()->add_entry());
+   }
+
+   for (QListIterator<File*> j(files); j.hasNext() && i < end; i++)
+   {
+      File* file = j.next();
+      if (i >= begin)
          file->populateEntry(this->res.mutable_entries()->add_entry(), false, this->maxNbHashesPerEntry);
+   }
 }
@@ -32,7 +32,7 @@ namespace FM
    {
       Q_OBJECT
    public:
-      GetEntriesResult(Directory* dir, int maxNbHashesPerEntry);
+      GetEntriesResult(Directory* dir, int maxNbHashesPerEntry, quint64 knownVersion, quint32 entriesOffset, quint32 nbMaxEntries);
       void start();
 
    private slots:
@@ -45,5 +45,8 @@ namespace FM
       Protos::Core::GetEntriesResult::EntryResult res;
       Directory* dir;
       const int maxNbHashesPerEntry;
+      const quint64 knownVersion;
+      const quint32 entriesOffset;
+      const quint32 nbMaxEntries;
    };
 }
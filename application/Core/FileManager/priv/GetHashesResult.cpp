@@ -31,8 +31,8 @@
 
 using namespace FM;
 
-GetHashesResult::GetHashesResult(const Protos::Common::Entry& fileEntry, Cache& cache, FileUpdater& fileUpdater) :
-   fileEntry(fileEntry), file(nullptr), cache(cache), fileUpdater(fileUpdater)
+GetHashesResult::GetHashesResult(const Protos::Common::Entry& fileEntry, const QList<Protos::Common::Entry>& nextFileEntries, bool sendNextHashes, Cache& cache, FileUpdater& fileUpdater) :
+   fileEntry(fileEntry), nextFileEntries(nextFileEntries), sendNextHashes(sendNextHashes), file(nullptr), cache(cache), fileUpdater(fileUpdater)
 {
    qRegisterMetaType<Protos::Core::HashResult>("Protos::Core::HashResult");
 
@@ -96,6 +96,9 @@ Protos::Core::GetHashesResult GetHashesResult::start()
       result.set_nb_hash(nbOfHashToBeSent);
    }
 
+   // Outside of 'mutex' because 'fileUpdater' may be locked while emitting 'Cache::chunkHashKnown'.
+   result.set_nb_next_hash(this->sendNextFilesHashes());
+
    result.set_status(Protos::Core::GetHashesResult_Status_OK);
 
    // No hash to send.
@@ -135,3 +138,39 @@ void GetHashesResult::sendNextHash(QSharedPointer<Chunk> chunk, bool direct)
    hashResult.mutable_hash()->set_hash(chunk->getHash().getData(), Common::Hash::HASH_SIZE);
    emit nextHash(hashResult);
 }
+
+/**
+  * Send the known hashes of the next files, the ones which aren't known are computed sooner.
+  * The hashes of a next file are never waited: the requester will ask them again when their turn comes.
+  * @return The number of sent hashes.
+  */
+int GetHashesResult::sendNextFilesHashes()
+{
+   int nbSent = 0;
+   for (int i = 0; i < this->nextFileEntries.size(); i++)
+   {
+      const Protos::Common::Entry& nextFileEntry = this->nextFileEntries[i];
+      File* nextFile = this->cache.getFile(nextFileEntry);
+      if (!nextFile)
+         continue;
+
+      if (!nextFile->hasAllHashes())
+         this->fileUpdater.fileAsked(nextFile);
+
+      const QVector<QSharedPointer<Chunk>>& chunks = nextFile->getChunks();
+      if (!this->sendNextHashes || nextFileEntry.chunk_size() != chunks.size())
+         continue;
+
+      for (int j = 0; j < chunks.size(); j++)
+         if (nextFileEntry.chunk(j).hash().size() == 0 && chunks[j]->hasHash())
+         {
+            Protos::Core::HashResult hashResult;
+            hashResult.set_num(j);
+            hashResult.mutable_hash()->set_hash(chunks[j]->getHash().getData(), Common::Hash::HASH_SIZE);
+            hashResult.set_next_file(i + 1);
+            emit nextHash(hashResult);
+            nbSent++;
+         }
+   }
+   return nbSent;
+}
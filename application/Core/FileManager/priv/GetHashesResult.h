@@ -39,7 +39,7 @@ namespace FM
    {
       Q_OBJECT
    public:
-      GetHashesResult(const Protos::Common::Entry& fileEntry, Cache& cache, FileUpdater& fileUpdater);
+      GetHashesResult(const Protos::Common::Entry& fileEntry, const QList<Protos::Common::Entry>& nextFileEntries, bool sendNextHashes, Cache& cache, FileUpdater& fileUpdater);
       ~GetHashesResult();
       Protos::Core::GetHashesResult start();
 
@@ -48,8 +48,11 @@ namespace FM
 
    private:
       void sendNextHash(QSharedPointer<Chunk> chunk, bool direct);
+      int sendNextFilesHashes();
 
       const Protos::Common::Entry fileEntry;
+      const QList<Protos::Common::Entry> nextFileEntries;
+      const bool sendNextHashes;
       File* file; // TODO: if the file is deleted how can we know, is it important?
       Cache& cache;
       FileUpdater& fileUpdater;
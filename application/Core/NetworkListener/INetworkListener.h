@@ -20,6 +20,7 @@
 
 #include <QObject>
 #include <QSharedPointer>
+#include <QList>
 
 #include <Protos/core_protocol.pb.h>
 
@@ -56,6 +57,20 @@ namespace NL
         */
       virtual SendStatus send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message, const Common::Hash& peerID = Common::Hash()) = 0;
 
+      struct UDPStats
+      {
+         quint64 nbDatagramsReceived;
+         quint32 nbDatagramsDropped; // Dropped by the system because its receive buffer was full, see the setting 'udp_buffer_size'. Only measured on Linux.
+         quint32 nbDatagramsRejected; // Malformed or coming from an unknown or dead peer.
+         quint32 nbDatagramsNotSent;
+
+         // Histograms of latencies, bucket i counts the durations in [2^i, 2^(i+1)[ µs, see 'Common::LatencyHistogram'.
+         QList<quint32> handlingLatency; // From the read of a datagram to the end of its handling by the UDP thread.
+         QList<quint32> handOffLatency; // From the read of a datagram to the start of its handling by the main thread, when it needs one.
+      };
+
+      virtual UDPStats getUDPStats() const = 0;
+
    signals:
       void received(const Common::Message& message);
       void IMAliveMessageToBeSend(Protos::Core::IMAlive& IMAliveMessage);
@@ -16,6 +16,7 @@ INCLUDEPATH += . \
 
 DEFINES += NETWORKLISTENER_LIBRARY
 SOURCES += priv/UDPListener.cpp \
+    priv/IMAliveHandler.cpp \
     priv/TCPListener.cpp \
     priv/Search.cpp \
     priv/NetworkListener.cpp \
@@ -27,6 +28,7 @@ SOURCES += priv/UDPListener.cpp \
 HEADERS += ISearch.h \
     INetworkListener.h \
     priv/UDPListener.h \
+    priv/IMAliveHandler.h \
     priv/TCPListener.h \
     priv/Search.h \
     priv/NetworkListener.h \
@@ -0,0 +1,181 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#include <priv/IMAliveHandler.h>
+using namespace NL;
+
+#include <limits>
+
+#include <QRandomGenerator64>
+
+#include <Common/Settings.h>
+#include <Common/Constants.h>
+#include <Common/Global.h>
+#include <Common/ProtoHelper.h>
+
+#include <Core/PeerManager/IPeer.h>
+
+#include <priv/Log.h>
+
+/**
+  * @class NL::IMAliveHandler
+  *
+  * Sends the 'IMAlive' messages periodically and handles the work handed off by the UDP thread (see 'UDPListener'):
+  * the updates of the peers and of the owners of the chunks we are downloading.
+  * It lives in the main thread like the 'PeerManager' and the 'DownloadManager'.
+  */
+
+IMAliveHandler::IMAliveHandler(
+   UDPListener& uDPListener,
+   QSharedPointer<FM::IFileManager> fileManager,
+   QSharedPointer<PM::IPeerManager> peerManager,
+   QSharedPointer<UM::IUploadManager> uploadManager,
+   QSharedPointer<DM::IDownloadManager> downloadManager,
+   quint16 unicastPort
+) :
+   uDPListener(uDPListener),
+   fileManager(fileManager),
+   peerManager(peerManager),
+   uploadManager(uploadManager),
+   downloadManager(downloadManager),
+   UNICAST_PORT(unicastPort),
+   currentIMAliveTag(0),
+   nextHashRequestType(FIRST_HASHES)
+{
+   connect(&this->timerIMAlive, &QTimer::timeout, this, &IMAliveHandler::sendIMAliveMessage);
+   this->timerIMAlive.start(static_cast<int>(SETTINGS.get<quint32>("peer_imalive_period")));
+}
+
+void IMAliveHandler::sendIMAliveMessage()
+{
+   Protos::Core::IMAlive IMAliveMessage;
+   IMAliveMessage.set_version(Common::Constants::PROTOCOL_VERSION);
+   Common::ProtoHelper::setStr(IMAliveMessage, &Protos::Core::IMAlive::set_core_version, Common::Global::getVersionFull());
+   IMAliveMessage.set_port(this->UNICAST_PORT);
+
+   const QString& nick = this->peerManager->getSelf()->getNick();
+   Common::ProtoHelper::setStr(IMAliveMessage, &Protos::Core::IMAlive::set_nick, nick.length() > MAX_NICK_LENGTH ? nick.left(MAX_NICK_LENGTH) : nick);
+
+   IMAliveMessage.set_amount(this->fileManager->getAmount());
+   IMAliveMessage.set_download_rate(this->downloadManager->getDownloadRate());
+   IMAliveMessage.set_upload_rate(this->uploadManager->getUploadRate());
+
+   this->currentIMAliveTag = QRandomGenerator64::global()->generate64();
+   IMAliveMessage.set_tag(this->currentIMAliveTag);
+
+   // We fill the rest of the message with a maximum of needed hash prefixes.
+   static const quint32 MAX_IMALIVE_THROUGHPUT = SETTINGS.get<quint32>("max_imalive_throughput");
+   static const int AVERAGE_FIXED_SIZE = 100; // [Byte]. Header size + information in the 'IMAlive' message without the hash prefixes.
+   static const quint32 IMALIVE_PERIOD = SETTINGS.get<quint32>("peer_imalive_period") / 1000; // [s]
+   static const int FIXED_RATE_PER_PEER = AVERAGE_FIXED_SIZE / IMALIVE_PERIOD; // [Byte/s]
+   static const int HASH_PREFIX_SIZE = 8; // A packed 'fixed64' has no overhead per value.
+   static const int PACKED_FIELD_OVERHEAD = 4; // The tag and the length of 'IMAlive.chunk_prefix'.
+
+   const int numberOfPeers = this->peerManager->getNbOfPeers();
+   const int maxNumberOfHashesToSend = numberOfPeers == 0 ? std::numeric_limits<int>::max() : IMALIVE_PERIOD * (MAX_IMALIVE_THROUGHPUT - numberOfPeers * FIXED_RATE_PER_PEER) / (numberOfPeers * HASH_PREFIX_SIZE);
+
+   int numberOfHashesToSend = (this->uDPListener.getMaxDatagramPayloadSize() - IMAliveMessage.ByteSizeLong() - Common::MessageHeader::HEADER_SIZE - PACKED_FIELD_OVERHEAD) / HASH_PREFIX_SIZE;
+   if (numberOfHashesToSend > maxNumberOfHashesToSend)
+      numberOfHashesToSend = maxNumberOfHashesToSend;
+
+   // The requested hashes method alternates from the first hashes and the oldest hashes.
+   // We are trying to have the knowledge about who has which chunk for the whole download queue (IDownloadManager::getTheOldestUnfinishedChunks(..))
+   // and for the chunks we want to download first (IDownloadManager::getTheFirstUnfinishedChunks(..)).
+   switch (this->nextHashRequestType)
+   {
+   case FIRST_HASHES:
+      this->currentChunkDownloaders = this->downloadManager->getTheFirstUnfinishedChunks(numberOfHashesToSend);
+      this->nextHashRequestType = OLDEST_HASHES;
+      break;
+   case OLDEST_HASHES:
+      this->currentChunkDownloaders = this->downloadManager->getTheOldestUnfinishedChunks(numberOfHashesToSend);
+      this->nextHashRequestType = FIRST_HASHES;
+      break;
+   }
+
+   // The owners of a chunk are kept by its 'IChunkDownloader' between two 'IMAlive' messages, only the asked chunks are refreshed.
+   IMAliveMessage.mutable_chunk_prefix()->Reserve(this->currentChunkDownloaders.size());
+   for (QListIterator<QSharedPointer<DM::IChunkDownloader>> i(this->currentChunkDownloaders); i.hasNext();)
+   {
+      QSharedPointer<DM::IChunkDownloader> chunkDownloader = i.next();
+      IMAliveMessage.add_chunk_prefix(chunkDownloader->getHash().getPrefix());
+
+      // If we already have the chunk . . .
+      QSharedPointer<FM::IChunk> chunk = this->fileManager->getChunk(chunkDownloader->getHash());
+      if (!chunk.isNull() && chunk->isComplete())
+         chunkDownloader->addPeer(this->peerManager->getSelf());
+      else
+         chunkDownloader->rmPeer(this->peerManager->getSelf());
+   }
+
+   emit IMAliveMessageToBeSend(IMAliveMessage);
+
+   this->uDPListener.send(Common::MessageHeader::CORE_IM_ALIVE, IMAliveMessage);
+}
+
+void IMAliveHandler::IMAliveReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, const Protos::Core::IMAlive& IMAlive, qint64 receivedTime)
+{
+   this->uDPListener.handedOffDatagramHandled(receivedTime);
+
+   this->peerManager->updatePeer(
+      peerID,
+      peerAddress,
+      IMAlive.port(),
+      Common::ProtoHelper::getStr(IMAlive, &Protos::Core::IMAlive::nick),
+      IMAlive.amount(),
+      Common::ProtoHelper::getStr(IMAlive, &Protos::Core::IMAlive::core_version),
+      IMAlive.download_rate(),
+      IMAlive.upload_rate(),
+      IMAlive.version()
+   );
+}
+
+void IMAliveHandler::goodbyeReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, qint64 receivedTime)
+{
+   this->uDPListener.handedOffDatagramHandled(receivedTime);
+
+   this->peerManager->removePeer(peerID, peerAddress);
+}
+
+void IMAliveHandler::chunksOwnedReceived(const Common::Hash& peerID, const Protos::Core::ChunksOwned& chunksOwned, qint64 receivedTime)
+{
+   this->uDPListener.handedOffDatagramHandled(receivedTime);
+
+   if (chunksOwned.tag() != this->currentIMAliveTag)
+   {
+      L_WARN(QString("ChunksOwned: tag (%1) doesn't match current tag (%2)").arg(chunksOwned.tag()).arg(this->currentIMAliveTag));
+      return;
+   }
+
+   if (chunksOwned.chunk_state_size() != this->currentChunkDownloaders.size())
+   {
+      L_WARN(QString("ChunksOwned: The size (%1) doesn't match the expected one (%2)").arg(chunksOwned.chunk_state_size()).arg(this->currentChunkDownloaders.size()));
+      return;
+   }
+
+   // The peer may have been removed since the datagram has been read.
+   PM::IPeer* peer = this->peerManager->getPeer(peerID);
+   if (!peer || !peer->isAvailable())
+      return;
+
+   for (int i = 0; i < chunksOwned.chunk_state_size(); i++)
+      if (chunksOwned.chunk_state(i))
+         this->currentChunkDownloaders[i]->addPeer(peer);
+      else
+         this->currentChunkDownloaders[i]->rmPeer(peer);
+}
@@ -0,0 +1,86 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QSharedPointer>
+#include <QHostAddress>
+#include <QList>
+
+#include <Protos/core_protocol.pb.h>
+
+#include <Common/Uncopyable.h>
+#include <Common/Hash.h>
+#include <Core/FileManager/IFileManager.h>
+#include <Core/PeerManager/IPeerManager.h>
+#include <Core/UploadManager/IUploadManager.h>
+#include <Core/DownloadManager/IDownloadManager.h>
+
+#include <priv/UDPListener.h>
+
+namespace NL
+{
+   class IMAliveHandler : public QObject, Common::Uncopyable
+   {
+      Q_OBJECT
+      static const int MAX_NICK_LENGTH = 255; // Datagram UDP are limited in size, this limit avoid to fill the whole datagram with only a nickname.
+
+   public:
+      IMAliveHandler(
+         UDPListener& uDPListener,
+         QSharedPointer<FM::IFileManager> fileManager,
+         QSharedPointer<PM::IPeerManager> peerManager,
+         QSharedPointer<UM::IUploadManager> uploadManager,
+         QSharedPointer<DM::IDownloadManager> downloadManager,
+         quint16 unicastPort
+      );
+
+   signals:
+      void IMAliveMessageToBeSend(Protos::Core::IMAlive& IMAliveMessage);
+
+   public slots:
+      void sendIMAliveMessage();
+
+      void IMAliveReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, const Protos::Core::IMAlive& IMAlive, qint64 receivedTime);
+      void goodbyeReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, qint64 receivedTime);
+      void chunksOwnedReceived(const Common::Hash& peerID, const Protos::Core::ChunksOwned& chunksOwned, qint64 receivedTime);
+
+   private:
+      UDPListener& uDPListener;
+
+      QSharedPointer<FM::IFileManager> fileManager;
+      QSharedPointer<PM::IPeerManager> peerManager;
+      QSharedPointer<UM::IUploadManager> uploadManager;
+      QSharedPointer<DM::IDownloadManager> downloadManager;
+
+      const quint16 UNICAST_PORT;
+
+      quint64 currentIMAliveTag;
+      QList<QSharedPointer<DM::IChunkDownloader>> currentChunkDownloaders;
+      enum HashRequestType
+      {
+         FIRST_HASHES,
+         OLDEST_HASHES
+      };
+      HashRequestType nextHashRequestType;
+
+      QTimer timerIMAlive;
+   };
+}
@@ -36,35 +36,58 @@ NetworkListener::NetworkListener(
    uploadManager(uploadManager),
    downloadManager(downloadManager),
    tCPListener(peerManager),
-   uDPListener(fileManager, peerManager, uploadManager, downloadManager, tCPListener.getCurrentPort())
+   uDPListener(new UDPListener(fileManager, peerManager, tCPListener.getCurrentPort())),
+   iMAliveHandler(*uDPListener, fileManager, peerManager, uploadManager, downloadManager, tCPListener.getCurrentPort())
 {
+   this->uDPThread.setObjectName("UDPListener");
+   this->uDPListener->moveToThread(&this->uDPThread);
+   connect(&this->uDPThread, &QThread::finished, this->uDPListener, &QObject::deleteLater);
+   this->uDPThread.start();
+
+   // The signals of 'uDPListener' are emitted by its thread, they are queued.
+   connect(this->uDPListener, &UDPListener::received, this, &NetworkListener::received);
+   connect(this->uDPListener, &UDPListener::IMAliveReceived, &this->iMAliveHandler, &IMAliveHandler::IMAliveReceived);
+   connect(this->uDPListener, &UDPListener::goodbyeReceived, &this->iMAliveHandler, &IMAliveHandler::goodbyeReceived);
+   connect(this->uDPListener, &UDPListener::chunksOwnedReceived, &this->iMAliveHandler, &IMAliveHandler::chunksOwnedReceived);
+   connect(&this->iMAliveHandler, &IMAliveHandler::IMAliveMessageToBeSend, this, &NetworkListener::IMAliveMessageToBeSend);
+
    connect(&this->configManager, &QNetworkConfigurationManager::configurationChanged, this, &NetworkListener::rebindSockets);
-   connect(&this->uDPListener, &UDPListener::received, this, &NetworkListener::received);
-   connect(&this->uDPListener, &UDPListener::IMAliveMessageToBeSend, this, &NetworkListener::IMAliveMessageToBeSend);
+
+   QMetaObject::invokeMethod(this->uDPListener, &UDPListener::rebindSockets, Qt::QueuedConnection);
+   this->iMAliveHandler.sendIMAliveMessage(); // Sent by the UDP thread once its sockets are bound.
 }
 
 NetworkListener::~NetworkListener()
 {
-   this->uDPListener.send(Common::MessageHeader::CORE_GOODBYE);
+   QMetaObject::invokeMethod(this->uDPListener, [this]() { this->uDPListener->send(Common::MessageHeader::CORE_GOODBYE); }, Qt::BlockingQueuedConnection);
+
+   this->uDPThread.quit();
+   this->uDPThread.wait();
+
    L_DEBU("NetworkListener deleted");
 }
 
 QSharedPointer<ISearch> NetworkListener::newSearch()
 {
-   return QSharedPointer<ISearch>(new Search(this->uDPListener));
+   return QSharedPointer<ISearch>(new Search(*this->uDPListener));
 }
 
 void NetworkListener::rebindSockets()
 {
    this->peerManager->removeAllPeers();
-   this->uDPListener.rebindSockets();
+   QMetaObject::invokeMethod(this->uDPListener, &UDPListener::rebindSockets, Qt::QueuedConnection);
    this->tCPListener.rebindSockets();
 }
 
 NetworkListener::SendStatus NetworkListener::send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message, const Common::Hash& peerID)
 {
    if (peerID.isNull())
-      return this->uDPListener.send(type, message);
+      return this->uDPListener->send(type, message);
    else
-      return this->uDPListener.send(type, message, peerID);
+      return this->uDPListener->send(type, message, peerID);
+}
+
+NetworkListener::UDPStats NetworkListener::getUDPStats() const
+{
+   return this->uDPListener->getStats();
 }
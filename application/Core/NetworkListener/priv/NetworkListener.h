@@ -20,6 +20,7 @@
 
 #include <QObject>
 #include <QSharedPointer>
+#include <QThread>
 #include <QNetworkConfigurationManager>
 
 #include <Common/Uncopyable.h>
@@ -30,6 +31,7 @@
 #include <INetworkListener.h>
 #include <ISearch.h>
 #include <priv/UDPListener.h>
+#include <priv/IMAliveHandler.h>
 #include <priv/TCPListener.h>
 #include <priv/Log.h>
 
@@ -55,6 +57,7 @@ namespace NL
 
    public:
       SendStatus send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message, const Common::Hash& peerID = Common::Hash());
+      UDPStats getUDPStats() const;
 
    private:      
       LOG_INIT_H("NetworkListener")
@@ -67,6 +70,9 @@ namespace NL
       QNetworkConfigurationManager configManager;
 
       TCPListener tCPListener;
-      UDPListener uDPListener;
+
+      QThread uDPThread;
+      UDPListener* uDPListener; // Lives in 'uDPThread', deleted when the thread finishes.
+      IMAliveHandler iMAliveHandler;
    };
 }
@@ -23,6 +23,8 @@ using namespace NL;
 
 #if defined(Q_OS_LINUX)
    #include <netinet/in.h>
+   #include <sys/socket.h>
+   #include <errno.h>
 #elif defined(Q_OS_DARWIN)
    #include <sys/types.h>
    #include <sys/socket.h>
@@ -30,13 +32,13 @@ using namespace NL;
    #include <Winsock.h>
 #endif
 
-#include <QRandomGenerator64>
+#include <QThread>
+#include <QMetaObject>
+#include <QVarLengthArray>
 
 #include <google/protobuf/message.h>
 
 #include <Common/Settings.h>
-#include <Common/Constants.h>
-#include <Common/Global.h>
 #include <Common/ProtoHelper.h>
 
 #include <Core/PeerManager/IPeer.h>
@@ -50,7 +52,14 @@ using namespace NL;
   * The goals of this class are:
   *  - Listen for incoming unicast and multicast datagrams, process them and dispatch the information the correct manager: 'FileManager', 'DownloadManager' or 'PeerManager'.
   *  - Offer methods to send unicast or multicast datagrams.
-  *  - Periodically send a 'IMAlive' multicast datagrams.
+  *
+  * It lives in its own thread (see 'NetworkListener') to not be delayed by the main event loop.
+  * The answers only needing the 'FileManager' ('ChunksOwned' and 'FindResult') are sent from this thread.
+  * The updates of the peers and of the chunk owners are handed off to the main thread by queued signals, see 'IMAliveHandler'.
+  * The time between the read of a datagram and its handling is measured by two histograms, see 'INetworkListener::UDPStats'.
+  *
+  * On Linux the pending datagrams are read by batch with 'recvmmsg(..)' and the answers are sent by batch with 'sendmmsg(..)'.
+  * The datagrams dropped by the system are counted with the socket option 'SO_RXQ_OVFL'.
   *
   * @author mcuony
   * @author gburri
@@ -59,35 +68,44 @@ using namespace NL;
 UDPListener::UDPListener(
    QSharedPointer<FM::IFileManager> fileManager,
    QSharedPointer<PM::IPeerManager> peerManager,
-   QSharedPointer<UM::IUploadManager> uploadManager,
-   QSharedPointer<DM::IDownloadManager> downloadManager,
    quint16 unicastPort
 ) :
    MAX_UDP_DATAGRAM_PAYLOAD_SIZE(static_cast<int>(SETTINGS.get<quint32>("max_udp_datagram_size"))),
-   bodyBuffer(UDPListener::buffer + Common::MessageHeader::HEADER_SIZE),
+   receiveRing(RECEIVE_RING_SIZE * BUFFER_SIZE, Qt::Uninitialized),
+   deferSending(false),
    UNICAST_PORT(unicastPort),
    MULTICAST_PORT(SETTINGS.get<quint32>("multicast_port")),
    multicastGroup(Utils::getMulticastGroup()),
    fileManager(fileManager),
    peerManager(peerManager),
-   uploadManager(uploadManager),
-   downloadManager(downloadManager),
-   currentIMAliveTag(0),
-   nextHashRequestType(FIRST_HASHES),
+   multicastSocket(this),
+   unicastSocket(this),
+   lastMulticastDropCount(0),
+   lastUnicastDropCount(0),
+   nbDatagramsReceived(0),
+   nbDatagramsDropped(0),
+   nbDatagramsRejected(0),
+   nbDatagramsNotSent(0),
    loggerIMAlive(LM::Builder::newLogger("NetworkListener (IMAlive)"))
 {
-   this->initMulticastUDPSocket();
-   this->initUnicastUDPSocket();
+   qRegisterMetaType<Common::Hash>("Common::Hash");
+   qRegisterMetaType<QHostAddress>("QHostAddress");
+   qRegisterMetaType<Protos::Core::IMAlive>("Protos::Core::IMAlive");
+   qRegisterMetaType<Common::Message>("Common::Message");
+   qRegisterMetaType<Protos::Common::FindResult>("Protos::Common::FindResult");
+   qRegisterMetaType<Protos::Core::ChunksOwned>("Protos::Core::ChunksOwned");
+
+   // Called by the file manager search thread, 'send(..)' is thread-safe.
+   connect(this->fileManager.data(), &FM::IFileManager::findDone, this, &UDPListener::findDone, Qt::DirectConnection);
 
-   connect(&this->timerIMAlive, &QTimer::timeout, this, &UDPListener::sendIMAliveMessage);
-   this->timerIMAlive.start(static_cast<int>(SETTINGS.get<quint32>("peer_imalive_period")));
+   this->clock.start();
 
-   this->sendIMAliveMessage();
+   // The sockets are bound by 'rebindSockets()' once moved to their thread.
 }
 
 /**
   * Send an UDP unicast datagram to the given peer.
-  * @return 'false' if the datagram can't be sent.
+  * Thread-safe, see 'sendDatagram(..)'.
   */
 INetworkListener::SendStatus UDPListener::send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message, const Common::Hash& peerID)
 {
@@ -95,39 +113,34 @@ INetworkListener::SendStatus UDPListener::send(Common::MessageHeader::MessageTyp
    if (!peer)
       return INetworkListener::SendStatus::PEER_UNKNOWN;
 
-   int messageSize;
-   if (!(messageSize = this->writeMessageToBuffer(type, message)))
+   const QByteArray& datagram = this->writeMessage(type, message);
+   if (datagram.isEmpty())
       return INetworkListener::SendStatus::MESSAGE_TOO_LARGE;
 
    L_DEBU(QString("Send unicast UDP to %1, header.getType(): %2, message size: %3 \n%4").
       arg(peer->toStringLog()).
       arg(Common::MessageHeader::messToStr(type)).
-      arg(messageSize).
+      arg(datagram.size()).
       arg(Common::ProtoHelper::getDebugStr(message))
    );
 
-   if (this->unicastSocket.writeDatagram(this->buffer, messageSize, peer->getIP(), peer->getPort()) == -1)
-   {
-      L_WARN(QString("Unable to send datagram (unicast): error: %1").arg(this->unicastSocket.errorString()));
-      return INetworkListener::SendStatus::UNABLE_TO_SEND;
-   }
-
-   return INetworkListener::SendStatus::OK;
+   return this->sendDatagram(datagram, peer->getIP(), peer->getPort(), false);
 }
 
 /**
   * Send an UDP multicast message.
+  * Thread-safe, see 'sendDatagram(..)'.
   */
 INetworkListener::SendStatus UDPListener::send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message)
 {
-   int messageSize;
-   if (!(messageSize = this->writeMessageToBuffer(type, message)))
+   const QByteArray& datagram = this->writeMessage(type, message);
+   if (datagram.isEmpty())
       return INetworkListener::SendStatus::MESSAGE_TOO_LARGE;
 
 #if DEBUG
    QString logMess = QString("Send multicast UDP: header.getType() = %1, message size = %2 \n%3").
       arg(Common::MessageHeader::messToStr(type)).
-      arg(messageSize).
+      arg(datagram.size()).
       arg(Common::ProtoHelper::getDebugStr(message));
 
    if (type == Common::MessageHeader::CORE_IM_ALIVE)
@@ -136,251 +149,445 @@ INetworkListener::SendStatus UDPListener::send(Common::MessageHeader::MessageTyp
       L_DEBU(logMess);
 #endif
 
-   if (this->multicastSocket.writeDatagram(this->buffer, messageSize, this->multicastGroup, MULTICAST_PORT) == -1)
-   {
-      L_WARN(QString("Unable to send datagram (multicast): error: %1").arg(this->unicastSocket.errorString()));
-      return INetworkListener::SendStatus::UNABLE_TO_SEND;
-   }
+   return this->sendDatagram(datagram, this->multicastGroup, MULTICAST_PORT, true);
+}
 
-   return INetworkListener::SendStatus::OK;
+int UDPListener::getMaxDatagramPayloadSize() const
+{
+   return this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE;
 }
 
-void UDPListener::sendIMAliveMessage()
+void UDPListener::rebindSockets()
 {
-   Protos::Core::IMAlive IMAliveMessage;
-   IMAliveMessage.set_version(Common::Constants::PROTOCOL_VERSION);
-   Common::ProtoHelper::setStr(IMAliveMessage, &Protos::Core::IMAlive::set_core_version, Common::Global::getVersionFull());
-   IMAliveMessage.set_port(this->UNICAST_PORT);
-
-   const QString& nick = this->peerManager->getSelf()->getNick();
-   Common::ProtoHelper::setStr(IMAliveMessage, &Protos::Core::IMAlive::set_nick, nick.length() > MAX_NICK_LENGTH ? nick.left(MAX_NICK_LENGTH) : nick);
-
-   IMAliveMessage.set_amount(this->fileManager->getAmount());
-   IMAliveMessage.set_download_rate(this->downloadManager->getDownloadRate());
-   IMAliveMessage.set_upload_rate(this->uploadManager->getUploadRate());
-
-   this->currentIMAliveTag = QRandomGenerator64::global()->generate64();
-   IMAliveMessage.set_tag(this->currentIMAliveTag);
-
-   // We fill the rest of the message with a maximum of needed hashes.
-   static const quint32 MAX_IMALIVE_THROUGHPUT = SETTINGS.get<quint32>("max_imalive_throughput");
-   static const int AVERAGE_FIXED_SIZE = 100; // [Byte]. Header size + information in the 'IMAlive' message without the hashes.
-   static const quint32 IMALIVE_PERIOD = SETTINGS.get<quint32>("peer_imalive_period") / 1000; // [s]
-   static const int FIXED_RATE_PER_PEER = AVERAGE_FIXED_SIZE / IMALIVE_PERIOD; // [Byte/s]
-   static const int HASH_SIZE = Common::Hash::HASH_SIZE + 4; // "4" is the overhead added by protobuff for each hash.
-
-   const int numberOfPeers = this->peerManager->getNbOfPeers();
-   const int maxNumberOfHashesToSend = numberOfPeers == 0 ? std::numeric_limits<int>::max() : IMALIVE_PERIOD * (MAX_IMALIVE_THROUGHPUT - numberOfPeers * FIXED_RATE_PER_PEER) / (numberOfPeers * HASH_SIZE);
-
-   int numberOfHashesToSend = (this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE - IMAliveMessage.ByteSizeLong() - Common::MessageHeader::HEADER_SIZE) / HASH_SIZE;
-   if (numberOfHashesToSend > maxNumberOfHashesToSend)
-      numberOfHashesToSend = maxNumberOfHashesToSend;
-
-   // The requested hashes method alternates from the first hashes and the oldest hashes.
-   // We are trying to have the knowledge about who has which chunk for the whole download queue (IDownloadManager::getTheOldestUnfinishedChunks(..))
-   // and for the chunks we want to download first (IDownloadManager::getTheFirstUnfinishedChunks(..)).
-   switch (this->nextHashRequestType)
-   {
-   case FIRST_HASHES:
-      this->currentChunkDownloaders = this->downloadManager->getTheFirstUnfinishedChunks(numberOfHashesToSend);
-      this->nextHashRequestType = OLDEST_HASHES;
-      break;
-   case OLDEST_HASHES:
-      this->currentChunkDownloaders = this->downloadManager->getTheOldestUnfinishedChunks(numberOfHashesToSend);
-      this->nextHashRequestType = FIRST_HASHES;
-      break;
-   }
+   this->initMulticastUDPSocket();
+   this->initUnicastUDPSocket();
+}
 
-   IMAliveMessage.mutable_chunk()->Reserve(this->currentChunkDownloaders.size());
-   for (QListIterator<QSharedPointer<DM::IChunkDownloader>> i(this->currentChunkDownloaders); i.hasNext();)
-   {
-      QSharedPointer<DM::IChunkDownloader> chunkDownloader = i.next();
-      IMAliveMessage.add_chunk()->set_hash(chunkDownloader->getHash().getData(), Common::Hash::HASH_SIZE);
+INetworkListener::UDPStats UDPListener::getStats() const
+{
+   INetworkListener::UDPStats stats;
+   stats.nbDatagramsReceived = this->nbDatagramsReceived.load();
+   stats.nbDatagramsDropped = this->nbDatagramsDropped.load();
+   stats.nbDatagramsRejected = this->nbDatagramsRejected.load();
+   stats.nbDatagramsNotSent = this->nbDatagramsNotSent.load();
+   stats.handlingLatency = this->handlingLatency.getBuckets();
+   stats.handOffLatency = this->handOffLatency.getBuckets();
+   return stats;
+}
 
-      // If we already have the chunk . . .
-      QSharedPointer<FM::IChunk> chunk = this->fileManager->getChunk(chunkDownloader->getHash());
-      if (!chunk.isNull() && chunk->isComplete())
-         chunkDownloader->addPeer(this->peerManager->getSelf());
-      else
-         chunkDownloader->rmPeer(this->peerManager->getSelf());
-   }
+/**
+  * Called by the main thread when it starts to handle the work handed off for a datagram.
+  * @param receivedTime The time the datagram has been read, see 'clock'.
+  */
+void UDPListener::handedOffDatagramHandled(qint64 receivedTime)
+{
+   this->handOffLatency.add(this->clock.nsecsElapsed() - receivedTime);
+}
 
-   emit IMAliveMessageToBeSend(IMAliveMessage);
+/**
+  * Send the results of a search asked by a peer with a 'CORE_FIND' message.
+  */
+void UDPListener::findDone(const Common::Hash& requesterID, quint64 tag, const QList<Protos::Common::FindResult>& results)
+{
+   for (QListIterator<Protos::Common::FindResult> i(results); i.hasNext();)
+   {
+      Protos::Common::FindResult result = i.next();
+      result.set_tag(tag);
+      this->send(Common::MessageHeader::CORE_FIND_RESULT, result, requesterID);
+   }
+}
 
-   this->send(Common::MessageHeader::CORE_IM_ALIVE, IMAliveMessage);
+void UDPListener::processPendingMulticastDatagrams()
+{
+   this->deferSending = true;
+   this->readPendingDatagrams(this->multicastSocket, &UDPListener::processMulticastDatagram, this->lastMulticastDropCount);
+   this->deferSending = false;
+   this->flushPendingDatagrams();
 }
 
-void UDPListener::rebindSockets()
+/**
+  * Function called when data is recevied by the socket : The corresponding proto is created and the coresponding event is rised.
+  */
+void UDPListener::processPendingUnicastDatagrams()
 {
-   this->initMulticastUDPSocket();
-   this->initUnicastUDPSocket();
+   this->deferSending = true;
+   this->readPendingDatagrams(this->unicastSocket, &UDPListener::processUnicastDatagram, this->lastUnicastDropCount);
+   this->deferSending = false;
+   this->flushPendingDatagrams();
 }
 
-void UDPListener::processPendingMulticastDatagrams()
+/**
+  * Read and process all the pending datagrams of the given socket.
+  * @param lastDropCount The last number of datagrams dropped by the system for this socket.
+  */
+void UDPListener::readPendingDatagrams(QUdpSocket& socket, DatagramProcessor process, quint32& lastDropCount)
 {
-   while (this->multicastSocket.hasPendingDatagrams())
+   char* const datagram = this->receiveRing.data();
+
+   while (socket.hasPendingDatagrams())
    {
       QHostAddress peerAddress;
-      const Common::MessageHeader& header = this->readDatagramToBuffer(this->multicastSocket, peerAddress);
-      if (header.isNull())
+      quint16 port;
+      const qint64 datagramSize = socket.readDatagram(datagram, BUFFER_SIZE, &peerAddress, &port);
+      if (datagramSize == -1)
+      {
+         L_WARN(QString("UDPListener::readPendingDatagrams(..): Unable to read datagram from address:port: %1:%2").arg(peerAddress.toString()).arg(port));
          continue;
+      }
+
+      this->nbDatagramsReceived.fetchAndAddRelaxed(1);
+      (this->*process)(datagram, datagramSize, peerAddress, this->clock.nsecsElapsed());
+
+#ifdef Q_OS_LINUX
+      // The first datagram is read by Qt to re-enable its read notifier, the remaining ones are read directly from the socket.
+      this->readPendingDatagramsByBatch(socket, process, lastDropCount);
+#else
+      Q_UNUSED(lastDropCount);
+#endif
+   }
+}
 
-      try
+#ifdef Q_OS_LINUX
+void UDPListener::readPendingDatagramsByBatch(QUdpSocket& socket, DatagramProcessor process, quint32& lastDropCount)
+{
+   const int socketDescriptor = static_cast<int>(socket.socketDescriptor());
+
+   mmsghdr headers[RECEIVE_RING_SIZE];
+   iovec iovecs[RECEIVE_RING_SIZE];
+   sockaddr_storage addresses[RECEIVE_RING_SIZE];
+   alignas(cmsghdr) char controls[RECEIVE_RING_SIZE][CMSG_SPACE(sizeof(quint32))];
+
+   forever
+   {
+      for (int i = 0; i < RECEIVE_RING_SIZE; i++)
       {
-         const Common::Message& message = Common::Message::readMessageBody(header, this->bodyBuffer);
+         iovecs[i].iov_base = this->receiveRing.data() + i * BUFFER_SIZE;
+         iovecs[i].iov_len = BUFFER_SIZE;
+         memset(&headers[i], 0, sizeof(mmsghdr));
+         headers[i].msg_hdr.msg_name = &addresses[i];
+         headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+         headers[i].msg_hdr.msg_iov = &iovecs[i];
+         headers[i].msg_hdr.msg_iovlen = 1;
+         headers[i].msg_hdr.msg_control = controls[i];
+         headers[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+      }
 
-         switch (header.getType())
-         {
-         case Common::MessageHeader::CORE_IM_ALIVE:
-            {
-               const Protos::Core::IMAlive& IMAliveMessage = message.getMessage<Protos::Core::IMAlive>();
+      const int nbDatagrams = recvmmsg(socketDescriptor, headers, RECEIVE_RING_SIZE, MSG_DONTWAIT, nullptr);
+      if (nbDatagrams <= 0)
+      {
+         if (nbDatagrams == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            L_WARN(QString("UDPListener::readPendingDatagramsByBatch(..): recvmmsg(..) failed, errno: %1").arg(errno));
+         return;
+      }
 
-               this->peerManager->updatePeer(
-                  header.getSenderID(),
-                  peerAddress,
-                  IMAliveMessage.port(),
-                  Common::ProtoHelper::getStr(IMAliveMessage, &Protos::Core::IMAlive::nick),
-                  IMAliveMessage.amount(),
-                  Common::ProtoHelper::getStr(IMAliveMessage, &Protos::Core::IMAlive::core_version),
-                  IMAliveMessage.download_rate(),
-                  IMAliveMessage.upload_rate(),
-                  IMAliveMessage.version()
-               );
+      this->nbDatagramsReceived.fetchAndAddRelaxed(nbDatagrams);
+      const qint64 receivedTime = this->clock.nsecsElapsed();
 
-               if (IMAliveMessage.chunk_size() > 0)
+      for (int i = 0; i < nbDatagrams; i++)
+      {
+         for (cmsghdr* cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&headers[i].msg_hdr, cmsg))
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+               quint32 dropCount;
+               memcpy(&dropCount, CMSG_DATA(cmsg), sizeof(dropCount));
+               if (dropCount > lastDropCount)
                {
-                  QList<Common::Hash> hashes;
-                  hashes.reserve(IMAliveMessage.chunk_size());
-                  for (int i = 0; i < IMAliveMessage.chunk_size(); i++)
-                     hashes << IMAliveMessage.chunk(i).hash();
-
-                  const QBitArray& bitArray = this->fileManager->haveChunks(hashes);
-
-                  if (!bitArray.isNull()) // If we own at least one chunk we reply with a CHUNKS_OWNED message.
-                  {
-                     Protos::Core::ChunksOwned chunkOwnedMessage;
-                     chunkOwnedMessage.set_tag(IMAliveMessage.tag());
-                     chunkOwnedMessage.mutable_chunk_state()->Reserve(bitArray.size());
-                     for (int i = 0; i < bitArray.size(); i++)
-                        chunkOwnedMessage.add_chunk_state(bitArray[i]);
-                     this->send(Common::MessageHeader::CORE_CHUNKS_OWNED, chunkOwnedMessage, header.getSenderID());
-                  }
+                  this->nbDatagramsDropped.fetchAndAddRelaxed(dropCount - lastDropCount);
+                  L_WARN(QString("%1 datagram(s) dropped by the system, the setting 'udp_buffer_size' may be too small").arg(dropCount - lastDropCount));
                }
+               lastDropCount = dropCount;
             }
-            break;
 
-         case Common::MessageHeader::CORE_GOODBYE:
-            this->peerManager->removePeer(header.getSenderID(), peerAddress);
-            break;
+         if (headers[i].msg_hdr.msg_flags & MSG_TRUNC)
+         {
+            this->nbDatagramsRejected.fetchAndAddRelaxed(1);
+            continue;
+         }
+
+         (this->*process)(static_cast<const char*>(iovecs[i].iov_base), headers[i].msg_len, QHostAddress(reinterpret_cast<const sockaddr*>(&addresses[i])), receivedTime);
+      }
+
+      if (nbDatagrams < RECEIVE_RING_SIZE)
+         return;
+   }
+}
+#endif
 
-         case Common::MessageHeader::CORE_FIND:
+void UDPListener::processMulticastDatagram(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress, qint64 receivedTime)
+{
+   const Common::MessageHeader& header = this->readHeader(datagram, datagramSize, peerAddress);
+   if (header.isNull())
+      return;
+
+   try
+   {
+      const Common::Message& message = Common::Message::readMessageBody(header, datagram + Common::MessageHeader::HEADER_SIZE);
+
+      switch (header.getType())
+      {
+      case Common::MessageHeader::CORE_IM_ALIVE:
+         {
+            const Protos::Core::IMAlive& IMAliveMessage = message.getMessage<Protos::Core::IMAlive>();
+
+            // The peer is updated by the main thread.
+            emit IMAliveReceived(header.getSenderID(), peerAddress, IMAliveMessage, receivedTime);
+
+            if (IMAliveMessage.chunk_prefix_size() > 0)
             {
-               PM::IPeer* peer = this->peerManager->getPeer(header.getSenderID());
+               QList<quint64> hashPrefixes;
+               hashPrefixes.reserve(IMAliveMessage.chunk_prefix_size());
+               for (int i = 0; i < IMAliveMessage.chunk_prefix_size(); i++)
+                  hashPrefixes << IMAliveMessage.chunk_prefix(i);
+
+               const QBitArray& bitArray = this->fileManager->haveChunksByPrefix(hashPrefixes);
 
-               if (peer && peer->isAvailable())
+               if (!bitArray.isNull()) // If we own at least one chunk we reply with a CHUNKS_OWNED message.
                {
-                  const Protos::Core::Find& findMessage = message.getMessage<Protos::Core::Find>();
-                  QList<QString> extensions;
-                  extensions.reserve(findMessage.pattern().extension_filter_size());
-                  for (int i = 0; i < findMessage.pattern().extension_filter_size(); i++)
-                     extensions << Common::ProtoHelper::getRepeatedStr(findMessage.pattern(), &Protos::Common::FindPattern::extension_filter, i);
-
-                  QList<Protos::Common::FindResult> results =
-                     this->fileManager->find(
-                        Common::ProtoHelper::getStr(findMessage.pattern(), &Protos::Common::FindPattern::pattern),
-                        extensions,
-                        findMessage.pattern().min_size() == 0 ? std::numeric_limits<qint64>::min() : (qint64)findMessage.pattern().min_size(), // According the protocol.
-                        findMessage.pattern().max_size() == 0 ? std::numeric_limits<qint64>::max() : (qint64)findMessage.pattern().max_size(), // According the protocol.
-                        findMessage.pattern().category(),
-                        SETTINGS.get<quint32>("max_number_of_search_result_to_send"),
-                        this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE - Common::MessageHeader::HEADER_SIZE
-                     );
-
-                  for (QMutableListIterator<Protos::Common::FindResult> i(results); i.hasNext();)
-                  {
-                     Protos::Common::FindResult& result = i.next();
-                     result.set_tag(findMessage.tag());
-                     this->send(Common::MessageHeader::CORE_FIND_RESULT, result, header.getSenderID());
-                  }
+                  Protos::Core::ChunksOwned chunkOwnedMessage;
+                  chunkOwnedMessage.set_tag(IMAliveMessage.tag());
+                  chunkOwnedMessage.mutable_chunk_state()->Reserve(bitArray.size());
+                  for (int i = 0; i < bitArray.size(); i++)
+                     chunkOwnedMessage.add_chunk_state(bitArray[i]);
+
+                  // The peer may not be known yet by the 'PeerManager', the answer is sent directly to its address.
+                  const QByteArray& datagram = this->writeMessage(Common::MessageHeader::CORE_CHUNKS_OWNED, chunkOwnedMessage);
+                  if (!datagram.isEmpty())
+                     this->sendDatagram(datagram, peerAddress, IMAliveMessage.port(), false);
                }
             }
-            break;
+         }
+         break;
+
+      case Common::MessageHeader::CORE_GOODBYE:
+         emit goodbyeReceived(header.getSenderID(), peerAddress, receivedTime);
+         break;
+
+      case Common::MessageHeader::CORE_FIND:
+         {
+            PM::IPeer* peer = this->peerManager->getPeer(header.getSenderID());
+
+            if (peer && peer->isAvailable())
+            {
+               const Protos::Core::Find& findMessage = message.getMessage<Protos::Core::Find>();
+               QList<QString> extensions;
+               extensions.reserve(findMessage.pattern().extension_filter_size());
+               for (int i = 0; i < findMessage.pattern().extension_filter_size(); i++)
+                  extensions << Common::ProtoHelper::getRepeatedStr(findMessage.pattern(), &Protos::Common::FindPattern::extension_filter, i);
+
+               // The search is done by the file manager thread, the results are sent by 'findDone(..)'.
+               this->fileManager->findAsync(
+                  header.getSenderID(),
+                  findMessage.tag(),
+                  Common::ProtoHelper::getStr(findMessage.pattern(), &Protos::Common::FindPattern::pattern),
+                  extensions,
+                  findMessage.pattern().min_size() == 0 ? std::numeric_limits<qint64>::min() : (qint64)findMessage.pattern().min_size(), // According the protocol.
+                  findMessage.pattern().max_size() == 0 ? std::numeric_limits<qint64>::max() : (qint64)findMessage.pattern().max_size(), // According the protocol.
+                  findMessage.pattern().category(),
+                  SETTINGS.get<quint32>("max_number_of_search_result_to_send"),
+                  this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE - Common::MessageHeader::HEADER_SIZE
+               );
+            }
+         }
+         break;
+
+      default:; // Ignore other messages.
+      }
+
+      emit received(message);
+      this->handlingLatency.add(this->clock.nsecsElapsed() - receivedTime);
+   }
+   catch (Common::ReadErrorException&)
+   {
+      this->nbDatagramsRejected.fetchAndAddRelaxed(1);
+      L_WARN(QString("Unable to read a multicast message from peer %1 %2").arg(header.getSenderID().toStr()).arg(peerAddress.toString()));
+   }
+}
+
+void UDPListener::processUnicastDatagram(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress, qint64 receivedTime)
+{
+   const Common::MessageHeader& header = this->readHeader(datagram, datagramSize, peerAddress);
+   if (header.isNull())
+      return;
 
-         default:; // Ignore other messages.
+   try
+   {
+      const Common::Message& message = Common::Message::readMessageBody(header, datagram + Common::MessageHeader::HEADER_SIZE);
+      PM::IPeer* peer = this->peerManager->getPeer(header.getSenderID());
+      if (!peer || !peer->isAvailable())
+         return;
+
+      switch (header.getType())
+      {
+      case Common::MessageHeader::CORE_CHUNKS_OWNED:
+         // The chunk owners are updated by the main thread.
+         emit chunksOwnedReceived(header.getSenderID(), message.getMessage<Protos::Core::ChunksOwned>(), receivedTime);
+         break;
+
+      case Common::MessageHeader::CORE_FIND_RESULT:
+         {
+            Protos::Common::FindResult findResultMessage = message.getMessage<Protos::Common::FindResult>();
+            findResultMessage.mutable_peer_id()->set_hash(header.getSenderID().getData(), Common::Hash::HASH_SIZE);
+            emit newFindResultMessage(findResultMessage);
          }
+         break;
 
-         emit received(message);
+      default:; // Ignore other messages.
       }
-      catch (Common::ReadErrorException&)
+
+      emit received(message);
+      this->handlingLatency.add(this->clock.nsecsElapsed() - receivedTime);
+   }
+   catch (Common::ReadErrorException&)
+   {
+      this->nbDatagramsRejected.fetchAndAddRelaxed(1);
+      L_WARN(QString("Unable to read an unicast message from peer %1 %2").arg(header.getSenderID().toStr()).arg(peerAddress.toString()));
+   }
+}
+
+#ifdef Q_OS_LINUX
+/**
+  * Fill 'sockAddr' with the given address and port, the address is mapped to IPv6 if 'toIPv6' is true.
+  * @return 'false' if the address can't be used with 'sendmmsg(..)', Qt will send it.
+  */
+static bool toSockAddr(const QHostAddress& address, quint16 port, bool toIPv6, sockaddr_storage& sockAddr, socklen_t& length)
+{
+   memset(&sockAddr, 0, sizeof(sockAddr));
+
+   if (address.protocol() == QAbstractSocket::IPv4Protocol)
+   {
+      if (toIPv6)
       {
-         L_WARN(QString("Unable to read a multicast message from peer %1 %2").arg(header.getSenderID().toStr()).arg(peerAddress.toString()));
+         sockaddr_in6* sockAddr6 = reinterpret_cast<sockaddr_in6*>(&sockAddr);
+         sockAddr6->sin6_family = AF_INET6;
+         sockAddr6->sin6_port = htons(port);
+         const quint32 ip = htonl(address.toIPv4Address());
+         sockAddr6->sin6_addr.s6_addr[10] = 0xFF;
+         sockAddr6->sin6_addr.s6_addr[11] = 0xFF;
+         memcpy(&sockAddr6->sin6_addr.s6_addr[12], &ip, sizeof(ip));
+         length = sizeof(sockaddr_in6);
       }
+      else
+      {
+         sockaddr_in* sockAddr4 = reinterpret_cast<sockaddr_in*>(&sockAddr);
+         sockAddr4->sin_family = AF_INET;
+         sockAddr4->sin_port = htons(port);
+         sockAddr4->sin_addr.s_addr = htonl(address.toIPv4Address());
+         length = sizeof(sockaddr_in);
+      }
+      return true;
+   }
+
+   if (address.protocol() == QAbstractSocket::IPv6Protocol && toIPv6 && address.scopeId().isEmpty())
+   {
+      sockaddr_in6* sockAddr6 = reinterpret_cast<sockaddr_in6*>(&sockAddr);
+      sockAddr6->sin6_family = AF_INET6;
+      sockAddr6->sin6_port = htons(port);
+      const Q_IPV6ADDR ip = address.toIPv6Address();
+      memcpy(sockAddr6->sin6_addr.s6_addr, ip.c, sizeof(ip.c));
+      length = sizeof(sockaddr_in6);
+      return true;
    }
+
+   return false;
 }
+#endif
 
 /**
-  * Function called when data is recevied by the socket : The corresponding proto is created and the coresponding event is rised.
+  * Thread-safe: if called from another thread the datagram is sent later by the UDP thread.
   */
-void UDPListener::processPendingUnicastDatagrams()
+INetworkListener::SendStatus UDPListener::sendDatagram(const QByteArray& datagram, const QHostAddress& address, quint16 port, bool multicast)
 {
-   while (this->unicastSocket.hasPendingDatagrams())
+   if (QThread::currentThread() != this->thread())
    {
-      QHostAddress peerAddress;
-      const Common::MessageHeader& header =  UDPListener::readDatagramToBuffer(this->unicastSocket, peerAddress);
-      if (header.isNull())
-         continue;
+      QMetaObject::invokeMethod(this, [=]() { this->sendDatagram(datagram, address, port, multicast); }, Qt::QueuedConnection);
+      return INetworkListener::SendStatus::OK;
+   }
 
-      try
-      {
-         const Common::Message& message = Common::Message::readMessageBody(header, this->bodyBuffer);
-         PM::IPeer* peer = this->peerManager->getPeer(header.getSenderID());
-         if (!peer || !peer->isAvailable())
-            continue;
+   if (!multicast && this->deferSending)
+   {
+      this->pendingDatagrams << PendingDatagram { datagram, address, port };
+      return INetworkListener::SendStatus::OK;
+   }
 
-         switch (header.getType())
-         {
-         case Common::MessageHeader::CORE_CHUNKS_OWNED:
-            {
-               const Protos::Core::ChunksOwned& chunksOwnedMessage = message.getMessage<Protos::Core::ChunksOwned>();
+   QUdpSocket& socket = multicast ? this->multicastSocket : this->unicastSocket;
+   if (socket.writeDatagram(datagram, address, port) == -1)
+   {
+      L_WARN(QString("Unable to send datagram (%1): error: %2").arg(multicast ? "multicast" : "unicast").arg(socket.errorString()));
+      this->nbDatagramsNotSent.fetchAndAddRelaxed(1);
+      return INetworkListener::SendStatus::UNABLE_TO_SEND;
+   }
 
-               if (chunksOwnedMessage.tag() != this->currentIMAliveTag)
-               {
-                  L_WARN(QString("ChunksOwned: tag (%1) doesn't match current tag (%2)").arg(chunksOwnedMessage.tag()).arg(currentIMAliveTag));
-                  continue;
-               }
+   return INetworkListener::SendStatus::OK;
+}
 
-               if (chunksOwnedMessage.chunk_state_size() != this->currentChunkDownloaders.size())
-               {
-                  L_WARN(QString("ChunksOwned: The size (%1) doesn't match the expected one (%2)").arg(chunksOwnedMessage.chunk_state_size()).arg(this->currentChunkDownloaders.size()));
-                  continue;
-               }
+/**
+  * Send the unicast datagrams queued while processing the received datagrams, with one system call on Linux.
+  */
+void UDPListener::flushPendingDatagrams()
+{
+   if (this->pendingDatagrams.isEmpty())
+      return;
 
-               for (int i = 0; i < chunksOwnedMessage.chunk_state_size(); i++)
-                  if (chunksOwnedMessage.chunk_state(i))
-                     this->currentChunkDownloaders[i]->addPeer(peer);
-                  else
-                     this->currentChunkDownloaders[i]->rmPeer(peer);
-            }
-            break;
+#ifdef Q_OS_LINUX
+   const bool toIPv6 = this->unicastSocket.localAddress().protocol() == QAbstractSocket::IPv6Protocol;
 
-         case Common::MessageHeader::CORE_FIND_RESULT:
-            {
-               Protos::Common::FindResult findResultMessage = message.getMessage<Protos::Common::FindResult>();
-               findResultMessage.mutable_peer_id()->set_hash(header.getSenderID().getData(), Common::Hash::HASH_SIZE);
-               emit newFindResultMessage(findResultMessage);
-            }
-            break;
+   QVarLengthArray<mmsghdr, 32> headers;
+   QVarLengthArray<iovec, 32> iovecs(this->pendingDatagrams.size());
+   QVarLengthArray<sockaddr_storage, 32> addresses(this->pendingDatagrams.size());
+   QList<PendingDatagram> datagramsSentByQt;
 
-         default:; // Ignore other messages.
-         }
+   for (int i = 0; i < this->pendingDatagrams.size(); i++)
+   {
+      PendingDatagram& datagram = this->pendingDatagrams[i];
+      socklen_t addressLength;
+      if (!toSockAddr(datagram.address, datagram.port, toIPv6, addresses[i], addressLength))
+      {
+         datagramsSentByQt << datagram;
+         continue;
+      }
+
+      iovecs[i].iov_base = datagram.data.data();
+      iovecs[i].iov_len = datagram.data.size();
 
-         emit received(message);
+      mmsghdr header;
+      memset(&header, 0, sizeof(header));
+      header.msg_hdr.msg_name = &addresses[i];
+      header.msg_hdr.msg_namelen = addressLength;
+      header.msg_hdr.msg_iov = &iovecs[i];
+      header.msg_hdr.msg_iovlen = 1;
+      headers.append(header);
+   }
+
+   const int socketDescriptor = static_cast<int>(this->unicastSocket.socketDescriptor());
+   int nbSent = 0;
+   while (nbSent < headers.size())
+   {
+      const int n = sendmmsg(socketDescriptor, headers.data() + nbSent, headers.size() - nbSent, 0);
+      if (n <= 0)
+      {
+         if (n == -1 && errno == EINTR)
+            continue;
+         L_WARN(QString("Unable to send %1 datagram(s) (unicast), errno: %2").arg(headers.size() - nbSent).arg(errno));
+         this->nbDatagramsNotSent.fetchAndAddRelaxed(headers.size() - nbSent);
+         break;
       }
-      catch (Common::ReadErrorException&)
+      nbSent += n;
+   }
+#else
+   const QList<PendingDatagram>& datagramsSentByQt = this->pendingDatagrams;
+#endif
+
+   for (QListIterator<PendingDatagram> i(datagramsSentByQt); i.hasNext();)
+   {
+      const PendingDatagram& datagram = i.next();
+      if (this->unicastSocket.writeDatagram(datagram.data, datagram.address, datagram.port) == -1)
       {
-         L_WARN(QString("Unable to read an unicast message from peer %1 %2").arg(header.getSenderID().toStr()).arg(peerAddress.toString()));
+         L_WARN(QString("Unable to send datagram (unicast): error: %1").arg(this->unicastSocket.errorString()));
+         this->nbDatagramsNotSent.fetchAndAddRelaxed(1);
       }
    }
+
+   this->pendingDatagrams.clear();
 }
 
 void UDPListener::initMulticastUDPSocket()
@@ -414,6 +621,13 @@ void UDPListener::initMulticastUDPSocket()
    this->multicastSocket.setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, BUFFER_SIZE_UDP);
    this->multicastSocket.setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, BUFFER_SIZE_UDP);
 
+#ifdef Q_OS_LINUX
+   // To count the datagrams dropped by the system, see 'readPendingDatagramsByBatch(..)'.
+   const int dropCounterEnabled = 1;
+   setsockopt(static_cast<int>(this->multicastSocket.socketDescriptor()), SOL_SOCKET, SO_RXQ_OVFL, &dropCounterEnabled, sizeof(dropCounterEnabled));
+   this->lastMulticastDropCount = 0;
+#endif
+
    connect(&this->multicastSocket, &QUdpSocket::readyRead, this, &UDPListener::processPendingMulticastDatagrams);
 }
 
@@ -429,42 +643,56 @@ void UDPListener::initUnicastUDPSocket()
    this->unicastSocket.setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, BUFFER_SIZE_UDP);
    this->unicastSocket.setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, BUFFER_SIZE_UDP);
 
+#ifdef Q_OS_LINUX
+   // To count the datagrams dropped by the system, see 'readPendingDatagramsByBatch(..)'.
+   const int dropCounterEnabled = 1;
+   setsockopt(static_cast<int>(this->unicastSocket.socketDescriptor()), SOL_SOCKET, SO_RXQ_OVFL, &dropCounterEnabled, sizeof(dropCounterEnabled));
+   this->lastUnicastDropCount = 0;
+#endif
+
    connect(&this->unicastSocket, &QUdpSocket::readyRead, this, &UDPListener::processPendingUnicastDatagrams);
 }
 
 /**
-  * Writes a given protobuff message to the buffer (this->buffer) prefixed by a header.
-  * @return the total size (header size + message size). Return 0 if the total size is bigger than 'Protos.Core.Settings.max_udp_datagram_size'.
+  * Serializes a given protobuff message prefixed by a header.
+  * It doesn't use a shared buffer because it can be called by any thread.
+  * @return An empty array if the total size (header size + message size) is bigger than 'Protos.Core.Settings.max_udp_datagram_size'.
   */
-int UDPListener::writeMessageToBuffer(Common::MessageHeader::MessageType type, const google::protobuf::Message& message)
+QByteArray UDPListener::writeMessage(Common::MessageHeader::MessageType type, const google::protobuf::Message& message) const
 {
    const Common::MessageHeader header(type, message.ByteSizeLong(), this->getOwnID());
 
-   const int nbBytesWritten = Common::Message::writeMessageToBuffer(this->buffer, this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE, header, &message);
-   if (!nbBytesWritten)
-      L_ERRO(QString("Datagram size too big: %1, max allowed: %2").arg(Common::MessageHeader::HEADER_SIZE + header.getSize()).arg(this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE));
+   const int datagramSize = Common::MessageHeader::HEADER_SIZE + header.getSize();
+   if (datagramSize > this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE)
+   {
+      L_ERRO(QString("Datagram size too big: %1, max allowed: %2").arg(datagramSize).arg(this->MAX_UDP_DATAGRAM_PAYLOAD_SIZE));
+      return QByteArray();
+   }
 
-   return nbBytesWritten;
+   QByteArray datagram(datagramSize, Qt::Uninitialized);
+   Common::Message::writeMessageToBuffer(datagram.data(), datagram.size(), header, &message);
+   return datagram;
 }
 
 /**
+  * Read the header of a received datagram and check it.
   * @return A null header if error.
   */
-Common::MessageHeader UDPListener::readDatagramToBuffer(QUdpSocket& socket, QHostAddress& peerAddress)
+Common::MessageHeader UDPListener::readHeader(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress)
 {
-   quint16 port;
-   const qint64 datagramSize = socket.readDatagram(this->buffer, BUFFER_SIZE, &peerAddress, &port);
-   if (datagramSize == -1)
+   if (datagramSize < Common::MessageHeader::HEADER_SIZE)
    {
-      L_WARN(QString("UDPListener::readDatagramToBuffer(..): Unable to read multicast datagram from address:port: %1:%2").arg(peerAddress.toString()).arg(port));
+      L_ERRO(QString("The datagram received from %1 is smaller than a header").arg(peerAddress.toString()));
+      this->nbDatagramsRejected.fetchAndAddRelaxed(1);
       return Common::MessageHeader();
    }
 
-   Common::MessageHeader header = Common::MessageHeader::readHeader(this->buffer);
+   Common::MessageHeader header = Common::MessageHeader::readHeader(datagram);
 
    if (header.getSize() > datagramSize - Common::MessageHeader::HEADER_SIZE)
    {
       L_ERRO("The message size (header.size) exceeds the datagram size received");
+      this->nbDatagramsRejected.fetchAndAddRelaxed(1);
       header.setNull();
       return header;
    }
@@ -482,6 +710,7 @@ Common::MessageHeader UDPListener::readDatagramToBuffer(QUdpSocket& socket, QHos
       if (!peer)
       {
           L_WARN(QString("We receive a datagram from an unknown peer (%1), skip").arg(peerAddress.toString()));
+         this->nbDatagramsRejected.fetchAndAddRelaxed(1);
          header.setNull();
          return header;
       }
@@ -489,6 +718,7 @@ Common::MessageHeader UDPListener::readDatagramToBuffer(QUdpSocket& socket, QHos
       if (!peer->isAlive())
       {
           L_WARN(QString("We receive a datagram from a dead peer (%1), skip").arg(peerAddress.toString()));
+         this->nbDatagramsRejected.fetchAndAddRelaxed(1);
          header.setNull();
          return header;
       }
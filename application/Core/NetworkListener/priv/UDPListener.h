@@ -20,10 +20,12 @@
 
 #include <QObject>
 #include <QUdpSocket>
-#include <QTimer>
 #include <QSharedPointer>
 #include <QNetworkInterface>
-#include <QUdpSocket>
+#include <QElapsedTimer>
+#include <QList>
+#include <QByteArray>
+#include <QAtomicInteger>
 
 #include <google/protobuf/message.h>
 
@@ -31,14 +33,13 @@
 #include <Protos/common.pb.h>
 
 #include <Common/Uncopyable.h>
+#include <Common/LatencyHistogram.h>
 #include <Common/Network/MessageHeader.h>
 #include <Common/Network/Message.h>
 #include <Common/LogManager/Builder.h>
 #include <Common/LogManager/ILogger.h>
 #include <Core/FileManager/IFileManager.h>
 #include <Core/PeerManager/IPeerManager.h>
-#include <Core/UploadManager/IUploadManager.h>
-#include <Core/DownloadManager/IDownloadManager.h>
 #include <INetworkListener.h>
 
 namespace NL
@@ -50,20 +51,24 @@ namespace NL
       // Usually the size of an UDP datagram is smaller, see 'Protos::CoreSettings::max_udp_datagram_size'.
       static const int BUFFER_SIZE = 65536;
 
-      static const int MAX_NICK_LENGTH = 255; // Datagram UDP are limited in size, this limit avoid to fill the whole datagram with only a nickname.
+      static const int RECEIVE_RING_SIZE = 16; // Number of datagrams read by one system call (Linux only).
 
    public:
       UDPListener(
          QSharedPointer<FM::IFileManager> fileManager,
          QSharedPointer<PM::IPeerManager> peerManager,
-         QSharedPointer<UM::IUploadManager> uploadManager,
-         QSharedPointer<DM::IDownloadManager> downloadManager,
          quint16 unicastPort
       );
 
       INetworkListener::SendStatus send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message, const Common::Hash& peerID);
       INetworkListener::SendStatus send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message = Protos::Common::Null());
 
+      int getMaxDatagramPayloadSize() const;
+
+      INetworkListener::UDPStats getStats() const;
+      void handedOffDatagramHandled(qint64 receivedTime);
+
+   public slots:
       void rebindSockets();
 
    signals:
@@ -71,11 +76,17 @@ namespace NL
         * This signal is emitted when a message is received (unicast or multicast).
         */
       void received(const Common::Message& message);
-      void IMAliveMessageToBeSend(Protos::Core::IMAlive& IMAliveMessage);
       void newFindResultMessage(const Protos::Common::FindResult& findResult);
 
+      /**
+        * These signals are emitted by the UDP thread for the work which must be done by the main thread.
+        * @param receivedTime See 'handedOffDatagramHandled(..)'.
+        */
+      void IMAliveReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, const Protos::Core::IMAlive& IMAlive, qint64 receivedTime);
+      void goodbyeReceived(const Common::Hash& peerID, const QHostAddress& peerAddress, qint64 receivedTime);
+      void chunksOwnedReceived(const Common::Hash& peerID, const Protos::Core::ChunksOwned& chunksOwned, qint64 receivedTime);
+
    private slots:
-      void sendIMAliveMessage();
       void processPendingMulticastDatagrams();
       void processPendingUnicastDatagrams();
 
@@ -83,15 +94,38 @@ namespace NL
       void initUnicastUDPSocket();
 
    private:
-      int writeMessageToBuffer(Common::MessageHeader::MessageType type, const google::protobuf::Message& message);
-      Common::MessageHeader readDatagramToBuffer(QUdpSocket& socket, QHostAddress& peerAddress);
+      typedef void (UDPListener::*DatagramProcessor)(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress, qint64 receivedTime);
+
+      void findDone(const Common::Hash& requesterID, quint64 tag, const QList<Protos::Common::FindResult>& results);
+
+      void readPendingDatagrams(QUdpSocket& socket, DatagramProcessor process, quint32& lastDropCount);
+#ifdef Q_OS_LINUX
+      void readPendingDatagramsByBatch(QUdpSocket& socket, DatagramProcessor process, quint32& lastDropCount);
+#endif
+      void processMulticastDatagram(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress, qint64 receivedTime);
+      void processUnicastDatagram(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress, qint64 receivedTime);
+
+      INetworkListener::SendStatus sendDatagram(const QByteArray& datagram, const QHostAddress& address, quint16 port, bool multicast);
+      void flushPendingDatagrams();
+
+      QByteArray writeMessage(Common::MessageHeader::MessageType type, const google::protobuf::Message& message) const;
+      Common::MessageHeader readHeader(const char* datagram, qint64 datagramSize, const QHostAddress& peerAddress);
 
       Common::Hash getOwnID() const;
 
       const int MAX_UDP_DATAGRAM_PAYLOAD_SIZE;
 
-      char buffer[BUFFER_SIZE]; // Buffer used when sending or receiving datagram.
-      char* const bodyBuffer;
+      QByteArray receiveRing; // 'RECEIVE_RING_SIZE' buffers of 'BUFFER_SIZE' bytes used when receiving datagrams.
+
+      // The unicast datagrams sent while processing the received datagrams are sent together after.
+      struct PendingDatagram
+      {
+         QByteArray data;
+         QHostAddress address;
+         quint16 port;
+      };
+      QList<PendingDatagram> pendingDatagrams;
+      bool deferSending;
 
       const quint16 UNICAST_PORT;
       const quint16 MULTICAST_PORT;
@@ -99,22 +133,22 @@ namespace NL
 
       QSharedPointer<FM::IFileManager> fileManager;
       QSharedPointer<PM::IPeerManager> peerManager;
-      QSharedPointer<UM::IUploadManager> uploadManager;
-      QSharedPointer<DM::IDownloadManager> downloadManager;
 
       QUdpSocket multicastSocket;
       QUdpSocket unicastSocket;
 
-      quint64 currentIMAliveTag;
-      QList<QSharedPointer<DM::IChunkDownloader>> currentChunkDownloaders;
-      enum HashRequestType
-      {
-         FIRST_HASHES,
-         OLDEST_HASHES
-      };
-      HashRequestType nextHashRequestType;
+      quint32 lastMulticastDropCount; // Number of datagrams dropped by the system for each socket, see 'SO_RXQ_OVFL'.
+      quint32 lastUnicastDropCount;
+
+      QAtomicInteger<quint64> nbDatagramsReceived;
+      QAtomicInteger<quint32> nbDatagramsDropped;
+      QAtomicInteger<quint32> nbDatagramsRejected;
+      QAtomicInteger<quint32> nbDatagramsNotSent;
+
+      QElapsedTimer clock; // Gives the time at which each datagram is read.
+      Common::LatencyHistogram handlingLatency;
+      Common::LatencyHistogram handOffLatency;
 
-      QTimer timerIMAlive;
       QSharedPointer<LM::ILogger> loggerIMAlive; // A logger especially for the IMAlive message.
    };
 }
@@ -0,0 +1,37 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#pragma once
+
+#include <QSharedPointer>
+
+#include <Core/FileManager/IChunk.h>
+
+namespace PM
+{
+   /**
+     * A chunk asked by a remote peer with a 'GetChunks' request.
+     * Its data from 'offset' to 'end' must be sent, the chunks of a request are sent back-to-back in the asked order.
+     */
+   struct ChunkToSend
+   {
+      QSharedPointer<FM::IChunk> chunk;
+      int offset;
+      int end; // Exclusive, it's the size announced to the remote peer in 'GetChunksResult.ChunkResult.chunk_size'.
+   };
+}
@@ -20,6 +20,7 @@
 
 #include <QObject>
 #include <QSharedPointer>
+#include <QList>
 #include <QHostAddress>
 
 #include <Protos/common.pb.h>
@@ -30,6 +31,7 @@
 #include <Core/PeerManager/IGetEntriesResult.h>
 #include <Core/PeerManager/IGetHashesResult.h>
 #include <Core/PeerManager/IGetChunksResult.h>
+#include <Core/PeerManager/PeerStats.h>
 
 namespace PM
 {
@@ -82,6 +84,14 @@ namespace PM
         */
       virtual void setSpeed(quint32 newSpeed) = 0;
 
+      /**
+        * The speed we can expect from this peer: 'getSpeed()' reduced by the ratio of failed requests.
+        * Used to choose a peer to download from.
+        */
+      virtual quint32 getExpectedSpeed() = 0;
+
+      virtual PeerStats getStats() const = 0;
+
       /**
         * Block a peer for a given duration [ms].
         * 'isAvailable()' will return false while the duration.
@@ -108,14 +118,15 @@ namespace PM
 
       /**
         * Ask for the hashes of a given file.
+        * The already known hashes of the files in 'nextFiles' are also sent, see 'Protos::Core::HashResult::next_file'.
         * Return a null pointer if the peer is not available.
         */
-      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file) = 0;
+      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles = QList<Protos::Common::Entry>()) = 0;
 
       /**
-        * Ask to download a chunk.
+        * Ask to download one or more chunks, their data are streamed back-to-back on the same socket.
         * Return a null pointer if the peer is not available.
         */
-      virtual QSharedPointer<IGetChunkResult> getChunks(const Protos::Core::GetChunks& chunks) = 0;
+      virtual QSharedPointer<IGetChunksResult> getChunks(const Protos::Core::GetChunks& chunks) = 0;
    };
 }
@@ -25,6 +25,7 @@
 #include <Core/FileManager/IChunk.h>
 
 #include <Core/PeerManager/ISocket.h>
+#include <Core/PeerManager/ChunkToSend.h>
 #include <Common/Hash.h>
 #include <Protos/common.pb.h>
 
@@ -61,6 +62,7 @@ namespace PM
         * May return ourself.
         * May return a peer not alive or not available.
         * Return 'nullptr' if the peer doesn't exist.
+        * Thread-safe.
         */
       virtual IPeer* getPeer(const Common::Hash& ID) = 0;
 
@@ -105,10 +107,10 @@ namespace PM
 
    signals:
       /**
-        * When a remote peer want a chunk, this signal is emitted.
-        * The chunk will be sent using the socket object. Once the data is finished to send the method 'ISocket::finished()' must be called.
+        * When a remote peer want some chunks, this signal is emitted.
+        * The chunks will be sent one after the other using the stream object. Once all the data is written the method 'ISocket::finished()' must be called.
         */
-      void getChunk(const QSharedPointer<FM::IChunk>& chunk, int offset, const QSharedPointer<PM::ISocket>& socket);
+      void getChunks(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ISocket>& socket);
 
       /**
         * Emitted when a peer becomes alive or is not blocked anymore.
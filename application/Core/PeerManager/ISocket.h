@@ -20,6 +20,7 @@
 
 #include <QtGlobal>
 #include <QByteArray>
+#include <QIODevice>
 
 #include <Protos/core_protocol.pb.h>
 
@@ -28,35 +29,41 @@
 
 namespace PM
 {
+   /**
+     * A stream of chunk data to or from a peer, see 'IGetChunksResult::stream(..)'.
+     * It is multiplexed with the other streams and messages on the connection to the peer and has its own flow control:
+     * the data written is buffered until the receiver can take it, see 'bytesToWrite()'.
+     * There is no blocking call, the transfers are driven by the signals of 'getDevice()'.
+     */
    class ISocket
    {
    public:
       virtual ~ISocket() {}
 
-      virtual void setReadBufferSize(qint64 size) = 0;
-
       virtual qint64 bytesAvailable() const = 0;
       virtual qint64 read(char* data, qint64 maxSize) = 0;
       virtual QByteArray readAll() = 0;
-      virtual bool waitForReadyRead(int msecs) = 0;
 
       virtual qint64 bytesToWrite() const = 0;
       virtual qint64 write(const char* data, qint64 maxSize) = 0;
       virtual qint64 write(const QByteArray& byteArray) = 0;
-      virtual bool waitForBytesWritten(int msecs) = 0;
 
-      virtual void moveToThread(QThread* targetThread) = 0;
       virtual QString errorString() const = 0;
 
       /**
-        * Returns the ID of the remote peer on which the socket is connected.
+        * The underlying device, its signals ('readyRead()', 'bytesWritten(qint64)') drive the transfers from the event loop.
+        */
+      virtual QIODevice* getDevice() = 0;
+
+      /**
+        * Returns the ID of the remote peer on which the stream is open.
         */
       virtual Common::Hash getRemotePeerID() const = 0;
 
       /**
-        * Used by uploader to tell when an upload is finished.
-        * @param closeTheSocket If true force the socket to be closed.
+        * Used by uploader to tell when an upload is finished, the data already written is still sent.
+        * @param abort If true the stream is reset, the connection and its other streams aren't affected.
         */
-      virtual void finished(bool closeTheSocket = false) = 0;
+      virtual void finished(bool abort = false) = 0;
    };
 }
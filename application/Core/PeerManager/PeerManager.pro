@@ -22,7 +22,8 @@ SOURCES += priv/PeerManager.cpp \
     priv/GetHashesResult.cpp \
     priv/Log.cpp \
     priv/PeerSelf.cpp \
-    priv/PeerMessageSocket.cpp
+    priv/PeerMessageSocket.cpp \
+    priv/ChunkStream.cpp
 HEADERS += IPeerManager.h \
     IGetChunksResult.h \
     IPeer.h \
@@ -34,9 +35,12 @@ HEADERS += IPeerManager.h \
     priv/Constants.h \
     priv/ConnectionPool.h \
     priv/PeerMessageSocket.h \
+    priv/ChunkStream.h \
     IGetEntriesResult.h \
     IGetHashesResult.h \
     ISocket.h \
+    ChunkToSend.h \
+    PeerStats.h \
     priv/GetEntriesResult.h \
     priv/GetHashesResult.h \
     priv/PeerSelf.h
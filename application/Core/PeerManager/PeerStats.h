@@ -0,0 +1,39 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+  
+#pragma once
+
+#include <QList>
+
+namespace PM
+{
+   /**
+     * Statistics measured on the exchanges with a remote peer, see 'IPeer::getStats()'.
+     * The speed and the RTT are smoothed with an exponentially weighted moving average.
+     */
+   struct PeerStats
+   {
+      quint32 speed; // [bytes/s]. 0 if unknown.
+      quint32 rtt; // [ms]. Delay between a request and its response, 0 if unknown.
+      quint32 nbRequests; // Number of 'GetEntries', 'GetHashes' and 'GetChunks' requests ended, answered or not.
+      quint32 nbErrors; // Requests answered with an error status.
+      quint32 nbTimeouts; // Requests not answered in time.
+      double failureRate; // Smoothed ratio of failed requests, between 0 and 1.
+      QList<quint32> lastSpeeds; // [bytes/s]. The speeds of the last transferred blocks, the most recent at the end.
+   };
+}
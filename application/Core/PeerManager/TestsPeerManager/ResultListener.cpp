@@ -24,6 +24,7 @@ using namespace PM;
 #include <QString>
 
 #include <Common/ProtoHelper.h>
+#include <Core/FileManager/IDataReader.h>
 
 #include <ISocket.h>
 
@@ -64,11 +65,31 @@ quint32 ResultListener::getNbHashReceivedFromLastGetHashes()
    return this->currentHash;
 }
 
+/**
+  * Must be called before sending a 'GetChunks' request, the data of each chunk is then read by 'stream(..)'.
+  */
+void ResultListener::setAskedChunks(const Protos::Core::GetChunks& chunks)
+{
+   this->chunkOffsets.clear();
+   for (int i = 0; i < chunks.chunks_size(); i++)
+      this->chunkOffsets << chunks.chunks(i).offset();
+
+   this->chunkSizes.clear();
+   this->receivedChunks.clear();
+   this->currentChunk.clear();
+   this->streamReceived = false;
+}
+
 bool ResultListener::isStreamReceived()
 {
    return this->streamReceived;
 }
 
+QList<QByteArray> ResultListener::getReceivedChunks() const
+{
+   return this->receivedChunks;
+}
+
 void ResultListener::entriesResult(const Protos::Core::GetEntriesResult& result)
 {
    this->entriesResultList << result;
@@ -89,24 +110,82 @@ void ResultListener::nextHashResult(const Protos::Core::HashResult& hashResult)
    this->currentHash++;
 }
 
-void ResultListener::chunkResult(const Protos::Core::GetChunkResult& result)
+void ResultListener::chunksResult(const Protos::Core::GetChunksResult& result)
 {
-   qDebug() << "ResultListener::chunkResult : " << Common::ProtoHelper::getDebugStr(result);
-}
+   if (result.results_size() <= 1)
+      qDebug() << "ResultListener::chunksResult : " << Common::ProtoHelper::getDebugStr(result);
 
-static const QByteArray CHUNK_DATA("ALL YOUR BYTE ARE BELONG TO US");
+   this->chunkSizes.clear();
+   for (int i = 0; i < result.results_size(); i++)
+      this->chunkSizes << (result.results(i).status() == Protos::Core::GetChunksResult::ChunkResult::OK ? static_cast<int>(result.results(i).chunk_size()) : 0);
+}
 
+/**
+  * Read the chunks sent back-to-back as the data arrives, the stream is finished when the 'IGetChunksResult' is deleted.
+  */
 void ResultListener::stream(QSharedPointer<PM::ISocket> socket)
 {
-   QByteArray data = socket->readAll();
-   qDebug() << "ResultListener::stream : " << data;
-   QCOMPARE(data, CHUNK_DATA);
-   socket->finished();
-   this->streamReceived = true;
+   this->chunkStream = socket;
+   connect(this->chunkStream->getDevice(), &QIODevice::readyRead, this, &ResultListener::readStream);
+   this->readStream();
 }
 
-void ResultListener::getChunk(QSharedPointer<FM::IChunk> chunk, int offset, QSharedPointer<ISocket> socket)
+/**
+  * Act as the upload manager: send the data of each chunk, up to the size announced in the 'GetChunksResult'.
+  */
+void ResultListener::getChunks(const QList<PM::ChunkToSend>& chunks, QSharedPointer<ISocket> socket)
 {
-   socket->write(CHUNK_DATA);
+   char buffer[65536];
+
+   for (QListIterator<PM::ChunkToSend> i(chunks); i.hasNext();)
+   {
+      const PM::ChunkToSend& chunkToSend = i.next();
+      QSharedPointer<FM::IDataReader> reader = chunkToSend.chunk->getDataReader();
+
+      for (int offset = chunkToSend.offset; offset < chunkToSend.end;)
+      {
+         const int bytesRead = qMin(reader->read(buffer, offset), chunkToSend.end - offset);
+         if (bytesRead <= 0)
+         {
+            socket->finished(true);
+            return;
+         }
+         socket->write(buffer, bytesRead);
+         offset += bytesRead;
+      }
+   }
+
+   // The stream sends the buffered data as the receiver reads it.
    socket->finished();
 }
+
+void ResultListener::readStream()
+{
+   char buffer[65536];
+
+   for (int i = this->receivedChunks.size(); i < this->chunkSizes.size() && i < this->chunkOffsets.size(); i = this->receivedChunks.size())
+   {
+      const int size = this->chunkSizes[i] == 0 ? 0 : this->chunkSizes[i] - this->chunkOffsets[i];
+      while (this->currentChunk.size() < size)
+      {
+         const qint64 bytesRead = this->chunkStream->read(buffer, qMin(static_cast<int>(sizeof(buffer)), size - this->currentChunk.size()));
+         if (bytesRead == 0)
+            return; // Wait for the next 'readyRead()'.
+
+         if (bytesRead == -1)
+         {
+            qDebug() << "ResultListener::readStream : unable to read the chunk" << i << ":" << this->chunkStream->errorString();
+            break;
+         }
+
+         this->currentChunk.append(buffer, bytesRead);
+      }
+
+      this->receivedChunks << this->currentChunk;
+      this->currentChunk.clear();
+   }
+
+   disconnect(this->chunkStream->getDevice(), &QIODevice::readyRead, this, &ResultListener::readStream);
+   this->chunkStream.clear();
+   this->streamReceived = true;
+}
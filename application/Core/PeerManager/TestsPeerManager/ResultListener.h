@@ -29,6 +29,7 @@
 #include <Core/FileManager/IChunk.h>
 
 #include <ISocket.h>
+#include <ChunkToSend.h>
 using namespace PM;
 
 class ResultListener : public QObject
@@ -44,7 +45,9 @@ public:
    const Common::Hash& getLastReceivedHash();
    quint32 getNbHashReceivedFromLastGetHashes();
 
+   void setAskedChunks(const Protos::Core::GetChunks& chunks);
    bool isStreamReceived();
+   QList<QByteArray> getReceivedChunks() const;
 
 public slots:
    void entriesResult(const Protos::Core::GetEntriesResult& result);
@@ -52,9 +55,12 @@ public slots:
    void hashesResult(const Protos::Core::GetHashesResult& result);
    void nextHashResult(const Protos::Core::HashResult& hashResult);
 
-   void chunkResult(const Protos::Core::GetChunkResult& result);
+   void chunksResult(const Protos::Core::GetChunksResult& result);
    void stream(QSharedPointer<PM::ISocket> socket);
-   void getChunk(QSharedPointer<FM::IChunk> chunk, int offset, QSharedPointer<PM::ISocket> socket);
+   void getChunks(const QList<PM::ChunkToSend>& chunks, QSharedPointer<PM::ISocket> socket);
+
+private slots:
+   void readStream();
 
 private:
    QList<Protos::Core::GetEntriesResult> entriesResultList;
@@ -65,6 +71,11 @@ private:
    quint32 currentHash;
    Common::Hash lastHashReceived;
 
+   QList<int> chunkOffsets; // Of the asked chunks.
+   QList<int> chunkSizes; // Announced in the last 'GetChunksResult', 0 if a chunk isn't sent.
+   QList<QByteArray> receivedChunks;
+   QByteArray currentChunk; // The data received of the chunk following 'receivedChunks'.
+   QSharedPointer<PM::ISocket> chunkStream;
    bool streamReceived;
 };
 
@@ -31,10 +31,12 @@ using namespace PM;
 #include <Common/Constants.h>
 #include <Common/Global.h>
 #include <Common/Settings.h>
+#include <Common/ProtoHelper.h>
 
 #include <ResultListener.h>
 #include <IGetEntriesResult.h>
 #include <IGetHashesResult.h>
+#include <IGetChunksResult.h>
 
 const int Tests::PORT = 59487;
 
@@ -67,6 +69,8 @@ void Tests::initTestCase()
 
    SETTINGS.setFilename("core_settings_peer_manager_tests.txt");
    SETTINGS.setSettingsMessage(new Protos::Core::Settings());
+   SETTINGS.set("buffer_size_reading", 65536u); // Used by 'FM::IDataReader' to read the chunks.
+   SETTINGS.set("socket_buffer_size", 131072u); // The window of the chunk streams.
 
    QVERIFY(this->createInitialFiles());
 
@@ -173,6 +177,33 @@ void Tests::getPeerFromID()
    }
 }
 
+/**
+  * The alive peers must be kept up to date when a peer appears and leaves.
+  */
+void Tests::updateAndRemovePeer()
+{
+   qDebug() << "===== updateAndRemovePeer() =====";
+
+   QSharedPointer<IPeerManager> peerManager = this->peerManagers[0];
+   const int nbPeers = peerManager->getNbOfPeers();
+   QCOMPARE(nbPeers, peerManager->getPeers().size());
+
+   const Common::Hash ID = Common::Hash::rand();
+   peerManager->updatePeer(ID, QHostAddress::LocalHost, PORT + 10, "Orphan", 0, QString(), 0, 0, Common::Constants::PROTOCOL_VERSION);
+   QCOMPARE(peerManager->getNbOfPeers(), nbPeers + 1);
+   QVERIFY(peerManager->getPeers().contains(peerManager->getPeer(ID)));
+
+   peerManager->removePeer(ID, QHostAddress::LocalHost);
+   QCOMPARE(peerManager->getNbOfPeers(), nbPeers);
+   QVERIFY(!peerManager->getPeers().contains(peerManager->getPeer(ID)));
+   QVERIFY(peerManager->getPeer(ID) != nullptr); // A peer is never deleted.
+
+   // Each remaining peer is still listed once.
+   const QList<IPeer*> peers = peerManager->getPeers();
+   for (QListIterator<IPeer*> i(peers); i.hasNext();)
+      QCOMPARE(peers.count(i.next()), 1);
+}
+
 /**
   * Peer#1 asking for the root entries of peer#2.
   */
@@ -245,6 +276,61 @@ void Tests::askForSomeEntries()
    }
 }
 
+/**
+  * Peer#1 asks a page of the first shared directory of peer#2 then asks it again with the known version.
+  */
+void Tests::askForSomeEntriesByPageAndVersion()
+{
+   qDebug() << "===== askForSomeEntriesByPageAndVersion() =====";
+
+   QElapsedTimer timer;
+
+   const Protos::Common::Entry dir = this->resultListener.getEntriesResultList().first().result(0).entries().entry(0);
+   const int nbResultsBefore = this->resultListener.getEntriesResultList().size();
+
+   Protos::Core::GetEntries getEntriesMessage1;
+   getEntriesMessage1.mutable_dirs()->add_entry()->CopyFrom(dir);
+   getEntriesMessage1.set_entries_offset(1);
+   getEntriesMessage1.set_nb_max_entries(2);
+   QSharedPointer<IGetEntriesResult> result1 = this->peerManagers[0]->getPeers()[0]->getEntries(getEntriesMessage1);
+   QVERIFY(!result1.isNull());
+   connect(result1.data(), &IGetEntriesResult::result, &this->resultListener, &ResultListener::entriesResult);
+   result1->start();
+
+   timer.start();
+   while (this->resultListener.getEntriesResultList().size() != nbResultsBefore + 1)
+   {
+      QTest::qWait(100);
+      if (timer.elapsed() > 3000)
+         QFAIL("We don't receive the result after sending 'getEntriesMessage1'.");
+   }
+
+   const Protos::Core::GetEntriesResult::EntryResult page = this->resultListener.getEntriesResultList().last().result(0);
+   QCOMPARE(page.status(), Protos::Core::GetEntriesResult::EntryResult::OK);
+   QCOMPARE(page.nb_total_entries(), 4u);
+   QCOMPARE(page.entries().entry_size(), 2);
+   QVERIFY(page.version() != 0);
+
+   Protos::Core::GetEntries getEntriesMessage2;
+   getEntriesMessage2.mutable_dirs()->add_entry()->CopyFrom(dir);
+   getEntriesMessage2.add_known_versions(page.version());
+   QSharedPointer<IGetEntriesResult> result2 = this->peerManagers[0]->getPeers()[0]->getEntries(getEntriesMessage2);
+   QVERIFY(!result2.isNull());
+   connect(result2.data(), &IGetEntriesResult::result, &this->resultListener, &ResultListener::entriesResult);
+   result2->start();
+
+   timer.start();
+   while (this->resultListener.getEntriesResultList().size() != nbResultsBefore + 2)
+   {
+      QTest::qWait(100);
+      if (timer.elapsed() > 3000)
+         QFAIL("We don't receive the result after sending 'getEntriesMessage2'.");
+   }
+
+   QCOMPARE(this->resultListener.getEntriesResultList().last().result(0).status(), Protos::Core::GetEntriesResult::EntryResult::NOT_MODIFIED);
+   QCOMPARE(this->resultListener.getEntriesResultList().last().result(0).entries().entry_size(), 0);
+}
+
 void Tests::askForHashes()
 {
    qDebug() << "===== askForHashes() =====";
@@ -311,29 +397,71 @@ void Tests::askForHashes()
    }
 }
 
+/**
+  * Ask the end of the last chunk of 'big.bin', see 'askForHashes()'.
+  */
 void Tests::askForAChunk()
 {
    qDebug() << "===== askForAChunk() =====";
 
-   connect(this->peerManagers[1].data(), &IPeerManager::getChunk, &this->resultListener, &ResultListener::getChunk);
+   const int NB_BYTES = 1024;
 
-   Protos::Core::GetChunk getChunkMessage;
-   getChunkMessage.mutable_chunk()->set_hash(this->resultListener.getLastReceivedHash().getData(), Common::Hash::HASH_SIZE);
-   getChunkMessage.set_offset(0);
-   QSharedPointer<IGetChunkResult> result = this->peerManagers[0]->getPeers()[0]->getChunk(getChunkMessage);
-   QVERIFY(!result.isNull());
-   connect(result.data(), &IGetChunkResult::result, &this->resultListener, &ResultListener::chunkResult);
-   connect(result.data(), &IGetChunkResult::stream, &this->resultListener, &ResultListener::stream);
-   result->start();
+   connect(this->peerManagers[1].data(), &IPeerManager::getChunks, &this->resultListener, &ResultListener::getChunks);
+
+   QVERIFY(this->askForChunks(QList<Common::Hash> { this->resultListener.getLastReceivedHash() }, Common::Constants::CHUNK_SIZE - NB_BYTES));
+   QCOMPARE(this->resultListener.getReceivedChunks().size(), 1);
+   QCOMPARE(this->resultListener.getReceivedChunks().first(), QByteArray(NB_BYTES, 3));
+}
+
+/**
+  * Compare the time to get many small files one by one and in one 'GetChunks' request.
+  * The data is sent by 'ResultListener::getChunks(..)', which acts as the upload manager.
+  */
+void Tests::askForSmallFilesInBatch()
+{
+   qDebug() << "===== askForSmallFilesInBatch() =====";
+
+   const int NUMBER_OF_FILES = 500;
+   const int FILE_SIZE = 1024;
+
+   QVERIFY(QDir().mkpath("sharedDirs/peer2/small"));
+   for (int i = 0; i < NUMBER_OF_FILES; i++)
+   {
+      QFile file(QString("sharedDirs/peer2/small/%1.bin").arg(i));
+      QVERIFY(file.open(QIODevice::WriteOnly));
+      file.write(QByteArray(FILE_SIZE, static_cast<char>(i)));
+   }
 
+   // Wait until the peer#2 has hashed all the files.
    QElapsedTimer timer;
    timer.start();
-   while (!this->resultListener.isStreamReceived())
+   QList<Common::Hash> hashes;
+   while ((hashes = this->getHashesOfSmallFiles()).size() != NUMBER_OF_FILES)
    {
       QTest::qWait(100);
-      if (timer.elapsed() > 10000)
-         QFAIL("We don't receive the stream");
+      if (timer.elapsed() > 30000)
+         QFAIL(QString("The small files aren't hashed. Number of hashes: %1").arg(hashes.size()).toLatin1());
+   }
+
+   // 1) One request per file.
+   timer.start();
+   for (QListIterator<Common::Hash> i(hashes); i.hasNext();)
+   {
+      QVERIFY(this->askForChunks(QList<Common::Hash> { i.next() }));
+      QCOMPARE(this->resultListener.getReceivedChunks().first().size(), FILE_SIZE);
    }
+   const qint64 timeOneByOne = timer.elapsed();
+
+   // 2) One request for all the files.
+   timer.start();
+   QVERIFY(this->askForChunks(hashes));
+   const qint64 timeBatch = timer.elapsed();
+
+   QCOMPARE(this->resultListener.getReceivedChunks().size(), NUMBER_OF_FILES);
+   for (int i = 0; i < NUMBER_OF_FILES; i++)
+      QCOMPARE(this->resultListener.getReceivedChunks()[i].size(), FILE_SIZE);
+
+   qDebug() << NUMBER_OF_FILES << "files of" << FILE_SIZE << "bytes. One request per file:" << timeOneByOne << "ms, one request for all the files:" << timeBatch << "ms";
 }
 
 void Tests::cleanupTestCase()
@@ -346,6 +474,69 @@ void Tests::cleanupTestCase()
    delete this->peerUpdater;
 }
 
+/**
+  * Send a 'GetChunks' request from peer#1 to peer#2 and wait for the data of the chunks, see 'ResultListener::getReceivedChunks()'.
+  */
+bool Tests::askForChunks(const QList<Common::Hash>& hashes, int offset)
+{
+   Protos::Core::GetChunks getChunksMessage;
+   for (QListIterator<Common::Hash> i(hashes); i.hasNext();)
+   {
+      Protos::Core::GetChunks::Chunk* chunk = getChunksMessage.add_chunks();
+      chunk->mutable_hash()->set_hash(i.next().getData(), Common::Hash::HASH_SIZE);
+      chunk->set_offset(offset);
+   }
+
+   this->resultListener.setAskedChunks(getChunksMessage);
+
+   QSharedPointer<IGetChunksResult> result = this->peerManagers[0]->getPeers()[0]->getChunks(getChunksMessage);
+   if (result.isNull())
+      return false;
+   connect(result.data(), &IGetChunksResult::result, &this->resultListener, &ResultListener::chunksResult);
+   connect(result.data(), &IGetChunksResult::stream, &this->resultListener, &ResultListener::stream);
+   result->start();
+
+   QElapsedTimer timer;
+   timer.start();
+   while (!this->resultListener.isStreamReceived())
+   {
+      QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+      if (timer.elapsed() > 10000)
+         return false;
+   }
+
+   return true;
+}
+
+/**
+  * Return the hashes of the files in '/small' known by the peer#2.
+  */
+QList<Common::Hash> Tests::getHashesOfSmallFiles()
+{
+   QList<Common::Hash> hashes;
+
+   const Protos::Common::Entries roots = this->fileManagers[1]->getEntries();
+   if (roots.entry_size() == 0)
+      return hashes;
+
+   const Protos::Common::Entries rootEntries = this->fileManagers[1]->getEntries(roots.entry(0));
+   for (int i = 0; i < rootEntries.entry_size(); i++)
+   {
+      if (rootEntries.entry(i).type() != Protos::Common::Entry_Type_DIR || Common::ProtoHelper::getStr(rootEntries.entry(i), &Protos::Common::Entry::name) != "small")
+         continue;
+
+      Protos::Common::Entry smallDir(rootEntries.entry(i));
+      smallDir.mutable_shared_entry()->CopyFrom(roots.entry(0).shared_entry());
+
+      const Protos::Common::Entries files = this->fileManagers[1]->getEntries(smallDir);
+      for (int j = 0; j < files.entry_size(); j++)
+         if (files.entry(j).chunk_size() == 1 && files.entry(j).chunk(0).hash().size() == Common::Hash::HASH_SIZE)
+            hashes << Common::Hash(files.entry(j).chunk(0).hash());
+   }
+
+   return hashes;
+}
+
 bool Tests::createInitialFiles()
 {
    qDebug() << "Create the directories structure in" << QDir::currentPath();
@@ -51,13 +51,18 @@ private slots:
    void initTestCase();
    void updatePeers();
    void getPeerFromID();
+   void updateAndRemovePeer();
    void askForRootEntries();
    void askForSomeEntries();
+   void askForSomeEntriesByPageAndVersion();
    void askForHashes();
    void askForAChunk();
+   void askForSmallFilesInBatch();
    void cleanupTestCase();
 
 private:
+   bool askForChunks(const QList<Common::Hash>& hashes, int offset = 0);
+   QList<Common::Hash> getHashesOfSmallFiles();
    bool createInitialFiles();
    bool deleteAllFiles();
 
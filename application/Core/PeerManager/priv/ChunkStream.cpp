@@ -0,0 +1,305 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <priv/ChunkStream.h>
+using namespace PM;
+
+#include <cstring>
+
+#include <priv/Log.h>
+#include <priv/PeerMessageSocket.h>
+
+/**
+  * @class PM::ChunkStream
+  *
+  * The data of a 'GetChunks' request, multiplexed with the other streams and messages on a 'PeerMessageSocket'.
+  * The data is sent in 'ChunkData' frames by the socket, the sender can't have more than the window of the
+  * receiver in flight: the receiver gives back the window with a 'ChunkWindow' message as the data is read.
+  * A stream can be aborted with a 'ChunkStreamReset' message without closing the connection.
+  *
+  * The requester only reads from its stream and the uploader only writes to its one.
+  */
+
+ChunkStream::ChunkStream(PeerMessageSocket* socket, quint32 ID, quint32 sendWindow, quint32 receiveWindow) :
+   socket(socket),
+   ID(ID),
+   remotePeerID(socket->getRemoteID()),
+   receivedOffset(0),
+   bytesBuffered(0),
+   receiveWindow(receiveWindow),
+   bytesConsumed(0),
+   toSendOffset(0),
+   sendWindow(sendWindow),
+   finishing(false),
+   ended(false),
+   aborted(false)
+{
+   this->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+ChunkStream::~ChunkStream()
+{
+   L_DEBU(QString("ChunkStream[%1] deleted").arg(this->ID));
+}
+
+quint32 ChunkStream::getID() const
+{
+   return this->ID;
+}
+
+qint64 ChunkStream::bytesAvailable() const
+{
+   return this->bytesBuffered + QIODevice::bytesAvailable();
+}
+
+qint64 ChunkStream::read(char* data, qint64 maxSize)
+{
+   return QIODevice::read(data, maxSize);
+}
+
+QByteArray ChunkStream::readAll()
+{
+   return QIODevice::readAll();
+}
+
+qint64 ChunkStream::bytesToWrite() const
+{
+   return this->toSend.size() - this->toSendOffset;
+}
+
+qint64 ChunkStream::write(const char* data, qint64 maxSize)
+{
+   return QIODevice::write(data, maxSize);
+}
+
+qint64 ChunkStream::write(const QByteArray& byteArray)
+{
+   return QIODevice::write(byteArray);
+}
+
+QString ChunkStream::errorString() const
+{
+   return QIODevice::errorString();
+}
+
+QIODevice* ChunkStream::getDevice()
+{
+   return this;
+}
+
+Common::Hash ChunkStream::getRemotePeerID() const
+{
+   return this->remotePeerID;
+}
+
+/**
+  * The uploader side stream is removed from the socket once its remaining data is sent.
+  * @param abort The remaining data is dropped and the peer is asked to reset its side of the stream.
+  */
+void ChunkStream::finished(bool abort)
+{
+   if (this->ended)
+      return;
+
+   if (abort)
+   {
+      this->discardData();
+      this->aborted = true;
+      this->setErrorString("Stream aborted");
+      this->end(true);
+      return;
+   }
+
+   this->finishing = true;
+   if (this->bytesToWrite() == 0)
+      this->end(false);
+}
+
+bool ChunkStream::isSequential() const
+{
+   return true;
+}
+
+bool ChunkStream::hasDataToSend() const
+{
+   return !this->ended && this->sendWindow > 0 && this->bytesToWrite() > 0;
+}
+
+/**
+  * Move the next data allowed by the window to the given frame.
+  * @return The size of the frame.
+  */
+int ChunkStream::takeFrame(std::string& frame, int maxSize)
+{
+   const int size = static_cast<int>(qMin(qMin(this->bytesToWrite(), this->sendWindow), static_cast<qint64>(maxSize)));
+
+   frame.assign(this->toSend.constData() + this->toSendOffset, size);
+   this->toSendOffset += size;
+   this->sendWindow -= size;
+
+   if (this->toSendOffset == this->toSend.size())
+   {
+      this->toSend.clear();
+      this->toSendOffset = 0;
+   }
+
+   return size;
+}
+
+/**
+  * Called once a frame taken with 'takeFrame(..)' has been given to the socket.
+  */
+void ChunkStream::frameSent(int size)
+{
+   emit bytesWritten(size);
+
+   if (this->finishing && this->bytesToWrite() == 0)
+      this->end(false);
+}
+
+void ChunkStream::windowIncreased(quint32 increment)
+{
+   if (this->ended)
+      return;
+
+   this->sendWindow += increment;
+
+   if (this->bytesToWrite() > 0)
+      this->socket->chunkDataToSend(this->ID);
+}
+
+void ChunkStream::dataReceived(const std::string& data)
+{
+   if (this->ended || data.empty())
+      return;
+
+   // The data given back to the sender but not yet read and the data read but not yet given back are both in flight.
+   if (this->bytesBuffered + this->bytesConsumed + static_cast<qint64>(data.size()) > this->receiveWindow)
+   {
+      L_WARN(QString("ChunkStream[%1]: The peer has sent more data than the window allows, the stream is reset").arg(this->ID));
+      this->discardData();
+      this->aborted = true;
+      this->setErrorString("Flow control violated by the peer");
+      this->end(true);
+      emit readyRead();
+      return;
+   }
+
+   this->received.enqueue(QByteArray(data.data(), static_cast<int>(data.size())));
+   this->bytesBuffered += data.size();
+   emit readyRead();
+}
+
+/**
+  * Called by the socket when the peer resets the stream or when the connection is closed.
+  * The stream is already removed from the socket.
+  */
+void ChunkStream::abort(const QString& error)
+{
+   if (this->ended)
+      return;
+
+   L_DEBU(QString("ChunkStream[%1] aborted: %2").arg(this->ID).arg(error));
+
+   this->ended = true;
+   this->aborted = true;
+   this->socket = nullptr;
+   this->discardData();
+   this->setErrorString(error);
+
+   // Wakes up the reader and the writer, they will get an error.
+   emit readyRead();
+   emit bytesWritten(0);
+}
+
+qint64 ChunkStream::readData(char* data, qint64 maxSize)
+{
+   if (this->aborted)
+      return -1;
+
+   qint64 bytesRead = 0;
+   while (bytesRead < maxSize && !this->received.isEmpty())
+   {
+      const QByteArray& block = this->received.head();
+      const int size = static_cast<int>(qMin(static_cast<qint64>(block.size() - this->receivedOffset), maxSize - bytesRead));
+      memcpy(data + bytesRead, block.constData() + this->receivedOffset, size);
+      bytesRead += size;
+      this->receivedOffset += size;
+
+      if (this->receivedOffset == block.size())
+      {
+         this->received.dequeue();
+         this->receivedOffset = 0;
+      }
+   }
+
+   this->bytesBuffered -= bytesRead;
+   this->bytesConsumed += bytesRead;
+
+   // The window is given back by quarter to limit the number of messages.
+   if (!this->ended && this->bytesConsumed >= this->receiveWindow / 4 && this->bytesConsumed > 0)
+   {
+      this->socket->sendChunkWindow(this->ID, this->bytesConsumed);
+      this->bytesConsumed = 0;
+   }
+
+   return bytesRead;
+}
+
+/**
+  * The data is buffered and sent by the socket as the window of the receiver permits, see 'bytesToWrite()'.
+  */
+qint64 ChunkStream::writeData(const char* data, qint64 maxSize)
+{
+   if (this->ended || this->finishing)
+      return -1;
+
+   if (this->toSendOffset > 0)
+   {
+      this->toSend.remove(0, this->toSendOffset);
+      this->toSendOffset = 0;
+   }
+   this->toSend.append(data, static_cast<int>(maxSize));
+
+   this->socket->chunkDataToSend(this->ID);
+   return maxSize;
+}
+
+void ChunkStream::discardData()
+{
+   this->received.clear();
+   this->receivedOffset = 0;
+   this->bytesBuffered = 0;
+   this->toSend.clear();
+   this->toSendOffset = 0;
+}
+
+/**
+  * Remove the stream from its socket.
+  */
+void ChunkStream::end(bool reset)
+{
+   this->ended = true;
+
+   if (this->socket)
+   {
+      PeerMessageSocket* socket = this->socket;
+      this->socket = nullptr;
+      socket->removeChunkStream(this->ID, reset);
+   }
+}
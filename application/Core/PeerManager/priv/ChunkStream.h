@@ -0,0 +1,97 @@
+/**
+  * D-LAN - A decentralized LAN file sharing software.
+  * Copyright (C) 2010-2012 Greg Burri <greg.burri@gmail.com>
+  *
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#pragma once
+
+#include <string>
+
+#include <QIODevice>
+#include <QQueue>
+#include <QByteArray>
+#include <QSharedPointer>
+
+#include <Common/Hash.h>
+#include <Common/Uncopyable.h>
+
+#include <ISocket.h>
+
+namespace PM
+{
+   class PeerMessageSocket;
+
+   class ChunkStream : public QIODevice, public ISocket, Common::Uncopyable
+   {
+      Q_OBJECT
+   public:
+      ChunkStream(PeerMessageSocket* socket, quint32 ID, quint32 sendWindow, quint32 receiveWindow);
+      ~ChunkStream();
+
+      quint32 getID() const;
+
+      qint64 bytesAvailable() const;
+      qint64 read(char* data, qint64 maxSize);
+      QByteArray readAll();
+
+      qint64 bytesToWrite() const;
+      qint64 write(const char* data, qint64 maxSize);
+      qint64 write(const QByteArray& byteArray);
+
+      QString errorString() const;
+      QIODevice* getDevice();
+
+      Common::Hash getRemotePeerID() const;
+
+      void finished(bool abort = false);
+
+      bool isSequential() const;
+
+      // Called by the socket.
+      bool hasDataToSend() const;
+      int takeFrame(std::string& frame, int maxSize);
+      void frameSent(int size);
+      void windowIncreased(quint32 increment);
+      void dataReceived(const std::string& data);
+      void abort(const QString& error);
+
+   protected:
+      qint64 readData(char* data, qint64 maxSize);
+      qint64 writeData(const char* data, qint64 maxSize);
+
+   private:
+      void discardData();
+      void end(bool reset);
+
+      PeerMessageSocket* socket; // Null once the stream is ended.
+      const quint32 ID;
+      const Common::Hash remotePeerID;
+
+      QQueue<QByteArray> received;
+      int receivedOffset; // In the first block of 'received'.
+      qint64 bytesBuffered;
+      const quint32 receiveWindow;
+      quint32 bytesConsumed; // Not yet given back to the sender with a 'ChunkWindow' message.
+
+      QByteArray toSend;
+      int toSendOffset;
+      qint64 sendWindow;
+
+      bool finishing; // 'finished()' has been called but some data remain to be sent.
+      bool ended;
+      bool aborted;
+   };
+}
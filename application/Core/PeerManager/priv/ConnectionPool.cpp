@@ -35,11 +35,14 @@ using namespace PM;
   * There is two kind of socket.
   * 1) Socket opened by another peer.
   * 2) Socket opened by yourself.
-  * When we want to send a message (for example 'GetHashes' to ask for some hashes) we must use the second kind.
-  * This constraint exists to avoid sending two messages simultaneously, when one of the message (or both) is a 'GetChunk'.
-  * The socket will be occupied for a moment to receive or send the stream of data and cannot handle others messages.
+  * When we want to send a request (for example 'GetHashes' to ask for some hashes) we must use the second kind.
   *
-  * The method 'getASocket()' may reuse a existing socket or create a new connection to the peer.
+  * All the exchanges with a peer are multiplexed on one main socket opened by us, thus there is at most one connection
+  * in each direction between two peers. The chunk transfers are framed streams with their own flow control, see 'ChunkStream',
+  * and the 'GetEntries' and 'GetHashes' messages never wait behind more than a few frames of chunk data.
+  *
+  * A 'GetEntries' or 'GetHashes' exchange can't be multiplexed with another one of the same kind because their results
+  * aren't identified, an additional socket is then used by 'getASocket(..)'. These sockets are reused and bounded by 'max_number_idle_socket'.
   */
 
 ConnectionPool::ConnectionPool(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, const Common::Hash& peerID) :
@@ -70,26 +73,54 @@ void ConnectionPool::newConnexion(QTcpSocket* tcpSocket)
 }
 
 /**
-  * Return an idle socket to the peer.
-  * A new connection is made if there is no idle socket.
+  * Return a socket to the peer with the given stream opened.
+  * The main socket is used first, otherwise an idle socket is reused.
+  * A new connection is made if there is no available socket.
   */
-QSharedPointer<PeerMessageSocket> ConnectionPool::getASocket()
+QSharedPointer<PeerMessageSocket> ConnectionPool::getASocket(PeerMessageSocket::Stream stream)
 {
+   QSharedPointer<PeerMessageSocket> mainSocket = this->getMainSocket();
+   if (mainSocket.isNull())
+      return mainSocket;
+
+   if (mainSocket->canOpenStream(stream))
+   {
+      mainSocket->openStream(stream);
+      return mainSocket;
+   }
+
    for (QListIterator<QSharedPointer<PeerMessageSocket>> i(this->socketsToPeer); i.hasNext();)
    {
       QSharedPointer<PeerMessageSocket> socket = i.next();
-      if (!socket->isActive())
+      if (socket != mainSocket && !socket->isActive() && socket->canOpenStream(stream))
       {
-         socket->setActive();
+         socket->openStream(stream);
          return socket;
       }
    }
 
-   if (!this->peerIP.isNull())
-      return this->addNewSocket(QSharedPointer<PeerMessageSocket>(new PeerMessageSocket(this->peerManager, this->fileManager, this->peerID, this->peerIP, this->port)), TO_PEER);
+   QSharedPointer<PeerMessageSocket> socket = this->addNewSocket(QSharedPointer<PeerMessageSocket>(new PeerMessageSocket(this->peerManager, this->fileManager, this->peerID, this->peerIP, this->port)), TO_PEER);
+   socket->openStream(stream);
+   return socket;
+}
+
+/**
+  * Return the socket to the peer carrying the chunk streams, a new connection is made if there is none
+  * or if the current one is being closed.
+  */
+QSharedPointer<PeerMessageSocket> ConnectionPool::getMainSocket()
+{
+   if (!this->mainSocket.isNull() && this->mainSocket->canOpenChunkStream())
+      return this->mainSocket;
+
+   if (this->peerIP.isNull())
+   {
+      L_ERRO("ConnectionPool::getMainSocket(): Unable to get a socket");
+      return QSharedPointer<PeerMessageSocket>();
+   }
 
-   L_ERRO("ConnectionPool::getASocket(): Unable to get a socket");
-   return QSharedPointer<PeerMessageSocket>();
+   this->mainSocket = this->addNewSocket(QSharedPointer<PeerMessageSocket>(new PeerMessageSocket(this->peerManager, this->fileManager, this->peerID, this->peerIP, this->port)), TO_PEER);
+   return this->mainSocket;
 }
 
 void ConnectionPool::closeAllSocket()
@@ -109,7 +140,7 @@ void ConnectionPool::socketBecomeIdle(PeerMessageSocket* socket)
    for (QListIterator<QSharedPointer<PeerMessageSocket>> i(this->getAllSockets()); i.hasNext();)
    {
      QSharedPointer<PeerMessageSocket> currentSocket = i.next();
-     if (!currentSocket.data()->isActive())
+     if (currentSocket != this->mainSocket && !currentSocket.data()->isActive())
      {
         n += 1;
         if (n > SETTINGS.get<quint32>("max_number_idle_socket"))
@@ -131,6 +162,8 @@ void ConnectionPool::socketClosed(PeerMessageSocket* socket)
       {
          if (i.next().data() == socket)
          {
+            if (this->mainSocket.data() == socket)
+               this->mainSocket.clear();
             socket->disconnect(this);
             i.remove();
             return;
@@ -139,17 +172,9 @@ void ConnectionPool::socketClosed(PeerMessageSocket* socket)
    }
 }
 
-void ConnectionPool::socketGetChunk(QSharedPointer<FM::IChunk> chunk, int offset, PeerMessageSocket* socket)
+void ConnectionPool::socketGetChunks(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ChunkStream>& chunkStream)
 {
-   for (QListIterator<QSharedPointer<PeerMessageSocket>> i(this->socketsFromPeer); i.hasNext();)
-   {
-      QSharedPointer<PeerMessageSocket> socketShared = i.next();
-      if (socketShared.data() == socket)
-      {
-         this->peerManager->onGetChunk(chunk, offset, socketShared);
-         break;
-      }
-   }
+   this->peerManager->onGetChunks(chunks, chunkStream);
 }
 
 /**
@@ -164,7 +189,7 @@ QSharedPointer<PeerMessageSocket> ConnectionPool::addNewSocket(QSharedPointer<Pe
       break;
    case FROM_PEER:
       this->socketsFromPeer << socket;
-      connect(socket.data(), &PeerMessageSocket::getChunk, this, &ConnectionPool::socketGetChunk, Qt::DirectConnection);
+      connect(socket.data(), &PeerMessageSocket::getChunks, this, &ConnectionPool::socketGetChunks, Qt::DirectConnection);
       break;
    }
 
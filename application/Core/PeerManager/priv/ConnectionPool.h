@@ -47,13 +47,14 @@ namespace PM
       void setIP(const QHostAddress& IP, quint16 port);
       void newConnexion(QTcpSocket* socket);
 
-      QSharedPointer<PeerMessageSocket> getASocket();
+      QSharedPointer<PeerMessageSocket> getASocket(PeerMessageSocket::Stream stream);
+      QSharedPointer<PeerMessageSocket> getMainSocket();
       void closeAllSocket();
 
    private slots:
       void socketBecomeIdle(PeerMessageSocket* socket);
       void socketClosed(PeerMessageSocket* socket);
-      void socketGetChunk(QSharedPointer<FM::IChunk> chunk, int offset, PeerMessageSocket* socket);
+      void socketGetChunks(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ChunkStream>& chunkStream);
 
    private:
       enum Direction { TO_PEER, FROM_PEER };
@@ -65,6 +66,7 @@ namespace PM
 
       QList<QSharedPointer<PeerMessageSocket>> socketsToPeer;
       QList<QSharedPointer<PeerMessageSocket>> socketsFromPeer;
+      QSharedPointer<PeerMessageSocket> mainSocket; // One of 'socketsToPeer', carries all the chunk streams.
 
       QHostAddress peerIP;
       quint16 port;
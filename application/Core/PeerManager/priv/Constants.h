@@ -23,4 +23,14 @@
 namespace PM
 {
    const int MAX_NICK_LENGTH = 255; // To avoid infinite nick length ;).
+
+   // Weight of a new sample in the smoothed speed, RTT and failure rate of a peer, see 'PM::PeerStats'.
+   const double PEER_STATS_SMOOTHING_FACTOR = 0.25;
+   const int PEER_STATS_NB_LAST_SPEEDS = 16;
+
+   const int MIN_SIZE_TO_COMPRESS_ENTRIES = 4 * 1024; // [byte]. A smaller 'GetEntriesResult' is sent uncompressed.
+   const quint32 MAX_UNCOMPRESSED_ENTRIES_SIZE = 32 * 1024 * 1024; // [byte]. A compressed 'GetEntriesResult' announcing a bigger size is rejected.
+
+   const int CHUNK_DATA_FRAME_SIZE = 16 * 1024; // [byte]. The maximum size of the data of a 'ChunkData' message.
+   const qint64 MAX_BUFFERED_CHUNK_DATA = 64 * 1024; // [byte]. No chunk data frame is given to a socket having more data than this waiting to be written.
 }
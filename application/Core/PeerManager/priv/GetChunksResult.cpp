@@ -22,16 +22,30 @@ using namespace PM;
 #include <Common/Settings.h>
 
 #include <priv/Log.h>
+#include <priv/Peer.h>
 
-GetChunksResult::GetChunksResult(const Protos::Core::GetChunks& chunks, QSharedPointer<PeerMessageSocket> socket) :
-   IGetChunksResult(SETTINGS.get<quint32>("socket_timeout")), chunks(chunks), socket(socket), closeTheSocket(false)
+GetChunksResult::GetChunksResult(const Protos::Core::GetChunks& chunks, Peer* peer, QSharedPointer<PeerMessageSocket> socket) :
+   IGetChunksResult(SETTINGS.get<quint32>("socket_timeout")), chunks(chunks), peer(peer), socket(socket), closeTheSocket(false)
 {
 }
 
+/**
+  * The stream is open before sending the request, the data can follow the result immediately.
+  */
 void GetChunksResult::start()
 {
-   connect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetChunksResult::newMessage, Qt::DirectConnection);
-   socket->send(Common::MessageHeader::CORE_GET_CHUNKS, this->chunks);
+   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
+
+   if (!this->socket.isNull())
+   {
+      this->chunkStream = this->socket->openChunkStream();
+      this->chunks.set_stream_id(this->chunkStream->getID());
+      this->chunks.set_window_size(SOCKET_BUFFER_SIZE);
+
+      connect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetChunksResult::newMessage, Qt::DirectConnection);
+      socket->send(Common::MessageHeader::CORE_GET_CHUNKS, this->chunks);
+   }
+   this->requestTimer.start();
    this->startTimer();
 }
 
@@ -40,34 +54,42 @@ void GetChunksResult::setStatus(bool closeTheSocket)
    this->closeTheSocket = closeTheSocket;
 }
 
+/**
+  * The stream is reset if the data isn't entirely received, the socket stays open for the other exchanges.
+  */
 void GetChunksResult::doDeleteLater()
 {
-   // We must disconnect because 'this->socket->finished' can read some data and emit 'newMessage'.
-   disconnect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetChunksResult::newMessage);
-   this->socket->finished(this->isTimedout() ? true : this->closeTheSocket);
-   this->socket.clear();
+   if (!this->socket.isNull())
+   {
+      disconnect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetChunksResult::newMessage);
+      if (!this->chunkStream.isNull())
+         this->chunkStream->finished(this->isTimedout() ? true : this->closeTheSocket);
+      this->chunkStream.clear();
+      this->socket.clear();
+   }
    this->deleteLater();
 }
 
 void GetChunksResult::newMessage(const Common::Message& message)
 {
-   if (message.getHeader().getType() != Common::MessageHeader::CORE_GET_CHUNKS_RESULT)
+   if (message.getHeader().getType() != Common::MessageHeader::CORE_GET_CHUNKS_RESULT || this->chunkStream.isNull())
+      return;
+
+   const Protos::Core::GetChunksResult& chunksResult = message.getMessage<Protos::Core::GetChunksResult>();
+   if (chunksResult.stream_id() != this->chunkStream->getID()) // The result of another request sharing the socket.
       return;
 
    this->stopTimer();
 
-   const Protos::Core::GetChunksResult& chunksResult = message.getMessage<Protos::Core::GetChunksResult>();
+   this->peer->requestAnswered(this->requestTimer.elapsed(), chunksResult.status() != Protos::Core::GetChunksResult::OK);
    emit result(chunksResult);
 
-   if (chunksResult.status() == Protos::Core::GetChunksResult::OK)
-   {
-      socket->stopListening();
-      emit stream(this->socket);
-   }
-   else
-   {
-      this->closeTheSocket = true;
-      // Segfault, maybe we cannot disconnect a signal during a call to the connected slot (this method)!?.
-      //disconnect(this->socket.data(), SIGNAL(newMessage(Common::MessageHeader::MessageType, const google::protobuf::Message&)), this, SLOT(newMessage(Common::MessageHeader::MessageType, const google::protobuf::Message&)));
-   }
+   // The request may have been released by a slot connected to 'result(..)'.
+   if (chunksResult.status() == Protos::Core::GetChunksResult::OK && !this->chunkStream.isNull())
+      emit stream(this->chunkStream);
+}
+
+void GetChunksResult::onTimeout()
+{
+   this->peer->requestTimedout();
 }
@@ -20,6 +20,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include <google/protobuf/message.h>
 
@@ -32,14 +33,16 @@
 
 #include <IGetChunksResult.h>
 #include <priv/PeerMessageSocket.h>
+#include <priv/ChunkStream.h>
 
 namespace PM
 {
+   class Peer;
    class GetChunksResult : public IGetChunksResult, Common::Uncopyable
    {
       Q_OBJECT
    public:
-      GetChunksResult(const Protos::Core::GetChunks& chunks, QSharedPointer<PeerMessageSocket> socket);
+      GetChunksResult(const Protos::Core::GetChunks& chunks, Peer* peer, QSharedPointer<PeerMessageSocket> socket);
       void start();
       void setStatus(bool closeTheSocket);
       void doDeleteLater();
@@ -48,8 +51,13 @@ namespace PM
       void newMessage(const Common::Message& message);
 
    private:
-      const Protos::Core::GetChunks chunks;
+      void onTimeout();
+
+      Protos::Core::GetChunks chunks;
+      Peer* peer;
+      QElapsedTimer requestTimer;
       QSharedPointer<PeerMessageSocket> socket;
+      QSharedPointer<ChunkStream> chunkStream;
       bool closeTheSocket;
    };
 }
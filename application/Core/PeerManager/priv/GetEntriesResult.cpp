@@ -19,13 +19,19 @@
 #include <priv/GetEntriesResult.h>
 using namespace PM;
 
+#include <QtEndian>
+
 #include <Common/Settings.h>
 
+#include <priv/Constants.h>
+
 #include <priv/Log.h>
+#include <priv/Peer.h>
 
-GetEntriesResult::GetEntriesResult(const Protos::Core::GetEntries& dirs, QSharedPointer<PeerMessageSocket> socket) :
-   IGetEntriesResult(SETTINGS.get<quint32>("socket_timeout")), dirs(dirs), socket(socket)
+GetEntriesResult::GetEntriesResult(const Protos::Core::GetEntries& dirs, Peer* peer, QSharedPointer<PeerMessageSocket> socket) :
+   IGetEntriesResult(SETTINGS.get<quint32>("socket_timeout")), dirs(dirs), peer(peer), socket(socket)
 {
+   this->dirs.set_accept_compression(true);
 }
 
 void GetEntriesResult::start()
@@ -35,6 +41,7 @@ void GetEntriesResult::start()
       connect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetEntriesResult::newMessage, Qt::DirectConnection);
       socket->send(Common::MessageHeader::CORE_GET_ENTRIES, this->dirs);
    }
+   this->requestTimer.start();
    this->startTimer();
 }
 
@@ -43,7 +50,7 @@ void GetEntriesResult::doDeleteLater()
    if (!this->socket.isNull())
    {
       disconnect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetEntriesResult::newMessage);
-      this->socket->finished();
+      this->socket->closeStream(PeerMessageSocket::ENTRIES);
       this->socket.clear();
    }
    this->deleteLater();
@@ -55,10 +62,41 @@ void GetEntriesResult::newMessage(const Common::Message& message)
       return;
 
    this->stopTimer();
+   this->peer->requestAnswered(this->requestTimer.elapsed(), false);
 
    if (!this->socket.isNull())
       disconnect(this->socket.data(), &PeerMessageSocket::newMessage, this, &GetEntriesResult::newMessage);
 
    const Protos::Core::GetEntriesResult& entries = message.getMessage<Protos::Core::GetEntriesResult>();
+
+   if (!entries.compressed_result().empty())
+   {
+      Protos::Core::GetEntriesResult uncompressedEntries;
+
+      // 'qUncompress(..)' allocates the size given by the first four bytes (big-endian), it must be checked before.
+      const uchar* compressedData = reinterpret_cast<const uchar*>(entries.compressed_result().data());
+      const int compressedSize = static_cast<int>(entries.compressed_result().size());
+      if (compressedSize < 4 || qFromBigEndian<quint32>(compressedData) > MAX_UNCOMPRESSED_ENTRIES_SIZE)
+      {
+         L_WARN(QString("GetEntriesResult::newMessage(..): compressed result rejected, size: %1").arg(compressedSize));
+         emit result(uncompressedEntries);
+         return;
+      }
+
+      const QByteArray serializedEntries = qUncompress(compressedData, compressedSize);
+      if (serializedEntries.isEmpty() || !uncompressedEntries.ParseFromArray(serializedEntries.constData(), serializedEntries.size()))
+      {
+         L_WARN("GetEntriesResult::newMessage(..): unable to uncompress the result");
+         uncompressedEntries.Clear();
+      }
+      emit result(uncompressedEntries);
+      return;
+   }
+
    emit result(entries);
 }
+
+void GetEntriesResult::onTimeout()
+{
+   this->peer->requestTimedout();
+}
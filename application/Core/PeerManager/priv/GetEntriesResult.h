@@ -19,6 +19,8 @@
 #pragma once
 
 #include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
 
 #include <google/protobuf/message.h>
 
@@ -33,11 +35,12 @@
 
 namespace PM
 {
+   class Peer;
    class GetEntriesResult : public IGetEntriesResult, Common::Uncopyable
    {
       Q_OBJECT
    public:
-      GetEntriesResult(const Protos::Core::GetEntries& dirs, QSharedPointer<PeerMessageSocket> socket);
+      GetEntriesResult(const Protos::Core::GetEntries& dirs, Peer* peer, QSharedPointer<PeerMessageSocket> socket);
       void start();
       void doDeleteLater();
 
@@ -45,7 +48,11 @@ namespace PM
       void newMessage(const Common::Message& message);
 
    private:
-      const Protos::Core::GetEntries dirs;
+      void onTimeout();
+
+      Protos::Core::GetEntries dirs;
+      Peer* peer;
+      QElapsedTimer requestTimer;
       QSharedPointer<PeerMessageSocket> socket;
    };
 }
@@ -22,9 +22,10 @@ using namespace PM;
 #include <Common/Settings.h>
 
 #include <priv/Log.h>
+#include <priv/Peer.h>
 
-GetHashesResult::GetHashesResult(const Protos::Common::Entry& file, QSharedPointer<PeerMessageSocket> socket) :
-   IGetHashesResult(SETTINGS.get<quint32>("get_hashes_timeout")), file(file), socket(socket)
+GetHashesResult::GetHashesResult(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, Peer* peer, QSharedPointer<PeerMessageSocket> socket) :
+   IGetHashesResult(SETTINGS.get<quint32>("get_hashes_timeout")), file(file), nextFiles(nextFiles), peer(peer), socket(socket)
 {
 }
 
@@ -32,15 +33,19 @@ void GetHashesResult::start()
 {
    Protos::Core::GetHashes message;
    message.mutable_file()->CopyFrom(this->file);
+   for (QListIterator<Protos::Common::Entry> i(this->nextFiles); i.hasNext();)
+      message.add_next_files()->CopyFrom(i.next());
+   message.set_send_next_hashes(!this->nextFiles.isEmpty());
    connect(this->socket.data(), SIGNAL(newMessage(Common::Message)), this, SLOT(newMessage(Common::Message)), Qt::DirectConnection);
    socket->send(Common::MessageHeader::CORE_GET_HASHES, message);
+   this->requestTimer.start();
    this->startTimer();
 }
 
 void GetHashesResult::doDeleteLater()
 {
    disconnect(this->socket.data(), SIGNAL(newMessage(Common::Message)), this, SLOT(newMessage(Common::Message)));
-   this->socket->finished();
+   this->socket->closeStream(PeerMessageSocket::HASHES);
    this->socket.clear();
    this->deleteLater();
 }
@@ -52,6 +57,11 @@ void GetHashesResult::newMessage(const Common::Message& message)
    case Common::MessageHeader::CORE_GET_HASHES_RESULT:
       {
          const Protos::Core::GetHashesResult& hashesResult = message.getMessage<Protos::Core::GetHashesResult>();
+         if (this->requestTimer.isValid())
+         {
+            this->peer->requestAnswered(this->requestTimer.elapsed(), hashesResult.status() != Protos::Core::GetHashesResult::OK);
+            this->requestTimer.invalidate();
+         }
          this->startTimer(); // Restart the timer.
          emit result(hashesResult);
       }
@@ -68,3 +78,8 @@ void GetHashesResult::newMessage(const Common::Message& message)
    default:;
    }
 }
+
+void GetHashesResult::onTimeout()
+{
+   this->peer->requestTimedout();
+}
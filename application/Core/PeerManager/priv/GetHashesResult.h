@@ -20,6 +20,8 @@
 
 #include <QObject>
 #include <QSharedPointer>
+#include <QList>
+#include <QElapsedTimer>
 
 #include <google/protobuf/message.h>
 
@@ -34,11 +36,12 @@
 
 namespace PM
 {
+   class Peer;
    class GetHashesResult : public IGetHashesResult, Common::Uncopyable
    {
       Q_OBJECT
    public:
-      GetHashesResult(const Protos::Common::Entry& file, QSharedPointer<PeerMessageSocket> socket);
+      GetHashesResult(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles, Peer* peer, QSharedPointer<PeerMessageSocket> socket);
       void start();
       void doDeleteLater();
 
@@ -46,7 +49,12 @@ namespace PM
       void newMessage(const Common::Message& message);
 
    private:
+      void onTimeout();
+
       const Protos::Common::Entry file;
+      const QList<Protos::Common::Entry> nextFiles;
+      Peer* peer;
+      QElapsedTimer requestTimer; // Invalidated when the first response is received.
       QSharedPointer<PeerMessageSocket> socket;
    };
 }
@@ -41,7 +41,13 @@ Peer::Peer(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManage
    nick(nick),
    sharingAmount(0),
    speed(MAX_SPEED),
+   rtt(0.0),
+   failureRate(0.0),
+   nbRequests(0),
+   nbErrors(0),
+   nbTimeouts(0),
    alive(false),
+   aliveIndex(-1),
    blocked(false),
    protocolVersion(0)
 {
@@ -60,7 +66,7 @@ Peer::Peer(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManage
   */
 QString Peer::toStringLog() const
 {
-   return QString("%1 %2 %3:%4 %5 %6/s").arg(this->nick).arg(this->ID.toStr()).arg(this->IP.toString()).arg(this->port).arg(this->alive ? "<alive>" : "<dead>").arg(Common::Global::formatByteSize(const_cast<Peer*>(this)->getSpeed(), 4));
+   return QString("%1 %2 %3:%4 %5 %6/s").arg(this->getNick()).arg(this->ID.toStr()).arg(this->getIP().toString()).arg(this->getPort()).arg(this->isAlive() ? "<alive>" : "<dead>").arg(Common::Global::formatByteSize(const_cast<Peer*>(this)->getSpeed(), 4));
 }
 
 Common::Hash Peer::getID() const
@@ -68,18 +74,24 @@ Common::Hash Peer::getID() const
    return this->ID;
 }
 
+/**
+  * Thread-safe, the address is used by the UDP thread, see 'NL::UDPListener'.
+  */
 QHostAddress Peer::getIP() const
 {
+   QMutexLocker locker(&this->mutex);
    return this->IP;
 }
 
 quint16 Peer::getPort() const
 {
+   QMutexLocker locker(&this->mutex);
    return this->port;
 }
 
 QString Peer::getNick() const
 {
+   QMutexLocker locker(&this->mutex);
    return this->nick;
 }
 
@@ -106,15 +118,12 @@ quint32 Peer::getUploadRate() const
 quint32 Peer::getSpeed()
 {
    QMutexLocker locker(&this->mutex);
-
-   // In [ms].
-   static const quint32 SPEED_VALIDITY_PERIOD = 1000 * SETTINGS.get<quint32>("download_rate_valid_time_factor") / (SETTINGS.get<quint32>("lan_speed") / 1024 / 1024);
-
-   if (this->speedTimer.isValid() && this->speedTimer.elapsed() > SPEED_VALIDITY_PERIOD)
-      this->speed = MAX_SPEED;
-   return this->speed;
+   return this->getSpeedUnlocked();
 }
 
+/**
+  * The speed is smoothed (EWMA), each block downloaded from the peer gives a sample.
+  */
 void Peer::setSpeed(quint32 newSpeed)
 {
    QMutexLocker locker(&this->mutex);
@@ -123,7 +132,81 @@ void Peer::setSpeed(quint32 newSpeed)
    if (this->speed == MAX_SPEED)
       this->speed = newSpeed;
    else
-      this->speed = (this->speed + newSpeed) / 2;
+      this->speed = static_cast<quint32>(PEER_STATS_SMOOTHING_FACTOR * newSpeed + (1.0 - PEER_STATS_SMOOTHING_FACTOR) * this->speed);
+
+   this->lastSpeeds << newSpeed;
+   if (this->lastSpeeds.size() > PEER_STATS_NB_LAST_SPEEDS)
+      this->lastSpeeds.removeFirst();
+}
+
+quint32 Peer::getExpectedSpeed()
+{
+   QMutexLocker locker(&this->mutex);
+   return static_cast<quint32>(this->getSpeedUnlocked() * (1.0 - this->failureRate));
+}
+
+PeerStats Peer::getStats() const
+{
+   QMutexLocker locker(&this->mutex);
+
+   PeerStats stats;
+   stats.speed = this->speed == MAX_SPEED ? 0 : this->speed;
+   stats.rtt = static_cast<quint32>(this->rtt);
+   stats.nbRequests = this->nbRequests;
+   stats.nbErrors = this->nbErrors;
+   stats.nbTimeouts = this->nbTimeouts;
+   stats.failureRate = this->failureRate;
+   stats.lastSpeeds = this->lastSpeeds;
+   return stats;
+}
+
+/**
+  * Called when the first response of a request is received.
+  * @param rtt [ms]
+  * @param error True if the response has an error status.
+  */
+void Peer::requestAnswered(qint64 rtt, bool error)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (this->rtt == 0.0)
+      this->rtt = rtt;
+   else
+      this->rtt = PEER_STATS_SMOOTHING_FACTOR * rtt + (1.0 - PEER_STATS_SMOOTHING_FACTOR) * this->rtt;
+
+   if (error)
+      this->nbErrors++;
+   this->addRequestResult(error);
+}
+
+void Peer::requestTimedout()
+{
+   QMutexLocker locker(&this->mutex);
+
+   this->nbTimeouts++;
+   this->addRequestResult(true);
+}
+
+/**
+  * The mutex must be locked.
+  */
+quint32 Peer::getSpeedUnlocked()
+{
+   // In [ms].
+   static const quint32 SPEED_VALIDITY_PERIOD = 1000 * SETTINGS.get<quint32>("download_rate_valid_time_factor") / (SETTINGS.get<quint32>("lan_speed") / 1024 / 1024);
+
+   if (this->speedTimer.isValid() && this->speedTimer.elapsed() > SPEED_VALIDITY_PERIOD)
+      this->speed = MAX_SPEED;
+   return this->speed;
+}
+
+/**
+  * The mutex must be locked.
+  */
+void Peer::addRequestResult(bool failed)
+{
+   this->nbRequests++;
+   this->failureRate = PEER_STATS_SMOOTHING_FACTOR * (failed ? 1.0 : 0.0) + (1.0 - PEER_STATS_SMOOTHING_FACTOR) * this->failureRate;
 }
 
 void Peer::block(int duration, const QString& reason)
@@ -166,9 +249,10 @@ void Peer::update(
    quint32 protocolVersion
 )
 {
-   this->alive = true;
    this->aliveTimer.start();
 
+   QMutexLocker locker(&this->mutex);
+   this->alive = true;
    this->IP = IP;
    this->port = port;
    this->nick = nick;
@@ -177,8 +261,9 @@ void Peer::update(
    this->downloadRate = downloadRate;
    this->uploadRate = uploadRate;
    this->protocolVersion = protocolVersion;
+   locker.unlock();
 
-   this->connectionPool.setIP(this->IP, this->port);
+   this->connectionPool.setIP(IP, port);
 }
 
 void Peer::setAsDead()
@@ -193,30 +278,30 @@ QSharedPointer<IGetEntriesResult> Peer::getEntries(const Protos::Core::GetEntrie
       return QSharedPointer<IGetEntriesResult>();
 
    return QSharedPointer<IGetEntriesResult>(
-      new GetEntriesResult(dirs, this->connectionPool.getASocket()),
+      new GetEntriesResult(dirs, this, this->connectionPool.getASocket(PeerMessageSocket::ENTRIES)),
       &IGetEntriesResult::doDeleteLater
    );
 }
 
-QSharedPointer<IGetHashesResult> Peer::getHashes(const Protos::Common::Entry& file)
+QSharedPointer<IGetHashesResult> Peer::getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles)
 {
    if (!this->isAvailable())
       return QSharedPointer<IGetHashesResult>();
 
    return QSharedPointer<IGetHashesResult>(
-      new GetHashesResult(file, this->connectionPool.getASocket()),
+      new GetHashesResult(file, nextFiles, this, this->connectionPool.getASocket(PeerMessageSocket::HASHES)),
       &IGetHashesResult::doDeleteLater
    );
 }
 
-QSharedPointer<IGetChunkResult> Peer::getChunk(const Protos::Core::GetChunk& chunk)
+QSharedPointer<IGetChunksResult> Peer::getChunks(const Protos::Core::GetChunks& chunks)
 {
    if (!this->isAvailable())
-      return QSharedPointer<IGetChunkResult>();
+      return QSharedPointer<IGetChunksResult>();
 
-   return QSharedPointer<IGetChunkResult>(
-      new GetChunksResult(chunk, this->connectionPool.getASocket()),
-      &IGetChunkResult::doDeleteLater
+   return QSharedPointer<IGetChunksResult>(
+      new GetChunksResult(chunks, this, this->connectionPool.getMainSocket()),
+      &IGetChunksResult::doDeleteLater
    );
 }
 
@@ -230,7 +315,14 @@ void Peer::consideredDead()
 {
    L_DEBU(QString("Peer is dead: %1").arg(this->toStringLog()));
    this->connectionPool.closeAllSocket();
+
+   QMutexLocker locker(&this->mutex);
+   const bool wasAlive = this->alive;
    this->alive = false;
+   locker.unlock();
+
+   if (wasAlive)
+      emit becomesDead();
 }
 
 void Peer::unblock()
@@ -48,6 +48,8 @@ namespace PM
       Q_OBJECT
       static const quint32 MAX_SPEED;
 
+      friend class PeerManager;
+
    public:
       Peer(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, Common::Hash ID, const QString& nick = QString());
 
@@ -64,6 +66,11 @@ namespace PM
 
       virtual quint32 getSpeed();
       virtual void setSpeed(quint32 newSpeed);
+      virtual quint32 getExpectedSpeed();
+      virtual PeerStats getStats() const;
+
+      void requestAnswered(qint64 rtt, bool error);
+      void requestTimedout();
 
       virtual void block(int duration, const QString& reason = QString());
 
@@ -83,13 +90,14 @@ namespace PM
       virtual void setAsDead();
 
       virtual QSharedPointer<IGetEntriesResult> getEntries(const Protos::Core::GetEntries& dirs);
-      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file);
-      virtual QSharedPointer<IGetChunkResult> getChunk(const Protos::Core::GetChunk& chunk);
+      virtual QSharedPointer<IGetHashesResult> getHashes(const Protos::Common::Entry& file, const QList<Protos::Common::Entry>& nextFiles);
+      virtual QSharedPointer<IGetChunksResult> getChunks(const Protos::Core::GetChunks& chunks);
 
       void newConnexion(QTcpSocket* tcpSocket);
 
    signals:
       void unblocked();
+      void becomesDead();
 
    protected slots:
       void consideredDead();
@@ -97,6 +105,8 @@ namespace PM
 
    protected:
       bool isVersionCompatible() const { return this->protocolVersion == Common::Constants::PROTOCOL_VERSION; }
+      quint32 getSpeedUnlocked();
+      void addRequestResult(bool failed);
 
       mutable QMutex mutex;
 
@@ -113,9 +123,17 @@ namespace PM
 
       QElapsedTimer speedTimer;
       quint32 speed; // [bytes/s]
+      QList<quint32> lastSpeeds;
+
+      double rtt; // [ms], 0 if unknown.
+      double failureRate;
+      quint32 nbRequests;
+      quint32 nbErrors;
+      quint32 nbTimeouts;
 
       bool alive;
       QTimer aliveTimer;
+      int aliveIndex; // Position in 'PeerManager::alivePeers', -1 if not in it. Managed by the 'PeerManager'.
 
       bool blocked;
       QString blockedReason;
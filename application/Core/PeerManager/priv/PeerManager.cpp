@@ -44,7 +44,7 @@ PeerManager::PeerManager(QSharedPointer<FM::IFileManager> fileManager) :
 
 PeerManager::~PeerManager()
 {
-   for (QMapIterator<Common::Hash, Peer*> i(this->peers); i.hasNext();)
+   for (QHashIterator<Common::Hash, Peer*> i(this->peers); i.hasNext();)
       delete i.next().value();
    delete this->self;
 
@@ -66,25 +66,14 @@ IPeer* PeerManager::getSelf()
 
 int PeerManager::getNbOfPeers() const
 {
-   int n = 0;
-   for (QMapIterator<Common::Hash, Peer*> i(this->peers); i.hasNext();)
-      if (i.next().value()->isAlive())
-         n++;
-   return n;
+   QMutexLocker locker(&this->mutex);
+   return this->alivePeers.size();
 }
 
 QList<IPeer*> PeerManager::getPeers() const
 {
-   QList<IPeer*> peers;
-
-   for (QMapIterator<Common::Hash, Peer*> i(this->peers); i.hasNext();)
-   {
-      Peer* peer = i.next().value();
-      if (peer->isAlive())
-         peers << peer;
-   }
-
-   return peers;
+   QMutexLocker locker(&this->mutex);
+   return this->alivePeers; // Implicitly shared, only copied if the alive peers change while the caller still holds the list.
 }
 
 IPeer* PeerManager::getPeer(const Common::Hash& ID)
@@ -95,6 +84,7 @@ IPeer* PeerManager::getPeer(const Common::Hash& ID)
    if (this->self->getID() == ID)
       return this->self;
 
+   QMutexLocker locker(&this->mutex);
    auto it = this->peers.find(ID);
    if (it != this->peers.end())
       return *it;
@@ -110,6 +100,8 @@ IPeer* PeerManager::createPeer(const Common::Hash& ID, const QString& nick)
 
    Peer* peer = new Peer(this, this->fileManager, ID, nick);
    connect(peer, &Peer::unblocked, this, &PeerManager::peerUnblocked);
+   connect(peer, &Peer::becomesDead, this, &PeerManager::peerBecomesDead);
+   QMutexLocker locker(&this->mutex);
    this->peers.insert(peer->getID(), peer);
 
    return peer;
@@ -140,6 +132,8 @@ void PeerManager::updatePeer(
    {
       peer = new Peer(this, this->fileManager, ID);
       connect(peer, &Peer::unblocked, this, &PeerManager::peerUnblocked);
+      connect(peer, &Peer::becomesDead, this, &PeerManager::peerBecomesDead);
+      QMutexLocker locker(&this->mutex);
       this->peers.insert(peer->getID(), peer);
    }
 
@@ -147,8 +141,12 @@ void PeerManager::updatePeer(
 
    peer->update(IP, port, nick, sharingAmount, coreVersion, downloadRate, uploadRate, protocolVersion);
 
-   if (wasDead && peer->isAvailable())
-      emit peerBecomesAvailable(peer);
+   if (wasDead)
+   {
+      this->addToAlivePeers(peer);
+      if (peer->isAvailable())
+         emit peerBecomesAvailable(peer);
+   }
 }
 
 void PeerManager::removePeer(const Common::Hash& ID, const QHostAddress& IP)
@@ -163,8 +161,12 @@ void PeerManager::removePeer(const Common::Hash& ID, const QHostAddress& IP)
 
 void PeerManager::removeAllPeers()
 {
-   for (QMapIterator<Common::Hash, Peer*> i(this->peers); i.hasNext();)
-      i.next().value()->setAsDead();
+   this->mutex.lock();
+   const QList<Peer*> peers = this->peers.values();
+   this->mutex.unlock();
+
+   for (QListIterator<Peer*> i(peers); i.hasNext();)
+      i.next()->setAsDead();
 }
 
 void PeerManager::newConnection(QTcpSocket* tcpSocket)
@@ -194,19 +196,19 @@ void PeerManager::newConnection(QTcpSocket* tcpSocket)
    }
 }
 
-void PeerManager::onGetChunk(QSharedPointer<FM::IChunk> chunk, int offset, QSharedPointer<PeerMessageSocket> socket)
+/**
+  * The 'GetChunksResult' message has already been sent, if nobody can send the data the stream is reset.
+  */
+void PeerManager::onGetChunks(const QList<ChunkToSend>& chunks, const QSharedPointer<ChunkStream>& chunkStream)
 {
-   if (this->receivers(SIGNAL(getChunk(QSharedPointer<FM::IChunk>, int, QSharedPointer<PM::ISocket>))) < 1)
+   if (this->receivers(SIGNAL(getChunks(QList<PM::ChunkToSend>, QSharedPointer<PM::ISocket>))) < 1)
    {
-      Protos::Core::GetChunkResult mess;
-      mess.set_status(Protos::Core::GetChunkResult::ERROR_UNKNOWN);
-      socket->send(Common::MessageHeader::CORE_GET_CHUNK_RESULT, mess);
-      socket->finished();
-      L_ERRO("PeerManager::onGetChunk(..): no slot connected to the signal 'getChunk(..)'");
+      chunkStream->finished(true);
+      L_ERRO("PeerManager::onGetChunks(..): no slot connected to the signal 'getChunks(..)'");
       return;
    }
 
-   emit getChunk(chunk, offset, socket);
+   emit getChunks(chunks, chunkStream);
 }
 
 void PeerManager::dataReceived(QTcpSocket* tcpSocket)
@@ -268,6 +270,40 @@ void PeerManager::peerUnblocked()
       emit peerBecomesAvailable(peer);
 }
 
+void PeerManager::peerBecomesDead()
+{
+   this->removeFromAlivePeers(static_cast<Peer*>(this->sender()));
+}
+
+void PeerManager::addToAlivePeers(Peer* peer)
+{
+   QMutexLocker locker(&this->mutex);
+
+   if (peer->aliveIndex != -1)
+      return;
+
+   peer->aliveIndex = this->alivePeers.size();
+   this->alivePeers << peer;
+}
+
+/**
+  * The last alive peer takes the place of the removed one.
+  */
+void PeerManager::removeFromAlivePeers(Peer* peer)
+{
+   QMutexLocker locker(&this->mutex);
+
+   const int index = peer->aliveIndex;
+   if (index == -1)
+      return;
+
+   Peer* lastPeer = static_cast<Peer*>(this->alivePeers.last());
+   this->alivePeers[index] = lastPeer;
+   lastPeer->aliveIndex = index;
+   this->alivePeers.removeLast();
+   peer->aliveIndex = -1;
+}
+
 void PeerManager::removeFromPending(QTcpSocket* socket)
 {
    for (QMutableListIterator<PendingSocket> i(this->pendingSockets); i.hasNext();)
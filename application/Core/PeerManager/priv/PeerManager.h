@@ -19,12 +19,13 @@
 #pragma once
 
 #include <QObject>
-#include <QMap>
+#include <QHash>
 #include <QString>
 #include <QTimer>
 #include <QElapsedTimer>
 #include <QList>
 #include <QTcpSocket>
+#include <QMutex>
 
 #include <Common/Hash.h>
 #include <Common/Uncopyable.h>
@@ -85,15 +86,19 @@ namespace PM
       void removeAllPeers();
       void newConnection(QTcpSocket* tcpSocket);
 
-      void onGetChunk(QSharedPointer<FM::IChunk> chunk, int offset, QSharedPointer<PeerMessageSocket> socket);
+      void onGetChunks(const QList<ChunkToSend>& chunks, const QSharedPointer<ChunkStream>& chunkStream);
 
    private slots:
       void dataReceived(QTcpSocket* tcpSocket = nullptr);
       void disconnected(QTcpSocket* tcpSocket = nullptr);
       void checkIdlePendingSockets();
       void peerUnblocked();
+      void peerBecomesDead();
 
    private:
+      void addToAlivePeers(Peer* peer);
+      void removeFromAlivePeers(Peer* peer);
+
       void removeFromPending(QTcpSocket* socket);
 
       LOG_INIT_H("PeerManager")
@@ -101,7 +106,9 @@ namespace PM
       QSharedPointer<FM::IFileManager> fileManager;
 
       PeerSelf* self; // Ourself.
-      QMap<Common::Hash, Peer*> peers; // The other peers.
+      QHash<Common::Hash, Peer*> peers; // The other peers. They are never deleted before the 'PeerManager'.
+      QList<IPeer*> alivePeers; // The alive peers in no particular order, each peer knows its position ('Peer::aliveIndex'). Returned as is by 'getPeers()'.
+      mutable QMutex mutex; // Protects 'peers' and 'alivePeers', the UDP thread looks up the peers.
 
       QTimer timer; ///< Used to check periodically if some pending sockets have timeouted.
       QList<PendingSocket> pendingSockets;
@@ -19,6 +19,8 @@
 #include <priv/PeerMessageSocket.h>
 using namespace PM;
 
+#include <cstring>
+
 #include <QCoreApplication>
 
 #include <Protos/core_protocol.pb.h>
@@ -42,143 +44,141 @@ void PeerMessageSocket::Logger::logError(const QString& message)
 }
 
 PeerMessageSocket::PeerMessageSocket(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, const Common::Hash& remotePeerID, QTcpSocket* socket) :
-   MessageSocket(new PeerMessageSocket::Logger(), socket, peerManager->getSelf()->getID(), remotePeerID), fileManager(fileManager), active(true), nbError(0)
+   MessageSocket(new PeerMessageSocket::Logger(), socket, peerManager->getSelf()->getID(), remotePeerID), entriesCompressionAccepted(false), fileManager(fileManager), incoming(true), active(true), closing(false), openStreams(0), nextChunkStreamID(1), sendingChunkData(false), nbError(0)
 {
    this->initUnactiveTimer();
+   connect(this->socket, &QAbstractSocket::bytesWritten, this, &PeerMessageSocket::sendChunkData);
 }
 
 PeerMessageSocket::PeerMessageSocket(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, const Common::Hash& remotePeerID, const QHostAddress& address, quint16 port) :
-   MessageSocket(new PeerMessageSocket::Logger(), address, port, peerManager->getSelf()->getID(), remotePeerID), fileManager(fileManager), active(true), nbError(0)
+   MessageSocket(new PeerMessageSocket::Logger(), address, port, peerManager->getSelf()->getID(), remotePeerID), entriesCompressionAccepted(false), fileManager(fileManager), incoming(false), active(true), closing(false), openStreams(0), nextChunkStreamID(1), sendingChunkData(false), nbError(0)
 {
    this->initUnactiveTimer();
+   connect(this->socket, &QAbstractSocket::bytesWritten, this, &PeerMessageSocket::sendChunkData);
 }
 
 PeerMessageSocket::~PeerMessageSocket()
 {
+   this->abortChunkStreams("The connection has been deleted");
    L_DEBU(QString("Socket[%1] deleted").arg(this->num));
 }
 
-void PeerMessageSocket::setReadBufferSize(qint64 size)
-{
-   this->socket->setReadBufferSize(size);
-}
-
-qint64 PeerMessageSocket::bytesAvailable() const
+void PeerMessageSocket::send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message)
 {
-   return this->socket->bytesAvailable();
-}
+   if (!this->isListening())
+      return;
 
-qint64 PeerMessageSocket::read(char* data, qint64 maxSize)
-{
-   return this->socket->read(data, maxSize);
-}
+   this->restartUnactiveTimer();
 
-QByteArray PeerMessageSocket::readAll()
-{
-   return this->socket->readAll();
-}
-
-bool PeerMessageSocket::waitForReadyRead(int msecs)
-{
-   return this->socket->waitForReadyRead(msecs);
+   this->MessageSocket::send(type, message);
 }
 
-qint64 PeerMessageSocket::bytesToWrite() const
+/**
+  * Is the socket currently been used?
+  */
+bool PeerMessageSocket::isActive() const
 {
-   return this->socket->bytesToWrite();
+   return this->active;
 }
 
-qint64 PeerMessageSocket::write(const char* data, qint64 maxSize)
+/**
+  * The other streams can be opened as long as the same kind of stream isn't already open.
+  */
+bool PeerMessageSocket::canOpenStream(Stream stream) const
 {
-   return this->socket->write(data, maxSize);
+   return this->isListening() && !this->closing && !(this->openStreams & stream);
 }
 
-qint64 PeerMessageSocket::write(const QByteArray& byteArray)
+/**
+  * Begin a new exchange on this socket, the socket becomes active.
+  */
+void PeerMessageSocket::openStream(Stream stream)
 {
-   return this->socket->write(byteArray);
+   this->setActive();
+   this->openStreams |= stream;
 }
 
-bool PeerMessageSocket::waitForBytesWritten(int msecs)
+/**
+  * Must be called when an exchange is terminated.
+  * The socket becomes idle when there is no more open stream.
+  * @param closeTheSocket The socket is closed once the other streams are finished, no new stream can be opened meanwhile.
+  */
+void PeerMessageSocket::closeStream(Stream stream, bool closeTheSocket)
 {
-   return this->socket->waitForBytesWritten(msecs);
-}
+   if (!(this->openStreams & stream))
+      return;
 
-void PeerMessageSocket::moveToThread(QThread* targetThread)
-{
-   this->socket->moveToThread(targetThread);
-}
+   this->openStreams &= ~stream;
 
-QString PeerMessageSocket::errorString() const
-{
-   return this->socket->errorString();
-}
+   if (closeTheSocket)
+   {
+      L_WARN(QString("Socket[%1] will be closed").arg(this->num));
+      this->closing = true;
+   }
 
-Common::Hash PeerMessageSocket::getRemotePeerID() const
-{
-   return this->MessageSocket::getRemoteID();
+   this->becomeIdleIfNoStream();
 }
 
-void PeerMessageSocket::send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message)
+/**
+  * Any number of chunk streams can share the socket.
+  */
+bool PeerMessageSocket::canOpenChunkStream() const
 {
-   if (!this->isListening())
-      return;
-
-   this->setActive();
-
-   this->MessageSocket::send(type, message);
+   return this->isListening() && !this->closing && !this->incoming;
 }
 
 /**
-  * Is the socket currently been used?
+  * Open a stream to receive the data of a 'GetChunks' request, its ID and window must be put in the request.
   */
-bool PeerMessageSocket::isActive() const
+QSharedPointer<ChunkStream> PeerMessageSocket::openChunkStream()
 {
-   return this->active;
+   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
+   return this->addChunkStream(this->nextChunkStreamID++, 0, SOCKET_BUFFER_SIZE);
 }
 
 /**
-  * Change the status of the socket to active. Automatically called when a message is sent.
+  * A stream has some data to send, the frames are sent in turn with the ones of the other streams.
   */
-void PeerMessageSocket::setActive()
+void PeerMessageSocket::chunkDataToSend(quint32 streamID)
 {
-   this->inactiveTimer.start(); // Some transactions (like GET_HASHES) can go for a long time, we have to restart the timer even for an active connection.
-
-   if (this->active)
+   QSharedPointer<ChunkStream> chunkStream = this->chunkStreams.value(streamID);
+   if (chunkStream.isNull())
       return;
 
-   L_DEBU(QString("Socket[%1] set to active >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>").arg(this->num));
+   if (!this->chunkStreamsToSend.contains(chunkStream))
+      this->chunkStreamsToSend << chunkStream;
 
-   this->active = true;
+   this->sendChunkData();
+}
+
+void PeerMessageSocket::sendChunkWindow(quint32 streamID, quint32 increment)
+{
+   Protos::Core::ChunkWindow chunkWindowMessage;
+   chunkWindowMessage.set_stream_id(streamID);
+   chunkWindowMessage.set_increment(increment);
+   this->send(Common::MessageHeader::CORE_CHUNK_WINDOW, chunkWindowMessage);
 }
 
 /**
-  * Must be called when a transaction is terminated.
+  * Called when a stream is finished or aborted locally.
+  * @param reset The peer is asked to reset its side of the stream.
   */
-void PeerMessageSocket::finished(bool closeTheSocket)
+void PeerMessageSocket::removeChunkStream(quint32 streamID, bool reset)
 {
-   if (!this->active)
+   QSharedPointer<ChunkStream> chunkStream = this->chunkStreams.take(streamID);
+   if (chunkStream.isNull())
       return;
 
-   L_DEBU(QString("Socket[%1] set to idle%2<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<").arg(this->num).arg(closeTheSocket ? " (socket forced to close) " : " "));
+   this->chunkStreamsToSend.removeOne(chunkStream);
 
-   if (closeTheSocket)
+   if (reset)
    {
-      L_WARN("Socket forced to close");
-      this->close();
-      return;
-   }
-   else if (!this->socket->isValid())
-   {
-      L_WARN("Socket non-valid, closed");
-      this->close();
-      return;
+      Protos::Core::ChunkStreamReset chunkStreamResetMessage;
+      chunkStreamResetMessage.set_stream_id(streamID);
+      this->send(Common::MessageHeader::CORE_CHUNK_STREAM_RESET, chunkStreamResetMessage);
    }
 
-   this->socket->flush();
-   this->active = false;
-
-   this->startListening();
-   emit becomeIdle(this);
+   this->becomeIdleIfNoStream();
 }
 
 /**
@@ -187,7 +187,9 @@ void PeerMessageSocket::finished(bool closeTheSocket)
 void PeerMessageSocket::close()
 {
    this->active = false;
+   this->openStreams = 0;
    this->stopListening();
+   this->abortChunkStreams("The connection has been closed");
    emit closed(this);
 }
 
@@ -202,10 +204,25 @@ void PeerMessageSocket::nextAskedHash(Protos::Core::HashResult hash)
    if (--this->nbHash == 0)
    {
       this->currentHashesResult.clear();
-      this->finished();
+      this->closeStream(HASHES);
    }
 }
 
+/**
+  * The version of the roots is derived from their content, the versions of the directories are kept by the file manager.
+  */
+quint64 PeerMessageSocket::getEntriesVersion(const Protos::Common::Entries& entries)
+{
+   const std::string serializedEntries = entries.SerializeAsString();
+   Common::Hasher hasher;
+   hasher.addData(serializedEntries.data(), static_cast<int>(serializedEntries.size()));
+   const Common::Hash hash = hasher.getResult();
+
+   quint64 version;
+   memcpy(&version, hash.getData(), sizeof(version));
+   return version;
+}
+
 void PeerMessageSocket::entriesResult(const Protos::Core::GetEntriesResult::EntryResult& result)
 {
    bool resultEmpty = true;
@@ -260,20 +277,40 @@ void PeerMessageSocket::onNewMessage(const Common::Message& message)
          if (!this->entriesResultsToReceive.isEmpty())
             return;
 
+         this->openStream(ENTRIES);
+
          const Protos::Core::GetEntries& getEntries = message.getMessage<Protos::Core::GetEntries>();
+         this->entriesCompressionAccepted = getEntries.accept_compression();
 
          for (int i = 0; i < getEntries.dirs().entry_size(); i++)
          {
-            QSharedPointer<FM::IGetEntriesResult> result = this->fileManager->getScannedEntries(getEntries.dirs().entry(i), getEntries.nb_max_hashes_per_entry() > 0 ? getEntries.nb_max_hashes_per_entry() : std::numeric_limits<int>::max());
+            QSharedPointer<FM::IGetEntriesResult> result = this->fileManager->getScannedEntries(
+               getEntries.dirs().entry(i),
+               getEntries.nb_max_hashes_per_entry() > 0 ? getEntries.nb_max_hashes_per_entry() : std::numeric_limits<int>::max(),
+               i < getEntries.known_versions_size() ? getEntries.known_versions(i) : 0,
+               getEntries.entries_offset(),
+               getEntries.nb_max_entries()
+            );
             connect(result.data(), &FM::IGetEntriesResult::result, this, &PeerMessageSocket::entriesResult, Qt::DirectConnection);
             connect(result.data(), &FM::IGetEntriesResult::timeout, this, &PeerMessageSocket::entriesResultTimeout, Qt::DirectConnection);
             this->entriesResultsToReceive << result;
             this->entriesResultMessage.add_result();
          }
 
-         // Add the root directories if asked.
+         // Add the root directories if asked, they are never paginated.
          if (getEntries.dirs().entry_size() == 0 || getEntries.get_roots())
-            this->entriesResultMessage.add_result()->mutable_entries()->CopyFrom(this->fileManager->getEntries());
+         {
+            Protos::Core::GetEntriesResult::EntryResult* rootsResult = this->entriesResultMessage.add_result();
+            const int rootsIndex = getEntries.dirs().entry_size();
+            rootsResult->mutable_entries()->CopyFrom(this->fileManager->getEntries());
+            rootsResult->set_version(getEntriesVersion(rootsResult->entries()));
+            rootsResult->set_nb_total_entries(rootsResult->entries().entry_size());
+            if (rootsIndex < getEntries.known_versions_size() && getEntries.known_versions(rootsIndex) == rootsResult->version())
+            {
+               rootsResult->set_status(Protos::Core::GetEntriesResult::EntryResult::NOT_MODIFIED);
+               rootsResult->clear_entries();
+            }
+         }
 
          if (this->entriesResultsToReceive.isEmpty())
             this->sendEntriesResultMessage();
@@ -283,76 +320,119 @@ void PeerMessageSocket::onNewMessage(const Common::Message& message)
       }
       break;
 
-   case Common::MessageHeader::CORE_GET_ENTRIES_RESULT:
-      this->finished();
-      break;
-
    case Common::MessageHeader::CORE_GET_HASHES:
       {
+         if (!this->currentHashesResult.isNull())
+            return;
+
+         this->openStream(HASHES);
+
          const Protos::Core::GetHashes& getHashes = message.getMessage<Protos::Core::GetHashes>();
 
-         this->currentHashesResult = this->fileManager->getHashes(getHashes.file());
+         static const int MAX_NB_NEXT_FILES = SETTINGS.get<quint32>("get_hashes_nb_next_files");
+         QList<Protos::Common::Entry> nextFiles;
+         for (int i = 0; i < getHashes.next_files_size() && i < MAX_NB_NEXT_FILES; i++)
+            nextFiles << getHashes.next_files(i);
+
+         this->currentHashesResult = this->fileManager->getHashes(getHashes.file(), nextFiles, getHashes.send_next_hashes());
          connect(this->currentHashesResult.data(), &FM::IGetHashesResult::nextHash, this, &PeerMessageSocket::nextAskedHash, Qt::QueuedConnection);
          Protos::Core::GetHashesResult res = this->currentHashesResult->start();
-         this->nbHash = res.nb_hash();
+         this->nbHash = res.nb_hash() + res.nb_next_hash();
 
          this->send(Common::MessageHeader::CORE_GET_HASHES_RESULT, res);
 
          if (res.status() != Protos::Core::GetHashesResult_Status_OK)
          {
             this->currentHashesResult.clear();
-            this->finished();
+            this->closeStream(HASHES);
          }
       }
       break;
 
-   case Common::MessageHeader::CORE_GET_HASHES_RESULT:
+   case Common::MessageHeader::CORE_GET_CHUNKS:
       {
-         const Protos::Core::GetHashesResult& getHashesResult = message.getMessage<Protos::Core::GetHashesResult>();
-         this->nbHash = getHashesResult.nb_hash();
-      }
-      break;
+         const Protos::Core::GetChunks& getChunksMessage = message.getMessage<Protos::Core::GetChunks>();
 
-   case Common::MessageHeader::CORE_HASH_RESULT:
-      {
-         if (--this->nbHash == 0)
-            this->finished();
-      }
-      break;
+         // TODO: implements 'GetChunksResult.ALREADY_DOWNLOADING' and 'GetChunksResult.TOO_MANY_CONNECTIONS'.
+         Protos::Core::GetChunksResult result;
+         result.set_stream_id(getChunksMessage.stream_id());
 
-   case Common::MessageHeader::CORE_GET_CHUNK:
-      {
-         const Protos::Core::GetChunk& getChunkMessage = message.getMessage<Protos::Core::GetChunk>();
-
-         const Common::Hash hash(getChunkMessage.chunk().hash());
-         if (hash.isNull())
+         if (!this->incoming || getChunksMessage.chunks_size() == 0 || this->chunkStreams.contains(getChunksMessage.stream_id()))
          {
-            L_WARN("GET_CHUNK: Chunk null");
-            this->finished(true);
+            L_WARN(QString("GET_CHUNKS: Invalid request, number of chunks: %1, stream: %2").arg(getChunksMessage.chunks_size()).arg(getChunksMessage.stream_id()));
+            result.set_status(Protos::Core::GetChunksResult::ERROR_UNKNOWN);
+            this->send(Common::MessageHeader::CORE_GET_CHUNKS_RESULT, result);
             break;
          }
 
-         // TODO: implements 'GetChunkResult.ALREADY_DOWNLOADING', 'GetChunkResult.TOO_MANY_CONNECTIONS' and 'GetChunkResult.DONT_HAVE_DATA_FROM_OFFSET'
-         QSharedPointer<FM::IChunk> chunk = this->fileManager->getChunk(hash);
-         if (chunk.isNull())
-         {
-            Protos::Core::GetChunkResult result;
-            result.set_status(Protos::Core::GetChunkResult::DONT_HAVE);
-            this->send(Common::MessageHeader::CORE_GET_CHUNK_RESULT, result);
-            this->finished();
+         result.set_status(Protos::Core::GetChunksResult::OK);
+         QList<ChunkToSend> chunksToSend;
 
-            L_WARN(QString("GET_CHUNK: Chunk unknown: %1").arg(hash.toStr()));
-         }
-         else
+         for (int i = 0; i < getChunksMessage.chunks_size(); i++)
          {
-            Protos::Core::GetChunkResult result;
-            result.set_status(Protos::Core::GetChunkResult::OK);
-            result.set_chunk_size(chunk->getKnownBytes());
-            this->send(Common::MessageHeader::CORE_GET_CHUNK_RESULT, result);
+            const Protos::Core::GetChunks::Chunk& chunkMessage = getChunksMessage.chunks(i);
+            Protos::Core::GetChunksResult::ChunkResult* chunkResult = result.add_results();
+
+            const Common::Hash hash(chunkMessage.hash().hash());
+            QSharedPointer<FM::IChunk> chunk = hash.isNull() ? QSharedPointer<FM::IChunk>() : this->fileManager->getChunk(hash);
+            if (chunk.isNull())
+            {
+               chunkResult->set_status(Protos::Core::GetChunksResult::ChunkResult::DONT_HAVE);
+               L_WARN(QString("GET_CHUNKS: Chunk unknown: %1").arg(hash.toStr()));
+               continue;
+            }
+
+            const int knownBytes = chunk->getKnownBytes();
+            if (static_cast<int>(chunkMessage.offset()) >= knownBytes)
+            {
+               chunkResult->set_status(Protos::Core::GetChunksResult::ChunkResult::DONT_HAVE_DATA_FROM_OFFSET);
+               continue;
+            }
+
+            chunkResult->set_status(Protos::Core::GetChunksResult::ChunkResult::OK);
+            chunkResult->set_chunk_size(knownBytes);
+            chunksToSend << ChunkToSend { chunk, static_cast<int>(chunkMessage.offset()), knownBytes };
+         }
+
+         // The stream is added before sending the result, thus a reset from the peer can't be missed.
+         QSharedPointer<ChunkStream> chunkStream;
+         if (!chunksToSend.isEmpty())
+            chunkStream = this->addChunkStream(getChunksMessage.stream_id(), getChunksMessage.window_size(), 0);
 
-            this->stopListening();
+         this->send(Common::MessageHeader::CORE_GET_CHUNKS_RESULT, result);
 
-            emit getChunk(chunk, getChunkMessage.offset(), this);
+         if (!chunkStream.isNull())
+            emit getChunks(chunksToSend, chunkStream);
+      }
+      break;
+
+   case Common::MessageHeader::CORE_CHUNK_DATA:
+      {
+         const Protos::Core::ChunkData& chunkDataMessage = message.getMessage<Protos::Core::ChunkData>();
+         QSharedPointer<ChunkStream> chunkStream = this->chunkStreams.value(chunkDataMessage.stream_id());
+         if (!chunkStream.isNull()) // The stream may have been reset by us, the data still in flight is dropped.
+            chunkStream->dataReceived(chunkDataMessage.data());
+      }
+      break;
+
+   case Common::MessageHeader::CORE_CHUNK_WINDOW:
+      {
+         const Protos::Core::ChunkWindow& chunkWindowMessage = message.getMessage<Protos::Core::ChunkWindow>();
+         QSharedPointer<ChunkStream> chunkStream = this->chunkStreams.value(chunkWindowMessage.stream_id());
+         if (!chunkStream.isNull())
+            chunkStream->windowIncreased(chunkWindowMessage.increment());
+      }
+      break;
+
+   case Common::MessageHeader::CORE_CHUNK_STREAM_RESET:
+      {
+         const Protos::Core::ChunkStreamReset& chunkStreamResetMessage = message.getMessage<Protos::Core::ChunkStreamReset>();
+         QSharedPointer<ChunkStream> chunkStream = this->chunkStreams.take(chunkStreamResetMessage.stream_id());
+         if (!chunkStream.isNull())
+         {
+            this->chunkStreamsToSend.removeOne(chunkStream);
+            chunkStream->abort("The stream has been reset by the peer");
+            this->becomeIdleIfNoStream();
          }
       }
       break;
@@ -363,7 +443,7 @@ void PeerMessageSocket::onNewMessage(const Common::Message& message)
 
 void PeerMessageSocket::onNewDataReceived()
 {
-   this->setActive();
+   this->restartUnactiveTimer();
 }
 
 void PeerMessageSocket::onDisconnected()
@@ -379,10 +459,125 @@ void PeerMessageSocket::initUnactiveTimer()
    this->inactiveTimer.start();
 }
 
+/**
+  * Some transactions (like GET_HASHES) can go for a long time, we have to restart the timer even for an active connection.
+  */
+void PeerMessageSocket::restartUnactiveTimer()
+{
+   this->inactiveTimer.start();
+}
+
+void PeerMessageSocket::setActive()
+{
+   this->restartUnactiveTimer();
+
+   if (!this->active)
+      L_DEBU(QString("Socket[%1] set to active >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>").arg(this->num));
+
+   this->active = true;
+}
+
+/**
+  * The socket becomes idle when there is no more open stream, it is closed instead if asked by 'closeStream(..)'.
+  */
+void PeerMessageSocket::becomeIdleIfNoStream()
+{
+   if (!this->active || this->openStreams != 0 || !this->chunkStreams.isEmpty())
+      return;
+
+   L_DEBU(QString("Socket[%1] set to idle%2<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<").arg(this->num).arg(this->closing ? " (socket forced to close) " : " "));
+
+   if (this->closing)
+   {
+      L_WARN("Socket forced to close");
+      this->close();
+      return;
+   }
+   else if (!this->socket->isValid())
+   {
+      L_WARN("Socket non-valid, closed");
+      this->close();
+      return;
+   }
+
+   this->socket->flush();
+   this->active = false;
+
+   emit becomeIdle(this);
+}
+
+QSharedPointer<ChunkStream> PeerMessageSocket::addChunkStream(quint32 streamID, quint32 sendWindow, quint32 receiveWindow)
+{
+   this->setActive();
+
+   // The stream may be released during a signal emitted by itself.
+   QSharedPointer<ChunkStream> chunkStream(new ChunkStream(this, streamID, sendWindow, receiveWindow), &QObject::deleteLater);
+   this->chunkStreams.insert(streamID, chunkStream);
+   return chunkStream;
+}
+
+/**
+  * Send the frames of the streams in turn as long as there is not too much data waiting in the socket.
+  * Called again each time some data is written by the socket, thus the other messages are never queued
+  * behind more than 'MAX_BUFFERED_CHUNK_DATA' bytes of chunk data.
+  */
+void PeerMessageSocket::sendChunkData()
+{
+   if (this->sendingChunkData) // Reentrant call from a 'bytesWritten(..)' signal of a stream.
+      return;
+
+   this->sendingChunkData = true;
+
+   while (!this->chunkStreamsToSend.isEmpty() && this->socket->bytesToWrite() < MAX_BUFFERED_CHUNK_DATA && this->isListening())
+   {
+      QSharedPointer<ChunkStream> chunkStream = this->chunkStreamsToSend.takeFirst();
+      if (!chunkStream->hasDataToSend()) // The window is exhausted, the stream is added again by 'chunkDataToSend(..)'.
+         continue;
+
+      this->chunkDataMessage.set_stream_id(chunkStream->getID());
+      const int frameSize = chunkStream->takeFrame(*this->chunkDataMessage.mutable_data(), CHUNK_DATA_FRAME_SIZE);
+      this->send(Common::MessageHeader::CORE_CHUNK_DATA, this->chunkDataMessage);
+
+      if (chunkStream->hasDataToSend() && !this->chunkStreamsToSend.contains(chunkStream))
+         this->chunkStreamsToSend << chunkStream;
+
+      chunkStream->frameSent(frameSize);
+   }
+
+   this->sendingChunkData = false;
+}
+
+void PeerMessageSocket::abortChunkStreams(const QString& error)
+{
+   const QList<QSharedPointer<ChunkStream>> chunkStreams = this->chunkStreams.values();
+   this->chunkStreams.clear();
+   this->chunkStreamsToSend.clear();
+
+   for (QListIterator<QSharedPointer<ChunkStream>> i(chunkStreams); i.hasNext();)
+      i.next()->abort(error);
+}
+
+/**
+  * The result is compressed if the asker accepts it and if it is big enough.
+  */
 void PeerMessageSocket::sendEntriesResultMessage()
 {
-   this->send(Common::MessageHeader::CORE_GET_ENTRIES_RESULT, this->entriesResultMessage);
+   if (this->entriesCompressionAccepted && this->entriesResultMessage.ByteSizeLong() >= static_cast<size_t>(MIN_SIZE_TO_COMPRESS_ENTRIES))
+   {
+      QByteArray serializedResult(static_cast<int>(this->entriesResultMessage.ByteSizeLong()), Qt::Uninitialized);
+      this->entriesResultMessage.SerializeWithCachedSizesToArray(reinterpret_cast<google::protobuf::uint8*>(serializedResult.data()));
+      const QByteArray compressedResult = qCompress(serializedResult);
+
+      Protos::Core::GetEntriesResult compressedMessage;
+      compressedMessage.set_compressed_result(compressedResult.constData(), compressedResult.size());
+      this->send(Common::MessageHeader::CORE_GET_ENTRIES_RESULT, compressedMessage);
+   }
+   else
+   {
+      this->send(Common::MessageHeader::CORE_GET_ENTRIES_RESULT, this->entriesResultMessage);
+   }
+
    this->entriesResultMessage.Clear();
    this->entriesResultsToReceive.clear();
-   this->finished();
+   this->closeStream(ENTRIES);
 }
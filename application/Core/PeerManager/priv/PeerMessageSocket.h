@@ -23,6 +23,8 @@
 #include <QHostAddress>
 #include <QTimer>
 #include <QQueue>
+#include <QHash>
+#include <QList>
 #include <QSharedPointer>
 
 #include <google/protobuf/message.h>
@@ -35,13 +37,14 @@
 #include <Core/FileManager/IGetEntriesResult.h>
 #include <Core/FileManager/IChunk.h>
 
-#include <ISocket.h>
+#include <ChunkToSend.h>
+#include <priv/ChunkStream.h>
 
 namespace PM
 {
    class PeerManager;
 
-   class PeerMessageSocket : public Common::MessageSocket, public ISocket
+   class PeerMessageSocket : public Common::MessageSocket
    {
       Q_OBJECT
 
@@ -54,39 +57,41 @@ namespace PM
       };
 
    public:
+      /**
+        * The kinds of exchange a socket can carry besides the chunk streams, see 'ChunkStream'.
+        * A socket may have several streams open at the same time but only one of each kind.
+        */
+      enum Stream
+      {
+         ENTRIES = 0x1,
+         HASHES = 0x2
+      };
+
       PeerMessageSocket(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, const Common::Hash& remotePeerID, QTcpSocket* socket);
       PeerMessageSocket(PeerManager* peerManager, QSharedPointer<FM::IFileManager> fileManager, const Common::Hash& remotePeerID, const QHostAddress& address, quint16 port);
       ~PeerMessageSocket();
 
-      void setReadBufferSize(qint64 size);
-
-      qint64 bytesAvailable() const;
-      qint64 read(char* data, qint64 maxSize);
-      QByteArray readAll();
-      bool waitForReadyRead(int msecs);
-
-      qint64 bytesToWrite() const;
-      qint64 write(const char* data, qint64 maxSize);
-      qint64 write(const QByteArray& byteArray);
-      bool waitForBytesWritten(int msecs);
-
-      void moveToThread(QThread* targetThread);
-      QString errorString() const;
-
-      Common::Hash getRemotePeerID() const;
-
       void send(Common::MessageHeader::MessageType type, const google::protobuf::Message& message);
 
       bool isActive() const;
-      void setActive();
 
-      void finished(bool closeTheSocket = false);
+      bool canOpenStream(Stream stream) const;
+      void openStream(Stream stream);
+      void closeStream(Stream stream, bool closeTheSocket = false);
+
+      bool canOpenChunkStream() const;
+      QSharedPointer<ChunkStream> openChunkStream();
+
+      // Called by 'ChunkStream'.
+      void chunkDataToSend(quint32 streamID);
+      void sendChunkWindow(quint32 streamID, quint32 increment);
+      void removeChunkStream(quint32 streamID, bool reset);
 
    public slots:
       void close();
 
    signals:
-      void getChunk(QSharedPointer<FM::IChunk>, int, PeerMessageSocket*);
+      void getChunks(const QList<PM::ChunkToSend>&, const QSharedPointer<PM::ChunkStream>&);
       void becomeIdle(PeerMessageSocket*);
 
       /**
@@ -104,16 +109,35 @@ namespace PM
       void onNewDataReceived();
       void onDisconnected();
       void initUnactiveTimer();
+      void restartUnactiveTimer();
+      void setActive();
+      void becomeIdleIfNoStream();
+
+      QSharedPointer<ChunkStream> addChunkStream(quint32 streamID, quint32 sendWindow, quint32 receiveWindow);
+      void sendChunkData();
+      void abortChunkStreams(const QString& error);
 
       void sendEntriesResultMessage();
+      static quint64 getEntriesVersion(const Protos::Common::Entries& entries);
 
       QList<QSharedPointer<FM::IGetEntriesResult>> entriesResultsToReceive;
       Protos::Core::GetEntriesResult entriesResultMessage;
+      bool entriesCompressionAccepted; // See 'Protos::Core::GetEntries::accept_compression'.
 
       QSharedPointer<FM::IFileManager> fileManager;
 
+      const bool incoming; // Only the peer which has opened the connection can ask for chunks.
+
       bool active;
+      bool closing; // No new stream can be opened, the socket is closed when the current ones are finished.
+      int openStreams; // A combination of 'Stream' flags.
       QTimer inactiveTimer;
+
+      QHash<quint32, QSharedPointer<ChunkStream>> chunkStreams;
+      quint32 nextChunkStreamID;
+      QList<QSharedPointer<ChunkStream>> chunkStreamsToSend; // Round robin between the streams having some data and some window.
+      bool sendingChunkData;
+      Protos::Core::ChunkData chunkDataMessage; // Reused for each frame.
       int nbError;
 
       // Used when asking hashes to the fileManager.
@@ -20,6 +20,7 @@
 using namespace RCM;
 
 #include <limits>
+#include <algorithm>
 
 #include <QCoreApplication>
 #include <QDateTime>
@@ -69,6 +70,7 @@ RemoteConnection::RemoteConnection(
    networkListener(networkListener),
    chatSystem(chatSystem),
    waitForStateResult(false),
+   stateArenaSize(0),
    authenticated(false),
    saltChallenge(0)
  #if DEBUG
@@ -133,11 +135,22 @@ void RemoteConnection::refresh()
    const int downloadRate = this->downloadManager->getDownloadRate();
    const int uploadRate = this->uploadManager->getUploadRate();
 
-   Protos::GUI::State state;
+   // The state and all its sub-messages are allocated in one arena and freed at once.
+   google::protobuf::ArenaOptions arenaOptions;
+   arenaOptions.start_block_size = std::max(arenaOptions.start_block_size, this->stateArenaSize);
+   arenaOptions.max_block_size = std::max(arenaOptions.max_block_size, this->stateArenaSize);
+   google::protobuf::Arena arena(arenaOptions);
+   Protos::GUI::State& state = *google::protobuf::Arena::CreateMessage<Protos::GUI::State>(&arena);
 
    state.set_integrity_check_enabled(SETTINGS.get<bool>("check_received_data_integrity"));
    state.set_password_defined(!SETTINGS.get<Common::Hash>("remote_password").isNull());
 
+   Protos::GUI::BandwidthLimits* bandwidthLimits = state.mutable_bandwidth_limits();
+   bandwidthLimits->set_upload_rate(SETTINGS.get<quint32>("upload_rate_limit"));
+   bandwidthLimits->set_upload_rate_per_peer(SETTINGS.get<quint32>("upload_rate_limit_per_peer"));
+   bandwidthLimits->set_download_rate(SETTINGS.get<quint32>("download_rate_limit"));
+   bandwidthLimits->set_download_rate_per_peer(SETTINGS.get<quint32>("download_rate_limit_per_peer"));
+
    // Ourself
    Protos::GUI::State::Peer* self = state.add_peer();
    self->mutable_peer_id()->set_hash(this->peerManager->getSelf()->getID().getData(), Common::Hash::HASH_SIZE);
@@ -164,6 +177,13 @@ void RemoteConnection::refresh()
       protoPeer->set_download_rate(peer->getDownloadRate());
       protoPeer->set_upload_rate(peer->getUploadRate());
 
+      const PM::PeerStats stats = peer->getStats();
+      protoPeer->set_speed(stats.speed);
+      protoPeer->set_rtt(stats.rtt);
+      protoPeer->set_nb_requests(stats.nbRequests);
+      protoPeer->set_nb_errors(stats.nbErrors);
+      protoPeer->set_nb_timeouts(stats.nbTimeouts);
+
       const auto& peerIP = peer->getIP();
       if (!peerIP.isNull())
          Common::ProtoHelper::setIP(*protoPeer->mutable_ip(), peer->getIP());
@@ -231,6 +251,23 @@ void RemoteConnection::refresh()
    Protos::GUI::State_Stats* stats = state.mutable_stats();
    stats->set_cache_status(static_cast<Protos::GUI::State::Stats::CacheStatus>(this->fileManager->getCacheStatus())); // Warning: IFileManager::CacheStatus and Protos::GUI::State_Stats_CacheStatus must be compatible.
    stats->set_progress(this->fileManager->getProgress());
+   const FM::IFileManager::CacheQueuesStats cacheQueuesStats = this->fileManager->getCacheQueuesStats();
+   stats->set_nb_entries_to_scan(cacheQueuesStats.nbEntriesToScan);
+   stats->set_nb_files_to_hash(cacheQueuesStats.nbFilesToHash + cacheQueuesStats.nbPrioritizedFilesToHash);
+   stats->set_nb_prioritized_files_to_hash(cacheQueuesStats.nbPrioritizedFilesToHash);
+   stats->set_scanning_wait_time(cacheQueuesStats.oldestEntryToScanWaitTime);
+   stats->set_hashing_wait_time(cacheQueuesStats.oldestFileToHashWaitTime);
+   stats->set_average_time_to_first_hash(cacheQueuesStats.averageTimeToFirstHash);
+   stats->set_max_time_to_first_hash(cacheQueuesStats.maxTimeToFirstHash);
+   const NL::INetworkListener::UDPStats udpStats = this->networkListener->getUDPStats();
+   stats->set_nb_datagrams_received(udpStats.nbDatagramsReceived);
+   stats->set_nb_datagrams_dropped(udpStats.nbDatagramsDropped);
+   stats->set_nb_datagrams_rejected(udpStats.nbDatagramsRejected);
+   stats->set_nb_datagrams_not_sent(udpStats.nbDatagramsNotSent);
+   for (QListIterator<quint32> i(udpStats.handlingLatency); i.hasNext();)
+      stats->add_udp_handling_latency(i.next());
+   for (QListIterator<quint32> i(udpStats.handOffLatency); i.hasNext();)
+      stats->add_udp_hand_off_latency(i.next());
    stats->set_download_rate(downloadRate);
    stats->set_upload_rate(uploadRate);
 
@@ -281,6 +318,8 @@ void RemoteConnection::refresh()
 
    this->waitForStateResult = true;
    this->send(Common::MessageHeader::GUI_STATE, state);
+
+   this->stateArenaSize = arena.SpaceUsed();
 }
 
 void RemoteConnection::closeSocket()
@@ -302,12 +341,17 @@ void RemoteConnection::getEntriesResult(const Protos::Core::GetEntriesResult& en
 {
    PM::IGetEntriesResult* getEntriesResult = static_cast<PM::IGetEntriesResult*>(this->sender());
 
-   Protos::GUI::BrowseResult result;
+   google::protobuf::Arena arena;
+   Protos::GUI::BrowseResult& result = *google::protobuf::Arena::CreateMessage<Protos::GUI::BrowseResult>(&arena);
    for (int i = 0; i < entries.result_size(); i++)
    {
+      const Protos::Core::GetEntriesResult::EntryResult& entryResult = entries.result(i);
       Protos::Common::Entries* entriesResult = result.add_entries();
-      if (entries.result(i).has_entries())
-         entriesResult->CopyFrom(entries.result(i).entries());
+      if (entryResult.has_entries())
+         entriesResult->CopyFrom(entryResult.entries());
+      result.add_versions(entryResult.version());
+      result.add_not_modified(entryResult.status() == Protos::Core::GetEntriesResult::EntryResult::NOT_MODIFIED);
+      result.add_nb_total_entries(entryResult.nb_total_entries());
    }
 
    result.set_tag(getEntriesResult->property("tag").toULongLong());
@@ -484,6 +528,17 @@ void RemoteConnection::onNewMessage(const Common::Message& message)
          if (coreSettingsMessage.enable_integrity_check() != Protos::Common::TS_NO_CHANGE)
             SETTINGS.set("check_received_data_integrity", coreSettingsMessage.enable_integrity_check() == Protos::Common::TriState::TS_TRUE);
 
+         if (coreSettingsMessage.has_bandwidth_limits())
+         {
+            const Protos::GUI::BandwidthLimits& bandwidthLimits = coreSettingsMessage.bandwidth_limits();
+            SETTINGS.set("upload_rate_limit", bandwidthLimits.upload_rate());
+            SETTINGS.set("upload_rate_limit_per_peer", bandwidthLimits.upload_rate_per_peer());
+            SETTINGS.set("download_rate_limit", bandwidthLimits.download_rate());
+            SETTINGS.set("download_rate_limit_per_peer", bandwidthLimits.download_rate_per_peer());
+            this->uploadManager->setRateLimits(bandwidthLimits.upload_rate(), bandwidthLimits.upload_rate_per_peer());
+            this->downloadManager->setRateLimits(bandwidthLimits.download_rate(), bandwidthLimits.download_rate_per_peer());
+         }
+
          try
          {
             QStringList sharedPaths;
@@ -588,6 +643,9 @@ void RemoteConnection::onNewMessage(const Common::Message& message)
             getEntries.mutable_dirs()->CopyFrom(browseMessage.dirs());
             getEntries.set_get_roots(browseMessage.get_roots());
             getEntries.set_nb_max_hashes_per_entry(Common::Constants::MAX_NB_HASHES_PER_ENTRY_GUI_BROWSE);
+            getEntries.mutable_known_versions()->CopyFrom(browseMessage.known_versions());
+            getEntries.set_entries_offset(browseMessage.entries_offset());
+            getEntries.set_nb_max_entries(browseMessage.nb_max_entries());
             QSharedPointer<PM::IGetEntriesResult> entries = peer->getEntries(getEntries);
             if (entries.isNull())
             {
@@ -605,7 +663,8 @@ void RemoteConnection::onNewMessage(const Common::Message& message)
          }
          else
          {
-            Protos::GUI::BrowseResult result;
+            google::protobuf::Arena arena;
+            Protos::GUI::BrowseResult& result = *google::protobuf::Arena::CreateMessage<Protos::GUI::BrowseResult>(&arena);
 
             // If we want to browse our files.
             if (peerID == this->peerManager->getSelf()->getID())
@@ -616,6 +675,14 @@ void RemoteConnection::onNewMessage(const Common::Message& message)
                // Add the root directories if asked. Populate shared dirs with their base path.
                if (browseMessage.dirs().entry_size() == 0 || browseMessage.get_roots())
                   result.add_entries()->CopyFrom(this->fileManager->getEntries());
+
+               // Our own entries are never versioned nor paginated.
+               for (int i = 0; i < result.entries_size(); i++)
+               {
+                  result.add_versions(0);
+                  result.add_not_modified(false);
+                  result.add_nb_total_entries(result.entries(i).entry_size());
+               }
             }
 
             result.set_tag(tag);
@@ -26,6 +26,7 @@
 #include <QLocale>
 
 #include <google/protobuf/message.h>
+#include <google/protobuf/arena.h>
 
 #include <Protos/gui_protocol.pb.h>
 #include <Protos/common.pb.h>
@@ -119,6 +120,7 @@ namespace RCM
       QTimer sendLogMessagesTimer;
 
       bool waitForStateResult; // To avoid to send refresh messages when we are already waiting an acknowledgment for a refresh message.
+      size_t stateArenaSize; // The memory used by the last state, the next one is allocated in a single block of this size.
 
       QTimer timerRefresh;
       QTimer timerCloseSocket;
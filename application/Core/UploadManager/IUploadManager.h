@@ -34,5 +34,10 @@ namespace UM
         * @return Byte/s.
         */
       virtual int getUploadRate() = 0;
+
+      /**
+        * Limit the upload rate, the rates are in byte/s. 0 means no limit.
+        */
+      virtual void setRateLimits(quint32 rate, quint32 ratePerPeer) = 0;
    };
 }
@@ -26,23 +26,37 @@ using namespace UM;
 #include <priv/Log.h>
 
 /**
-  * Un chunk uploader will write a given chunk to a given socket.
-  * This operation is threaded and must be run by a 'Common::ThreadPool'.
+  * Un chunk uploader will write the given chunks to a given socket, back-to-back in the asked order.
+  * The transfer is driven by the event loop of the socket thread: the socket is never moved to another thread
+  * and no thread is blocked waiting the socket. Only the reading of each block from the disk is done by a thread of
+  * the given 'Common::ThreadPool', see 'run()'.
+  * The rate is limited by the 'Common::BandwidthLimiter' shared by all the uploads.
   */
 
 quint64 ChunkUploader::currentID(1);
 
-ChunkUploader::ChunkUploader(const QSharedPointer<FM::IChunk>& chunk, int offset, const QSharedPointer<PM::ISocket>& socket, Common::TransferRateCalculator& transferRateCalculator) :
+ChunkUploader::ChunkUploader(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ISocket>& socket, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool) :
    Common::Timeoutable(SETTINGS.get<quint32>("upload_lifetime")),
-   mainThread(QThread::currentThread()),
    ID(currentID++),
-   chunk(chunk),
-   offset(offset),
+   chunks(chunks),
+   current(0),
+   chunk(chunks.first().chunk),
+   offset(chunks.first().offset),
    socket(socket),
    transferRateCalculator(transferRateCalculator),
+   bandwidthLimiter(bandwidthLimiter),
+   limiterPeer(nullptr),
+   threadPool(threadPool),
+   bytesRead(0),
+   reading(false),
+   waitingForSocket(false),
    closeTheSocket(false),
-   toStop(false)
+   toStop(false),
+   ended(false)
 {
+   this->socketTimer.setSingleShot(true);
+   this->socketTimer.setInterval(SETTINGS.get<quint32>("socket_timeout"));
+   connect(&this->socketTimer, &QTimer::timeout, this, &ChunkUploader::socketTimeout);
 }
 
 ChunkUploader::~ChunkUploader()
@@ -63,8 +77,6 @@ Common::Hash ChunkUploader::getPeerID() const
 
 int ChunkUploader::getProgress() const
 {
-   QMutexLocker locker(&this->mutex);
-
    const int chunkSize = this->chunk->getChunkSize();
    if (chunkSize != 0)
       return 10000LL * this->offset / chunkSize;
@@ -77,101 +89,195 @@ QSharedPointer<FM::IChunk> ChunkUploader::getChunk() const
    return this->chunk;
 }
 
-void ChunkUploader::init(QThread* thread)
+void ChunkUploader::start()
+{
+   static const quint32 BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_reading");
+
+   L_DEBU(QString("Starting uploading a chunk from offset %1: %2").arg(this->offset).arg(this->chunk->toStringLog()));
+
+   this->buffer.resize(BUFFER_SIZE);
+   this->limiterPeer = this->bandwidthLimiter.transferStarted(this->socket->getRemotePeerID());
+   connect(this->socket->getDevice(), &QIODevice::bytesWritten, this, &ChunkUploader::bytesWritten);
+   this->readNextBlock();
+}
+
+/**
+  * Stop the current upload. It returns immediately.
+  * Do nothing if there is no current upload.
+  * If a block is being read the upload is ended when the reading is finished.
+  */
+void ChunkUploader::stop()
+{
+   if (this->ended)
+      return;
+
+   this->toStop = true;
+   this->closeTheSocket = true; // The remote peer is still waiting the rest of the data.
+
+   if (!this->reading)
+      this->end();
+}
+
+void ChunkUploader::init(QThread*)
 {
-  this->socket->moveToThread(thread);
 }
 
 /**
   * Called by the thread pool ('Common::ThreadPool') in another thread.
+  * Read the next block of the current chunk.
   */
 void ChunkUploader::run()
 {
-   L_DEBU(QString("Starting uploading a chunk from offset %1: %2").arg(this->offset).arg(this->chunk->toStringLog()));
-
-   static const quint32 BUFFER_SIZE = SETTINGS.get<quint32>("buffer_size_reading");
-   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
-   static const quint32 SOCKET_TIMEOUT = SETTINGS.get<quint32>("socket_timeout");
+   this->bytesRead = -1;
 
    try
    {
-      QSharedPointer<FM::IDataReader> reader = this->chunk->getDataReader();
+      if (this->reader.isNull())
+         this->reader = this->chunk->getDataReader();
 
-      char buffer[BUFFER_SIZE];
-      int bytesRead = 0;
-
-      while (bytesRead = reader->read(buffer, this->offset))
-      {
-         const int bytesSent = this->socket->write(buffer, bytesRead);
-
-         if (bytesSent == -1)
-         {
-            L_WARN(QString("Socket: cannot send data: %1").arg(this->chunk->toStringLog()));
-            this->closeTheSocket = true;
-            goto end;
-         }
-
-         this->mutex.lock();
-         if (this->toStop)
-         {
-            this->mutex.unlock();
-            goto end;
-         }
-         this->offset += bytesSent;
-         this->mutex.unlock();
-
-         while (socket->bytesToWrite() > SOCKET_BUFFER_SIZE)
-         {
-            if (!socket->waitForBytesWritten(SOCKET_TIMEOUT))
-            {
-               L_WARN(QString("Socket: cannot write data, error: \"%1\", chunk: %2").arg(socket->errorString()).arg(this->chunk->toStringLog()));
-               this->closeTheSocket = true;
-               goto end;
-            }
-         }
-
-         this->transferRateCalculator.addData(bytesSent);
-      }
+      this->bytesRead = qMin(this->reader->read(this->buffer.data(), this->offset), this->chunks[this->current].end - this->offset);
    }
    catch (FM::UnableToOpenFileInReadModeException&)
    {
       L_WARN("UnableToOpenFileInReadModeException");
-      this->closeTheSocket = true;
    }
    catch (FM::IOErrorException&)
    {
       L_WARN("IOErrorException");
-      this->closeTheSocket = true;
    }
    catch (FM::ChunkDeletedException)
    {
       L_WARN("ChunkDeletedException");
-      this->closeTheSocket = true;
    }
    catch (FM::ChunkDataUnknownException)
    {
       L_WARN("ChunkDataUnknownException");
+   }
+}
+
+/**
+  * Called in the main thread when a block has been read.
+  */
+void ChunkUploader::finished()
+{
+   this->reading = false;
+
+   if (this->toStop)
+   {
+      this->end();
+      return;
+   }
+
+   if (this->bytesRead <= 0)
+   {
+      L_WARN(QString("Unable to read the announced data: %1").arg(this->chunk->toStringLog()));
       this->closeTheSocket = true;
+      this->end();
+      return;
    }
 
-end:
-   this->socket->moveToThread(this->mainThread);
+   if (const int delay = this->bandwidthLimiter.reserve(this->limiterPeer, this->bytesRead))
+      QTimer::singleShot(delay, this, SLOT(writeBlock()));
+   else
+      this->writeBlock();
 }
 
-void ChunkUploader::finished()
+void ChunkUploader::writeBlock()
 {
-   this->socket->finished(this->closeTheSocket);
-   this->startTimer();
+   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
+
+   if (this->ended)
+      return;
+
+   const qint64 bytesSent = this->socket->write(this->buffer.constData(), this->bytesRead);
+   if (bytesSent == -1)
+   {
+      L_WARN(QString("Socket: cannot send data: %1").arg(this->chunk->toStringLog()));
+      this->closeTheSocket = true;
+      this->end();
+      return;
+   }
+
+   this->offset += bytesSent;
+   this->transferRateCalculator.addData(bytesSent);
+
+   // The next block is read only when the socket buffer is drained enough, see 'bytesWritten()'.
+   if (this->socket->bytesToWrite() > SOCKET_BUFFER_SIZE)
+   {
+      this->waitingForSocket = true;
+      this->socketTimer.start();
+   }
+   else
+   {
+      this->readNextBlock();
+   }
+}
+
+void ChunkUploader::bytesWritten()
+{
+   static const quint32 SOCKET_BUFFER_SIZE = SETTINGS.get<quint32>("socket_buffer_size");
+
+   if (!this->waitingForSocket)
+      return;
+
+   if (this->socket->bytesToWrite() > SOCKET_BUFFER_SIZE)
+   {
+      this->socketTimer.start();
+      return;
+   }
+
+   this->waitingForSocket = false;
+   this->socketTimer.stop();
+   this->readNextBlock();
+}
+
+void ChunkUploader::socketTimeout()
+{
+   L_WARN(QString("Socket: cannot write data, error: \"%1\", chunk: %2").arg(this->socket->errorString()).arg(this->chunk->toStringLog()));
+   this->closeTheSocket = true;
+   this->end();
 }
 
 /**
-  * Stop the current upload. It returns immediately.
-  * Do nothing if there is no current upload.
-  * See 'Upload::upload()'.
+  * Ask the thread pool to read the next block, go to the next chunk if the current one is entirely sent.
+  * Exactly the announced size of each chunk must be sent.
   */
-void ChunkUploader::stop()
+void ChunkUploader::readNextBlock()
 {
-   this->mutex.lock();
-   this->toStop = true;
-   this->mutex.unlock();
+   if (this->offset >= this->chunks[this->current].end)
+   {
+      if (++this->current >= this->chunks.size())
+      {
+         this->end();
+         return;
+      }
+
+      this->chunk = this->chunks[this->current].chunk;
+      this->offset = this->chunks[this->current].offset;
+      this->reader.clear();
+
+      L_DEBU(QString("Starting uploading a chunk from offset %1: %2").arg(this->offset).arg(this->chunk->toStringLog()));
+   }
+
+   this->reading = true;
+   this->threadPool.run(this->getWeakRef());
+}
+
+void ChunkUploader::end()
+{
+   if (this->ended)
+      return;
+
+   this->ended = true;
+   this->waitingForSocket = false;
+   this->socketTimer.stop();
+
+   if (this->limiterPeer)
+   {
+      disconnect(this->socket->getDevice(), &QIODevice::bytesWritten, this, &ChunkUploader::bytesWritten);
+      this->bandwidthLimiter.transferFinished(this->limiterPeer);
+   }
+
+   this->socket->finished(this->closeTheSocket);
+   this->startTimer();
 }
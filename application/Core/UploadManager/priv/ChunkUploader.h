@@ -18,27 +18,33 @@
   
 #pragma once
 
-#include <QMutex>
 #include <QThread>
+#include <QTimer>
+#include <QByteArray>
 
 #include <Common/Timeoutable.h>
 #include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
+#include <Common/ThreadPool.h>
 #include <Common/IRunnable.h>
+#include <Common/SelfWeakPointer.h>
 #include <Core/FileManager/Exceptions.h>
 #include <Core/FileManager/IChunk.h>
 #include <Core/FileManager/IDataReader.h>
 #include <Core/PeerManager/ISocket.h>
+#include <Core/PeerManager/ChunkToSend.h>
 
 #include <IChunkUploader.h>
 
 namespace UM
 {
-   class ChunkUploader : public Common::IRunnable, public IChunkUploader, public Common::Timeoutable
+   class ChunkUploader : public Common::Timeoutable, public Common::SelfWeakPointer<ChunkUploader>, public Common::IRunnable, public IChunkUploader
    {
+      Q_OBJECT
       static quint64 currentID; ///< Used to generate the new upload ID.
 
    public:
-      ChunkUploader(const QSharedPointer<FM::IChunk>& chunk, int offset, const QSharedPointer<PM::ISocket>& socket, Common::TransferRateCalculator& transferRateCalculator);
+      ChunkUploader(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ISocket>& socket, Common::TransferRateCalculator& transferRateCalculator, Common::BandwidthLimiter& bandwidthLimiter, Common::ThreadPool& threadPool);
       ~ChunkUploader();
 
       quint64 getID() const;
@@ -46,24 +52,44 @@ namespace UM
       int getProgress() const;
       QSharedPointer<FM::IChunk> getChunk() const;
 
+      void start();
+      void stop();
+
       void init(QThread* thread);
       void run();
       void finished();
-      void stop();
 
-   private:
-      mutable QMutex mutex;
+   private slots:
+      void writeBlock();
+      void bytesWritten();
+      void socketTimeout();
 
-      QThread* mainThread;
+   private:
+      void readNextBlock();
+      void end();
 
       const quint64 ID; ///< Each uploader has an ID to identified it.
-      QSharedPointer<FM::IChunk> chunk; ///< The chunk uploaded.
+      const QList<PM::ChunkToSend> chunks; ///< The chunks to upload one after the other.
+      int current; ///< The index of the chunk being uploaded in 'chunks'.
+      QSharedPointer<FM::IChunk> chunk; ///< The chunk being uploaded.
       int offset; ///< The current offset into the chunk.
       QSharedPointer<PM::ISocket> socket;
 
       Common::TransferRateCalculator& transferRateCalculator;
+      Common::BandwidthLimiter& bandwidthLimiter;
+      Common::BandwidthLimiter::Peer* limiterPeer;
+      Common::ThreadPool& threadPool;
+
+      QSharedPointer<FM::IDataReader> reader; ///< Only used by the thread reading the data.
+      QByteArray buffer; ///< The last block read from the chunk.
+      int bytesRead;
+
+      QTimer socketTimer; ///< Started while waiting the socket buffer to be written.
 
+      bool reading; ///< A block is being read by a thread of the pool.
+      bool waitingForSocket;
       bool closeTheSocket;
       bool toStop;
+      bool ended;
    };
 }
@@ -33,10 +33,10 @@ using namespace UM;
 /**
   * @class UM::UploaderManager
   *
-  * Will listen the signal 'getChunk' of the peerManager, when this signal is received an Uploader is created and data is sent to the peer.
-  * After the chunk was sent to the peer the Uploader is deleted.
+  * Will listen the signal 'getChunks' of the peerManager, when this signal is received an Uploader is created and data is sent to the peer.
+  * After the chunks were sent to the peer the Uploader is deleted.
   *
-  * We cannot use a QThreadPool object instead of the class 'Uploader' because we have to use the method 'PM::ISocket::moveToThread' when using a socket in a thread. This isn't possible with the 'QRunnable' class.
+  * The uploads are driven by the event loop, the thread pool is only used to read the data from the disk.
   */
 
 LOG_INIT_CPP(UploadManager)
@@ -44,8 +44,9 @@ LOG_INIT_CPP(UploadManager)
 UploadManager::UploadManager(QSharedPointer<PM::IPeerManager> peerManager) :
    peerManager(peerManager), threadPool(static_cast<int>(SETTINGS.get<quint32>("upload_min_nb_thread")), SETTINGS.get<quint32>("upload_thread_lifetime"))
 {
-   this->threadPool.setStackSize(MIN_UPLOAD_THREAD_STACK_SIZE + SETTINGS.get<quint32>("buffer_size_reading"));
-   connect(this->peerManager.data(), SIGNAL(getChunk(QSharedPointer<FM::IChunk>, int, QSharedPointer<PM::ISocket>)), this, SLOT(getChunk(QSharedPointer<FM::IChunk>, int, QSharedPointer<PM::ISocket>)), Qt::DirectConnection);
+   this->threadPool.setStackSize(MIN_UPLOAD_THREAD_STACK_SIZE);
+   this->bandwidthLimiter.setLimits(SETTINGS.get<quint32>("upload_rate_limit"), SETTINGS.get<quint32>("upload_rate_limit_per_peer"));
+   connect(this->peerManager.data(), SIGNAL(getChunks(QList<PM::ChunkToSend>, QSharedPointer<PM::ISocket>)), this, SLOT(getChunks(QList<PM::ChunkToSend>, QSharedPointer<PM::ISocket>)), Qt::DirectConnection);
 }
 
 UploadManager::~UploadManager()
@@ -72,12 +73,17 @@ int UploadManager::getUploadRate()
    return this->transferRateCalculator.getTransferRate();
 }
 
-void UploadManager::getChunk(const QSharedPointer<FM::IChunk>& chunk, int offset, const QSharedPointer<PM::ISocket>& socket)
+void UploadManager::setRateLimits(quint32 rate, quint32 ratePerPeer)
 {
-   QSharedPointer<ChunkUploader> upload(new ChunkUploader(chunk, offset, socket, this->transferRateCalculator));
+   this->bandwidthLimiter.setLimits(rate, ratePerPeer);
+}
+
+void UploadManager::getChunks(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ISocket>& socket)
+{
+   QSharedPointer<ChunkUploader> upload = (new ChunkUploader(chunks, socket, this->transferRateCalculator, this->bandwidthLimiter, this->threadPool))->grabStrongRef();
    connect(upload.data(), SIGNAL(timeout()), this, SLOT(uploadTimeout()));
    this->uploads << upload;
-   this->threadPool.run(upload.toWeakRef());
+   upload->start();
 }
 
 void UploadManager::uploadTimeout()
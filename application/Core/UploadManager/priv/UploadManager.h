@@ -25,6 +25,7 @@
 #include <Common/Hash.h>
 #include <Common/ThreadPool.h>
 #include <Common/TransferRateCalculator.h>
+#include <Common/BandwidthLimiter.h>
 #include <Core/PeerManager/IPeerManager.h>
 
 #include <IUploadManager.h>
@@ -44,9 +45,10 @@ namespace UM
       QList<IChunkUploader*> getChunkUploaders() const;
 
       int getUploadRate();
+      void setRateLimits(quint32 rate, quint32 ratePerPeer);
 
    private slots:
-      void getChunk(const QSharedPointer<FM::IChunk>& chunk, int offset, const QSharedPointer<PM::ISocket>& socket);
+      void getChunks(const QList<PM::ChunkToSend>& chunks, const QSharedPointer<PM::ISocket>& socket);
       void uploadTimeout();
 
    private:
@@ -55,6 +57,7 @@ namespace UM
       static const quint32 MIN_UPLOAD_THREAD_STACK_SIZE;
 
       Common::TransferRateCalculator transferRateCalculator;
+      Common::BandwidthLimiter bandwidthLimiter;
 
       QSharedPointer<PM::IPeerManager> peerManager;
 
@@ -25,12 +25,14 @@ using namespace GUI;
 
 #include <Common/Global.h>
 
+#include <Constants.h>
 #include <Log.h>
 
 /**
   * @class GUI::BrowseModel
   *
   * The model of a distant peer file system. The directory content is lazy loaded, see the method 'loadChildren()'.
+  * A directory is loaded by pages of 'Constants::NB_MAX_ENTRIES_PER_BROWSE_PAGE' entries.
   * Used by 'WidgetBrowse'.
   */
 
@@ -184,18 +186,23 @@ void BrowseModel::refresh()
       return;
 
    Protos::Common::Entries entries;
+   QList<quint64> knownVersions; // The unchanged directories will be returned empty.
 
    this->root->mapReverseDepthFirst(
-      [&entries](Tree* tree)
+      [&entries, &knownVersions](Tree* tree)
       {
          if (tree->getNbChildren() > 0)
+         {
             entries.add_entry()->CopyFrom(tree->getItem());
+            knownVersions << tree->getVersion();
+         }
          return true;
       }
    );
+   knownVersions << this->root->getVersion();
 
-   this->browseResult = this->coreConnection->browse(this->peerID, entries, true);
-   connect(this->browseResult.data(), SIGNAL(result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>&)), this, SLOT(resultRefresh(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>&)));
+   this->browseResult = this->coreConnection->browse(this->peerID, entries, true, knownVersions);
+   connect(this->browseResult.data(), SIGNAL(result(const Protos::GUI::BrowseResult&)), this, SLOT(resultRefresh(const Protos::GUI::BrowseResult&)));
    connect(this->browseResult.data(), SIGNAL(timeout()), this, SLOT(resultTimeout()));
    this->browseResult->start();
 }
@@ -224,28 +231,38 @@ int BrowseModel::nbSharedDirs() const
    return this->sharedEntryListModel.getSharedDirectories().size();
 }
 
-void BrowseModel::resultRefresh(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>& entries)
+void BrowseModel::resultRefresh(const Protos::GUI::BrowseResult& browseResult)
 {
+   const google::protobuf::RepeatedPtrField<Protos::Common::Entries>& entries = browseResult.entries();
+
    if (entries.size() == 0)
    {
       this->reset();
    }
    else
    {
-      // Synchronize the content of all directories.
+      // Synchronize the content of all modified directories.
       int j = -1;
       this->root->mapReverseDepthFirst([&](Tree* tree) {
          if (tree->getNbChildren() > 0)
          {
             if (++j >= entries.size() - 1)
                return false;
+            if (j < browseResult.not_modified_size() && browseResult.not_modified(j))
+               return true;
             this->synchronize(tree, entries.Get(j));
+            tree->setVersion(j < browseResult.versions_size() ? browseResult.versions(j) : 0);
          }
          return true;
       });
 
       // Synchronize the root.
-      this->synchronizeRoot(entries.Get(entries.size() - 1));
+      const int rootsIndex = entries.size() - 1;
+      if (rootsIndex >= browseResult.not_modified_size() || !browseResult.not_modified(rootsIndex))
+      {
+         this->synchronizeRoot(entries.Get(rootsIndex));
+         this->root->setVersion(rootsIndex < browseResult.versions_size() ? browseResult.versions(rootsIndex) : 0);
+      }
    }
 
    this->browseResult.clear();
@@ -253,21 +270,33 @@ void BrowseModel::resultRefresh(const google::protobuf::RepeatedPtrField<Protos:
    emit loadingResultFinished();
 }
 
-void BrowseModel::result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>& entries)
+/**
+  * The entries are appended to the current browsed directory, the next page is asked if some entries are missing.
+  */
+void BrowseModel::result(const Protos::GUI::BrowseResult& browseResult)
 {
-   if (entries.size() > 0 && entries.Get(0).entry_size() > 0)
+   if (browseResult.entries_size() > 0)
    {
-      this->beginInsertRows(this->currentBrowseIndex, 0, entries.Get(0).entry_size() - 1);
+      Tree* tree = this->currentBrowseIndex.internalPointer() ? static_cast<Tree*>(this->currentBrowseIndex.internalPointer()) : this->root;
+      const Protos::Common::Entries& entries = browseResult.entries(0);
+      const int nbChildren = tree->getNbChildren();
+      const quint64 version = browseResult.versions_size() > 0 ? browseResult.versions(0) : 0;
 
-      if (this->currentBrowseIndex.internalPointer())
+      if (entries.entry_size() > 0)
       {
-         Tree* tree = static_cast<Tree*>(this->currentBrowseIndex.internalPointer());
-         tree->insertChildren(entries.Get(0));
+         this->beginInsertRows(this->currentBrowseIndex, nbChildren, nbChildren + entries.entry_size() - 1);
+         tree->insertChildren(entries);
+         this->endInsertRows();
       }
-      else
-         this->root->insertChildren(entries.Get(0));
 
-      this->endInsertRows();
+      // If the directory has changed between two pages the next refresh will synchronize it entirely.
+      tree->setVersion(nbChildren == 0 || tree->getVersion() == version ? version : 0);
+
+      if (tree != this->root && entries.entry_size() > 0 && browseResult.nb_total_entries_size() > 0 && static_cast<quint32>(tree->getNbChildren()) < browseResult.nb_total_entries(0))
+      {
+         this->browse(tree);
+         return;
+      }
    }
 
    this->currentBrowseIndex = QModelIndex();
@@ -282,10 +311,15 @@ void BrowseModel::resultTimeout()
    emit loadingResultFinished();
 }
 
+/**
+  * Ask the roots if 'tree' is null else the next page of its entries.
+  */
 void BrowseModel::browse(Tree* tree)
 {
-   this->browseResult = tree ? this->coreConnection->browse(this->peerID, tree->getItem()) : this->coreConnection->browse(this->peerID);
-   connect(this->browseResult.data(), SIGNAL(result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>&)), this, SLOT(result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>&)));
+   this->browseResult = tree ?
+      this->coreConnection->browse(this->peerID, tree->getItem(), tree->getNbChildren(), Constants::NB_MAX_ENTRIES_PER_BROWSE_PAGE) :
+      this->coreConnection->browse(this->peerID);
+   connect(this->browseResult.data(), SIGNAL(result(const Protos::GUI::BrowseResult&)), this, SLOT(result(const Protos::GUI::BrowseResult&)));
    connect(this->browseResult.data(), SIGNAL(timeout()), this, SLOT(resultTimeout()));
    this->browseResult->start();
 }
@@ -398,13 +432,14 @@ void BrowseModel::reset()
   * Either a file or a directory in the tree view structure.
   */
 
-BrowseModel::Tree::Tree()
+BrowseModel::Tree::Tree() :
+   version(0)
 {
    this->getItem().set_type(Protos::Common::Entry_Type_DIR);
 }
 
 BrowseModel::Tree::Tree(const Protos::Common::Entry& entry, Tree* parent) :
-   Common::Tree<Protos::Common::Entry, BrowseModel::Tree>(entry, parent)
+   Common::Tree<Protos::Common::Entry, BrowseModel::Tree>(entry, parent), version(0)
 {
    this->copySharedDirFromParent();
    if (this->getItem().shared_entry().shared_name().size() == 0)
@@ -447,6 +482,16 @@ QVariant BrowseModel::Tree::data(int column) const
    }
 }
 
+quint64 BrowseModel::Tree::getVersion() const
+{
+   return this->version;
+}
+
+void BrowseModel::Tree::setVersion(quint64 version)
+{
+   this->version = version;
+}
+
 void BrowseModel::Tree::copySharedDirFromParent()
 {
    // Copy the shared directory ID from the parent.
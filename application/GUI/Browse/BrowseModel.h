@@ -68,8 +68,8 @@ namespace GUI
       void loadingResultFinished();
 
    protected slots:
-      virtual void resultRefresh(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>& entries);
-      virtual void result(const google::protobuf::RepeatedPtrField<Protos::Common::Entries>& entries);
+      virtual void resultRefresh(const Protos::GUI::BrowseResult& browseResult);
+      virtual void result(const Protos::GUI::BrowseResult& browseResult);
       virtual void resultTimeout();
 
    protected:
@@ -91,8 +91,13 @@ namespace GUI
          virtual bool hasUnloadedChildren() const;
          virtual QVariant data(int column) const;
 
+         quint64 getVersion() const;
+         void setVersion(quint64 version);
+
       protected:
          virtual void copySharedDirFromParent();
+
+         quint64 version; // The version of the children given by the remote peer, 0 if unknown.
       };
 
       QSharedPointer<RCC::ICoreConnection> coreConnection;
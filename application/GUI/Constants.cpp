@@ -21,3 +21,5 @@ using namespace GUI;
 
 const QString Constants::EMOTICONS_DIRECTORY("emoticons");
 const QString Constants::DEFAULT_EMOTICON_THEME("Default");
+
+const quint32 Constants::NB_MAX_ENTRIES_PER_BROWSE_PAGE = 500;
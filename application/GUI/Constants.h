@@ -27,5 +27,7 @@ namespace GUI
    public:
       static const QString EMOTICONS_DIRECTORY;
       static const QString DEFAULT_EMOTICON_THEME;
+
+      static const quint32 NB_MAX_ENTRIES_PER_BROWSE_PAGE;
    };
 }